@@ -0,0 +1,719 @@
+// Нагрузочный клиент для /ws: открывает много соединений к запущенному серверу, регистрирует их
+// и шлёт сообщения с заданной общей частотой. Сообщения и ответы собираются теми же JsonPacker/JsonParser,
+// что и у сервера. Задержка доставки считается по времени отправки, записанному в текст сообщения.
+// Недоставленное считается по ожидаемому числу получателей и сверяется со счётчиками /metrics сервера.
+//
+// Профили (--profile):
+//   general    -- все пишут в general, каждое сообщение получают все соединения;
+//   pairs      -- соединения разбиты на пары, каждая пара пишет в свою комнату 1:1;
+//   reconnect  -- как general, но каждые --churn-interval-ms доля --churn соединений обрывается
+//                 и продолжает сессию по токену (шторм переподключений).
+//
+// Пример: chat-loadgen --profile=pairs --connections=5000 --rate=20000 --seconds=30 --server-pid=$(pidof Test-Project)
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+#include "core/Metrics.hpp"
+#include "protocol/JsonPacker.hpp"
+#include "protocol/JsonParser.hpp"
+
+namespace
+{
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+enum class Profile
+{
+    General,
+    Pairs,
+    Reconnect
+};
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    std::string port = "18080";
+    Profile profile = Profile::General;
+    std::size_t connections = 1000;
+    double rate = 1000;                // Сообщений в секунду на все соединения.
+    std::size_t seconds = 30;
+    std::size_t messageBytes = 64;
+    std::size_t connectRate = 1000;    // Новых соединений в секунду при разгоне.
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    double churn = 0.05;               // Доля соединений, обрываемых за один раз в профиле reconnect.
+    std::size_t churnIntervalMs = 1000;
+    long serverPid = 0;                // Для оценки памяти сервера на соединение (Linux, /proc).
+};
+
+constexpr std::string_view messagePrefix = "lg:";
+constexpr IDType generalChatId = 1;
+
+struct Stats
+{
+    std::atomic<std::uint64_t> registered{0};
+    std::atomic<std::uint64_t> resumed{0};
+    std::atomic<std::uint64_t> roomsJoined{0};
+    std::atomic<std::uint64_t> sent{0};
+    std::atomic<std::uint64_t> delivered{0};
+    std::atomic<std::uint64_t> serverErrors{0};
+    std::atomic<std::uint64_t> connectionErrors{0};
+    LatencyHistogram delivery;      // Отправка -> получение, нс.
+    LatencyHistogram registration;  // Открытие соединения -> register-result, нс.
+    LatencyHistogram resume;        // Обрыв -> register-result продолжения, нс.
+};
+
+Stats stats;
+
+std::uint64_t nanosecondsBetween(Clock::time_point from, Clock::time_point to)
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+}
+
+std::uint64_t nowNanoseconds()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+}
+
+// Одно соединение. Все обработчики выполняются в strand соединения; снаружи -- только через net::post.
+class Client : public std::enable_shared_from_this<Client>
+{
+public:
+    Client(net::io_context& context, const tcp::resolver::results_type& endpoints, const Options& options, std::string username)
+        : endpoints_(endpoints), options_(options), username_(std::move(username)),
+          strand_(net::make_strand(context)), sendTimer_(strand_)
+    {
+    }
+
+    void start()
+    {
+        net::post(strand_, [self = shared_from_this()]() { self->connect(); });
+    }
+
+    // Сообщения в chatId каждые interval, первое -- через offset.
+    void startSending(IDType chatId, Clock::duration interval, Clock::duration offset)
+    {
+        net::post(strand_, [self = shared_from_this(), chatId, interval, offset]() {
+            self->chatId_ = chatId;
+            self->interval_ = interval;
+            self->sending_ = true;
+            self->scheduleSend(offset);
+        });
+    }
+
+    void stopSending()
+    {
+        net::post(strand_, [self = shared_from_this()]() {
+            self->sending_ = false;
+            self->sendTimer_.cancel();
+        });
+    }
+
+    void createRoomWith(IDType peerId)
+    {
+        net::post(strand_, [self = shared_from_this(), peerId]() {
+            ClientCreateRoomRequest request;
+            request.userId = self->userId_;
+            request.name = "lg-pair";
+            request.isPrivate = true;
+            request.participantUserIds = {peerId};
+            self->write(JsonPacker::packCreateRoomRequest(request));
+        });
+    }
+
+    // Обрывает соединение без close-кадра и сразу продолжает сессию новым.
+    void reconnect()
+    {
+        net::post(strand_, [self = shared_from_this()]() {
+            if (self->connection_ == nullptr || self->sessionToken_.empty() || self->reconnecting_)
+                return;
+            self->reconnecting_ = true;
+            self->droppedAt_ = Clock::now();
+            beast::error_code ignored;
+            beast::get_lowest_layer(self->connection_->stream).socket().close(ignored);
+            self->connect();
+        });
+    }
+
+    void close()
+    {
+        net::post(strand_, [self = shared_from_this()]() {
+            self->sending_ = false;
+            self->sendTimer_.cancel();
+            if (self->connection_ != nullptr)
+            {
+                beast::error_code ignored;
+                beast::get_lowest_layer(self->connection_->stream).socket().close(ignored);
+            }
+        });
+    }
+
+    // Читаются координатором после того, как соединение зарегистрировано.
+    [[nodiscard]] IDType userId() const { return publishedUserId_.load(); }
+    [[nodiscard]] IDType pairChatId() const { return publishedChatId_.load(); }
+
+private:
+    // Одно подключение. Переподключение создаёт новое: операции прежнего ещё могут завершаться
+    // и не должны трогать его буфер и очередь записи.
+    struct Connection
+    {
+        explicit Connection(const net::strand<net::io_context::executor_type>& strand) : stream(strand) {}
+
+        websocket::stream<beast::tcp_stream> stream;
+        beast::flat_buffer buffer;
+        // У websocket::stream может быть только одна незавершённая запись, остальные ждут здесь.
+        std::deque<std::string> writeQueue;
+        bool writing = false;
+    };
+    using ConnectionPtr = std::shared_ptr<Connection>;
+
+    void connect()
+    {
+        connection_ = std::make_shared<Connection>(strand_);
+        connectedAt_ = Clock::now();
+        auto& socket = beast::get_lowest_layer(connection_->stream);
+        socket.expires_after(std::chrono::seconds(30));
+        socket.async_connect(endpoints_, [self = shared_from_this(), connection = connection_](beast::error_code error,
+                                                                                              const tcp::endpoint&) {
+            if (self->failed(error, connection))
+                return;
+            beast::get_lowest_layer(connection->stream).expires_never();
+            connection->stream.set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+            connection->stream.async_handshake(self->options_.host + ":" + self->options_.port, "/ws",
+                                               [self, connection](beast::error_code handshakeError) {
+                                                   if (self->failed(handshakeError, connection))
+                                                       return;
+                                                   self->read(connection);
+                                               });
+        });
+    }
+
+    void read(const ConnectionPtr& connection)
+    {
+        connection->stream.async_read(connection->buffer, [self = shared_from_this(), connection](beast::error_code error,
+                                                                                                 std::size_t) {
+            if (self->failed(error, connection))
+                return;
+            const auto frame = beast::buffers_to_string(connection->buffer.data());
+            connection->buffer.consume(connection->buffer.size());
+            self->onFrame(frame);
+            self->read(connection);
+        });
+    }
+
+    void onFrame(const std::string& frame)
+    {
+        const auto payload = JsonParser::parseJson(frame);
+        if (!payload.has_value())
+            return;
+        const auto type = JsonParser::parseMessageTypeView(*payload);
+        if (!type.has_value())
+            return;
+
+        if (*type == "chat-msg")
+        {
+            const auto message = JsonParser::parseServerChatMessagePayload(*payload);
+            if (!message.has_value())
+                return;
+            lastServerMessageId_ = std::max(lastServerMessageId_, message->serverMessageId);
+            std::string_view text = message->message;
+            if (!text.starts_with(messagePrefix))
+                return;
+            text.remove_prefix(messagePrefix.size());
+            std::uint64_t sentAt = 0;
+            std::from_chars(text.data(), text.data() + text.size(), sentAt);
+            const auto now = nowNanoseconds();
+            stats.delivery.record(now > sentAt ? now - sentAt : 0);
+            stats.delivered.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (*type == "hello")
+        {
+            ClientRegisterRequest request;
+            request.publicKey = "loadgen";
+            request.username = username_;
+            request.password = "loadgen";
+            request.clientVersion = "chat-loadgen";
+            // Уведомления о тысячах соседей исказили бы измерение рассылок.
+            request.presence = "none";
+            if (reconnecting_)
+            {
+                request.sessionToken = sessionToken_;
+                request.lastServerMessageId = lastServerMessageId_;
+            }
+            write(JsonPacker::packRegisterRequest(request));
+        }
+        else if (*type == "register-result")
+        {
+            const auto result = JsonParser::parseServerRegistrationPayload(*payload);
+            if (!result.has_value())
+                return;
+            const auto now = Clock::now();
+            if (reconnecting_)
+            {
+                reconnecting_ = false;
+                stats.resume.record(nanosecondsBetween(droppedAt_, now));
+                stats.resumed.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            userId_ = result->userId;
+            sessionToken_ = result->sessionToken;
+            publishedUserId_.store(userId_);
+            stats.registration.record(nanosecondsBetween(connectedAt_, now));
+            stats.registered.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (*type == "room-created")
+        {
+            const auto room = JsonParser::parseServerRoomCreatedPayload(*payload);
+            if (room.has_value() && room->created && publishedChatId_.load() == 0)
+            {
+                publishedChatId_.store(room->chatId);
+                stats.roomsJoined.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        else if (*type == "error")
+        {
+            if (stats.serverErrors.fetch_add(1, std::memory_order_relaxed) < 5)
+                std::cerr << "server error: " << frame << '\n';
+        }
+    }
+
+    void scheduleSend(Clock::duration delay)
+    {
+        sendTimer_.expires_after(delay);
+        sendTimer_.async_wait([self = shared_from_this()](beast::error_code error) {
+            if (error || !self->sending_)
+                return;
+            self->sendMessage();
+            self->scheduleSend(self->interval_);
+        });
+    }
+
+    void sendMessage()
+    {
+        if (reconnecting_ || userId_ == 0)
+            return;
+        ClientChatMessageRequest request;
+        request.userId = userId_;
+        request.chatId = chatId_;
+        request.message.assign(messagePrefix);
+        request.message += std::to_string(nowNanoseconds());
+        request.message.push_back(':');
+        if (request.message.size() < options_.messageBytes)
+            request.message.append(options_.messageBytes - request.message.size(), 'x');
+        request.clientMessageId = ++nextClientMessageId_;
+        write(JsonPacker::packChatMessageRequest(request));
+        stats.sent.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void write(std::string message)
+    {
+        if (connection_ == nullptr)
+            return;
+        connection_->writeQueue.push_back(std::move(message));
+        if (!connection_->writing)
+            writeNext(connection_);
+    }
+
+    void writeNext(const ConnectionPtr& connection)
+    {
+        if (connection->writeQueue.empty())
+        {
+            connection->writing = false;
+            return;
+        }
+        connection->writing = true;
+        connection->stream.text(true);
+        connection->stream.async_write(net::buffer(connection->writeQueue.front()),
+                                       [self = shared_from_this(), connection](beast::error_code error, std::size_t) {
+                                           if (self->failed(error, connection))
+                                               return;
+                                           connection->writeQueue.pop_front();
+                                           self->writeNext(connection);
+                                       });
+    }
+
+    // true, если операция завершилась ошибкой; ошибки прежних подключений после reconnect() не считаются.
+    bool failed(const beast::error_code& error, const ConnectionPtr& connection)
+    {
+        if (!error)
+            return false;
+        if (connection == connection_ && error != net::error::operation_aborted && error != websocket::error::closed)
+        {
+            stats.connectionErrors.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+private:
+    const tcp::resolver::results_type& endpoints_;
+    const Options& options_;
+    const std::string username_;
+    net::strand<net::io_context::executor_type> strand_;
+    net::steady_timer sendTimer_;
+
+    ConnectionPtr connection_;
+
+    Clock::time_point connectedAt_;
+    Clock::time_point droppedAt_;
+    bool reconnecting_ = false;
+    IDType userId_ = 0;
+    std::string sessionToken_;
+    std::uint64_t lastServerMessageId_ = 0;
+    std::atomic<IDType> publishedUserId_{0};
+    std::atomic<IDType> publishedChatId_{0};
+
+    bool sending_ = false;
+    IDType chatId_ = generalChatId;
+    Clock::duration interval_{};
+    std::uint64_t nextClientMessageId_ = 0;
+};
+
+std::optional<Options> parseOptions(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view argument = argv[i];
+        const auto separator = argument.find('=');
+        if (!argument.starts_with("--") || separator == std::string_view::npos)
+        {
+            std::cerr << "unexpected argument: " << argument << '\n';
+            return std::nullopt;
+        }
+        const auto name = argument.substr(2, separator - 2);
+        const std::string value(argument.substr(separator + 1));
+        try
+        {
+            if (name == "host")
+                options.host = value;
+            else if (name == "port")
+                options.port = value;
+            else if (name == "profile")
+            {
+                if (value == "general")
+                    options.profile = Profile::General;
+                else if (value == "pairs")
+                    options.profile = Profile::Pairs;
+                else if (value == "reconnect")
+                    options.profile = Profile::Reconnect;
+                else
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "connections")
+                options.connections = std::stoul(value);
+            else if (name == "rate")
+                options.rate = std::stod(value);
+            else if (name == "seconds")
+                options.seconds = std::stoul(value);
+            else if (name == "message-bytes")
+                options.messageBytes = std::stoul(value);
+            else if (name == "connect-rate")
+                options.connectRate = std::max<std::size_t>(1, std::stoul(value));
+            else if (name == "threads")
+                options.threads = std::max<std::size_t>(1, std::stoul(value));
+            else if (name == "churn")
+                options.churn = std::stod(value);
+            else if (name == "churn-interval-ms")
+                options.churnIntervalMs = std::max<std::size_t>(1, std::stoul(value));
+            else if (name == "server-pid")
+                options.serverPid = std::stol(value);
+            else
+                throw std::invalid_argument(std::string(name));
+        }
+        catch (const std::exception&)
+        {
+            std::cerr << "invalid option: " << argument << '\n';
+            return std::nullopt;
+        }
+    }
+    if (options.profile == Profile::Pairs && options.connections % 2 != 0)
+    {
+        ++options.connections;
+    }
+    return options;
+}
+
+// Резидентная память процесса в байтах; 0, если недоступна.
+std::uint64_t residentBytes(long pid)
+{
+#if defined(__linux__)
+    if (pid <= 0)
+        return 0;
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.starts_with("VmRSS:"))
+            return std::stoull(line.substr(6)) * 1024;
+    }
+#else
+    (void)pid;
+#endif
+    return 0;
+}
+
+void raiseFileLimit()
+{
+#if defined(__linux__)
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+// Счётчики сервера, по которым видно, что сообщения отбросил он сам, а не потеряла сеть.
+struct ServerDrops
+{
+    std::uint64_t droppedMessages = 0;
+    std::uint64_t slowConsumerDisconnects = 0;
+};
+
+// Читает /metrics сервера; nullopt, если метрики недоступны.
+std::optional<ServerDrops> fetchServerDrops(const Options& options)
+{
+    try
+    {
+        net::io_context context;
+        tcp::resolver resolver(context);
+        beast::tcp_stream stream(context);
+        stream.expires_after(std::chrono::seconds(5));
+        stream.connect(resolver.resolve(options.host, options.port));
+        http::request<http::empty_body> request(http::verb::get, "/metrics", 11);
+        request.set(http::field::host, options.host);
+        http::write(stream, request);
+        beast::flat_buffer buffer;
+        http::response<http::string_body> response;
+        http::read(stream, buffer, response);
+        if (response.result() != http::status::ok)
+            return std::nullopt;
+
+        ServerDrops drops;
+        const auto sample = [](std::string_view line, std::string_view name, std::uint64_t& value) {
+            if (line.starts_with(name) && line.size() > name.size() && line[name.size()] == ' ')
+                std::from_chars(line.data() + name.size() + 1, line.data() + line.size(), value);
+        };
+        std::string_view body = response.body();
+        while (!body.empty())
+        {
+            const auto end = std::min(body.find('\n'), body.size());
+            const auto line = body.substr(0, end);
+            sample(line, "chat_outbound_dropped_messages_total", drops.droppedMessages);
+            sample(line, "chat_slow_consumer_disconnects_total", drops.slowConsumerDisconnects);
+            body.remove_prefix(std::min(end + 1, body.size()));
+        }
+        return drops;
+    }
+    catch (const std::exception&)
+    {
+        return std::nullopt;
+    }
+}
+
+template<typename Predicate>
+bool waitFor(std::string_view what, std::chrono::seconds timeout, Predicate&& done)
+{
+    const auto deadline = Clock::now() + timeout;
+    while (!done())
+    {
+        if (Clock::now() > deadline)
+        {
+            std::cerr << "timed out waiting for " << what << '\n';
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return true;
+}
+
+void printLatency(std::string_view name, const LatencyHistogram::Snapshot& snapshot)
+{
+    const auto ms = [](std::uint64_t nanoseconds) { return static_cast<double>(nanoseconds) / 1e6; };
+    std::printf("%-14s count %-10llu p50 %8.3f ms  p99 %8.3f ms  p999 %8.3f ms  max %8.3f ms\n", std::string(name).c_str(),
+                static_cast<unsigned long long>(snapshot.count), ms(snapshot.percentile(0.5)),
+                ms(snapshot.percentile(0.99)), ms(snapshot.percentile(0.999)), ms(snapshot.max()));
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const auto parsed = parseOptions(argc, argv);
+    if (!parsed.has_value())
+    {
+        std::cerr << "usage: chat-loadgen [--host=127.0.0.1] [--port=18080] [--profile=general|pairs|reconnect]\n"
+                     "                    [--connections=1000] [--rate=1000] [--seconds=30] [--message-bytes=64]\n"
+                     "                    [--connect-rate=1000] [--threads=N] [--churn=0.05] [--churn-interval-ms=1000]\n"
+                     "                    [--server-pid=PID]\n";
+        return 2;
+    }
+    const Options& options = *parsed;
+    raiseFileLimit();
+
+    net::io_context context(static_cast<int>(options.threads));
+    auto guard = net::make_work_guard(context);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < options.threads; ++i)
+    {
+        threads.emplace_back([&context]() { context.run(); });
+    }
+
+    tcp::resolver resolver(context);
+    const auto endpoints = resolver.resolve(options.host, options.port);
+
+    // Разгон: соединения открываются с частотой connectRate, имена уникальны между запусками.
+    const auto runId = std::random_device{}() % 1000000;
+    const auto rssBefore = residentBytes(options.serverPid);
+    std::vector<std::shared_ptr<Client>> clients;
+    clients.reserve(options.connections);
+    const auto rampStart = Clock::now();
+    for (std::size_t i = 0; i < options.connections; ++i)
+    {
+        auto client = std::make_shared<Client>(context, endpoints, options,
+                                               "lg-" + std::to_string(runId) + "-" + std::to_string(i));
+        client->start();
+        clients.push_back(std::move(client));
+        std::this_thread::sleep_until(rampStart + std::chrono::microseconds(1000000 * (i + 1) / options.connectRate));
+    }
+    waitFor("registration", std::chrono::seconds(60), [&]() { return stats.registered.load() >= options.connections; });
+    const auto rampSeconds = std::chrono::duration<double>(Clock::now() - rampStart).count();
+    const auto rssAfter = residentBytes(options.serverPid);
+    std::printf("connected     %llu of %zu in %.2f s\n", static_cast<unsigned long long>(stats.registered.load()),
+                options.connections, rampSeconds);
+    if (rssBefore != 0 && rssAfter != 0)
+    {
+        std::printf("server memory %.1f KiB per connection (RSS %+.1f MiB)\n",
+                    static_cast<double>(rssAfter - std::min(rssBefore, rssAfter)) / 1024.0 / static_cast<double>(options.connections),
+                    (static_cast<double>(rssAfter) - static_cast<double>(rssBefore)) / 1024.0 / 1024.0);
+    }
+
+    std::vector<IDType> chatIds(clients.size(), generalChatId);
+    if (options.profile == Profile::Pairs)
+    {
+        for (std::size_t i = 0; i + 1 < clients.size(); i += 2)
+        {
+            clients[i]->createRoomWith(clients[i + 1]->userId());
+        }
+        waitFor("rooms", std::chrono::seconds(60), [&]() { return stats.roomsJoined.load() >= clients.size(); });
+        for (std::size_t i = 0; i < clients.size(); ++i)
+        {
+            chatIds[i] = clients[i]->pairChatId();
+        }
+    }
+
+    // Каждое соединение пишет с одинаковым интервалом, фазы разнесены равномерно.
+    const auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(clients.size()) / std::max(options.rate, 1e-3)));
+    std::mt19937_64 random(runId);
+    std::uniform_int_distribution<Clock::rep> phase(0, std::max<Clock::rep>(interval.count() - 1, 0));
+    const auto dropsBefore = fetchServerDrops(options);
+    const auto deliveredBefore = stats.delivered.load();
+    const auto sentBefore = stats.sent.load();
+    const auto measureStart = Clock::now();
+    for (std::size_t i = 0; i < clients.size(); ++i)
+    {
+        clients[i]->startSending(chatIds[i], interval, Clock::duration(phase(random)));
+    }
+
+    const auto measureEnd = measureStart + std::chrono::seconds(options.seconds);
+    auto nextChurn = measureStart + std::chrono::milliseconds(options.churnIntervalMs);
+    const auto churnCount = static_cast<std::size_t>(options.churn * static_cast<double>(clients.size()));
+    std::uniform_int_distribution<std::size_t> pick(0, clients.size() - 1);
+    while (Clock::now() < measureEnd)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (options.profile == Profile::Reconnect && Clock::now() >= nextChurn)
+        {
+            for (std::size_t i = 0; i < churnCount; ++i)
+            {
+                clients[pick(random)]->reconnect();
+            }
+            nextChurn += std::chrono::milliseconds(options.churnIntervalMs);
+        }
+    }
+    for (const auto& client : clients)
+    {
+        client->stopSending();
+    }
+    const auto elapsed = std::chrono::duration<double>(Clock::now() - measureStart).count();
+    const auto sent = stats.sent.load() - sentBefore;
+    // Даём доставить то, что уже в пути.
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    const auto delivered = stats.delivered.load() - deliveredBefore;
+    const auto dropsAfter = fetchServerDrops(options);
+
+    std::printf("sent          %llu msgs, %.0f msgs/s\n", static_cast<unsigned long long>(sent), static_cast<double>(sent) / elapsed);
+    std::printf("delivered     %llu msgs, %.0f msgs/s\n", static_cast<unsigned long long>(delivered),
+                static_cast<double>(delivered) / elapsed);
+    // Каждое сообщение получают все участники комнаты, включая отправителя. При переподключениях
+    // пропущенное приходит повтором, и ожидаемое число не определено.
+    if (options.profile != Profile::Reconnect)
+    {
+        const std::uint64_t recipients = options.profile == Profile::Pairs ? 2 : clients.size();
+        const auto expected = sent * recipients;
+        std::printf("lost          %llu of %llu deliveries\n",
+                    static_cast<unsigned long long>(expected - std::min(expected, delivered)),
+                    static_cast<unsigned long long>(expected));
+    }
+    if (dropsBefore.has_value() && dropsAfter.has_value())
+    {
+        std::printf("server drops  %llu msgs, %llu slow-consumer disconnects\n",
+                    static_cast<unsigned long long>(dropsAfter->droppedMessages - dropsBefore->droppedMessages),
+                    static_cast<unsigned long long>(dropsAfter->slowConsumerDisconnects - dropsBefore->slowConsumerDisconnects));
+    }
+    else
+    {
+        std::printf("server drops  unknown (/metrics unavailable)\n");
+    }
+    printLatency("delivery", stats.delivery.snapshot());
+    printLatency("registration", stats.registration.snapshot());
+    if (options.profile == Profile::Reconnect)
+    {
+        printLatency("resume", stats.resume.snapshot());
+    }
+    std::printf("errors        server %llu, connection %llu\n", static_cast<unsigned long long>(stats.serverErrors.load()),
+                static_cast<unsigned long long>(stats.connectionErrors.load()));
+
+    for (const auto& client : clients)
+    {
+        client->close();
+    }
+    guard.reset();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    context.stop();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+// Сравнение прежнего хранения участников комнаты (std::set<UserContextPtr> и снимок,
+// пересобираемый после каждого изменения состава) с плоским упорядоченным вектором Room.
+// join/leave -- добавление и удаление всех участников в случайном порядке,
+// fan-out -- проход рассылки по снимку, churn -- вход одного участника, рассылка и его выход,
+// held -- то же, но рассылка ещё держит снимок, когда участник выходит (снимок копируется).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "core/Room.hpp"
+
+namespace
+{
+
+constexpr std::size_t operationsPerCase = 2000000;
+
+// Не даёт компилятору выбросить проход по получателям.
+volatile std::size_t sink = 0;
+
+// Прежняя реализация Room без блокировок и форматов: только то, что влияет на членство.
+class SetRoom
+{
+public:
+    void addUser(const UserContextPtr& user)
+    {
+        if (users_.insert(user).second)
+            snapshot_.reset();
+    }
+
+    void removeUser(const UserContextPtr& user)
+    {
+        if (users_.erase(user) != 0)
+            snapshot_.reset();
+    }
+
+    RecipientList snapshot()
+    {
+        if (snapshot_ == nullptr)
+            snapshot_ = Recipients::owning({users_.begin(), users_.end()});
+        return snapshot_;
+    }
+
+private:
+    std::set<UserContextPtr> users_;
+    RecipientList snapshot_;
+};
+
+class FlatRoom
+{
+public:
+    FlatRoom() : room_(1, Room::Type::Public, "bench", true)
+    {
+    }
+
+    void addUser(const UserContextPtr& user)
+    {
+        room_.addUser(user);
+    }
+
+    void removeUser(const UserContextPtr& user)
+    {
+        room_.removeUser(user);
+    }
+
+    RecipientList snapshot()
+    {
+        return room_.snapshot();
+    }
+
+private:
+    Room room_;
+};
+
+std::vector<UserContextPtr> makeUsers(std::size_t count)
+{
+    std::vector<UserContextPtr> users;
+    users.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto user = std::make_shared<UserContext>();
+        user->userId = static_cast<IDType>(i + 1);
+        users.push_back(std::move(user));
+    }
+    return users;
+}
+
+// То же, что делает поток рассылки с каждым получателем до постановки в его очередь.
+std::size_t visitRecipients(const RecipientList& recipients)
+{
+    std::size_t total = 0;
+    for (const auto* user : recipients->users)
+    {
+        total += user->format.index() + 1;
+    }
+    return total;
+}
+
+template<typename Body>
+double nanosecondsPer(std::size_t operations, Body&& body)
+{
+    const auto start = std::chrono::steady_clock::now();
+    body();
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / static_cast<double>(operations);
+}
+
+struct Result
+{
+    double join = 0;
+    double leave = 0;
+    double fanout = 0;
+    double churn = 0;
+    double held = 0;
+};
+
+template<typename RoomModel>
+Result run(std::size_t roomSize)
+{
+    auto users = makeUsers(roomSize + 1);
+    const auto extra = users.back();
+    users.pop_back();
+    std::mt19937 random(42);
+
+    Result result;
+    const std::size_t rounds = std::max<std::size_t>(1, operationsPerCase / roomSize);
+    for (std::size_t round = 0; round < rounds; ++round)
+    {
+        RoomModel room;
+        std::shuffle(users.begin(), users.end(), random);
+        result.join += nanosecondsPer(roomSize, [&]() {
+            for (const auto& user : users)
+                room.addUser(user);
+        });
+        std::shuffle(users.begin(), users.end(), random);
+        result.leave += nanosecondsPer(roomSize, [&]() {
+            for (const auto& user : users)
+                room.removeUser(user);
+        });
+    }
+    result.join /= static_cast<double>(rounds);
+    result.leave /= static_cast<double>(rounds);
+
+    RoomModel room;
+    for (const auto& user : users)
+        room.addUser(user);
+
+    std::size_t total = 0;
+    result.fanout = nanosecondsPer(rounds * roomSize, [&]() {
+        for (std::size_t round = 0; round < rounds; ++round)
+            total += visitRecipients(room.snapshot());
+    });
+
+    const std::size_t churnRounds = std::max<std::size_t>(1, rounds / 8);
+    result.churn = nanosecondsPer(churnRounds, [&]() {
+        for (std::size_t round = 0; round < churnRounds; ++round)
+        {
+            room.addUser(extra);
+            total += visitRecipients(room.snapshot());
+            room.removeUser(extra);
+        }
+    });
+    result.held = nanosecondsPer(churnRounds, [&]() {
+        for (std::size_t round = 0; round < churnRounds; ++round)
+        {
+            room.addUser(extra);
+            const auto inFlight = room.snapshot();
+            room.removeUser(extra);
+            total += visitRecipients(inFlight);
+        }
+    });
+    sink = total;
+    return result;
+}
+
+void print(const char* name, std::size_t roomSize, const Result& result)
+{
+    std::cout << roomSize << '\t' << name << '\t' << result.join << "\t\t" << result.leave << "\t\t"
+              << result.fanout << "\t\t" << result.churn << "\t\t" << result.held << '\n';
+}
+
+} // namespace
+
+int main()
+{
+    std::cout << "users\tmodel\tjoin ns/op\tleave ns/op\tfan-out ns/user\tchurn ns/msg\theld ns/msg\n";
+    for (const std::size_t roomSize : {16, 256, 4096, 32768})
+    {
+        print("set", roomSize, run<SetRoom>(roomSize));
+        print("flat", roomSize, run<FlatRoom>(roomSize));
+    }
+    return 0;
+}
@@ -0,0 +1,495 @@
+// Микробенчмарки на Google Benchmark: разбор каждого запроса клиента (JsonParser::parse*Request) во всех
+// видах документа, упаковка каждого сообщения JsonPacker::pack*, вход/выход и рассылка в комнате
+// с подменёнными соединениями и путь регистрации при 1k/10k/100k зарегистрированных пользователей.
+// Сеть не нужна. Результаты по умолчанию сохраняются в chat-microbench.json; два таких файла сравнивает
+// tools/compare.py из Google Benchmark.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include "core/FanoutExecutor.hpp"
+#include "core/Room.hpp"
+#include "core/ShardedMap.hpp"
+#include "core/UserDirectory.hpp"
+#include "core/UsernameIndex.hpp"
+#include "protocol/JsonPacker.hpp"
+#include "protocol/JsonParser.hpp"
+#include "protocol/MessageDispatch.hpp"
+#include "protocol/WirePacker.hpp"
+
+namespace
+{
+
+// Соединение без сети: считает отправленные кадры, чтобы рассылку можно было дождаться.
+class MockConnection final : public crow::websocket::connection
+{
+public:
+    void send_binary(std::string message) override { sent(message); }
+    void send_text(std::string message) override { sent(message); }
+    void send_ping(std::string) override {}
+    void send_pong(std::string) override {}
+    void close(std::string const&, uint16_t) override {}
+    std::string get_remote_ip() override { return "127.0.0.1"; }
+    std::string get_subprotocol() const override { return {}; }
+
+    static inline std::atomic<std::uint64_t> delivered{0};
+
+private:
+    static void sent(const std::string& message)
+    {
+        benchmark::DoNotOptimize(message.data());
+        delivered.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Пользователи с подменёнными соединениями; соединения живут, пока жив набор.
+struct MockUsers
+{
+    explicit MockUsers(std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto connection = std::make_unique<MockConnection>();
+            auto user = std::make_shared<UserContext>();
+            user->connection = connection.get();
+            user->userId = static_cast<IDType>(i + 1);
+            user->username = "user-" + std::to_string(i + 1);
+            user->authorized.store(true);
+            connections.push_back(std::move(connection));
+            users.push_back(std::move(user));
+        }
+    }
+
+    std::vector<std::unique_ptr<MockConnection>> connections;
+    std::vector<UserContextPtr> users;
+};
+
+// --- Кадры запросов клиента ---
+
+std::string registerFrame()
+{
+    ClientRegisterRequest request;
+    request.publicKey = "client-public-key";
+    request.username = "alice";
+    request.password = "secret";
+    request.clientVersion = "1.0.0";
+    request.presence = "rooms";
+    return JsonPacker::packRegisterRequest(request);
+}
+
+std::string chatMessageFrame()
+{
+    ClientChatMessageRequest request;
+    request.userId = 42;
+    request.chatId = 1;
+    request.message = "Привет! Line one\nline two with \"quotes\" and a tab\t.";
+    request.clientMessageId = 1001;
+    return JsonPacker::packChatMessageRequest(request);
+}
+
+std::string dataRequestFrame()
+{
+    ClientDataRequest request;
+    request.dataType = "messages";
+    request.userId = 42;
+    request.chatId = 1;
+    request.before = 123456;
+    request.limit = 50;
+    return JsonPacker::packDataRequest(request);
+}
+
+std::string createRoomFrame()
+{
+    ClientCreateRoomRequest request;
+    request.userId = 42;
+    request.participantUserIds = {7, 8, 9, 10, 11, 12, 13, 14};
+    request.isPrivate = false;
+    request.name = "team";
+    return JsonPacker::packCreateRoomRequest(request);
+}
+
+std::string leaveRoomFrame()
+{
+    ClientLeaveRoomRequest request;
+    request.userId = 42;
+    request.chatId = 5;
+    return JsonPacker::packLeaveRoomRequest(request);
+}
+
+// Тот же запрос в MessagePack: сервер принимает те же поля в бинарных кадрах.
+std::string toMsgPack(const std::string& json)
+{
+    const auto bytes = nlohmann::json::to_msgpack(nlohmann::json::parse(json));
+    return std::string(bytes.begin(), bytes.end());
+}
+
+// Разбор запроса из уже разобранного документа: makeDocument вызывается один раз, вне замера.
+template<typename MakeDocument, typename Parse>
+void registerParse(const std::string& name, std::string frame, MakeDocument makeDocument, Parse parse)
+{
+    benchmark::RegisterBenchmark(name.c_str(), [frame = std::move(frame), makeDocument, parse](benchmark::State& state) {
+        const auto document = makeDocument(frame);
+        if (!document.has_value())
+        {
+            state.SkipWithError("frame does not parse");
+            return;
+        }
+        for (auto _ : state)
+        {
+            auto request = parse(*document);
+            benchmark::DoNotOptimize(request);
+        }
+    });
+}
+
+template<typename Parse>
+void registerParseRequest(const std::string& type, const std::string& json, Parse parse)
+{
+    registerParse("Parse/" + type + "/nlohmann", json, [](const std::string& frame) { return JsonParser::parseJson(frame); }, parse);
+    registerParse("Parse/" + type + "/fast", json, [](const std::string& frame) { return FastJsonObject::parse(frame); }, parse);
+    registerParse("Parse/" + type + "/msgpack", toMsgPack(json), [](const std::string& frame) { return MsgPackObject::parse(frame); },
+                  parse);
+}
+
+// Весь путь кадра chat-msg, как в onWebSocketMessage: документ, тип, запрос.
+void registerParseFrame()
+{
+    benchmark::RegisterBenchmark("ParseFrame/chat-msg/inbound", [frame = chatMessageFrame()](benchmark::State& state) {
+        for (auto _ : state)
+        {
+            const auto document = JsonParser::parseInbound(frame);
+            const auto type = JsonParser::parseMessageTypeView(*document);
+            auto request = classifyClientMessage(*type) == ClientMessageType::ChatMessage
+                               ? JsonParser::parseChatMessageRequest(*document)
+                               : std::nullopt;
+            benchmark::DoNotOptimize(request);
+        }
+    });
+    benchmark::RegisterBenchmark("ParseFrame/chat-msg/msgpack", [frame = toMsgPack(chatMessageFrame())](benchmark::State& state) {
+        for (auto _ : state)
+        {
+            const auto document = MsgPackObject::parse(frame);
+            const auto type = JsonParser::parseMessageTypeView(*document);
+            auto request = classifyClientMessage(*type) == ClientMessageType::ChatMessage
+                               ? JsonParser::parseChatMessageRequest(*document)
+                               : std::nullopt;
+            benchmark::DoNotOptimize(request);
+        }
+    });
+}
+
+// --- Сообщения сервера ---
+
+ServerChatMessagePayload chatMessagePayload()
+{
+    ServerChatMessagePayload payload;
+    payload.userId = 42;
+    payload.userName = "alice";
+    payload.chatId = 1;
+    payload.message = "Привет! Line one\nline two with \"quotes\" and a tab\t.";
+    payload.serverMessageId = 1234567;
+    return payload;
+}
+
+ServerRegistrationPayload registrationPayload()
+{
+    ServerRegistrationPayload payload;
+    payload.registered = true;
+    payload.userId = 42;
+    payload.serverPublicKey = "server-public-key-stub";
+    payload.serverName = "Messenger2 Server";
+    payload.sessionToken = "0123456789abcdef0123456789abcdef";
+    return payload;
+}
+
+std::map<IDType, std::string> namedIds(std::size_t count, std::string_view prefix)
+{
+    std::map<IDType, std::string> result;
+    for (std::size_t i = 1; i <= count; ++i)
+        result.emplace(static_cast<IDType>(i), std::string(prefix) + std::to_string(i));
+    return result;
+}
+
+// Упаковка в переиспользуемый буфер, как в рассылках сервера.
+template<typename Payload, typename Pack>
+void registerPackInto(const std::string& type, Payload payload, Pack pack)
+{
+    benchmark::RegisterBenchmark(("Pack/" + type).c_str(), [payload = std::move(payload), pack](benchmark::State& state) {
+        std::string out;
+        for (auto _ : state)
+        {
+            out.clear();
+            pack(payload, out);
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * out.size()));
+    });
+}
+
+template<typename Payload, typename Pack>
+void registerPackString(const std::string& type, Payload payload, Pack pack)
+{
+    benchmark::RegisterBenchmark(("Pack/" + type).c_str(), [payload = std::move(payload), pack](benchmark::State& state) {
+        std::size_t size = 0;
+        for (auto _ : state)
+        {
+            auto out = pack(payload);
+            size = out.size();
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * size));
+    });
+}
+
+void registerPackers()
+{
+    // Клиент -> Сервер.
+    registerPackString("request/register", *JsonParser::parseRegisterRequest(*JsonParser::parseJson(registerFrame())),
+                       [](const auto& payload) { return JsonPacker::packRegisterRequest(payload); });
+    registerPackString("request/chat-msg", *JsonParser::parseChatMessageRequest(*JsonParser::parseJson(chatMessageFrame())),
+                       [](const auto& payload) { return JsonPacker::packChatMessageRequest(payload); });
+    registerPackString("request/data-request", *JsonParser::parseDataRequest(*JsonParser::parseJson(dataRequestFrame())),
+                       [](const auto& payload) { return JsonPacker::packDataRequest(payload); });
+    registerPackString("request/create-room", *JsonParser::parseCreateRoomRequest(*JsonParser::parseJson(createRoomFrame())),
+                       [](const auto& payload) { return JsonPacker::packCreateRoomRequest(payload); });
+    registerPackString("request/leave-room", *JsonParser::parseLeaveRoomRequest(*JsonParser::parseJson(leaveRoomFrame())),
+                       [](const auto& payload) { return JsonPacker::packLeaveRoomRequest(payload); });
+
+    // Сервер -> Клиент.
+    ServerHelloPayload hello;
+    hello.registrationTimeoutSeconds = 20;
+    hello.serverName = "Messenger2 Server";
+    registerPackInto("hello", hello, [](const auto& payload, std::string& out) { JsonPacker::packServerHello(payload, out); });
+    registerPackInto("register-result", registrationPayload(),
+                     [](const auto& payload, std::string& out) { JsonPacker::packRegistration(payload, out); });
+    registerPackInto("error", ServerErrorPayload{"error", "chat-not-found", "Chat not found"},
+                     [](const auto& payload, std::string& out) { JsonPacker::packError(payload, out); });
+    registerPackInto("chat-msg", chatMessagePayload(),
+                     [](const auto& payload, std::string& out) { JsonPacker::packChatMessage(payload, out); });
+    ServerRoomCreatedPayload created;
+    created.created = true;
+    created.chatId = 5;
+    created.participantUserIds = {42, 7, 8, 9, 10, 11, 12, 13, 14};
+    created.name = "team";
+    registerPackInto("room-created", created, [](const auto& payload, std::string& out) { JsonPacker::packRoomCreated(payload, out); });
+    registerPackInto("room-left", ServerRoomLeftPayload{"room-left", true, 42, 5},
+                     [](const auto& payload, std::string& out) { JsonPacker::packRoomLeft(payload, out); });
+    ServerChatsRequestPayload chats;
+    chats.chats = namedIds(20, "room-");
+    registerPackInto("chats-payload", chats,
+                     [](const auto& payload, std::string& out) { JsonPacker::packRequestChatsPayload(payload, out); });
+    ServerUsersRequestPayload users;
+    const auto userNames = namedIds(100, "user-");
+    users.users.assign(userNames.begin(), userNames.end());
+    users.hasMore = true;
+    registerPackInto("users-payload", users,
+                     [](const auto& payload, std::string& out) { JsonPacker::packRequestUsersPayload(payload, out); });
+    ServerUserChangesPayload changes;
+    changes.registered = namedIds(10, "user-");
+    changes.logout = {11, 12, 13};
+    registerPackInto("user-changes", changes,
+                     [](const auto& payload, std::string& out) { JsonPacker::packUserChanges(payload, out); });
+    ServerMessagesPayload messages;
+    messages.chatId = 1;
+    for (std::uint64_t i = 1; i <= 50; ++i)
+        messages.messages.push_back({i, 42, "alice", "message number " + std::to_string(i), 1700000000000 + i});
+    registerPackInto("messages-payload", messages,
+                     [](const auto& payload, std::string& out) { JsonPacker::packMessagesPayload(payload, out); });
+    benchmark::RegisterBenchmark("Pack/server-info", [](benchmark::State& state) {
+        for (auto _ : state)
+        {
+            auto out = JsonPacker::packServerInfo(true, "Messenger2 Server");
+            benchmark::DoNotOptimize(out.data());
+        }
+    });
+}
+
+// --- Комната ---
+
+// Вход и выход одного пользователя в комнате из range(0) участников.
+void BM_RoomAddRemove(benchmark::State& state)
+{
+    const auto memberCount = static_cast<std::size_t>(state.range(0));
+    MockUsers members(memberCount + 1);
+    Room room(1, Room::Type::Public, "bench", true);
+    for (std::size_t i = 0; i < memberCount; ++i)
+        room.addUser(members.users[i]);
+    const auto& extra = members.users.back();
+
+    for (auto _ : state)
+    {
+        room.addUser(extra);
+        room.removeUser(extra);
+    }
+}
+BENCHMARK(BM_RoomAddRemove)->Arg(2)->Arg(100)->Arg(1000)->Arg(10000);
+
+// Рассылка chat-msg в комнату из range(0) участников до отправки последнему из них.
+void BM_RoomBroadcast(benchmark::State& state)
+{
+    const auto memberCount = static_cast<std::size_t>(state.range(0));
+    MockUsers members(memberCount);
+    Room room(1, Room::Type::Public, "bench", true);
+    for (const auto& user : members.users)
+        room.addUser(user);
+    FanoutExecutor executor;
+    const auto payload = chatMessagePayload();
+
+    for (auto _ : state)
+    {
+        const auto target = MockConnection::delivered.load() + memberCount;
+        room.broadcast(executor, [&payload](WireFormatSet formats) {
+            return WirePacker::encode(formats, [&payload](WireCodec codec) { return WirePacker::packChatMessage(codec, payload); });
+        });
+        while (MockConnection::delivered.load() < target)
+            std::this_thread::yield();
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * memberCount));
+}
+BENCHMARK(BM_RoomBroadcast)->Arg(2)->Arg(100)->Arg(1000)->Arg(10000)->UseRealTime();
+
+// --- Регистрация ---
+
+// Таблицы пользователей сервера, заполненные count пользователями.
+struct UserTables
+{
+    explicit UserTables(std::size_t count) : users(count)
+    {
+        for (const auto& user : users.users)
+        {
+            usernames.tryClaim(user->username, user);
+            usersById.insertOrAssign(user->userId, user);
+            directory.add(user->userId, user->username);
+        }
+        directory.publish();
+    }
+
+    MockUsers users;
+    UsernameIndex usernames;
+    ShardedMap<IDType, UserContextPtr> usersById;
+    UserDirectory directory;
+};
+
+// Регистрация и выход одного пользователя, как в handleRegistrationMessage и endSession:
+// разбор кадра, занятие имени, таблица по ID, список пользователей, ответ register-result.
+void BM_RegisterLogout(benchmark::State& state)
+{
+    UserTables tables(static_cast<std::size_t>(state.range(0)));
+    const auto frame = registerFrame();
+    const auto userId = static_cast<IDType>(state.range(0) + 1);
+    auto response = registrationPayload();
+    std::string out;
+
+    for (auto _ : state)
+    {
+        const auto document = JsonParser::parseInbound(frame);
+        const auto request = JsonParser::parseRegisterRequest(*document);
+        auto user = std::make_shared<UserContext>();
+        if (!tables.usernames.tryClaim(request->username, user))
+        {
+            state.SkipWithError("username taken");
+            break;
+        }
+        user->userId = userId;
+        user->username = request->username;
+        tables.usersById.insertOrAssign(userId, user);
+        tables.directory.add(userId, user->username);
+        response.userId = userId;
+        out.clear();
+        JsonPacker::packRegistration(response, out);
+        benchmark::DoNotOptimize(out.data());
+
+        tables.usersById.erase(userId);
+        tables.usernames.release(user->username, user);
+        tables.directory.remove(userId);
+    }
+}
+BENCHMARK(BM_RegisterLogout)->Arg(1000)->Arg(10000)->Arg(100000);
+
+// Публикация нового снимка списка пользователей после одного входа (раз на окно presence).
+void BM_DirectoryPublish(benchmark::State& state)
+{
+    UserTables tables(static_cast<std::size_t>(state.range(0)));
+    const auto userId = static_cast<IDType>(state.range(0) + 1);
+    bool present = false;
+    for (auto _ : state)
+    {
+        if (present)
+            tables.directory.remove(userId);
+        else
+            tables.directory.add(userId, "newcomer");
+        present = !present;
+        tables.directory.publish();
+    }
+}
+BENCHMARK(BM_DirectoryPublish)->Arg(1000)->Arg(10000)->Arg(100000);
+
+// Страница data-request "users": без фильтра и по началу имени.
+void BM_UsersPage(benchmark::State& state)
+{
+    UserTables tables(static_cast<std::size_t>(state.range(0)));
+    const std::string_view prefix = state.range(1) != 0 ? "user-1" : "";
+    for (auto _ : state)
+    {
+        auto page = tables.directory.page(0, prefix, 100, 0);
+        benchmark::DoNotOptimize(page);
+    }
+}
+BENCHMARK(BM_UsersPage)->ArgsProduct({{1000, 10000, 100000}, {0, 1}});
+
+void registerDynamicBenchmarks()
+{
+    registerParseRequest("register", registerFrame(), [](const auto& document) { return JsonParser::parseRegisterRequest(document); });
+    registerParseRequest("chat-msg", chatMessageFrame(), [](const auto& document) { return JsonParser::parseChatMessageRequest(document); });
+    registerParseRequest("data-request", dataRequestFrame(), [](const auto& document) { return JsonParser::parseDataRequest(document); });
+    registerParseRequest("create-room", createRoomFrame(), [](const auto& document) { return JsonParser::parseCreateRoomRequest(document); });
+    registerParseRequest("leave-room", leaveRoomFrame(), [](const auto& document) { return JsonParser::parseLeaveRoomRequest(document); });
+    registerParseFrame();
+    registerPackers();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    registerDynamicBenchmarks();
+
+    // Без --benchmark_out результаты сохраняются в chat-microbench.json.
+    std::vector<char*> arguments(argv, argv + argc);
+    std::string outFile = "--benchmark_out=chat-microbench.json";
+    std::string outFormat = "--benchmark_out_format=json";
+    const bool hasOut = std::any_of(arguments.begin(), arguments.end(), [](const char* argument) {
+        return std::string_view(argument).starts_with("--benchmark_out=");
+    });
+    if (!hasOut)
+    {
+        arguments.push_back(outFile.data());
+        arguments.push_back(outFormat.data());
+    }
+    int count = static_cast<int>(arguments.size());
+
+    benchmark::Initialize(&count, arguments.data());
+    if (benchmark::ReportUnrecognizedArguments(count, arguments.data()))
+    {
+        return 1;
+    }
+#if defined(CHAT_JSON_BACKEND_FAST)
+    benchmark::AddCustomContext("chat-json-backend", "fast");
+#else
+    benchmark::AddCustomContext("chat-json-backend", "nlohmann");
+#endif
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
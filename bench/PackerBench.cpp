@@ -0,0 +1,111 @@
+// Сравнение прежней сериализации (временный nlohmann::json + dump())
+// с прямой записью JsonPacker для самых частых сообщений: chat-msg и user-changes.
+// Перед замером проверяется, что оба пути дают одинаковые байты.
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include "protocol/JsonPacker.hpp"
+
+namespace
+{
+
+constexpr std::size_t iterations = 1000000;
+
+// Не даёт компилятору выбросить результат сериализации.
+volatile std::size_t sink = 0;
+
+std::string packChatMessageDom(const ServerChatMessagePayload& payload)
+{
+    const nlohmann::json json = {
+        {"type", payload.type},
+        {"user-id", payload.userId},
+        {"username", payload.userName},
+        {"chat-id", payload.chatId},
+        {"message", payload.message},
+        {"server-message-id", payload.serverMessageId},
+    };
+    return json.dump();
+}
+
+std::string packUserChangesDom(const ServerUserChangesPayload& payload)
+{
+    nlohmann::json registered = nlohmann::json::object();
+    for (const auto& [id, name] : payload.registered)
+        registered[std::to_string(id)] = name;
+    const nlohmann::json json = {
+        {"type", payload.type},
+        {"registered", registered},
+        {"logout", payload.logout},
+    };
+    return json.dump();
+}
+
+template<typename Body>
+double measure(Body&& body)
+{
+    std::size_t totalBytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        totalBytes += body(i);
+    }
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    sink = totalBytes;
+    return elapsed.count() / static_cast<double>(iterations);
+}
+
+} // namespace
+
+int main()
+{
+    ServerChatMessagePayload chat;
+    chat.userId = 42;
+    chat.userName = "alice";
+    chat.chatId = 1;
+    chat.message = "Привет! Line one\nline two with \"quotes\" and a tab\t.";
+    chat.serverMessageId = 1234567;
+
+    ServerUserChangesPayload change;
+    change.registered = {{42, "alice"}, {43, "bob"}};
+    change.logout = {7};
+
+    if (packChatMessageDom(chat) != JsonPacker::packChatMessage(chat) ||
+        packUserChangesDom(change) != JsonPacker::packUserChanges(change))
+    {
+        std::cerr << "serializers disagree\n";
+        return 1;
+    }
+
+    std::string buffer;
+    const auto chatDom = measure([&](std::size_t i) {
+        chat.serverMessageId = i;
+        return packChatMessageDom(chat).size();
+    });
+    const auto chatDirect = measure([&](std::size_t i) {
+        chat.serverMessageId = i;
+        return JsonPacker::packChatMessage(chat).size();
+    });
+    const auto chatReused = measure([&](std::size_t i) {
+        chat.serverMessageId = i;
+        buffer.clear();
+        JsonPacker::packChatMessage(chat, buffer);
+        return buffer.size();
+    });
+    const auto changeDom = measure([&](std::size_t i) {
+        change.logout.front() = static_cast<IDType>(i);
+        return packUserChangesDom(change).size();
+    });
+    const auto changeDirect = measure([&](std::size_t i) {
+        change.logout.front() = static_cast<IDType>(i);
+        return JsonPacker::packUserChanges(change).size();
+    });
+
+    std::cout << "message\t\tnlohmann ns\tdirect ns\treused buffer ns\n";
+    std::cout << "chat-msg\t" << chatDom << "\t\t" << chatDirect << "\t\t" << chatReused << '\n';
+    std::cout << "user-changes\t" << changeDom << "\t\t" << changeDirect << "\t\t-\n";
+    return 0;
+}
@@ -0,0 +1,135 @@
+// Сравнение прежней модели (одна глобальная блокировка на всё состояние)
+// с шардированными таблицами и блокировкой на комнату.
+// Каждый поток шлёт сообщения в свою комнату, поэтому при шардировании потоки не должны мешать друг другу.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "core/Room.hpp"
+#include "core/ShardedMap.hpp"
+#include "protocol/WirePacker.hpp"
+
+namespace
+{
+
+constexpr std::size_t usersPerRoom = 16;
+constexpr std::size_t messagesPerThread = 200000;
+
+std::vector<UserContextPtr> makeUsers(std::size_t count)
+{
+    std::vector<UserContextPtr> users;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        users.push_back(std::make_shared<UserContext>());
+    }
+    return users;
+}
+
+template<typename Body>
+double measure(std::size_t threadCount, Body&& body)
+{
+    std::vector<std::thread> threads;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&body, t]() { body(static_cast<IDType>(t + 1)); });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(threadCount * messagesPerThread) / elapsed.count();
+}
+
+double runGlobalLock(std::size_t threadCount)
+{
+    FanoutExecutor executor;
+    std::mutex stateMutex;
+    std::unordered_map<IDType, RoomPtr> rooms;
+    std::unordered_map<IDType, UserContextPtr> usersById;
+    for (std::size_t t = 0; t < threadCount; ++t)
+    {
+        const auto roomId = static_cast<IDType>(t + 1);
+        auto room = std::make_shared<Room>(roomId, Room::Type::Public, "room", true);
+        for (const auto& user : makeUsers(usersPerRoom))
+        {
+            room->addUser(user);
+        }
+        rooms.emplace(roomId, room);
+        usersById.emplace(roomId, std::make_shared<UserContext>());
+    }
+
+    return measure(threadCount, [&](IDType roomId) {
+        const std::string message(256, 'x');
+        for (std::size_t i = 0; i < messagesPerThread; ++i)
+        {
+            std::scoped_lock lock(stateMutex);
+            const auto sender = usersById.find(roomId);
+            const auto room = rooms.find(roomId);
+            if (sender != usersById.end() && room != rooms.end())
+            {
+                room->second->broadcast(executor, [&message](WireFormatSet formats) {
+                    return WirePacker::encode(formats, [&message](WireCodec) { return message; });
+                });
+            }
+        }
+    });
+}
+
+double runSharded(std::size_t threadCount)
+{
+    FanoutExecutor executor;
+    ShardedMap<IDType, RoomPtr> rooms;
+    ShardedMap<IDType, UserContextPtr> usersById;
+    for (std::size_t t = 0; t < threadCount; ++t)
+    {
+        const auto roomId = static_cast<IDType>(t + 1);
+        auto room = std::make_shared<Room>(roomId, Room::Type::Public, "room", true);
+        for (const auto& user : makeUsers(usersPerRoom))
+        {
+            room->addUser(user);
+        }
+        rooms.insertOrAssign(roomId, room);
+        usersById.insertOrAssign(roomId, std::make_shared<UserContext>());
+    }
+
+    return measure(threadCount, [&](IDType roomId) {
+        const std::string message(256, 'x');
+        for (std::size_t i = 0; i < messagesPerThread; ++i)
+        {
+            const auto sender = usersById.find(roomId);
+            const auto room = rooms.find(roomId);
+            if (sender.has_value() && room.has_value())
+            {
+                (*room)->broadcast(executor, [&message](WireFormatSet formats) {
+                    return WirePacker::encode(formats, [&message](WireCodec) { return message; });
+                });
+            }
+        }
+    });
+}
+
+} // namespace
+
+int main()
+{
+    const std::size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "threads\tglobal-lock msg/s\tsharded msg/s\n";
+    for (std::size_t threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        const auto global = runGlobalLock(threads);
+        const auto sharded = runSharded(threads);
+        std::cout << threads << '\t' << static_cast<std::uint64_t>(global) << "\t\t"
+                  << static_cast<std::uint64_t>(sharded) << '\n';
+    }
+    return 0;
+}
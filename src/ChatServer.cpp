@@ -1,25 +1,108 @@
 #include "ChatServer.hpp"
 
-#include <set>
-#include <thread>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <type_traits>
 #include <utility>
 
+#include "core/Latency.hpp"
+#include "core/Logger.hpp"
+#include "core/MemoryPool.hpp"
 #include "protocol/JsonMessages.hpp"
 #include "protocol/JsonPacker.hpp"
 #include "protocol/JsonParser.hpp"
+#include "protocol/MsgPackReader.hpp"
+#include "protocol/WirePacker.hpp"
 
-ChatServer::ChatServer(std::string serverName, std::string serverPublicKey, std::chrono::seconds registrationTimeout)
+ChatServer::ChatServer(std::string serverName, std::string serverPublicKey, std::chrono::seconds registrationTimeout,
+                       OutboxLimits outboxLimits, CompressionOptions compression, HistoryOptions history,
+                       std::chrono::seconds sessionGracePeriod, std::chrono::milliseconds presenceWindow,
+                       ClusterOptions cluster, ThreadOptions threads)
     : serverName_(std::move(serverName)),
       serverPublicKey_(std::move(serverPublicKey)),
-      registrationTimeout_(registrationTimeout)
+      registrationTimeout_(registrationTimeout),
+      outboxLimits_(outboxLimits),
+      compression_(compression),
+      recentMessagesPerRoom_(history.recentMessagesPerRoom),
+      sessionGracePeriod_(sessionGracePeriod),
+      cluster_(std::move(cluster)),
+      instanceId_(cluster_.bus != nullptr ? cluster_.bus->instanceId() : 0),
+      ioThreads_(threads.ioThreads),
+      fanout_(threads.fanoutThreads != 0 ? threads.fanoutThreads : std::thread::hardware_concurrency()),
+      presenceWindow_(presenceWindow)
 {
-    rooms_.emplace(1, Room(1, Room::Type::Public, "general"));
+    if (cluster_.instanceCount == 0 || instanceId_ >= cluster_.instanceCount)
+    {
+        throw std::invalid_argument("instance id must be less than instance count");
+    }
+    usernames_ = cluster_.usernames != nullptr ? cluster_.usernames : std::make_shared<UsernameIndex>();
+    nextUserId_.store(static_cast<IDType>(nextOwnId(0, 1)));
+    nextRoomId_.store(static_cast<IDType>(nextOwnId(0, 2)));
+    nextServerMessageId_.store(nextOwnId(0, 1));
+    if (compression_.enabled)
+    {
+        sharedCompressor_ = std::make_shared<DeflateCompressor>(compression_.windowBits, false, compression_.level,
+                                                                compression_.memLevel);
+    }
+    if (!history.directory.empty())
+    {
+        history_ = std::make_unique<MessageLog>(std::move(history));
+        // ID продолжаются после сохранённых, чтобы история не смешивалась с новыми сообщениями и комнатами.
+        nextServerMessageId_.store(nextOwnId(history_->lastMessageId(), 1));
+        nextRoomId_.store(static_cast<IDType>(nextOwnId(history_->lastChatId(), 2)));
+    }
+    const auto general = ObjectPool::makeShared<Room>(1, Room::Type::Public, "general", true, recentMessagesPerRoom_);
+    if (history_ != nullptr)
+    {
+        // Из прошлых запусков доступна только general: остальные комнаты не переживают перезапуск.
+        auto recent = history_->readBefore(1, 0, recentMessagesPerRoom_ + 1);
+        const bool olderExist = recent.size() > recentMessagesPerRoom_;
+        if (olderExist)
+        {
+            recent.erase(recent.begin());
+        }
+        general->seedRecentMessages(std::move(recent), olderExist);
+    }
+    rooms_.insertOrAssign(1, general);
     init();
 }
 
+ChatServer::~ChatServer()
+{
+    // Поток шины вызывает методы сервера: останавливается раньше, чем разрушается остальное.
+    if (cluster_.bus != nullptr)
+    {
+        cluster_.bus->stop();
+    }
+}
+
 void ChatServer::run(std::uint16_t port)
 {
-    server_.port(port).multithreaded().run();
+    // Собственный журнал Crow пишет синхронно в stderr; от него остаются только предупреждения и ошибки.
+    server_.loglevel(crow::LogLevel::Warning).port(port);
+    if (ioThreads_ != 0)
+        server_.concurrency(static_cast<std::uint16_t>(ioThreads_));
+    else
+        server_.multithreaded();
+    server_.run();
+    shutdown();
+}
+
+void ChatServer::shutdown()
+{
+    if (cluster_.bus != nullptr)
+    {
+        cluster_.bus->stop();
+    }
+    timers_.stop();
+    fanout_.stop();
+    if (history_ != nullptr)
+    {
+        history_->stop();
+    }
 }
 
 void ChatServer::init()
@@ -28,6 +111,12 @@ void ChatServer::init()
         return infoServer();
     });
 
+    CROW_ROUTE(server_, "/metrics")([this]() {
+        crow::response response(metricsText());
+        response.set_header("Content-Type", std::string(MetricsWriter::contentType));
+        return response;
+    });
+
     CROW_WEBSOCKET_ROUTE(server_, "/ws")
         .onopen([this](crow::websocket::connection& conn) {
             onWebSocketOpen(conn);
@@ -38,6 +127,15 @@ void ChatServer::init()
         .onclose([this](crow::websocket::connection& conn, const std::string& reason, uint16_t closeCode) {
             onWebSocketClose(conn, reason, closeCode);
         });
+
+    scheduleLatencyReportCheck();
+
+    if (cluster_.bus != nullptr)
+    {
+        cluster_.bus->start([this](const BusEvent& event) {
+            onBusEvent(event);
+        });
+    }
 }
 
 std::string ChatServer::infoServer() const
@@ -45,17 +143,138 @@ std::string ChatServer::infoServer() const
     return JsonPacker::packServerInfo(true, serverName_);
 }
 
+void ChatServer::scheduleLatencyReportCheck()
+{
+    // Сводку по SIGUSR1 пишет поток таймеров: в обработчике сигнала можно только поставить флаг.
+    timers_.schedule(latencyReportPoll, [this]() {
+        LatencyStats::logReportIfRequested();
+        scheduleLatencyReportCheck();
+    });
+}
+
+std::string ChatServer::metricsText() const
+{
+    MetricsWriter writer;
+
+    writer.family("chat_connections", "gauge", "Open WebSocket connections.");
+    writer.sample("chat_connections", clients_.size());
+    writer.family("chat_users", "gauge", "Registered users, including sessions waiting for resume.");
+    writer.sample("chat_users", usersById_.size());
+    writer.family("chat_rooms", "gauge", "Open rooms.");
+    writer.sample("chat_rooms", rooms_.size());
+    if (cluster_.bus != nullptr)
+    {
+        writer.family("chat_bus_events_total", "counter", "Events exchanged with other server instances; sent events count once per peer.");
+        writer.sample("chat_bus_events_total", {{"direction", "sent"}}, cluster_.bus->sentCount());
+        writer.sample("chat_bus_events_total", {{"direction", "received"}}, cluster_.bus->receivedCount());
+    }
+
+    writer.family("chat_connections_opened_total", "counter", "WebSocket connections accepted.");
+    writer.sample("chat_connections_opened_total", metrics_.connectionsOpened.value());
+    writer.family("chat_connections_closed_total", "counter", "WebSocket connections closed.");
+    writer.sample("chat_connections_closed_total", metrics_.connectionsClosed.value());
+    writer.family("chat_received_bytes_total", "counter", "Bytes of client WebSocket frames.");
+    writer.sample("chat_received_bytes_total", metrics_.bytesReceived.value());
+
+    writer.family("chat_messages_received_total", "counter", "Client messages by type.");
+    for (std::size_t i = 0; i < clientMessageTypeCount; ++i)
+    {
+        writer.sample("chat_messages_received_total", {{"type", clientMessageTypeName(static_cast<ClientMessageType>(i))}},
+                      metrics_.messagesReceived[i].value());
+    }
+
+    writer.family("chat_parse_failures_total", "counter", "Client messages rejected before a handler, by error code.");
+    writer.sample("chat_parse_failures_total", {{"code", "invalid-json"}}, metrics_.invalidJson.value());
+    writer.sample("chat_parse_failures_total", {{"code", "invalid-msgpack"}}, metrics_.invalidMsgPack.value());
+    writer.sample("chat_parse_failures_total", {{"code", "not-authorized"}}, metrics_.notAuthorized.value());
+    writer.sample("chat_parse_failures_total", {{"code", "unknown-message-type"}}, metrics_.unknownMessageType.value());
+    for (std::size_t i = 0; i < clientMessageTypeCount; ++i)
+    {
+        writer.sample("chat_parse_failures_total", {{"code", messageRoutes_[i].errorCode}}, metrics_.invalidPayloads[i].value());
+    }
+
+    writer.family("chat_message_recipients", "histogram", "Recipients of one chat message.");
+    writer.histogram("chat_message_recipients", metrics_.chatRecipients.snapshot());
+    writer.family("chat_user_changes_recipients", "histogram", "Recipients of one user-changes frame.");
+    writer.histogram("chat_user_changes_recipients", metrics_.presenceRecipients.snapshot());
+    if constexpr (AllocationStats::enabled)
+    {
+        writer.family("chat_frame_allocations", "histogram", "Heap allocations by the connection thread for one client frame, by type.");
+        for (std::size_t i = 0; i < clientMessageTypeCount; ++i)
+        {
+            writer.histogram("chat_frame_allocations", {"type", clientMessageTypeName(static_cast<ClientMessageType>(i))},
+                             metrics_.frameAllocations[i].snapshot());
+        }
+        writer.family("chat_allocations_total", "counter", "Heap allocations by all threads of the process.");
+        writer.sample("chat_allocations_total", AllocationStats::total());
+    }
+
+    // Очереди исходящих сообщений открытых соединений: сумма и самая длинная.
+    std::size_t queuedBytes = 0;
+    std::size_t queuedMessages = 0;
+    std::size_t inFlightBytes = 0;
+    std::size_t maxQueuedBytes = 0;
+    std::size_t maxQueuedMessages = 0;
+    std::size_t maxInFlightBytes = 0;
+    std::uint64_t dropped = metrics_.outboundDropped.value();
+    std::uint64_t coalesced = metrics_.outboundCoalesced.value();
+    clients_.forEach([&](crow::websocket::connection*, const UserContextPtr& user) {
+        const auto stats = user->outbox.stats();
+        queuedBytes += stats.queuedBytes;
+        queuedMessages += stats.queuedMessages;
+        inFlightBytes += stats.inFlightBytes;
+        maxQueuedBytes = std::max(maxQueuedBytes, stats.queuedBytes);
+        maxQueuedMessages = std::max(maxQueuedMessages, stats.queuedMessages);
+        maxInFlightBytes = std::max(maxInFlightBytes, stats.inFlightBytes);
+        dropped += stats.droppedMessages;
+        coalesced += stats.coalescedMessages;
+    });
+    writer.family("chat_outbound_queued_bytes", "gauge", "Bytes waiting in connection outboxes, all connections.");
+    writer.sample("chat_outbound_queued_bytes", queuedBytes);
+    writer.family("chat_outbound_queued_bytes_max", "gauge", "Bytes waiting in the outbox of the most backed-up connection.");
+    writer.sample("chat_outbound_queued_bytes_max", maxQueuedBytes);
+    writer.family("chat_outbound_queued_messages", "gauge", "Messages waiting in connection outboxes, all connections.");
+    writer.sample("chat_outbound_queued_messages", queuedMessages);
+    writer.family("chat_outbound_queued_messages_max", "gauge", "Messages waiting in the outbox of the most backed-up connection.");
+    writer.sample("chat_outbound_queued_messages_max", maxQueuedMessages);
+    writer.family("chat_outbound_in_flight_bytes", "gauge", "Estimated bytes handed to Crow but not yet read by clients, as of each connection's last send.");
+    writer.sample("chat_outbound_in_flight_bytes", inFlightBytes);
+    writer.family("chat_outbound_in_flight_bytes_max", "gauge", "Largest per-connection estimate of bytes not yet read by the client.");
+    writer.sample("chat_outbound_in_flight_bytes_max", maxInFlightBytes);
+    writer.family("chat_outbound_dropped_messages_total", "counter", "Messages dropped by outbox limits, including outboxes of connections closed with code 4008.");
+    writer.sample("chat_outbound_dropped_messages_total", dropped);
+    writer.family("chat_outbound_coalesced_messages_total", "counter", "Queued user-change messages replaced by a newer one for the same user.");
+    writer.sample("chat_outbound_coalesced_messages_total", coalesced);
+    writer.family("chat_slow_consumer_disconnects_total", "counter", "Connections closed with code 4008 because their outbox could not stay within its limits.");
+    writer.sample("chat_slow_consumer_disconnects_total", metrics_.slowConsumerDisconnects.value());
+
+    writer.family("chat_fanout_pending_deliveries", "gauge", "Broadcasts not yet queued to connections.");
+    writer.sample("chat_fanout_pending_deliveries", fanout_.pendingDeliveries());
+
+    writer.family("chat_latency_seconds", "summary", "Latency of message processing stages.");
+    for (std::size_t i = 0; i < latencyStageCount; ++i)
+    {
+        const auto stage = static_cast<LatencyStage>(i);
+        writer.latencySummary("chat_latency_seconds", {"stage", latencyStageName(stage)}, LatencyStats::snapshot(stage));
+    }
+
+    writer.family("chat_log_dropped_total", "counter", "Log records dropped because a thread log buffer was full.");
+    writer.sample("chat_log_dropped_total", Logger::dropped());
+
+    return writer.take();
+}
+
 void ChatServer::onWebSocketOpen(crow::websocket::connection& conn)
 {
-    CROW_LOG_INFO << "onWebSocketOpen(" << &conn << ")\n";
-    auto user = std::make_shared<UserContext>();
+    CHAT_LOG_INFO("ws-open").field("connection", &conn);
+    metrics_.connectionsOpened.add();
+    auto user = ObjectPool::makeShared<UserContext>();
     user->connection = &conn;
     user->connectionTime = std::chrono::steady_clock::now();
+    user->outbox.setLimits(outboxLimits_);
 
-    {
-        std::scoped_lock lock(stateMutex_);
-        clients_[&conn] = user;
-    }
+    clients_.insertOrAssign(&conn, user);
+    conn.userdata(user.get());
 
     ServerHelloPayload helloPayload{};
     helloPayload.authorized = false;
@@ -63,22 +282,67 @@ void ChatServer::onWebSocketOpen(crow::websocket::connection& conn)
     helloPayload.serverName = serverName_;
     conn.send_text(JsonPacker::packServerHello(helloPayload));
 
-    std::thread([this, connection = &conn]() {
-        std::this_thread::sleep_for(registrationTimeout_);
+    user->registrationTimer = timers_.schedule(registrationTimeout_, [this, connection = &conn]() {
         disconnectIfRegistrationTimedOut(connection);
-    }).detach();
+    });
+}
+
+template<typename Document, typename Request, std::optional<Request> (*Parse)(const Document&),
+         void (ChatServer::*Handle)(const UserContextPtr&, Request)>
+bool ChatServer::invokeRoute(ChatServer& server, const UserContextPtr& user, const Document& payload)
+{
+    auto request = Parse(payload);
+    if (!request.has_value())
+    {
+        return false;
+    }
+    const auto parsedAt = LatencyStats::Clock::now();
+    LatencyStats::record(LatencyStage::Parse, LatencyStats::frameReceivedAt(), parsedAt);
+    (server.*Handle)(user, std::move(*request));
+    LatencyStats::record(LatencyStage::Dispatch, parsedAt, LatencyStats::Clock::now());
+    return true;
+}
+
+template<typename Request, std::optional<Request> (*ParseText)(const JsonParser::InboundDocument&),
+         std::optional<Request> (*ParseBinary)(const MsgPackObject&),
+         void (ChatServer::*Handle)(const UserContextPtr&, Request)>
+constexpr ChatServer::MessageRoute ChatServer::makeRoute(ClientMessageType type, bool requiresAuthorization,
+                                                         const char* errorCode, const char* errorMessage)
+{
+    return {type, requiresAuthorization, errorCode, errorMessage,
+            &invokeRoute<JsonParser::InboundDocument, Request, ParseText, Handle>,
+            &invokeRoute<MsgPackObject, Request, ParseBinary, Handle>};
 }
 
+constexpr std::array<ChatServer::MessageRoute, clientMessageTypeCount> ChatServer::messageRoutes_{{
+    makeRoute<ClientRegisterRequest, &JsonParser::parseRegisterRequest, &JsonParser::parseRegisterRequest,
+              &ChatServer::handleRegistrationMessage>(
+        ClientMessageType::Register, false, "public-key-required", "Field 'public-key' must be string"),
+    makeRoute<ClientChatMessageRequest, &JsonParser::parseChatMessageRequest, &JsonParser::parseChatMessageRequest,
+              &ChatServer::handleChatMessage>(
+        ClientMessageType::ChatMessage, true, "invalid-chat-payload", "user-id, chat-id and message are required"),
+    makeRoute<ClientCreateRoomRequest, &JsonParser::parseCreateRoomRequest, &JsonParser::parseCreateRoomRequest,
+              &ChatServer::handleCreateRoomRequest>(
+        ClientMessageType::CreateRoom, true, "invalid-create-room-payload", "user-id and participant-user-ids are required"),
+    makeRoute<ClientLeaveRoomRequest, &JsonParser::parseLeaveRoomRequest, &JsonParser::parseLeaveRoomRequest,
+              &ChatServer::handleLeaveRoomRequest>(
+        ClientMessageType::LeaveRoom, true, "invalid-leave-room-payload", "user-id and chat-id are required"),
+    makeRoute<ClientDataRequest, &JsonParser::parseDataRequest, &JsonParser::parseDataRequest,
+              &ChatServer::handleDataRequest>(
+        ClientMessageType::DataRequest, true, "invalid-data-request", "user-id and data-type are required"),
+}};
+
 void ChatServer::onWebSocketMessage(crow::websocket::connection& conn, const std::string& data, bool isBinary)
 {
-    CROW_LOG_INFO << "onWebSocketMessage(" << &conn << ", \""<< data << "\", " << isBinary << ")\n";
+    // Каждый кадр -- только на уровне debug, текст кадра -- только при LoggerOptions::logPayloads.
+    CHAT_LOG_DEBUG("ws-message").field("connection", &conn).field("binary", isBinary).payload("payload", data);
+    metrics_.bytesReceived.add(data.size());
+    LatencyStats::setFrameReceivedAt(LatencyStats::Clock::now());
+    const auto allocationsAtFrame = AllocationStats::thread();
     try
     {
-        if (isBinary)
-        {
-            conn.send_text(JsonPacker::packError({"error", "binary-not-supported", "Use JSON text messages only"}));
-            return;
-        }
+        // Служебные буферы разбора и временные данные обработчика освобождаются разом после кадра.
+        MessageArena::Scope arena;
 
         const auto user = findUser(&conn);
         if (user == nullptr)
@@ -93,145 +357,160 @@ void ChatServer::onWebSocketMessage(crow::websocket::connection& conn, const std
             return;
         }
 
-        const auto jsonPayload = JsonParser::parseJson(data);
-        if (!jsonPayload.has_value())
-        {
-            conn.send_text(JsonPacker::packError({"error", "invalid-json", "Payload must be valid JSON object"}));
-            return;
-        }
-
-        const auto type = JsonParser::parseMessageType(*jsonPayload);
-        if (!type.has_value())
-        {
-            conn.send_text(JsonPacker::packError({"error", "invalid-json", "Field 'type' is required"}));
-            return;
-        }
-
-        if (*type == "register")
+        // Кодировка входящего кадра определяется его типом, ответы идут в кодировке соединения.
+        if (isBinary)
         {
-            const auto request = JsonParser::parseRegisterRequest(*jsonPayload);
-            if (!request.has_value())
+            const auto binaryPayload = MsgPackObject::parse(data);
+            if (!binaryPayload.has_value())
             {
-                conn.send_text(
-                    JsonPacker::packError({"error", "public-key-required", "Field 'public-key' must be string"}));
+                metrics_.invalidMsgPack.add();
+                user->send(WirePacker::packError(user->format.codec, {"error", "invalid-msgpack", "Payload must be valid MessagePack map"}));
                 return;
             }
-
-            handleRegistrationMessage(user, *request);
+            dispatchMessage(user, *binaryPayload, allocationsAtFrame);
             return;
         }
 
-        if (!user->authorized.load())
+        const auto jsonPayload = JsonParser::parseInbound(data);
+        if (!jsonPayload.has_value())
         {
-            conn.send_text(JsonPacker::packError({"error", "not-authorized", "Register first"}));
+            metrics_.invalidJson.add();
+            user->send(WirePacker::packError(user->format.codec, {"error", "invalid-json", "Payload must be valid JSON object"}));
             return;
         }
+        dispatchMessage(user, *jsonPayload, allocationsAtFrame);
+    }
+    catch (const std::bad_alloc&)
+    {
+        conn.close("out of memory", crow::websocket::CloseStatusCode::UnexpectedCondition);
+    }
+    catch (const std::exception&)
+    {
+        conn.close("internal error", crow::websocket::CloseStatusCode::UnexpectedCondition);
+    }
+}
 
-        if (*type == "chat-msg")
-        {
-            const auto request = JsonParser::parseChatMessageRequest(*jsonPayload);
-            if (!request.has_value())
-            {
-                conn.send_text(JsonPacker::packError(
-                    {"error", "invalid-chat-payload", "user-id, chat-id and message are required"}));
-                return;
-            }
+template<typename Document>
+void ChatServer::dispatchMessage(const UserContextPtr& user, const Document& payload, std::uint64_t allocationsAtFrame)
+{
+    constexpr bool isBinary = std::is_same_v<Document, MsgPackObject>;
 
-            handleChatMessage(user, *request);
-            return;
-        }
+    const auto type = JsonParser::parseMessageTypeView(payload);
+    if (!type.has_value())
+    {
+        (isBinary ? metrics_.invalidMsgPack : metrics_.invalidJson).add();
+        user->send(WirePacker::packError(user->format.codec, {"error", isBinary ? "invalid-msgpack" : "invalid-json", "Field 'type' is required"}));
+        return;
+    }
 
-        if (*type == "create-room")
+    static_assert([] {
+        for (std::size_t i = 0; i < clientMessageTypeCount; ++i)
         {
-            const auto request = JsonParser::parseCreateRoomRequest(*jsonPayload);
-            if (!request.has_value())
-            {
-                conn.send_text(JsonPacker::packError(
-                    {"error", "invalid-create-room-payload", "user-id and participant-user-ids are required"}));
-                return;
-            }
-
-            handleCreateRoomRequest(user, *request);
-            return;
+            if (static_cast<std::size_t>(messageRoutes_[i].type) != i)
+                return false;
         }
+        return true;
+    }(), "messageRoutes_ must be indexed by ClientMessageType");
 
-        if (*type == "leave-room")
-        {
-            const auto request = JsonParser::parseLeaveRoomRequest(*jsonPayload);
-            if (!request.has_value())
-            {
-                conn.send_text(
-                    JsonPacker::packError({"error", "invalid-leave-room-payload", "user-id and chat-id are required"}));
-                return;
-            }
-
-            handleLeaveRoomRequest(user, *request);
-            return;
-        }
+    const auto messageType = classifyClientMessage(*type);
+    const MessageRoute* route =
+        messageType.has_value() ? &messageRoutes_[static_cast<std::size_t>(*messageType)] : nullptr;
+    if (route != nullptr)
+    {
+        metrics_.messagesReceived[static_cast<std::size_t>(*messageType)].add();
+    }
 
-        if(*type == "data-request")
-        {
-            const auto request = JsonParser::parseDataRequest(*jsonPayload);
-            if (!request.has_value())
-            {
-                conn.send_text(JsonPacker::packError({"error", "invalid-data-request", "Error! Fuck you."}));
-                return;
-            }
-            handleDataRequest(user, *request);
-            return;
-        }
+    if ((route == nullptr || route->requiresAuthorization) && !user->authorized.load())
+    {
+        metrics_.notAuthorized.add();
+        user->send(WirePacker::packError(user->format.codec, {"error", "not-authorized", "Register first"}));
+        return;
+    }
 
-        conn.send_text(JsonPacker::packError({"error", "unknown-message-type", "Unsupported message type"}));
+    if (route == nullptr)
+    {
+        metrics_.unknownMessageType.add();
+        user->send(WirePacker::packError(user->format.codec, {"error", "unknown-message-type", "Unsupported message type"}));
+        return;
     }
-    catch (const std::bad_alloc&)
+
+    bool handled = false;
+    if constexpr (isBinary)
+        handled = route->invokeBinary(*this, user, payload);
+    else
+        handled = route->invoke(*this, user, payload);
+    if (!handled)
     {
-        conn.close("out of memory", crow::websocket::CloseStatusCode::UnexpectedCondition);
+        metrics_.invalidPayloads[static_cast<std::size_t>(*messageType)].add();
+        user->send(WirePacker::packError(user->format.codec, {"error", route->errorCode, route->errorMessage}));
     }
-    catch (const std::exception&)
+    if constexpr (AllocationStats::enabled)
     {
-        conn.close("internal error", crow::websocket::CloseStatusCode::UnexpectedCondition);
+        metrics_.frameAllocations[static_cast<std::size_t>(*messageType)].record(AllocationStats::thread() - allocationsAtFrame);
     }
 }
 
-void ChatServer::onWebSocketClose(crow::websocket::connection& conn, const std::string&, uint16_t)
+void ChatServer::onWebSocketClose(crow::websocket::connection& conn, const std::string&, uint16_t closeCode)
 {
-    CROW_LOG_INFO << "onWebSocketClose(" << &conn << ")\n";
-    std::scoped_lock lock(stateMutex_);
-    const auto clientIt = clients_.find(&conn);
-    if (clientIt == clients_.end())
+    CHAT_LOG_INFO("ws-close").field("connection", &conn).field("code", closeCode);
+    metrics_.connectionsClosed.add();
+    conn.userdata(nullptr);
+    const auto user = clients_.erase(&conn).value_or(nullptr);
+    if (user == nullptr)
     {
         return;
     }
 
-    const auto user = clientIt->second;
-    if (user != nullptr && user->userId != 0)
+    user->closing.store(true);
+    timers_.cancel(user->registrationTimer);
+    // Счётчики очереди соединения переходят в счётчики сервера.
+    const auto outbound = user->outbox.stats();
+    metrics_.outboundDropped.add(outbound.droppedMessages);
+    metrics_.outboundCoalesced.add(outbound.coalescedMessages);
+    if (outbound.overflowed)
     {
-        usersById_.erase(user->userId);
+        metrics_.slowConsumerDisconnects.add();
     }
 
-    for (const auto roomId : user->roomIds)
+    std::vector<IDType> roomIds;
     {
-        const auto roomIt = rooms_.find(roomId);
-        if (roomIt != rooms_.end())
+        // Под той же блокировкой, что и регистрация: она либо завершилась целиком, либо не начнётся.
+        std::scoped_lock lock(registrationMutex_);
+        roomIds = user->detach();
+        if (!user->authorized.load())
         {
-            roomIt->second.removeUser(user);
-            if (roomId != 1 && roomIt->second.empty())
+            return;
+        }
+
+        const auto session = sessions_.find(user->sessionToken);
+        if (session != sessions_.end())
+        {
+            if (session->second.user != user)
             {
-                rooms_.erase(roomIt);
+                // Сессию уже продолжило новое соединение, оно же забрало имя и комнаты.
+                return;
             }
+            // Пользователь остаётся в комнатах и в списке: рассылки этому соединению молча отбрасываются,
+            // а пропущенное клиент получит при продолжении сессии.
+            session->second.parked = true;
+            session->second.roomIds = std::move(roomIds);
+            session->second.expiryTimer = timers_.schedule(sessionGracePeriod_, [this, token = user->sessionToken, user]() {
+                expireSession(token, user);
+            });
+            return;
         }
     }
 
-    sendAllNewUserInfo(user, "logout");
-
-    clients_.erase(clientIt);
+    endSession(user, roomIds);
 }
 
-void ChatServer::handleRegistrationMessage(const UserContextPtr& user, const ClientRegisterRequest& request)
+void ChatServer::handleRegistrationMessage(const UserContextPtr& user, ClientRegisterRequest request)
 {
+    // Продолжение сессии по токену: имя и пароль не нужны, ID и комнаты берутся из сессии.
+    const bool resuming = !request.sessionToken.empty();
     ServerRegistrationPayload response{};
     {
-        std::scoped_lock lock(stateMutex_);
+        std::scoped_lock lock(registrationMutex_);
         if (user->closing.load())
         {
             return;
@@ -239,85 +518,281 @@ void ChatServer::handleRegistrationMessage(const UserContextPtr& user, const Cli
 
         if (user->authorized.load())
         {
-            user->connection->send_text(JsonPacker::packError({"register-error", "already-registered", "Already registered"}));
+            user->send(WirePacker::packError(user->format.codec, {"register-error", "already-registered", "Already registered"}));
             return;
         }
-        if(request.username.empty())
+        if(!resuming && request.username.empty())
         {
-            user->connection->send_text(JsonPacker::packError({"register-error", "empty-username", "Username is empty"}));
+            user->send(WirePacker::packError(user->format.codec, {"register-error", "empty-username", "Username is empty"}));
             return;
         }
-        if(request.password.empty())
+        if(!resuming && request.password.empty())
         {
-            user->connection->send_text(JsonPacker::packError({"register-error", "empty-password", "Password is empty"}));
+            user->send(WirePacker::packError(user->format.codec, {"register-error", "empty-password", "Password is empty"}));
             return;
         }
 
-        //Проверка, что нет пользователя с таким именем
-        for(const auto& [ID, userByID] : usersById_)
+        if(!resuming && !user->password.empty() && user->password != request.password)
         {
-            if(ID == user->userId)
-                continue;
-            if(!userByID->authorized)//Если пользователь не авторизован -- то тот, кто раньше занял имя, того и тапки
-                continue;
-            if(userByID->username == request.username)
-            {
-                user->connection->send_text(JsonPacker::packError({"register-error", "username-busy", "There is a user with that name"}));
-                return;
-            }
+            user->send(WirePacker::packError(user->format.codec, {"register-error", "wrong-password", "Invalid password"}));
+            return;
         }
 
-        if(!user->password.empty() && user->password != request.password)
+        const auto codec = parseWireCodec(request.encoding);
+        if(!codec.has_value())
         {
-            user->connection->send_text(JsonPacker::packError({"register-error", "wrong-password", "Invalid password"}));
+            user->send(WirePacker::packError(user->format.codec, {"register-error", "unsupported-encoding", "Supported encodings: json, msgpack"}));
             return;
         }
 
-        user->publicKey = request.publicKey;
-        user->username = request.username;
-        user->password = request.password;
-        user->userId = nextUserId_.fetch_add(1);
-        user->authorized.store(true);
+        const auto presenceScope = parsePresenceScope(request.presence);
+        if(!presenceScope.has_value())
+        {
+            user->send(WirePacker::packError(user->format.codec, {"register-error", "unsupported-presence", "Supported presence: all, rooms, none"}));
+            return;
+        }
 
-        usersById_[user->userId] = user;
+        std::shared_ptr<DeflateCompressor> compressor;
+        if(!request.compression.empty() && request.compression != "none")
+        {
+            if(request.compression != "deflate" || sharedCompressor_ == nullptr)
+            {
+                user->send(WirePacker::packError(user->format.codec, {"register-error", "unsupported-compression", "Compression is not available"}));
+                return;
+            }
+            compressor = negotiateCompression(request);
+        }
 
-        auto roomIt = rooms_.find(1);
-        if (roomIt != rooms_.end())
+        // Имя (или сессия) занимается последним: после этого регистрация уже не отклоняется.
+        std::vector<IDType> roomIds;
+        UserContextPtr previousSessionUser;
+        if (resuming)
+        {
+            auto previous = takeOverSession(user, request.sessionToken);
+            if (!previous.has_value())
+            {
+                user->send(WirePacker::packError(user->format.codec, {"register-error", "invalid-session", "Session expired or unknown"}));
+                return;
+            }
+            roomIds = std::move(previous->roomIds);
+            previousSessionUser = std::move(previous->user);
+        }
+        else
         {
-            roomIt->second.addUser(user);
-            user->roomIds.insert(1);
+            //Кто раньше занял имя, того и тапки
+            if(!usernames_->tryClaim(request.username, user))
+            {
+                user->send(WirePacker::packError(user->format.codec, {"register-error", "username-busy", "There is a user with that name"}));
+                return;
+            }
+
+            user->publicKey = request.publicKey;
+            user->username = request.username;
+            user->password = request.password;
+            user->userId = nextUserId_.fetch_add(cluster_.instanceCount);
+            if (sessionGracePeriod_.count() > 0)
+            {
+                user->sessionToken = issueSessionToken();
+                sessions_[user->sessionToken].user = user;
+            }
+            roomIds.push_back(1);
         }
-    
-        sendAllNewUserInfo(user, "registered");
+        user->format.codec = *codec;
+        user->presenceScope = *presenceScope;
+        user->presenceBatched = request.userChanges;
 
+        // Ответ уходит до включения сжатия: из него клиент узнаёт согласованные параметры.
+        // До authorized рассылки этому соединению не доставляются, поэтому ответ приходит первым.
         response.registered = true;
+        response.resumed = resuming;
         response.userId = user->userId;
         response.serverPublicKey = serverPublicKey_;
         response.serverName = serverName_;
+        response.sessionToken = user->sessionToken;
+        if (compressor != nullptr)
+        {
+            response.compression = "deflate";
+            response.compressionWindowBits = static_cast<std::uint32_t>(compressor->windowBits());
+            response.compressionContextTakeover = compressor->contextTakeover();
+        }
+        user->send(WirePacker::packRegistration(user->format.codec, response));
+
+        user->format.sharedDeflate = compressor != nullptr && compressor == sharedCompressor_;
+        user->compressor = std::move(compressor);
+        user->authorized.store(true);
+        timers_.cancel(user->registrationTimer);
+
+        usersById_.insertOrAssign(user->userId, user);
+
+        // Новое соединение входит в комнаты раньше, чем из них выходит прежнее: комната не опустеет и не закроется.
+        for (const auto roomId : roomIds)
+        {
+            const auto room = rooms_.find(roomId);
+            if (!room.has_value())
+            {
+                continue;
+            }
+            addUserToRoom(user, *room);
+            if (resuming)
+            {
+                removeUserFromRoom(previousSessionUser, *room);
+            }
+        }
+    }
+
+    if (resuming)
+    {
+        // Для остальных пользователей сессия не прерывалась: уведомления о выходе и входе не рассылаются.
+        if (request.lastServerMessageId.has_value())
+        {
+            replayMissedMessages(user, *request.lastServerMessageId);
+        }
+        return;
+    }
+    queuePresence(user, PresenceBatcher::Kind::Registered, user->rooms());
+}
+
+std::shared_ptr<DeflateCompressor> ChatServer::negotiateCompression(const ClientRegisterRequest& request) const
+{
+    // Окно клиента ограничивает окно сервера (как server_max_window_bits в RFC 7692), но не расширяет его.
+    int windowBits = sharedCompressor_->windowBits();
+    if (request.compressionWindowBits != 0)
+    {
+        windowBits = std::min(windowBits, DeflateCompressor::clampWindowBits(static_cast<int>(request.compressionWindowBits)));
+    }
+    const bool contextTakeover = request.compressionContextTakeover && compression_.allowContextTakeover;
+
+    // Без сохранения контекста и с окном сервера сообщения сжимаются один раз на рассылку.
+    if (!contextTakeover && windowBits == sharedCompressor_->windowBits())
+    {
+        return sharedCompressor_;
+    }
+    return std::make_shared<DeflateCompressor>(windowBits, contextTakeover, compression_.level, compression_.memLevel);
+}
+
+std::string ChatServer::issueSessionToken()
+{
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string token;
+    do
+    {
+        // 128 бит из системного источника случайности: токен -- единственное, что нужно для входа в сессию.
+        token.clear();
+        for (int word = 0; word < 4; ++word)
+        {
+            auto bits = static_cast<std::uint32_t>(tokenSource_());
+            for (int digit = 0; digit < 8; ++digit, bits >>= 4)
+            {
+                token.push_back(digits[bits & 0xF]);
+            }
+        }
+    } while (sessions_.contains(token));
+    return token;
+}
+
+std::optional<ChatServer::Session> ChatServer::takeOverSession(const UserContextPtr& user, const std::string& token)
+{
+    const auto it = sessions_.find(token);
+    if (it == sessions_.end())
+    {
+        return std::nullopt;
+    }
+    Session& session = it->second;
+    Session previous{std::exchange(session.user, user), session.parked, std::exchange(session.roomIds, {}),
+                     std::exchange(session.expiryTimer, TimerWheel::invalidTimer)};
+    session.parked = false;
+
+    if (previous.parked)
+    {
+        // Если таймер уже сработал, expireSession увидит другого владельца сессии и ничего не сделает.
+        timers_.cancel(previous.expiryTimer);
+    }
+    else
+    {
+        // Прежнее соединение ещё не заметило обрыва (частый случай при смене сети): закрываем его сами.
+        previous.user->closing.store(true);
+        previous.user->close("session resumed", crow::websocket::CloseStatusCode::NormalClosure);
+        previous.roomIds = previous.user->detach();
+    }
+
+    user->userId = previous.user->userId;
+    user->username = previous.user->username;
+    user->password = previous.user->password;
+    user->publicKey = previous.user->publicKey;
+    user->sessionToken = token;
+    usernames_->transfer(user->username, previous.user, user);
+    return previous;
+}
+
+void ChatServer::expireSession(const std::string& token, const UserContextPtr& user)
+{
+    std::vector<IDType> roomIds;
+    {
+        std::scoped_lock lock(registrationMutex_);
+        const auto it = sessions_.find(token);
+        if (it == sessions_.end() || it->second.user != user)
+        {
+            return;
+        }
+        roomIds = std::move(it->second.roomIds);
+        sessions_.erase(it);
     }
+    endSession(user, roomIds);
+}
 
-    user->connection->send_text(JsonPacker::packRegistration(response));
+void ChatServer::endSession(const UserContextPtr& user, const std::vector<IDType>& roomIds)
+{
+    usersById_.erase(user->userId);
+    usernames_->release(user->username, user);
+    for (const auto roomId : roomIds)
+    {
+        if (const auto room = rooms_.find(roomId))
+        {
+            removeUserFromRoom(user, *room);
+        }
+    }
+    queuePresence(user, PresenceBatcher::Kind::Logout, roomIds);
+}
+
+void ChatServer::replayMissedMessages(const UserContextPtr& user, std::uint64_t afterId)
+{
+    // Пропущенное отправляется страницей messages-payload на каждую комнату; остаток клиент дочитывает
+    // через data-request "messages" с after. Рассылки идут параллельно, повторы клиент отбрасывает по server-message-id.
+    for (const auto roomId : user->rooms())
+    {
+        if (const auto room = rooms_.find(roomId))
+        {
+            sendMessagesPage(user, roomId, loadHistoryAfter(**room, afterId, maxHistoryPage));
+        }
+    }
 }
 
-void ChatServer::handleChatMessage(const UserContextPtr& user, const ClientChatMessageRequest& request)
+void ChatServer::handleChatMessage(const UserContextPtr& user, ClientChatMessageRequest request)
 {
     if (request.userId != user->userId)
     {
-        user->connection->send_text(JsonPacker::packError({"error", "wrong-user-id", "Invalid user-id"}));
+        user->send(WirePacker::packError(user->format.codec, {"error", "wrong-user-id", "Invalid user-id"}));
         return;
     }
 
-    std::scoped_lock lock(stateMutex_);
-    if (!user->roomIds.contains(request.chatId))
+    if (!user->inRoom(request.chatId))
     {
-        user->connection->send_text(JsonPacker::packError({"error", "chat-access-denied", "No access to this chat"}));
+        user->send(WirePacker::packError(user->format.codec, {"error", "chat-access-denied", "No access to this chat"}));
         return;
     }
 
-    const auto roomIt = rooms_.find(request.chatId);
-    if (roomIt == rooms_.end())
+    const auto room = rooms_.find(request.chatId);
+    if (!room.has_value())
     {
-        user->connection->send_text(JsonPacker::packError({"error", "chat-not-found", "Chat not found"}));
+        user->send(WirePacker::packError(user->format.codec, {"error", "chat-not-found", "Chat not found"}));
+        return;
+    }
+
+    // Сообщение, которое шина не передаст, не получит никто: иначе его увидели бы только участники этого экземпляра.
+    if (cluster_.bus != nullptr &&
+        BusEvent::encodedHeaderSize + user->username.size() + request.message.size() > cluster_.bus->maxEventSize())
+    {
+        user->send(WirePacker::packError(user->format.codec, {"error", "message-too-large", "Message is too large"}));
         return;
     }
 
@@ -325,182 +800,621 @@ void ChatServer::handleChatMessage(const UserContextPtr& user, const ClientChatM
     response.userId = user->userId;
     response.userName = user->username;
     response.chatId = request.chatId;
-    response.message = request.message;
-    response.serverMessageId = nextServerMessageId_.fetch_add(1);
-
-    roomIt->second.broadcast(JsonPacker::packChatMessage(response));
+    response.message = std::move(request.message);
+
+    const auto recipients = (*room)->broadcast(fanout_, [&](WireFormatSet formats) {
+        response.serverMessageId = nextServerMessageId_.fetch_add(cluster_.instanceCount);
+        auto payloads = WirePacker::encode(
+            formats, [&](WireCodec codec) { return WirePacker::packChatMessage(codec, response); }, sharedCompressor_.get());
+        // Под блокировкой комнаты: в кольцо и журнал сообщения комнаты попадают по возрастанию ID.
+        // Ответ уже упакован, его строки переезжают в кольцо без копии.
+        StoredMessage stored{response.serverMessageId, response.chatId, response.userId, MessageLog::now(),
+                             std::move(response.userName), std::move(response.message)};
+        if (history_ != nullptr)
+        {
+            history_->append(stored);
+        }
+        if (cluster_.bus != nullptr)
+        {
+            // Тоже под блокировкой: другие экземпляры получают сообщения комнаты в порядке ID.
+            // publish только ставит событие в очередь, сокета под блокировкой шина не касается.
+            BusEvent event;
+            event.kind = BusEvent::Kind::ChatMessage;
+            event.roomId = stored.chatId;
+            event.userId = stored.userId;
+            event.serverMessageId = stored.serverMessageId;
+            event.timestamp = stored.timestamp;
+            event.name = stored.username;
+            event.text = stored.message;
+            cluster_.bus->publish(std::move(event));
+        }
+        (*room)->rememberMessage(std::move(stored));
+        return payloads;
+    }, LatencyStats::frameReceivedAt());
+    metrics_.chatRecipients.record(recipients);
 }
 
-void ChatServer::handleCreateRoomRequest(const UserContextPtr& user, const ClientCreateRoomRequest& request)
+void ChatServer::handleCreateRoomRequest(const UserContextPtr& user, ClientCreateRoomRequest request)
 {
     if (request.userId != user->userId)
     {
-        user->connection->send_text(JsonPacker::packError({"error", "wrong-user-id", "Invalid user-id"}));
+        user->send(WirePacker::packError(user->format.codec, {"error", "wrong-user-id", "Invalid user-id"}));
         return;
     }
 
-    std::vector<IDType> participants;
-    std::scoped_lock lock(stateMutex_);
-
-    const IDType roomId = nextRoomId_.fetch_add(1);
-    Room room(roomId, request.isPrivate ? Room::Type::Private : Room::Type::Public, request.name);
+    std::pmr::vector<UserContextPtr> participants(MessageArena::resource());
 
-    room.addUser(user);
-    user->roomIds.insert(roomId);
-    participants.push_back(user->userId);
+    const IDType roomId = nextRoomId_.fetch_add(cluster_.instanceCount);
+    const auto room = ObjectPool::makeShared<Room>(roomId, request.isPrivate ? Room::Type::Private : Room::Type::Public,
+                                             request.name, false, recentMessagesPerRoom_);
+    rooms_.insertOrAssign(roomId, room);
 
-    std::set<IDType> uniqueIds(request.participantUserIds.begin(), request.participantUserIds.end());
-    uniqueIds.erase(user->userId);
+    if (!addUserToRoom(user, room))
+    {
+        return;
+    }
+    participants.push_back(user);
+
+    std::pmr::vector<IDType> uniqueIds(request.participantUserIds.begin(), request.participantUserIds.end(),
+                                       MessageArena::resource());
+    std::sort(uniqueIds.begin(), uniqueIds.end());
+    uniqueIds.erase(std::unique(uniqueIds.begin(), uniqueIds.end()), uniqueIds.end());
+    std::erase(uniqueIds, user->userId);
+    std::pmr::vector<IDType> remoteIds(MessageArena::resource());
     for (const auto participantId : uniqueIds)
     {
-        const auto participantIt = usersById_.find(participantId);
-        if (participantIt == usersById_.end())
+        const auto participant = usersById_.find(participantId).value_or(nullptr);
+        if (participant == nullptr)
         {
+            // Пользователь другого экземпляра: в комнату его добавит свой экземпляр по RoomCreated.
+            if (cluster_.bus != nullptr && directory_.contains(participantId))
+                remoteIds.push_back(participantId);
             continue;
         }
-
-        auto& participant = participantIt->second;
-        if (participant == nullptr || !participant->authorized.load())
+        if (!participant->authorized.load())
         {
             continue;
         }
 
-        room.addUser(participant);
-        participant->roomIds.insert(roomId);
-        participants.push_back(participantId);
+        if (addUserToRoom(participant, room))
+        {
+            participants.push_back(participant);
+        }
     }
 
-    rooms_.emplace(roomId, std::move(room));
-
     ServerRoomCreatedPayload response{};
     response.created = true;
     response.chatId = roomId;
-    response.participantUserIds = participants;
+    response.participantUserIds.reserve(participants.size() + remoteIds.size());
+    for (const auto& participant : participants)
+        response.participantUserIds.push_back(participant->userId);
+    response.participantUserIds.insert(response.participantUserIds.end(), remoteIds.begin(), remoteIds.end());
     response.name = request.name;
 
-    std::string toSend = JsonPacker::packRoomCreated(response);
-
-    for(const auto& id : response.participantUserIds)
+    if (!remoteIds.empty())
     {
-        auto user = usersById_.find(id);
-        if(user == usersById_.end())
-            continue;
-        user->second->connection->send_text(toSend);
+        BusEvent event;
+        event.kind = BusEvent::Kind::RoomCreated;
+        event.roomId = roomId;
+        event.userId = user->userId;
+        event.flag = request.isPrivate;
+        event.name = request.name;
+        event.ids = response.participantUserIds;
+        cluster_.bus->publish(std::move(event));
     }
+    sendRoomCreated(participants, response);
+}
+
+void ChatServer::sendRoomCreated(std::span<const UserContextPtr> participants, const ServerRoomCreatedPayload& response)
+{
+    WireFormatSet formats;
+    for (const auto& participant : participants)
+        formats.insert(participant->format);
+    const auto toSend = WirePacker::encode(
+        formats, [&](WireCodec codec) { return WirePacker::packRoomCreated(codec, response); }, sharedCompressor_.get());
+
+    for(const auto& participant : participants)
+        participant->send(toSend);
 }
 
-void ChatServer::handleLeaveRoomRequest(const UserContextPtr& user, const ClientLeaveRoomRequest& request)
+void ChatServer::handleLeaveRoomRequest(const UserContextPtr& user, ClientLeaveRoomRequest request)
 {
     if (request.userId != user->userId)
     {
-        user->connection->send_text(JsonPacker::packError({"error", "wrong-user-id", "Invalid user-id"}));
+        user->send(WirePacker::packError(user->format.codec, {"error", "wrong-user-id", "Invalid user-id"}));
         return;
     }
 
-    std::scoped_lock lock(stateMutex_);
-    const auto roomIt = rooms_.find(request.chatId);
-    if (roomIt == rooms_.end())
+    const auto room = rooms_.find(request.chatId);
+    if (!room.has_value())
     {
-        user->connection->send_text(JsonPacker::packError({"error", "chat-not-found", "Chat not found"}));
+        user->send(WirePacker::packError(user->format.codec, {"error", "chat-not-found", "Chat not found"}));
         return;
     }
 
-    if (!user->roomIds.contains(request.chatId))
+    if (!user->inRoom(request.chatId))
     {
-        user->connection->send_text(JsonPacker::packError({"error", "chat-access-denied", "No access to this chat"}));
+        user->send(WirePacker::packError(user->format.codec, {"error", "chat-access-denied", "No access to this chat"}));
         return;
     }
 
-    roomIt->second.removeUser(user);
-    user->roomIds.erase(request.chatId);
-
-    if (request.chatId != 1 && roomIt->second.empty())
-    {
-        rooms_.erase(roomIt);
-    }
+    user->leaveRoom(request.chatId);
+    removeUserFromRoom(user, *room);
 
     ServerRoomLeftPayload response{};
     response.left = true;
     response.userId = user->userId;
     response.chatId = request.chatId;
 
-    user->connection->send_text(JsonPacker::packRoomLeft(response));
+    user->send(WirePacker::packRoomLeft(user->format.codec, response));
 }
 
-void ChatServer::handleDataRequest(const UserContextPtr& user, const ClientDataRequest& request)
+void ChatServer::handleDataRequest(const UserContextPtr& user, ClientDataRequest request)
 {
     if (request.userId != user->userId)
     {
-        user->connection->send_text(JsonPacker::packError({"error", "wrong-user-id", "Invalid user-id"}));
+        user->send(WirePacker::packError(user->format.codec, {"error", "wrong-user-id", "Invalid user-id"}));
         return;
     }
     if(request.dataType == "chats")
     {
         ServerChatsRequestPayload response;
-        for(const auto& id : user->roomIds)
+        for(const auto& id : user->rooms())
         {
-            auto roomFound = rooms_.find(id);
-            if(roomFound != rooms_.end())
-                response.chats[id] = roomFound->second.getName();
+            if(const auto roomFound = rooms_.find(id))
+                response.chats[id] = (*roomFound)->getName();
         }
-        user->connection->send_text(JsonPacker::packRequestChatsPayload(response));
+        user->send(WirePacker::packRequestChatsPayload(user->format.codec, response));
     }
     else if(request.dataType == "users")
     {
+        const auto afterId = static_cast<IDType>(std::min<std::uint64_t>(request.after.value_or(0), std::numeric_limits<IDType>::max()));
+        // Клиенты без limit и after ждут весь список, как до постраничной выдачи; страницы -- только по их запросу.
+        const bool paged = request.limit != 0 || request.after.has_value();
+        const std::size_t limit = !paged                ? std::numeric_limits<std::size_t>::max()
+                                  : request.limit == 0 ? defaultUsersPage
+                                                        : std::min<std::size_t>(request.limit, maxUsersPage);
+        auto page = directory_.page(afterId, request.prefix, limit, user->userId);
+
         ServerUsersRequestPayload response;
-        for(const auto& [connection, userPtr] : clients_)
-        {
-            if(userPtr->userId != user->userId)
-                response.users[userPtr->userId] = userPtr->username;
-        }
-        std::string res = JsonPacker::packRequestUsersPayload(response);
-        std::cout << "To user: " << res << '\n';
-        user->connection->send_text(res);
+        response.users = std::move(page.users);
+        response.hasMore = page.hasMore;
+        user->send(WirePacker::packRequestUsersPayload(user->format.codec, response));
+    }
+    else if(request.dataType == "messages")
+    {
+        sendHistory(user, request);
+    }
+}
+
+void ChatServer::sendHistory(const UserContextPtr& user, const ClientDataRequest& request)
+{
+    if (request.after.has_value() && request.before != 0)
+    {
+        user->send(WirePacker::packError(user->format.codec, {"error", "invalid-data-request", "Use either before or after"}));
+        return;
+    }
+    if (!user->inRoom(request.chatId))
+    {
+        user->send(WirePacker::packError(user->format.codec, {"error", "chat-access-denied", "No access to this chat"}));
+        return;
+    }
+    const auto room = rooms_.find(request.chatId);
+    if (!room.has_value())
+    {
+        user->send(WirePacker::packError(user->format.codec, {"error", "chat-not-found", "Chat not found"}));
+        return;
+    }
+
+    const std::size_t limit = request.limit == 0 ? defaultHistoryPage : std::min<std::size_t>(request.limit, maxHistoryPage);
+    sendMessagesPage(user, request.chatId,
+                     request.after.has_value() ? loadHistoryAfter(**room, *request.after, limit)
+                                               : loadHistoryBefore(**room, request.before, limit));
+}
+
+void ChatServer::sendMessagesPage(const UserContextPtr& user, IDType chatId, MessageRing::Page page)
+{
+    ServerMessagesPayload response;
+    response.chatId = chatId;
+    response.hasMore = page.hasMore;
+    response.truncated = page.truncated;
+    response.messages.reserve(page.messages.size());
+    for (auto& message : page.messages)
+    {
+        response.messages.push_back(ServerHistoryMessage{message.serverMessageId, message.userId, std::move(message.username),
+                                                         std::move(message.message), static_cast<std::uint64_t>(message.timestamp)});
+    }
+    user->send(WirePacker::packMessagesPayload(user->format.codec, response));
+}
+
+MessageRing::Page ChatServer::loadHistoryAfter(const Room& room, std::uint64_t afterId, std::size_t limit) const
+{
+    auto page = room.recentAfter(afterId, limit);
+    if (page.complete || history_ == nullptr)
+    {
+        // Без журнала вытесненное из кольца потеряно: клиент получает то, что есть, с признаком truncated.
+        return page;
+    }
+
+    // Начало страницы старше кольца: читаем журнал, а если он кончился раньше limit -- добираем из кольца
+    // сообщения, которые ещё не успели записаться. Если журнал обрывается раньше кольца (удалён по сроку
+    // хранения), пропуск между ними помечается truncated.
+    page.messages = history_->readAfter(room.id(), afterId, limit + 1);
+    page.hasMore = page.messages.size() > limit;
+    page.truncated = false;
+    if (page.hasMore)
+    {
+        page.messages.pop_back();
+        return page;
+    }
+    const auto lastId = page.messages.empty() ? afterId : page.messages.back().serverMessageId;
+    auto newer = room.recentAfter(lastId, limit - page.messages.size());
+    std::move(newer.messages.begin(), newer.messages.end(), std::back_inserter(page.messages));
+    page.hasMore = newer.hasMore;
+    page.truncated = newer.truncated;
+    return page;
+}
+
+MessageRing::Page ChatServer::loadHistoryBefore(const Room& room, std::uint64_t beforeId, std::size_t limit) const
+{
+    auto page = room.recentBefore(beforeId, limit);
+    if (page.complete || history_ == nullptr)
+    {
+        return page;
+    }
+
+    // Кольцо дало самый новый хвост страницы, более старое начало -- из журнала.
+    const auto missing = limit - page.messages.size();
+    const auto boundary = page.messages.empty() ? beforeId : page.messages.front().serverMessageId;
+    auto older = history_->readBefore(room.id(), boundary, missing + 1);
+    page.hasMore = older.size() > missing;
+    if (page.hasMore)
+    {
+        older.erase(older.begin());
     }
+    std::move(page.messages.begin(), page.messages.end(), std::back_inserter(older));
+    page.messages = std::move(older);
+    return page;
 }
 
 void ChatServer::disconnectIfRegistrationTimedOut(crow::websocket::connection* connection)
 {
-    UserContextPtr user;
+    const auto user = clients_.find(connection).value_or(nullptr);
+    if (user == nullptr || user->authorized.load())
+    {
+        return;
+    }
+    user->closing.store(true);
+    user->close("registration timeout", crow::websocket::CloseStatusCode::PolicyViolated);
+}
+
+UserContextPtr ChatServer::findUser(crow::websocket::connection* connection)
+{
+    // userdata выставляется в onWebSocketOpen и снимается в onWebSocketClose на том же потоке соединения,
+    // поэтому быстрый путь не требует обращения к таблице clients_.
+    if (auto* user = static_cast<UserContext*>(connection->userdata()))
+    {
+        return user->shared_from_this();
+    }
+    return clients_.find(connection).value_or(nullptr);
+}
+
+bool ChatServer::addUserToRoom(const UserContextPtr& user, const RoomPtr& room)
+{
+    if (!room->addUser(user))
     {
-        std::scoped_lock lock(stateMutex_);
-        const auto it = clients_.find(connection);
-        if (it == clients_.end() || it->second->authorized.load())
+        return false;
+    }
+    // Если соединение закрылось между двумя шагами, onWebSocketClose уже не увидит эту комнату.
+    if (!user->joinRoom(room->id()))
+    {
+        removeUserFromRoom(user, room);
+        return false;
+    }
+    return true;
+}
+
+void ChatServer::removeUserFromRoom(const UserContextPtr& user, const RoomPtr& room)
+{
+    if (room->removeUser(user))
+    {
+        rooms_.eraseIf(room->id(), [&room](const RoomPtr& current) { return current == room; });
+    }
+}
+
+void ChatServer::queuePresence(const UserContextPtr& user, PresenceBatcher::Kind kind, std::vector<IDType> roomIds)
+{
+    if (cluster_.bus != nullptr)
+    {
+        BusEvent event;
+        event.kind = BusEvent::Kind::Presence;
+        event.userId = user->userId;
+        event.flag = kind == PresenceBatcher::Kind::Registered;
+        event.name = user->username;
+        event.ids = roomIds;
+        cluster_.bus->publish(std::move(event));
+    }
+    queuePresenceChange({user->userId, kind, user->username, std::move(roomIds)});
+}
+
+void ChatServer::queuePresenceChange(PresenceBatcher::Change change)
+{
+    if (change.kind == PresenceBatcher::Kind::Registered)
+        directory_.add(change.userId, change.username);
+    else
+        directory_.remove(change.userId);
+    const bool schedule = presence_.add(std::move(change));
+    if (presenceWindow_.count() == 0)
+    {
+        flushPresence();
+    }
+    else if (schedule)
+    {
+        timers_.schedule(presenceWindow_, [this]() {
+            flushPresence();
+        });
+    }
+}
+
+void ChatServer::flushPresence()
+{
+    const auto changes = presence_.take();
+    directory_.publish();
+    if (changes.empty())
+    {
+        return;
+    }
+
+    // selected -- индексы изменений по возрастанию; nullptr -- все.
+    const auto pack = [&](const std::vector<std::uint32_t>* selected, const WireFormatSet& formats) {
+        ServerUserChangesPayload payload;
+        const auto add = [&](const PresenceBatcher::Change& change) {
+            if (change.kind == PresenceBatcher::Kind::Registered)
+                payload.registered.emplace(change.userId, change.username);
+            else
+                payload.logout.push_back(change.userId);
+        };
+        if (selected == nullptr)
         {
-            return;
+            for (const auto& change : changes)
+                add(change);
+        }
+        else
+        {
+            for (const auto index : *selected)
+                add(changes[index]);
+        }
+        return WirePacker::encode(
+            formats, [&](WireCodec codec) { return WirePacker::packUserChanges(codec, payload); }, sharedCompressor_.get());
+    };
+
+    std::vector<UserContextPtr> recipients;
+    usersById_.forEach([&](IDType, const UserContextPtr& userPtr) {
+        if (userPtr->presenceScope != PresenceScope::None)
+            recipients.push_back(userPtr);
+    });
+
+    // Изменения по комнатам, для получателей с PresenceScope::Rooms: они обходят только свои комнаты.
+    std::unordered_map<IDType, std::vector<std::uint32_t>> changesByRoom;
+    for (std::uint32_t i = 0; i < changes.size(); ++i)
+    {
+        for (const auto roomId : changes[i].roomIds)
+            changesByRoom[roomId].push_back(i);
+    }
+
+    // Подписанным на user-changes со scope All -- один общий кадр со всеми изменениями, включая их собственные:
+    // клиент пропускает свой user-id сам. Со scope Rooms -- кадр на каждый различный набор изменений.
+    // Остальным -- прежние user-change, по одному общему кадру на изменение, без собственного входа получателя.
+    std::vector<UserContextPtr> batchedAll;
+    std::map<std::vector<std::uint32_t>, std::vector<UserContextPtr>> batchedBySelection;
+    auto legacyOwners = std::make_shared<std::vector<UserContextPtr>>();
+    std::vector<UserContext*> legacyAll;
+    std::vector<std::vector<UserContext*>> legacyByChange(changes.size());
+
+    std::vector<std::uint32_t> selectedAt(changes.size(), 0);
+    std::uint32_t stamp = 0;
+    std::vector<std::uint32_t> selected;
+    for (auto& recipient : recipients)
+    {
+        if (recipient->presenceScope == PresenceScope::All)
+        {
+            if (recipient->presenceBatched)
+            {
+                batchedAll.push_back(std::move(recipient));
+            }
+            else
+            {
+                legacyAll.push_back(recipient.get());
+                legacyOwners->push_back(std::move(recipient));
+            }
+            continue;
+        }
+
+        ++stamp;
+        selected.clear();
+        for (const auto roomId : recipient->rooms())
+        {
+            const auto it = changesByRoom.find(roomId);
+            if (it == changesByRoom.end())
+                continue;
+            for (const auto index : it->second)
+            {
+                if (selectedAt[index] != stamp)
+                {
+                    selectedAt[index] = stamp;
+                    selected.push_back(index);
+                }
+            }
+        }
+        if (selected.empty())
+        {
+            continue;
+        }
+        if (recipient->presenceBatched)
+        {
+            std::sort(selected.begin(), selected.end());
+            batchedBySelection[selected].push_back(std::move(recipient));
+            continue;
+        }
+        for (const auto index : selected)
+        {
+            if (changes[index].userId != recipient->userId)
+                legacyByChange[index].push_back(recipient.get());
+        }
+        legacyOwners->push_back(std::move(recipient));
+    }
+
+    const auto formatsOf = [](const auto& users) {
+        WireFormatSet formats;
+        for (const auto& user : users)
+            formats.insert(user->format);
+        return formats;
+    };
+
+    if (!batchedAll.empty())
+    {
+        const auto formats = formatsOf(batchedAll);
+        metrics_.presenceRecipients.record(batchedAll.size());
+        fanout_.post(presenceLane, Recipients::owning(std::move(batchedAll)), pack(nullptr, formats));
+    }
+    for (auto& [selection, users] : batchedBySelection)
+    {
+        const auto formats = formatsOf(users);
+        metrics_.presenceRecipients.record(users.size());
+        fanout_.post(presenceLane, Recipients::owning(std::move(users)), pack(&selection, formats));
+    }
+
+    if (legacyOwners->empty())
+    {
+        return;
+    }
+    // Списки получателей user-change -- простые указатели, всех их держит один общий legacyOwners.
+    const std::shared_ptr<const void> keepAlive = legacyOwners;
+    for (std::size_t i = 0; i < changes.size(); ++i)
+    {
+        auto list = std::make_shared<Recipients>();
+        list->users.reserve(legacyAll.size() + legacyByChange[i].size());
+        for (auto* const user : legacyAll)
+        {
+            if (user->userId != changes[i].userId)
+                list->users.push_back(user);
         }
-        user = it->second;
-        user->closing.store(true);
+        list->users.insert(list->users.end(), legacyByChange[i].begin(), legacyByChange[i].end());
+        if (list->users.empty())
+            continue;
+        list->keepAlive = keepAlive;
+
+        ServerUsersSomeChange payload;
+        payload.changeType = changes[i].kind == PresenceBatcher::Kind::Registered ? "registered" : "logout";
+        payload.userId = changes[i].userId;
+        payload.username = changes[i].username;
+        const auto formats = formatsOf(list->users);
+        metrics_.presenceRecipients.record(list->users.size());
+        // Следующий user-change того же пользователя заменяет этот в переполненной очереди соединения.
+        fanout_.post(presenceLane, std::move(list),
+                     WirePacker::encode(
+                         formats, [&](WireCodec codec) { return WirePacker::packUserChange(codec, payload); },
+                         sharedCompressor_.get()),
+                     Outbox::MessageKind::Presence, changes[i].userId);
     }
+}
 
-    if (user != nullptr && user->connection != nullptr)
+void ChatServer::onBusEvent(const BusEvent& event)
+{
+    switch (event.kind)
     {
-        user->connection->close("registration timeout", crow::websocket::CloseStatusCode::PolicyViolated);
+    case BusEvent::Kind::ChatMessage:
+        deliverRemoteMessage(event);
+        break;
+    case BusEvent::Kind::Presence:
+        queuePresenceChange({event.userId, event.flag ? PresenceBatcher::Kind::Registered : PresenceBatcher::Kind::Logout,
+                             event.name, event.ids});
+        break;
+    case BusEvent::Kind::RoomCreated:
+        joinRemoteRoom(event);
+        break;
     }
 }
 
-UserContextPtr ChatServer::findUser(crow::websocket::connection* connection)
+void ChatServer::deliverRemoteMessage(const BusEvent& event)
 {
-    std::scoped_lock lock(stateMutex_);
-    const auto it = clients_.find(connection);
-    if (it == clients_.end())
+    observeMessageId(event.serverMessageId);
+    const auto room = rooms_.find(event.roomId);
+    if (!room.has_value())
     {
-        return nullptr;
+        // У этого экземпляра нет участников комнаты.
+        return;
     }
-    return it->second;
+
+    ServerChatMessagePayload response{};
+    response.userId = event.userId;
+    response.userName = event.name;
+    response.chatId = event.roomId;
+    response.message = event.text;
+    response.serverMessageId = event.serverMessageId;
+
+    (*room)->broadcast(fanout_, [&](WireFormatSet formats) {
+        StoredMessage stored{response.serverMessageId, response.chatId, response.userId, event.timestamp,
+                             response.userName, response.message};
+        if (history_ != nullptr)
+        {
+            history_->append(stored);
+        }
+        (*room)->rememberMessage(std::move(stored));
+        return WirePacker::encode(
+            formats, [&](WireCodec codec) { return WirePacker::packChatMessage(codec, response); }, sharedCompressor_.get());
+    });
 }
 
-void ChatServer::sendAllNewUserInfo(UserContextPtr newUser, std::string info)
+void ChatServer::joinRemoteRoom(const BusEvent& event)
 {
-    if(!newUser || !newUser->authorized.load())
+    std::vector<UserContextPtr> participants;
+    for (const auto participantId : event.ids)
+    {
+        const auto participant = usersById_.find(participantId).value_or(nullptr);
+        if (participant != nullptr && participant->authorized.load())
+            participants.push_back(participant);
+    }
+    if (participants.empty())
+    {
         return;
-    ServerUsersSomeChange change;
-    change.changeType = std::move(info);
-    change.userId = newUser->userId;
-    change.username = newUser->username;
-    std::string msg = JsonPacker::packUserChange(std::move(change));
-
-    for(auto& [conn, userPtr] : clients_)
-        if(userPtr->authorized.load() && userPtr->userId != newUser->userId)
-            conn->send_text(msg);
-}
\ No newline at end of file
+    }
+
+    // ID комнаты тот же, что у создателя: по нему сюда приходят её сообщения.
+    const auto room = ObjectPool::makeShared<Room>(event.roomId, event.flag ? Room::Type::Private : Room::Type::Public,
+                                             event.name, false, recentMessagesPerRoom_);
+    rooms_.insertOrAssign(event.roomId, room);
+    std::erase_if(participants, [&](const UserContextPtr& participant) { return !addUserToRoom(participant, room); });
+    if (participants.empty())
+    {
+        rooms_.eraseIf(event.roomId, [&room](const RoomPtr& current) { return current == room; });
+        return;
+    }
+
+    ServerRoomCreatedPayload response{};
+    response.created = true;
+    response.chatId = event.roomId;
+    response.participantUserIds = event.ids;
+    response.name = event.name;
+    sendRoomCreated(participants, response);
+}
+
+std::uint64_t ChatServer::nextOwnId(std::uint64_t current, std::uint64_t first) const
+{
+    const std::uint64_t start = first + instanceId_;
+    if (current < start)
+    {
+        return start;
+    }
+    const std::uint64_t step = cluster_.instanceCount;
+    return start + ((current - start) / step + 1) * step;
+}
+
+void ChatServer::observeMessageId(std::uint64_t serverMessageId)
+{
+    const auto next = nextOwnId(serverMessageId, 1);
+    auto current = nextServerMessageId_.load();
+    while (current < next && !nextServerMessageId_.compare_exchange_weak(current, next))
+    {
+    }
+}
@@ -1,59 +1,232 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <mutex>
+#include <optional>
+#include <random>
+#include <span>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <crow.h>
 
+#include "core/AllocationStats.hpp"
+#include "core/EventBus.hpp"
+#include "core/FanoutExecutor.hpp"
+#include "core/MessageLog.hpp"
+#include "core/Metrics.hpp"
+#include "core/Outbox.hpp"
+#include "core/PresenceBatcher.hpp"
 #include "core/Room.hpp"
+#include "core/ShardedMap.hpp"
+#include "core/TimerWheel.hpp"
+#include "core/UserDirectory.hpp"
+#include "core/UsernameIndex.hpp"
+#include "protocol/DeflateCompressor.hpp"
 #include "protocol/JsonMessages.hpp"
+#include "protocol/JsonParser.hpp"
+#include "protocol/MessageDispatch.hpp"
+
+// Потоки одного сервера; 0 -- по числу ядер. Шарду, который владеет одним ядром, хватает по одному.
+struct ThreadOptions
+{
+    std::size_t ioThreads = 0;      // Потоки Crow, обслуживающие соединения.
+    std::size_t fanoutThreads = 0;  // Потоки FanoutExecutor.
+};
 
 class ChatServer
 {
 public:
-    ChatServer(std::string serverName, std::string serverPublicKey, std::chrono::seconds registrationTimeout);
+    ChatServer(std::string serverName, std::string serverPublicKey, std::chrono::seconds registrationTimeout,
+               OutboxLimits outboxLimits = {}, CompressionOptions compression = {}, HistoryOptions history = {},
+               std::chrono::seconds sessionGracePeriod = std::chrono::seconds(60),
+               std::chrono::milliseconds presenceWindow = std::chrono::milliseconds(100),
+               ClusterOptions cluster = {}, ThreadOptions threads = {});
+    ~ChatServer();
 
     void run(std::uint16_t port);
 
 private:
+    // Шарды процесса принимают соединения через общий ShardListener, а не через свой server_.
+    friend class ShardListener;
+
     void init();
+    // Останавливает шину, таймеры, рассылку и журнал после того, как перестали приходить соединения.
+    void shutdown();
     std::string infoServer() const;
+    std::string metricsText() const;
+    void scheduleLatencyReportCheck();
 
     void onWebSocketOpen(crow::websocket::connection& conn);
     void onWebSocketMessage(crow::websocket::connection& conn, const std::string& data, bool isBinary);
     void onWebSocketClose(crow::websocket::connection& conn, const std::string& reason, uint16_t closeCode);
 
-    void handleRegistrationMessage(const UserContextPtr& user, const ClientRegisterRequest& request);
-    void handleChatMessage(const UserContextPtr& user, const ClientChatMessageRequest& request);
-    void handleCreateRoomRequest(const UserContextPtr& user, const ClientCreateRoomRequest& request);
-    void handleLeaveRoomRequest(const UserContextPtr& user, const ClientLeaveRoomRequest& request);
-    void handleDataRequest(const UserContextPtr& user, const ClientDataRequest& request);
-
+    // Разобранный запрос передаётся обработчику во владение: строки из него забираются без копии.
+    void handleRegistrationMessage(const UserContextPtr& user, ClientRegisterRequest request);
+    void handleChatMessage(const UserContextPtr& user, ClientChatMessageRequest request);
+    void handleCreateRoomRequest(const UserContextPtr& user, ClientCreateRoomRequest request);
+    void handleLeaveRoomRequest(const UserContextPtr& user, ClientLeaveRoomRequest request);
+    void handleDataRequest(const UserContextPtr& user, ClientDataRequest request);
+
+    // Маршрут одного типа клиентского сообщения: разбор в типизированный запрос и вызов обработчика.
+    // invoke разбирает текстовые кадры (JSON), invokeBinary -- бинарные (MessagePack).
+    struct MessageRoute
+    {
+        ClientMessageType type;
+        bool requiresAuthorization;
+        const char* errorCode;      // Ошибка, если payload не разобрался в запрос.
+        const char* errorMessage;
+        bool (*invoke)(ChatServer& server, const UserContextPtr& user, const JsonParser::InboundDocument& payload);
+        bool (*invokeBinary)(ChatServer& server, const UserContextPtr& user, const MsgPackObject& payload);
+    };
+
+    template<typename Document, typename Request, std::optional<Request> (*Parse)(const Document&),
+             void (ChatServer::*Handle)(const UserContextPtr&, Request)>
+    static bool invokeRoute(ChatServer& server, const UserContextPtr& user, const Document& payload);
+
+    template<typename Request, std::optional<Request> (*ParseText)(const JsonParser::InboundDocument&),
+             std::optional<Request> (*ParseBinary)(const MsgPackObject&),
+             void (ChatServer::*Handle)(const UserContextPtr&, Request)>
+    static constexpr MessageRoute makeRoute(ClientMessageType type, bool requiresAuthorization, const char* errorCode,
+                                            const char* errorMessage);
+
+    template<typename Document>
+    // allocationsAtFrame -- AllocationStats::thread() при приёме кадра.
+    void dispatchMessage(const UserContextPtr& user, const Document& payload, std::uint64_t allocationsAtFrame);
+
+    static const std::array<MessageRoute, clientMessageTypeCount> messageRoutes_;
+
+    // Страница истории для data-request "messages": последние сообщения из кольца комнаты, остальное из журнала.
+    void sendHistory(const UserContextPtr& user, const ClientDataRequest& request);
+    MessageRing::Page loadHistoryAfter(const Room& room, std::uint64_t afterId, std::size_t limit) const;
+    MessageRing::Page loadHistoryBefore(const Room& room, std::uint64_t beforeId, std::size_t limit) const;
+    void sendMessagesPage(const UserContextPtr& user, IDType chatId, MessageRing::Page page);
+
+    // Сессии: после обрыва соединения пользователь остаётся в комнатах и в списке пользователей
+    // ещё sessionGracePeriod_, и новое соединение может продолжить сессию по токену.
+    // Вызываются под registrationMutex_, кроме endSession и replayMissedMessages.
+    std::string issueSessionToken();
+    struct Session;
+    // Переносит сессию на user и возвращает её прежнее состояние; nullopt, если токен неизвестен.
+    std::optional<Session> takeOverSession(const UserContextPtr& user, const std::string& token);
+    void expireSession(const std::string& token, const UserContextPtr& user);
+    void endSession(const UserContextPtr& user, const std::vector<IDType>& roomIds);
+    void replayMissedMessages(const UserContextPtr& user, std::uint64_t afterId);
+
+    std::shared_ptr<DeflateCompressor> negotiateCompression(const ClientRegisterRequest& request) const;
     void disconnectIfRegistrationTimedOut(crow::websocket::connection* connection);
     UserContextPtr findUser(crow::websocket::connection* connection);
+    bool addUserToRoom(const UserContextPtr& user, const RoomPtr& room);
+    void sendRoomCreated(std::span<const UserContextPtr> participants, const ServerRoomCreatedPayload& response);
+    void removeUserFromRoom(const UserContextPtr& user, const RoomPtr& room);
+
+    // События других экземпляров; вызываются потоком шины.
+    void onBusEvent(const BusEvent& event);
+    void deliverRemoteMessage(const BusEvent& event);
+    void joinRemoteRoom(const BusEvent& event);
+    // Следующий ID с шагом cluster_.instanceCount после current, из последовательности, начатой с first.
+    [[nodiscard]] std::uint64_t nextOwnId(std::uint64_t current, std::uint64_t first) const;
+    // Сообщения экземпляров упорядочены по server-message-id: свои следующие ID больше уже увиденных чужих.
+    void observeMessageId(std::uint64_t serverMessageId);
 
 private:
     std::string serverName_;
     std::string serverPublicKey_;
     std::chrono::seconds registrationTimeout_;
+    OutboxLimits outboxLimits_;
+    CompressionOptions compression_;
+    // Компрессор без сохранения контекста с окном сервера, общий для всех соединений; nullptr, если сжатие выключено.
+    std::shared_ptr<DeflateCompressor> sharedCompressor_;
+
+    // Журнал истории сообщений; nullptr, если каталог истории не задан.
+    std::unique_ptr<MessageLog> history_;
+    std::size_t recentMessagesPerRoom_;
+    static constexpr std::size_t defaultHistoryPage = 50;
+    static constexpr std::size_t maxHistoryPage = 200;
+    static constexpr std::size_t defaultUsersPage = 100;
+    static constexpr std::size_t maxUsersPage = 1000;
+
+    // Счётчики для /metrics. Объявлены раньше потоков рассылки и таймеров, которые в них пишут.
+    struct ServerMetrics
+    {
+        Counter connectionsOpened;
+        Counter connectionsClosed;
+        Counter bytesReceived;
+        std::array<Counter, clientMessageTypeCount> messagesReceived;
+        // Ошибки разбора по кодам ошибок, которые получает клиент.
+        Counter invalidJson;
+        Counter invalidMsgPack;
+        Counter notAuthorized;
+        Counter unknownMessageType;
+        std::array<Counter, clientMessageTypeCount> invalidPayloads;  // Код -- MessageRoute::errorCode.
+        Histogram chatRecipients;      // Получатели одного chat-msg.
+        Histogram presenceRecipients;  // Получатели одного кадра user-changes.
+        // Счётчики очередей закрытых соединений; к ним добавляются счётчики открытых.
+        Counter outboundDropped;
+        Counter outboundCoalesced;
+        Counter slowConsumerDisconnects;
+        // Выделения памяти потоком соединения на один кадр, от разбора до конца обработчика.
+        // Пишутся только при AllocationStats::enabled.
+        std::array<Histogram, clientMessageTypeCount> frameAllocations;
+    };
+    ServerMetrics metrics_;
+    static constexpr std::chrono::milliseconds latencyReportPoll{500};
 
     crow::SimpleApp server_;
 
-    std::unordered_map<IDType, Room> rooms_;
-    std::unordered_map<crow::websocket::connection*, UserContextPtr> clients_;
-    std::unordered_map<IDType, UserContextPtr> usersById_;
-    std::mutex stateMutex_;
+    // Каждая комната защищена своим мьютексом, таблицы -- блокировками своих шардов.
+    ShardedMap<IDType, RoomPtr> rooms_;
+    ShardedMap<crow::websocket::connection*, UserContextPtr> clients_;
+    ShardedMap<IDType, UserContextPtr> usersById_;
+    // Имена зарегистрированных пользователей; освобождаются в onWebSocketClose.
+    // Свой или общий с другими шардами процесса (ClusterOptions::usernames).
+    std::shared_ptr<UsernameIndex> usernames_;
+    // Сериализует регистрацию, продолжение и закрытие сессий; уникальность имени обеспечивает usernames_.
+    std::mutex registrationMutex_;
+
+    struct Session
+    {
+        UserContextPtr user;                 // Текущее соединение сессии или последнее, если оно оборвалось.
+        bool parked = false;                 // Соединение оборвалось, ждём продолжения до expiryTimer.
+        std::vector<IDType> roomIds;         // Комнаты на момент обрыва.
+        TimerWheel::TimerId expiryTimer = TimerWheel::invalidTimer;
+    };
+    std::chrono::seconds sessionGracePeriod_;  // 0 -- сессии не продолжаются, токены не выдаются.
+    // Под registrationMutex_.
+    std::unordered_map<std::string, Session> sessions_;
+    std::random_device tokenSource_;
+
+    // Шина между экземплярами и номер этого экземпляра (0 без шины).
+    ClusterOptions cluster_;
+    std::uint32_t instanceId_ = 0;
+    std::size_t ioThreads_;
 
     std::atomic<IDType> nextUserId_{1};
     std::atomic<IDType> nextRoomId_{2};
     std::atomic<std::uint64_t> nextServerMessageId_{1};
 
+    // Полоса рассылки для уведомлений о пользователях; ID комнат начинаются с 1, поэтому 0 свободен.
+    static constexpr std::uint64_t presenceLane = 0;
+    FanoutExecutor fanout_;
+
+    // Входы и выходы копятся presenceWindow_ и рассылаются одним user-changes; 0 -- сразу.
+    std::chrono::milliseconds presenceWindow_;
+    PresenceBatcher presence_;
+    // Список для data-request "users"; новый снимок публикуется вместе с каждым user-changes.
+    UserDirectory directory_;
+
+    // Объявлен последним: разрушается первым и дожидается своего потока до разрушения остального состояния.
+    TimerWheel timers_;
+
 private:
 
-    void sendAllNewUserInfo(UserContextPtr newUser, std::string info);
+    void queuePresence(const UserContextPtr& user, PresenceBatcher::Kind kind, std::vector<IDType> roomIds);
+    // Изменение своего или другого экземпляра: в список пользователей и в ближайший user-changes.
+    void queuePresenceChange(PresenceBatcher::Change change);
+    void flushPresence();
 
 };
 
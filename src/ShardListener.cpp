@@ -0,0 +1,75 @@
+#include "ShardListener.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "core/CpuAffinity.hpp"
+#include "core/Metrics.hpp"
+
+ShardListener::ShardListener(std::vector<std::unique_ptr<ChatServer>> shards)
+    : shards_(std::move(shards)), cpuCount_(std::max(1u, std::thread::hardware_concurrency()))
+{
+    init();
+}
+
+void ShardListener::run(std::uint16_t port)
+{
+    // Crow запускает concurrency - 1 потоков соединений и отдельный поток приёма: по потоку на шард.
+    server_.loglevel(crow::LogLevel::Warning).port(port).concurrency(static_cast<std::uint16_t>(shards_.size() + 1));
+    server_.run();
+    for (auto& shard : shards_)
+    {
+        shard->shutdown();
+    }
+}
+
+void ShardListener::init()
+{
+    CROW_ROUTE(server_, "/info")([this]() {
+        return shards_.front()->infoServer();
+    });
+
+    // Счётчики у каждого шарда свои: /metrics?shard=i, без параметра -- шард 0.
+    CROW_ROUTE(server_, "/metrics")([this](const crow::request& request) {
+        std::size_t index = 0;
+        if (const char* shard = request.url_params.get("shard"))
+        {
+            const auto [end, error] = std::from_chars(shard, shard + std::strlen(shard), index);
+            if (error != std::errc() || *end != '\0' || index >= shards_.size())
+            {
+                return crow::response(404);
+            }
+        }
+        crow::response response(shards_[index]->metricsText());
+        response.set_header("Content-Type", std::string(MetricsWriter::contentType));
+        return response;
+    });
+
+    CROW_WEBSOCKET_ROUTE(server_, "/ws")
+        .onopen([this](crow::websocket::connection& conn) {
+            shardOfThread().onWebSocketOpen(conn);
+        })
+        .onmessage([this](crow::websocket::connection& conn, const std::string& data, bool isBinary) {
+            shardOfThread().onWebSocketMessage(conn, data, isBinary);
+        })
+        .onclose([this](crow::websocket::connection& conn, const std::string& reason, uint16_t closeCode) {
+            shardOfThread().onWebSocketClose(conn, reason, closeCode);
+        });
+}
+
+ChatServer& ShardListener::shardOfThread()
+{
+    // Потоки соединений создаёт Crow; каждый берёт следующий шард и переходит на его ядро, где уже
+    // работают потоки рассылки, таймеров и шины этого шарда.
+    thread_local std::optional<std::size_t> shard;
+    if (!shard.has_value())
+    {
+        shard = nextShard_.fetch_add(1, std::memory_order_relaxed) % shards_.size();
+        pinCurrentThreadToCpu(*shard % cpuCount_);
+    }
+    return *shards_[*shard];
+}
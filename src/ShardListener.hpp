@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <crow.h>
+
+#include "ChatServer.hpp"
+
+// Общий порт для шардов одного процесса. Crow сам создаёт слушающий сокет и не даёт выставить на нём
+// SO_REUSEPORT, поэтому вместо N сокетов на одном порту -- один Crow с потоком соединений на шард.
+// Crow держит соединение на одном потоке всю его жизнь; поток при первом обращении получает свой шард
+// и привязывается к его ядру, и события соединения обрабатывает только этот шард.
+class ShardListener
+{
+public:
+    explicit ShardListener(std::vector<std::unique_ptr<ChatServer>> shards);
+
+    // Возвращает после остановки Crow (SIGINT/SIGTERM), остановив и шарды.
+    void run(std::uint16_t port);
+
+private:
+    void init();
+    // Шард текущего потока соединений.
+    ChatServer& shardOfThread();
+
+    std::vector<std::unique_ptr<ChatServer>> shards_;
+    std::size_t cpuCount_;
+    std::atomic<std::size_t> nextShard_{0};
+
+    // Объявлен последним: разрушается раньше шардов, к которым обращаются его потоки.
+    crow::SimpleApp server_;
+};
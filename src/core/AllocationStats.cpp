@@ -0,0 +1,81 @@
+#include "core/AllocationStats.hpp"
+
+#ifdef CHAT_COUNT_ALLOCATIONS
+
+#include <cstdlib>
+#include <new>
+
+#include "core/Metrics.hpp"
+
+namespace
+{
+
+// Оба счётчика инициализируются константами: operator new можно вызывать до старта main.
+thread_local std::uint64_t threadAllocations = 0;
+Counter totalAllocations;
+
+void* allocate(std::size_t size)
+{
+    ++threadAllocations;
+    totalAllocations.add();
+    if (size == 0)
+    {
+        size = 1;
+    }
+    while (true)
+    {
+        if (void* memory = std::malloc(size))
+        {
+            return memory;
+        }
+        const auto handler = std::get_new_handler();
+        if (handler == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+} // namespace
+
+// Остальные формы (new[], nothrow) по стандарту вызывают эти. Выровненные формы не заменяются и не считаются.
+// Замена попадает в программу вместе с этим объектным файлом, который тянут вызовы AllocationStats.
+void* operator new(std::size_t size)
+{
+    return allocate(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+std::uint64_t AllocationStats::thread()
+{
+    return threadAllocations;
+}
+
+std::uint64_t AllocationStats::total()
+{
+    return totalAllocations.value();
+}
+
+#else
+
+std::uint64_t AllocationStats::thread()
+{
+    return 0;
+}
+
+std::uint64_t AllocationStats::total()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+// Счётчик выделений памяти через глобальный operator new. Включается CMake-опцией CHAT_COUNT_ALLOCATIONS:
+// тогда operator new/delete заменяются считающими (malloc/free), без неё счётчики всегда 0 и ничего не стоят.
+class AllocationStats
+{
+public:
+#ifdef CHAT_COUNT_ALLOCATIONS
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    // Выделения текущего потока с его старта: разность двух значений -- выделения между ними.
+    [[nodiscard]] static std::uint64_t thread();
+    // Выделения всех потоков процесса.
+    [[nodiscard]] static std::uint64_t total();
+};
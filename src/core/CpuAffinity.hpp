@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+
+// Привязка текущего потока к одному ядру. Потоки, созданные после привязки, на Linux наследуют её,
+// поэтому шард, запущенный в привязанном потоке, целиком работает на своём ядре.
+// false, если привязка не поддерживается или ядра нет.
+bool pinCurrentThreadToCpu(std::size_t cpu);
@@ -0,0 +1,328 @@
+#include "core/EventBus.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <utility>
+
+namespace
+{
+
+// Поля пишутся little-endian фиксированной ширины, строки и списки -- с длиной перед ними.
+template<typename T>
+void appendInteger(std::string& out, T value)
+{
+    const auto bits = static_cast<std::uint64_t>(value);
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        out.push_back(static_cast<char>((bits >> (8 * i)) & 0xFF));
+    }
+}
+
+void appendString(std::string& out, std::string_view value)
+{
+    appendInteger(out, static_cast<std::uint32_t>(value.size()));
+    out.append(value);
+}
+
+class Reader
+{
+public:
+    explicit Reader(std::string_view data) : data_(data) {}
+
+    template<typename T>
+    bool integer(T& value)
+    {
+        if (data_.size() < sizeof(T))
+            return false;
+        std::uint64_t bits = 0;
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+        {
+            bits |= std::uint64_t{static_cast<unsigned char>(data_[i])} << (8 * i);
+        }
+        value = static_cast<T>(bits);
+        data_.remove_prefix(sizeof(T));
+        return true;
+    }
+
+    bool string(std::string& value)
+    {
+        std::uint32_t size = 0;
+        if (!integer(size) || data_.size() < size)
+            return false;
+        value.assign(data_.substr(0, size));
+        data_.remove_prefix(size);
+        return true;
+    }
+
+    [[nodiscard]] bool finished() const { return data_.empty(); }
+    [[nodiscard]] std::size_t remaining() const { return data_.size(); }
+
+private:
+    std::string_view data_;
+};
+
+} // namespace
+
+std::string BusEvent::encode() const
+{
+    std::string out;
+    out.reserve(encodedSize());
+    appendInteger(out, static_cast<std::uint8_t>(kind));
+    appendInteger(out, origin);
+    appendInteger(out, roomId);
+    appendInteger(out, userId);
+    appendInteger(out, serverMessageId);
+    appendInteger(out, timestamp);
+    appendInteger(out, static_cast<std::uint8_t>(flag));
+    appendString(out, name);
+    appendString(out, text);
+    appendInteger(out, static_cast<std::uint32_t>(ids.size()));
+    for (const auto id : ids)
+    {
+        appendInteger(out, id);
+    }
+    return out;
+}
+
+std::size_t BusEvent::encodedSize() const
+{
+    return encodedHeaderSize + name.size() + text.size() + ids.size() * sizeof(IDType);
+}
+
+std::optional<BusEvent> BusEvent::decode(std::string_view data)
+{
+    Reader reader(data);
+    BusEvent event;
+    std::uint8_t kind = 0;
+    std::uint8_t flag = 0;
+    std::uint32_t idCount = 0;
+    if (!reader.integer(kind) || kind > static_cast<std::uint8_t>(Kind::RoomCreated) || !reader.integer(event.origin) ||
+        !reader.integer(event.roomId) || !reader.integer(event.userId) || !reader.integer(event.serverMessageId) ||
+        !reader.integer(event.timestamp) || !reader.integer(flag) || !reader.string(event.name) ||
+        !reader.string(event.text) || !reader.integer(idCount) || reader.remaining() != idCount * sizeof(IDType))
+    {
+        return std::nullopt;
+    }
+    event.kind = static_cast<Kind>(kind);
+    event.flag = flag != 0;
+    event.ids.resize(idCount);
+    for (auto& id : event.ids)
+    {
+        reader.integer(id);
+    }
+    return event;
+}
+
+EventBus::EventBus(std::uint32_t instanceId) : instanceId_(instanceId)
+{
+}
+
+std::uint32_t EventBus::instanceId() const
+{
+    return instanceId_;
+}
+
+std::size_t EventBus::maxEventSize() const
+{
+    return std::numeric_limits<std::size_t>::max();
+}
+
+std::uint64_t EventBus::sentCount() const
+{
+    return sent_.value();
+}
+
+std::uint64_t EventBus::receivedCount() const
+{
+    return received_.value();
+}
+
+// Очередь Вьюкова: производители цепляют узел обменом head_, потребитель идёт по next от tail_.
+// Узел, который производитель уже взял, но ещё не прицепил, потребитель увидит на следующем проходе:
+// pushed_ увеличивается только после того, как узел прицеплен.
+class InProcessBus::Inbox
+{
+public:
+    Inbox() : head_(&stub_), tail_(&stub_) {}
+
+    ~Inbox()
+    {
+        while (pop() != nullptr)
+        {
+        }
+        if (tail_ != &stub_)
+            delete tail_;
+    }
+
+    Inbox(const Inbox&) = delete;
+    Inbox& operator=(const Inbox&) = delete;
+
+    // Из любого потока.
+    void push(std::shared_ptr<const BusEvent> event)
+    {
+        if (stopped_.load(std::memory_order_acquire))
+            return;
+        auto* node = new Node{{nullptr}, std::move(event)};
+        auto* previous = head_.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+        pushed_.fetch_add(1, std::memory_order_release);
+        pushed_.notify_one();
+    }
+
+    // Только из потока шины. nullptr -- ящик пуст.
+    std::shared_ptr<const BusEvent> pop()
+    {
+        auto* next = tail_->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+            return nullptr;
+        auto* previous = std::exchange(tail_, next);
+        if (previous != &stub_)
+            delete previous;
+        // Узел остаётся хвостом, событие из него забираем сразу.
+        return std::move(next->event);
+    }
+
+    // Только из потока шины: ждёт, пока seen не устареет или ящик не остановят.
+    void wait(std::uint64_t seen) const
+    {
+        pushed_.wait(seen, std::memory_order_acquire);
+    }
+
+    [[nodiscard]] std::uint64_t pushed() const
+    {
+        return pushed_.load(std::memory_order_acquire);
+    }
+
+    void stop()
+    {
+        stopped_.store(true, std::memory_order_release);
+        pushed_.fetch_add(1, std::memory_order_release);
+        pushed_.notify_one();
+    }
+
+    [[nodiscard]] bool stopped() const
+    {
+        return stopped_.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next{nullptr};
+        std::shared_ptr<const BusEvent> event;
+    };
+
+    Node stub_;
+    std::atomic<Node*> head_;
+    Node* tail_;
+    std::atomic<std::uint64_t> pushed_{0};
+    std::atomic<bool> stopped_{false};
+};
+
+class InProcessBus::Hub
+{
+public:
+    struct Member
+    {
+        std::uint32_t instanceId = 0;
+        std::shared_ptr<Inbox> inbox;
+    };
+    using Members = std::vector<Member>;
+
+    // Вход и выход экземпляров редки: снимок пересобирается под mutex, publish читает его без блокировки.
+    void join(std::uint32_t instanceId, std::shared_ptr<Inbox> inbox)
+    {
+        std::scoped_lock lock(mutex_);
+        auto next = std::make_shared<Members>(*members_.load());
+        next->push_back(Member{instanceId, std::move(inbox)});
+        members_.store(std::move(next));
+    }
+
+    void leave(const Inbox* inbox)
+    {
+        std::scoped_lock lock(mutex_);
+        auto next = std::make_shared<Members>(*members_.load());
+        std::erase_if(*next, [inbox](const Member& member) { return member.inbox.get() == inbox; });
+        members_.store(std::move(next));
+    }
+
+    [[nodiscard]] std::shared_ptr<const Members> members() const
+    {
+        return members_.load();
+    }
+
+private:
+    std::mutex mutex_;
+    std::atomic<std::shared_ptr<const Members>> members_{std::make_shared<const Members>()};
+};
+
+InProcessBus::InProcessBus(std::shared_ptr<Hub> hub, std::uint32_t instanceId)
+    : EventBus(instanceId), hub_(std::move(hub)), inbox_(std::make_shared<Inbox>())
+{
+    hub_->join(instanceId, inbox_);
+}
+
+InProcessBus::~InProcessBus()
+{
+    hub_->leave(inbox_.get());
+    stop();
+}
+
+std::shared_ptr<InProcessBus::Hub> InProcessBus::makeHub()
+{
+    return std::make_shared<Hub>();
+}
+
+void InProcessBus::start(Handler handler)
+{
+    handler_ = std::move(handler);
+    thread_ = std::thread([this]() { run(); });
+}
+
+void InProcessBus::publish(BusEvent event)
+{
+    event.origin = instanceId();
+    // Одно событие на всех получателей: копируются только указатели.
+    const auto shared = std::make_shared<const BusEvent>(std::move(event));
+    const auto members = hub_->members();
+    for (const auto& member : *members)
+    {
+        if (member.inbox != inbox_)
+        {
+            member.inbox->push(shared);
+            sent_.add();
+        }
+    }
+}
+
+void InProcessBus::stop()
+{
+    inbox_->stop();
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+void InProcessBus::run()
+{
+    while (true)
+    {
+        // pushed() читается до pop: событие, добавленное после неудачного pop, изменит его и разбудит wait.
+        const auto seen = inbox_->pushed();
+        if (inbox_->stopped())
+            return;
+        bool delivered = false;
+        while (auto event = inbox_->pop())
+        {
+            received_.add();
+            handler_(*event);
+            delivered = true;
+            if (inbox_->stopped())
+                return;
+        }
+        if (!delivered)
+            inbox_->wait(seen);
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "core/Metrics.hpp"
+#include "core/Types.hpp"
+
+class UsernameIndex;
+
+// Событие, которое один экземпляр сервера сообщает остальным.
+struct BusEvent
+{
+    enum class Kind : std::uint8_t
+    {
+        ChatMessage,  // Сообщение в комнату: каждый экземпляр рассылает его своим участникам комнаты.
+        Presence,     // Вход или выход пользователя: для user-changes и списка пользователей.
+        RoomCreated   // Новая комната: экземпляры добавляют в неё своих пользователей из ids.
+    };
+
+    Kind kind = Kind::ChatMessage;
+    std::uint32_t origin = 0;              // Экземпляр-отправитель; ставит шина.
+    IDType roomId = 0;
+    IDType userId = 0;                     // Отправитель сообщения, пользователь присутствия или создатель комнаты.
+    std::uint64_t serverMessageId = 0;
+    std::int64_t timestamp = 0;            // Время приёма сообщения, мс от эпохи Unix.
+    bool flag = false;                     // Presence: true -- вход. RoomCreated: true -- приватная комната.
+    std::string name;                      // Имя пользователя или комнаты.
+    std::string text;                      // Текст сообщения.
+    std::vector<IDType> ids;               // Presence: комнаты пользователя. RoomCreated: участники.
+
+    // Компактный бинарный вид для шин между процессами: поля фиксированной ширины, затем name, text и ids.
+    [[nodiscard]] std::string encode() const;
+    [[nodiscard]] std::size_t encodedSize() const;
+    // Размер encode() без name, text и ids.
+    static constexpr std::size_t encodedHeaderSize =
+        sizeof(std::uint8_t) + sizeof(std::uint32_t) + 2 * sizeof(IDType) + sizeof(std::uint64_t) + sizeof(std::int64_t) +
+        sizeof(std::uint8_t) + 3 * sizeof(std::uint32_t);
+    [[nodiscard]] static std::optional<BusEvent> decode(std::string_view data);
+};
+
+// Шина событий между экземплярами сервера. Каждое опубликованное событие доставляется
+// один раз каждому другому экземпляру; свои события обработчик не получает.
+// События одного отправителя приходят в порядке публикации.
+class EventBus
+{
+public:
+    using Handler = std::function<void(const BusEvent&)>;
+
+    explicit EventBus(std::uint32_t instanceId);
+    virtual ~EventBus() = default;
+
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
+
+    // handler вызывается потоком шины. Публиковать можно и до start: события уходят, но входящие не читаются.
+    virtual void start(Handler handler) = 0;
+    virtual void publish(BusEvent event) = 0;
+    // После stop обработчик больше не вызывается.
+    virtual void stop() = 0;
+    // Наибольший encodedSize() события, которое шина доставит; без ограничения -- SIZE_MAX.
+    [[nodiscard]] virtual std::size_t maxEventSize() const;
+
+    [[nodiscard]] std::uint32_t instanceId() const;
+
+    // Для /metrics: события, отправленные другим экземплярам (по одному на получателя), и принятые от них.
+    [[nodiscard]] std::uint64_t sentCount() const;
+    [[nodiscard]] std::uint64_t receivedCount() const;
+
+protected:
+    Counter sent_;
+    Counter received_;
+
+private:
+    std::uint32_t instanceId_;
+};
+
+// Шина для нескольких экземпляров в одном процессе: события передаются без сериализации и без блокировок.
+// У каждого экземпляра свой входящий ящик -- очередь многих производителей и одного потребителя (MPSC):
+// publish кладёт в ящики получателей указатель на одно общее событие, поток шины получателя забирает их
+// и засыпает на atomic::wait, когда ящик пуст. Список ящиков Hub публикует неизменяемым снимком.
+// Экземпляры, созданные с одним Hub, видят друг друга.
+class InProcessBus final : public EventBus
+{
+public:
+    class Hub;
+    class Inbox;
+
+    InProcessBus(std::shared_ptr<Hub> hub, std::uint32_t instanceId);
+    ~InProcessBus() override;
+
+    void start(Handler handler) override;
+    void publish(BusEvent event) override;
+    void stop() override;
+
+    [[nodiscard]] static std::shared_ptr<Hub> makeHub();
+
+private:
+    void run();
+
+private:
+    std::shared_ptr<Hub> hub_;
+    // Ящик живёт, пока на него ссылается снимок Hub: publish из чужого потока может застать его после stop.
+    std::shared_ptr<Inbox> inbox_;
+    Handler handler_;
+    std::thread thread_;
+};
+
+// Экземпляры сервера, связанные шиной. ID пользователей, комнат и сообщений экземпляр выдаёт с шагом
+// instanceCount, начиная со своего номера, поэтому ID разных экземпляров не пересекаются.
+struct ClusterOptions
+{
+    std::shared_ptr<EventBus> bus;      // nullptr -- единственный экземпляр; номер экземпляра -- bus->instanceId().
+    std::uint32_t instanceCount = 1;
+    // Общий индекс имён экземпляров одного процесса: имя уникально среди всех них. nullptr -- свой у экземпляра.
+    std::shared_ptr<UsernameIndex> usernames;
+};
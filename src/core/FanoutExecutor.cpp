@@ -0,0 +1,169 @@
+#include "core/FanoutExecutor.hpp"
+
+#include <algorithm>
+
+#include "core/Latency.hpp"
+
+std::shared_ptr<const Recipients> Recipients::owning(std::vector<UserContextPtr> owners)
+{
+    auto result = std::make_shared<Recipients>();
+    result->users.reserve(owners.size());
+    for (const auto& user : owners)
+    {
+        result->users.push_back(user.get());
+    }
+    result->keepAlive = std::make_shared<const std::vector<UserContextPtr>>(std::move(owners));
+    return result;
+}
+
+FanoutExecutor::FanoutExecutor(std::size_t workerCount)
+{
+    workerCount = std::max<std::size_t>(1, workerCount);
+    workers_.reserve(workerCount);
+    for (std::size_t i = 0; i < workerCount; ++i)
+    {
+        auto worker = std::make_unique<Worker>();
+        worker->thread = std::thread([raw = worker.get()]() { run(*raw); });
+        workers_.push_back(std::move(worker));
+    }
+}
+
+FanoutExecutor::~FanoutExecutor()
+{
+    stop();
+}
+
+void FanoutExecutor::post(std::uint64_t laneKey, RecipientList recipients, WirePayloads message,
+                          Outbox::MessageKind kind, std::uint64_t coalesceKey,
+                          std::chrono::steady_clock::time_point receivedAt)
+{
+    if (recipients == nullptr || recipients->users.empty() || message.empty())
+    {
+        return;
+    }
+
+    auto& worker = *workers_[laneKey % workers_.size()];
+    {
+        std::scoped_lock lock(worker.mutex);
+        if (worker.stopped)
+        {
+            return;
+        }
+        worker.queue.push_back(Delivery{std::move(recipients), std::move(message), kind, coalesceKey,
+                                        LatencyStats::Clock::now(), receivedAt});
+    }
+    worker.wakeup.notify_one();
+}
+
+void FanoutExecutor::stop()
+{
+    for (auto& worker : workers_)
+    {
+        {
+            std::scoped_lock lock(worker->mutex);
+            worker->stopped = true;
+        }
+        worker->wakeup.notify_one();
+    }
+    for (auto& worker : workers_)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+std::size_t FanoutExecutor::workerCount() const
+{
+    return workers_.size();
+}
+
+std::size_t FanoutExecutor::pendingDeliveries() const
+{
+    std::size_t result = 0;
+    for (const auto& worker : workers_)
+    {
+        std::scoped_lock lock(worker->mutex);
+        result += worker->queue.size();
+    }
+    return result;
+}
+
+void FanoutExecutor::run(Worker& worker)
+{
+    std::vector<Delivery> batch;
+    std::vector<UserContext*> toFlush;
+    // Соединения, отправку которых придержала оценка непрочитанного: поток возвращается к ним сам.
+    std::vector<UserContextPtr> throttled;
+    std::vector<UserContextPtr> retrying;
+    while (true)
+    {
+        {
+            std::unique_lock lock(worker.mutex);
+            const auto ready = [&worker]() { return worker.stopped || !worker.queue.empty(); };
+            if (throttled.empty())
+                worker.wakeup.wait(lock, ready);
+            else
+                worker.wakeup.wait_for(lock, Outbox::retryInterval, ready);
+            if (worker.stopped && worker.queue.empty())
+            {
+                return;
+            }
+            // Забираем всю очередь одним обменом, производители не ждут, пока идёт доставка.
+            batch.swap(worker.queue);
+        }
+
+        retrying.swap(throttled);
+        for (auto& user : retrying)
+        {
+            if (user->flushOutbox())
+            {
+                throttled.push_back(std::move(user));
+            }
+        }
+        retrying.clear();
+
+        // Сначала раскладываем всю пачку по очередям получателей, затем каждому соединению
+        // отправляем накопленное одним проходом.
+        for (const auto& delivery : batch)
+        {
+            for (auto* const user : delivery.recipients->users)
+            {
+                switch (user->outbox.push(delivery.message.forFormat(user->format), delivery.kind, delivery.coalesceKey))
+                {
+                case Outbox::PushResult::FlushNeeded:
+                    toFlush.push_back(user);
+                    break;
+                case Outbox::PushResult::Overflow:
+                    user->close("slow consumer", Outbox::slowConsumerCloseCode);
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+        for (auto* const user : toFlush)
+        {
+            if (user->flushOutbox())
+            {
+                // Получатели живы, пока жива доставка; очередь держит соединение сама.
+                throttled.push_back(user->shared_from_this());
+            }
+        }
+        toFlush.clear();
+
+        // Отправка закончена для всех, чьи очереди отправляет этот поток; очереди, отправку которых уже
+        // запланировал другой поток, тот дописывает сам, поэтому время до последнего получателя -- оценка снизу.
+        const auto sentAt = LatencyStats::Clock::now();
+        for (const auto& delivery : batch)
+        {
+            LatencyStats::record(LatencyStage::Fanout, delivery.postedAt, sentAt);
+            if (delivery.receivedAt != std::chrono::steady_clock::time_point{})
+            {
+                LatencyStats::record(LatencyStage::EndToEnd, delivery.receivedAt, sentAt);
+            }
+        }
+        batch.clear();
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "core/Outbox.hpp"
+#include "core/SharedPayload.hpp"
+#include "core/UserContext.hpp"
+
+using UserContextPtr = std::shared_ptr<UserContext>;
+
+// Получатели одной рассылки. Поток рассылки обходит users -- простые указатели, поэтому снимок
+// копируется как массив чисел, без счётчиков ссылок. Пока жив keepAlive, жив каждый из users.
+struct Recipients
+{
+    std::vector<UserContext*> users;
+    std::shared_ptr<const void> keepAlive;
+
+    // Список, который сам владеет своими получателями.
+    [[nodiscard]] static std::shared_ptr<const Recipients> owning(std::vector<UserContextPtr> owners);
+};
+
+using RecipientList = std::shared_ptr<const Recipients>;
+
+// Пул потоков рассылки. Каждая доставка привязана к полосе (lane) по ключу,
+// полоса всегда обслуживается одним потоком, поэтому порядок сообщений внутри полосы сохраняется.
+class FanoutExecutor
+{
+public:
+    explicit FanoutExecutor(std::size_t workerCount = std::thread::hardware_concurrency());
+    ~FanoutExecutor();
+
+    FanoutExecutor(const FanoutExecutor&) = delete;
+    FanoutExecutor& operator=(const FanoutExecutor&) = delete;
+
+    // Каждый получатель получает payload своего формата из message.
+    // receivedAt -- время получения кадра клиента, вызвавшего рассылку, для LatencyStage::EndToEnd; по умолчанию не считается.
+    // kind и coalesceKey передаются в Outbox::push каждого получателя.
+    void post(std::uint64_t laneKey, RecipientList recipients, WirePayloads message,
+              Outbox::MessageKind kind = Outbox::MessageKind::Regular, std::uint64_t coalesceKey = 0,
+              std::chrono::steady_clock::time_point receivedAt = {});
+    // Доставляет всё, что уже поставлено в очередь, и останавливает потоки. Кадры, придержанные
+    // в очередях медленных клиентов (Outbox::TakeResult::Throttled), не дожидаются.
+    void stop();
+
+    [[nodiscard]] std::size_t workerCount() const;
+    // Рассылки, которые ещё не разложены по очередям соединений.
+    [[nodiscard]] std::size_t pendingDeliveries() const;
+
+private:
+    struct Delivery
+    {
+        RecipientList recipients;
+        WirePayloads message;
+        Outbox::MessageKind kind = Outbox::MessageKind::Regular;
+        std::uint64_t coalesceKey = 0;
+        std::chrono::steady_clock::time_point postedAt;
+        std::chrono::steady_clock::time_point receivedAt;
+    };
+
+    struct alignas(64) Worker
+    {
+        mutable std::mutex mutex;
+        std::condition_variable wakeup;
+        std::vector<Delivery> queue;
+        bool stopped = false;
+        std::thread thread;
+    };
+
+    static void run(Worker& worker);
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+};
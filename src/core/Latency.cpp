@@ -0,0 +1,94 @@
+#include "core/Latency.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+#include "core/Logger.hpp"
+
+namespace
+{
+
+// Статические, а не в куче: запись не должна проверять инициализацию, а гистограммы живут до конца процесса.
+std::array<LatencyHistogram, latencyStageCount> stageHistograms;
+
+std::atomic<bool> reportRequested{false};
+static_assert(std::atomic<bool>::is_always_lock_free, "requestReport() is called from a signal handler");
+
+thread_local LatencyStats::Clock::time_point currentFrameReceivedAt;
+
+} // namespace
+
+std::string_view latencyStageName(LatencyStage stage)
+{
+    switch (stage)
+    {
+    case LatencyStage::Parse:
+        return "parse";
+    case LatencyStage::Dispatch:
+        return "dispatch";
+    case LatencyStage::LockWait:
+        return "lock-wait";
+    case LatencyStage::Serialize:
+        return "serialize";
+    case LatencyStage::Fanout:
+        return "fanout";
+    case LatencyStage::EndToEnd:
+        return "end-to-end";
+    case LatencyStage::Count:
+        break;
+    }
+    return {};
+}
+
+void LatencyStats::record(LatencyStage stage, Clock::time_point from, Clock::time_point to)
+{
+    const auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+    stageHistograms[static_cast<std::size_t>(stage)].record(static_cast<std::uint64_t>(std::max<std::int64_t>(nanoseconds, 0)));
+}
+
+LatencyHistogram::Snapshot LatencyStats::snapshot(LatencyStage stage)
+{
+    return stageHistograms[static_cast<std::size_t>(stage)].snapshot();
+}
+
+void LatencyStats::setFrameReceivedAt(Clock::time_point receivedAt)
+{
+    currentFrameReceivedAt = receivedAt;
+}
+
+LatencyStats::Clock::time_point LatencyStats::frameReceivedAt()
+{
+    return currentFrameReceivedAt;
+}
+
+void LatencyStats::requestReport() noexcept
+{
+    reportRequested.store(true, std::memory_order_relaxed);
+}
+
+void LatencyStats::logReportIfRequested()
+{
+    if (reportRequested.exchange(false, std::memory_order_relaxed))
+    {
+        logReport();
+    }
+}
+
+void LatencyStats::logReport()
+{
+    // Запрошена явно, поэтому пишется при любом уровне журнала.
+    for (std::size_t i = 0; i < latencyStageCount; ++i)
+    {
+        const auto stage = static_cast<LatencyStage>(i);
+        const auto histogram = snapshot(stage);
+        LogRecord(LogLevel::Info, "latency")
+            .field("stage", latencyStageName(stage))
+            .field("count", histogram.count)
+            .field("p50-ns", histogram.percentile(0.5))
+            .field("p90-ns", histogram.percentile(0.9))
+            .field("p99-ns", histogram.percentile(0.99))
+            .field("p999-ns", histogram.percentile(0.999))
+            .field("max-ns", histogram.max());
+    }
+}
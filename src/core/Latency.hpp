@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "core/Metrics.hpp"
+
+// Этапы обработки клиентского сообщения, для которых копятся гистограммы задержек.
+enum class LatencyStage : std::uint8_t
+{
+    Parse,      // Кадр получен -> запрос разобран.
+    Dispatch,   // Запрос разобран -> обработчик вернул управление.
+    LockWait,   // Ожидание блокировки комнаты в Room::broadcast.
+    Serialize,  // Сообщение рассылки собрано под блокировкой комнаты (ID, журнал, кодирование).
+    Fanout,     // Рассылка поставлена в очередь -> отправлена последнему получателю.
+    EndToEnd,   // Кадр chat-msg получен -> рассылка отправлена последнему получателю.
+    Count
+};
+
+inline constexpr std::size_t latencyStageCount = static_cast<std::size_t>(LatencyStage::Count);
+
+std::string_view latencyStageName(LatencyStage stage);
+
+// Гистограммы задержек по этапам, одни на процесс: их читают /metrics и сводка по SIGUSR1.
+class LatencyStats
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static void record(LatencyStage stage, Clock::time_point from, Clock::time_point to);
+
+    [[nodiscard]] static LatencyHistogram::Snapshot snapshot(LatencyStage stage);
+
+    // Время получения кадра, который сейчас обрабатывает этот поток; ставит onWebSocketMessage.
+    static void setFrameReceivedAt(Clock::time_point receivedAt);
+    [[nodiscard]] static Clock::time_point frameReceivedAt();
+
+    // Запрос сводки из обработчика сигнала: только атомарная запись.
+    static void requestReport() noexcept;
+    // Пишет сводку по этапам в журнал, если её запросили после прошлого вызова.
+    static void logReportIfRequested();
+    static void logReport();
+};
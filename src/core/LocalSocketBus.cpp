@@ -0,0 +1,349 @@
+#include "core/LocalSocketBus.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "core/Logger.hpp"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+constexpr std::string_view socketSuffix = ".sock";
+constexpr auto peerRefreshInterval = std::chrono::seconds(1);
+// Через сколько повторить отправку получателю, чья очередь в ядре была полна.
+constexpr auto sendRetryInterval = std::chrono::milliseconds(10);
+
+#ifndef _WIN32
+
+[[noreturn]] void throwErrno(const char* what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+std::optional<sockaddr_un> socketAddress(const std::filesystem::path& path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    const auto& native = path.native();
+    if (native.size() >= sizeof(address.sun_path))
+    {
+        return std::nullopt;
+    }
+    std::memcpy(address.sun_path, native.c_str(), native.size() + 1);
+    return address;
+}
+
+#endif
+
+} // namespace
+
+#ifdef _WIN32
+
+LocalSocketBus::LocalSocketBus(std::filesystem::path directory, std::uint32_t instanceId)
+    : EventBus(instanceId), directory_(std::move(directory))
+{
+    throw std::system_error(std::make_error_code(std::errc::not_supported), "LocalSocketBus");
+}
+
+LocalSocketBus::~LocalSocketBus() = default;
+
+void LocalSocketBus::start(Handler) {}
+void LocalSocketBus::publish(BusEvent) {}
+void LocalSocketBus::stop() {}
+std::size_t LocalSocketBus::maxEventSize() const { return maxDatagramSize; }
+void LocalSocketBus::run() {}
+void LocalSocketBus::sendLoop() {}
+LocalSocketBus::SendResult LocalSocketBus::sendBatch(const Peer&, const std::deque<std::shared_ptr<const std::string>>&,
+                                                     std::size_t&)
+{
+    return SendResult::Gone;
+}
+void LocalSocketBus::refreshPeers() {}
+
+#else
+
+LocalSocketBus::LocalSocketBus(std::filesystem::path directory, std::uint32_t instanceId)
+    : EventBus(instanceId),
+      directory_(std::move(directory)),
+      path_(directory_ / (std::to_string(instanceId) + std::string(socketSuffix)))
+{
+    std::filesystem::create_directories(directory_);
+    const auto address = socketAddress(path_);
+    if (!address.has_value())
+    {
+        throw std::system_error(std::make_error_code(std::errc::filename_too_long), "LocalSocketBus");
+    }
+
+    // Неблокирующий: получатель, который не читает, не должен останавливать поток отправки.
+    socket_ = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (socket_ < 0)
+    {
+        throwErrno("socket");
+    }
+    // Файл от упавшего экземпляра с тем же ID мешает bind.
+    std::error_code ignored;
+    std::filesystem::remove(path_, ignored);
+    if (::bind(socket_, reinterpret_cast<const sockaddr*>(&*address), sizeof(*address)) != 0)
+    {
+        const auto error = errno;
+        ::close(socket_);
+        throw std::system_error(error, std::generic_category(), "bind");
+    }
+    const int bufferSize = static_cast<int>(4 * maxDatagramSize);
+    ::setsockopt(socket_, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+    ::setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    refreshPeers();
+    sender_ = std::thread([this]() { sendLoop(); });
+}
+
+LocalSocketBus::~LocalSocketBus()
+{
+    stop();
+    ::close(socket_);
+    std::error_code ignored;
+    std::filesystem::remove(path_, ignored);
+}
+
+void LocalSocketBus::start(Handler handler)
+{
+    handler_ = std::move(handler);
+    thread_ = std::thread([this]() { run(); });
+}
+
+void LocalSocketBus::publish(BusEvent event)
+{
+    event.origin = instanceId();
+    auto data = std::make_shared<const std::string>(event.encode());
+    if (data->size() > maxDatagramSize)
+    {
+        CHAT_LOG_WARNING("bus-event-too-large").field("size", data->size());
+        return;
+    }
+
+    // Только постановка в очереди: publish зовут под блокировкой комнаты, сокет трогает поток отправки.
+    {
+        std::scoped_lock lock(peersMutex_);
+        for (const auto& peer : peers_)
+        {
+            if (peer->queuedBytes + data->size() > maxQueuedBytes)
+            {
+                if (!peer->overflowed)
+                {
+                    CHAT_LOG_WARNING("bus-peer-queue-full").field("peer", peer->instanceId).field("bytes", peer->queuedBytes);
+                    peer->overflowed = true;
+                }
+                continue;
+            }
+            peer->overflowed = false;
+            peer->queuedBytes += data->size();
+            peer->queue.push_back(data);
+        }
+    }
+    sendWakeup_.notify_one();
+}
+
+void LocalSocketBus::stop()
+{
+    if (stopped_.exchange(true))
+    {
+        return;
+    }
+    {
+        // Поток отправки проверяет stopped_ под этим мьютексом: без него пробуждение могло бы потеряться.
+        std::scoped_lock lock(peersMutex_);
+    }
+    sendWakeup_.notify_one();
+    if (sender_.joinable())
+    {
+        sender_.join();
+    }
+    if (!thread_.joinable())
+    {
+        return;
+    }
+    // Пустая датаграмма себе будит поток, ждущий в poll.
+    if (const auto address = socketAddress(path_))
+    {
+        ::sendto(socket_, "", 0, 0, reinterpret_cast<const sockaddr*>(&*address), sizeof(*address));
+    }
+    thread_.join();
+}
+
+std::size_t LocalSocketBus::maxEventSize() const
+{
+    return maxDatagramSize;
+}
+
+void LocalSocketBus::sendLoop()
+{
+    std::vector<std::shared_ptr<Peer>> ready;
+    std::unique_lock lock(peersMutex_);
+    while (true)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        bool waiting = false;
+        ready.clear();
+        for (const auto& peer : peers_)
+        {
+            if (peer->queue.empty())
+                continue;
+            if (peer->retryAt <= now)
+                ready.push_back(peer);
+            else
+                waiting = true;
+        }
+        if (ready.empty())
+        {
+            // При остановке то, что уже можно отправить, отправлено; ждать заполненных получателей не будем.
+            if (stopped_.load())
+            {
+                return;
+            }
+            if (waiting)
+                sendWakeup_.wait_for(lock, sendRetryInterval);
+            else
+                sendWakeup_.wait(lock);
+            continue;
+        }
+
+        for (const auto& peer : ready)
+        {
+            // Очередь забирается целиком, publish тем временем пишет в новую.
+            const auto batch = std::exchange(peer->queue, {});
+            lock.unlock();
+            std::size_t sent = 0;
+            const auto result = sendBatch(*peer, batch, sent);
+            lock.lock();
+
+            // Неотправленный остаток возвращается в начало очереди, если очередь получателя в ядре полна,
+            // и отбрасывается, если получатель остановился (его файл исчезнет при следующем обходе каталога).
+            const auto kept = result == SendResult::Blocked ? batch.begin() + static_cast<std::ptrdiff_t>(sent) : batch.end();
+            for (auto it = batch.begin(); it != kept; ++it)
+            {
+                peer->queuedBytes -= (*it)->size();
+            }
+            if (result == SendResult::Blocked)
+            {
+                peer->queue.insert(peer->queue.begin(), kept, batch.end());
+                peer->retryAt = std::chrono::steady_clock::now() + sendRetryInterval;
+            }
+        }
+    }
+}
+
+LocalSocketBus::SendResult LocalSocketBus::sendBatch(const Peer& peer,
+                                                     const std::deque<std::shared_ptr<const std::string>>& batch,
+                                                     std::size_t& sent)
+{
+    const auto address = socketAddress(peer.path);
+    if (!address.has_value())
+    {
+        return SendResult::Gone;
+    }
+    for (const auto& data : batch)
+    {
+        ssize_t result = -1;
+        do
+        {
+            result = ::sendto(socket_, data->data(), data->size(), 0, reinterpret_cast<const sockaddr*>(&*address),
+                              sizeof(*address));
+        } while (result < 0 && errno == EINTR);
+        if (result < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return SendResult::Blocked;
+            }
+            // ECONNREFUSED/ENOENT: экземпляр остановился.
+            CHAT_LOG_DEBUG("bus-send-failed").field("peer", peer.instanceId).field("errno", errno);
+            return SendResult::Gone;
+        }
+        ++sent;
+        sent_.add();
+    }
+    return SendResult::Sent;
+}
+
+void LocalSocketBus::run()
+{
+    std::string buffer(maxDatagramSize, '\0');
+    auto nextRefresh = std::chrono::steady_clock::now() + peerRefreshInterval;
+    while (!stopped_.load())
+    {
+        pollfd descriptor{socket_, POLLIN, 0};
+        const auto ready = ::poll(&descriptor, 1, static_cast<int>(std::chrono::milliseconds(peerRefreshInterval).count()));
+        if (std::chrono::steady_clock::now() >= nextRefresh)
+        {
+            refreshPeers();
+            nextRefresh = std::chrono::steady_clock::now() + peerRefreshInterval;
+        }
+        if (ready <= 0)
+        {
+            continue;
+        }
+
+        const auto size = ::recv(socket_, buffer.data(), buffer.size(), MSG_DONTWAIT);
+        if (size <= 0 || stopped_.load())
+        {
+            continue;
+        }
+        const auto event = BusEvent::decode(std::string_view(buffer.data(), static_cast<std::size_t>(size)));
+        if (!event.has_value())
+        {
+            CHAT_LOG_WARNING("bus-invalid-event").field("size", size);
+            continue;
+        }
+        received_.add();
+        handler_(*event);
+    }
+}
+
+void LocalSocketBus::refreshPeers()
+{
+    std::vector<std::shared_ptr<Peer>> peers;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory_, error))
+    {
+        const auto name = entry.path().filename().string();
+        if (!name.ends_with(socketSuffix))
+            continue;
+        std::uint32_t id = 0;
+        const auto digits = std::string_view(name).substr(0, name.size() - socketSuffix.size());
+        const auto [end, parsed] = std::from_chars(digits.data(), digits.data() + digits.size(), id);
+        if (parsed != std::errc() || end != digits.data() + digits.size() || id == instanceId())
+            continue;
+        auto peer = std::make_shared<Peer>();
+        peer->instanceId = id;
+        peer->path = entry.path();
+        peers.push_back(std::move(peer));
+    }
+
+    std::scoped_lock lock(peersMutex_);
+    // Уже известные получатели сохраняют свои очереди.
+    for (auto& peer : peers)
+    {
+        const auto known = std::find_if(peers_.begin(), peers_.end(), [&](const std::shared_ptr<Peer>& current) {
+            return current->instanceId == peer->instanceId;
+        });
+        if (known != peers_.end())
+        {
+            peer = *known;
+        }
+    }
+    peers_ = std::move(peers);
+}
+
+#endif
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/EventBus.hpp"
+
+// Шина между процессами на одной машине через датаграммные Unix-сокеты.
+// Каждый экземпляр слушает <directory>/<instanceId>.sock, остальные находит по файлам сокетов в каталоге.
+// Событие кодируется один раз и ставится в очередь каждого другого экземпляра; очереди отправляет одной
+// датаграммой на событие отдельный поток через неблокирующий сокет, так что publish не ждёт получателей.
+// Датаграммы Unix-сокета не теряются и не переупорядочиваются. Если очередь получателя в ядре полна,
+// его события ждут в нашей очереди и отправка повторяется; остальные получатели его не ждут. Если и наша
+// очередь получателя превысила maxQueuedBytes (он не читает), новые события для него отбрасываются.
+// Только POSIX; на Windows конструктор бросает std::system_error.
+class LocalSocketBus final : public EventBus
+{
+public:
+    // Ошибки создания сокета -- std::system_error.
+    LocalSocketBus(std::filesystem::path directory, std::uint32_t instanceId);
+    ~LocalSocketBus() override;
+
+    void start(Handler handler) override;
+    void publish(BusEvent event) override;
+    void stop() override;
+    [[nodiscard]] std::size_t maxEventSize() const override;
+
+    // Наибольшее событие: датаграмму ограничивает буфер сокета (net.core.wmem_max), большие события
+    // отбрасываются с предупреждением в журнале.
+    static constexpr std::size_t maxDatagramSize = 64 * 1024;
+    // Предел неотправленных событий одного получателя.
+    static constexpr std::size_t maxQueuedBytes = 64 * maxDatagramSize;
+
+private:
+    struct Peer
+    {
+        std::uint32_t instanceId = 0;
+        std::filesystem::path path;
+        // Под peersMutex_.
+        std::deque<std::shared_ptr<const std::string>> queue;
+        std::size_t queuedBytes = 0;
+        std::chrono::steady_clock::time_point retryAt;  // Очередь получателя в ядре была полна.
+        bool overflowed = false;                        // Уже предупредили об отброшенных событиях.
+    };
+
+    enum class SendResult
+    {
+        Sent,
+        Blocked,  // Очередь получателя в ядре полна: остаток отправить позже.
+        Gone      // Получатель остановился: остаток отбросить.
+    };
+
+    void run();
+    void sendLoop();
+    // Отправляет batch с начала; sent -- сколько событий ушло.
+    SendResult sendBatch(const Peer& peer, const std::deque<std::shared_ptr<const std::string>>& batch,
+                         std::size_t& sent);
+    // Перечитывает каталог: экземпляры могут запускаться и останавливаться в любой момент.
+    void refreshPeers();
+
+private:
+    std::filesystem::path directory_;
+    std::filesystem::path path_;
+    int socket_ = -1;
+    Handler handler_;
+
+    std::mutex peersMutex_;
+    std::condition_variable sendWakeup_;
+    // Получатель переживает обход каталога, пока у потока отправки есть его события.
+    std::vector<std::shared_ptr<Peer>> peers_;
+
+    std::atomic<bool> stopped_{false};
+    std::thread thread_;
+    std::thread sender_;
+};
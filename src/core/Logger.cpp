@@ -0,0 +1,403 @@
+#include "core/Logger.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "protocol/Utf8.hpp"
+
+namespace
+{
+
+constexpr std::chrono::milliseconds writeInterval{20};
+
+// Кольцевой буфер одного потока: пишет только владелец, читает только фоновый поток.
+// head и tail -- счётчики байт за всё время; в буфере всегда лежат целые строки.
+struct ThreadBuffer
+{
+    explicit ThreadBuffer(std::size_t size, std::uint32_t index)
+        : capacity(std::bit_ceil(size)), data(std::make_unique<char[]>(capacity)), threadIndex(index)
+    {
+    }
+
+    const std::size_t capacity;
+    const std::unique_ptr<char[]> data;
+    const std::uint32_t threadIndex;
+    alignas(64) std::atomic<std::uint64_t> head{0};
+    alignas(64) std::atomic<std::uint64_t> tail{0};
+    std::atomic<bool> abandoned{false};  // Поток завершился; буфер удаляется, когда опустеет.
+};
+
+struct LoggerState
+{
+    std::atomic<LogLevel> level{LogLevel::Info};
+    std::atomic<bool> logPayloads{false};
+    std::atomic<std::size_t> threadBufferBytes{LoggerOptions{}.threadBufferBytes};
+    std::atomic<std::uint64_t> dropped{0};
+
+    std::mutex mutex;  // buffers, sink, writer, stopping.
+    std::condition_variable wakeup;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::uint32_t nextThreadIndex = 1;
+    std::FILE* sink = nullptr;
+    bool ownsSink = false;
+    bool stopping = false;
+    std::thread writer;
+
+    ~LoggerState()
+    {
+        // Если stop() не вызвали, дописываем накопленное при завершении программы.
+        if (writer.joinable())
+        {
+            {
+                std::scoped_lock lock(mutex);
+                stopping = true;
+            }
+            wakeup.notify_one();
+            writer.join();
+        }
+    }
+};
+
+LoggerState& state()
+{
+    static LoggerState instance;
+    return instance;
+}
+
+// Регистрирует буфер потока при первой записи и помечает его брошенным при завершении потока.
+struct ThreadBufferHolder
+{
+    ThreadBufferHolder()
+    {
+        auto& logger = state();
+        std::scoped_lock lock(logger.mutex);
+        buffer = std::make_shared<ThreadBuffer>(logger.threadBufferBytes.load(), logger.nextThreadIndex++);
+        logger.buffers.push_back(buffer);
+    }
+
+    ~ThreadBufferHolder()
+    {
+        buffer->abandoned.store(true, std::memory_order_release);
+    }
+
+    std::shared_ptr<ThreadBuffer> buffer;
+};
+
+ThreadBuffer& threadBuffer()
+{
+    thread_local ThreadBufferHolder holder;
+    return *holder.buffer;
+}
+
+// Строка собирается здесь, чтобы не выделять память на каждую запись.
+std::string& threadLine()
+{
+    thread_local std::string line;
+    return line;
+}
+
+void push(ThreadBuffer& buffer, std::string_view line)
+{
+    const auto head = buffer.head.load(std::memory_order_relaxed);
+    const auto tail = buffer.tail.load(std::memory_order_acquire);
+    if (line.size() > buffer.capacity - (head - tail))
+    {
+        state().dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    const auto offset = static_cast<std::size_t>(head & (buffer.capacity - 1));
+    const auto first = std::min(line.size(), buffer.capacity - offset);
+    std::copy_n(line.data(), first, buffer.data.get() + offset);
+    std::copy_n(line.data() + first, line.size() - first, buffer.data.get());
+    buffer.head.store(head + line.size(), std::memory_order_release);
+}
+
+void drain(ThreadBuffer& buffer, std::string& out)
+{
+    const auto tail = buffer.tail.load(std::memory_order_relaxed);
+    const auto head = buffer.head.load(std::memory_order_acquire);
+    if (head == tail)
+    {
+        return;
+    }
+    const auto size = static_cast<std::size_t>(head - tail);
+    const auto offset = static_cast<std::size_t>(tail & (buffer.capacity - 1));
+    const auto first = std::min(size, buffer.capacity - offset);
+    out.append(buffer.data.get() + offset, first);
+    out.append(buffer.data.get(), size - first);
+    buffer.tail.store(head, std::memory_order_release);
+}
+
+// Забирает всё из буферов и пишет одним fwrite; брошенные пустые буферы удаляются.
+void writeAll(std::string& batch)
+{
+    auto& logger = state();
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::scoped_lock lock(logger.mutex);
+        std::erase_if(logger.buffers, [](const std::shared_ptr<ThreadBuffer>& buffer) {
+            return buffer->abandoned.load(std::memory_order_acquire) &&
+                   buffer->head.load(std::memory_order_acquire) == buffer->tail.load(std::memory_order_relaxed);
+        });
+        buffers = logger.buffers;
+    }
+
+    batch.clear();
+    for (const auto& buffer : buffers)
+    {
+        drain(*buffer, batch);
+    }
+    if (!batch.empty() && logger.sink != nullptr)
+    {
+        std::fwrite(batch.data(), 1, batch.size(), logger.sink);
+        std::fflush(logger.sink);
+    }
+}
+
+void runWriter()
+{
+    auto& logger = state();
+    std::string batch;
+    while (true)
+    {
+        {
+            std::unique_lock lock(logger.mutex);
+            logger.wakeup.wait_for(lock, writeInterval, [&logger]() { return logger.stopping; });
+            if (logger.stopping)
+            {
+                break;
+            }
+        }
+        writeAll(batch);
+    }
+    writeAll(batch);
+}
+
+const char* levelName(LogLevel level)
+{
+    switch (level)
+    {
+    case LogLevel::Debug:
+        return "debug";
+    case LogLevel::Info:
+        return "info";
+    case LogLevel::Warning:
+        return "warning";
+    case LogLevel::Error:
+        return "error";
+    case LogLevel::Off:
+        break;
+    }
+    return "off";
+}
+
+// Строка JSON; некорректный UTF-8 заменяется на U+FFFD, а не ломает запись.
+void appendString(std::string& out, std::string_view value)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    const auto* data = reinterpret_cast<const unsigned char*>(value.data());
+    for (std::size_t i = 0; i < value.size();)
+    {
+        const unsigned char c = data[i];
+        if (c >= 0x80)
+        {
+            const auto length = utf8SequenceLength(data + i, value.size() - i);
+            if (length == 0)
+            {
+                out.append("\xEF\xBF\xBD");
+                ++i;
+            }
+            else
+            {
+                out.append(value.data() + i, length);
+                i += length;
+            }
+            continue;
+        }
+        if (c == '"' || c == '\\')
+        {
+            out.push_back('\\');
+            out.push_back(static_cast<char>(c));
+        }
+        else if (c < 0x20)
+        {
+            out.append("\\u00");
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 0xF]);
+        }
+        else
+        {
+            out.push_back(static_cast<char>(c));
+        }
+        ++i;
+    }
+    out.push_back('"');
+}
+
+} // namespace
+
+std::optional<LogLevel> parseLogLevel(std::string_view name)
+{
+    for (const auto level : {LogLevel::Debug, LogLevel::Info, LogLevel::Warning, LogLevel::Error, LogLevel::Off})
+    {
+        if (name == levelName(level))
+            return level;
+    }
+    return std::nullopt;
+}
+
+void Logger::start(LoggerOptions options)
+{
+    auto& logger = state();
+    std::scoped_lock lock(logger.mutex);
+    if (logger.writer.joinable())
+    {
+        return;
+    }
+    logger.level.store(options.level);
+    logger.logPayloads.store(options.logPayloads);
+    logger.threadBufferBytes.store(options.threadBufferBytes);
+    logger.sink = stderr;
+    logger.ownsSink = false;
+    if (!options.file.empty())
+    {
+        if (auto* file = std::fopen(options.file.string().c_str(), "ab"))
+        {
+            logger.sink = file;
+            logger.ownsSink = true;
+        }
+    }
+    logger.stopping = false;
+    logger.writer = std::thread(runWriter);
+}
+
+void Logger::stop()
+{
+    auto& logger = state();
+    {
+        std::scoped_lock lock(logger.mutex);
+        if (!logger.writer.joinable())
+        {
+            return;
+        }
+        logger.stopping = true;
+    }
+    logger.wakeup.notify_one();
+    logger.writer.join();
+
+    std::scoped_lock lock(logger.mutex);
+    if (logger.ownsSink)
+    {
+        std::fclose(logger.sink);
+    }
+    logger.sink = nullptr;
+    logger.ownsSink = false;
+}
+
+void Logger::setLevel(LogLevel level)
+{
+    state().level.store(level, std::memory_order_relaxed);
+}
+
+bool Logger::enabled(LogLevel level)
+{
+    return level != LogLevel::Off && level >= state().level.load(std::memory_order_relaxed);
+}
+
+bool Logger::logPayloads()
+{
+    return state().logPayloads.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Logger::dropped()
+{
+    return state().dropped.load(std::memory_order_relaxed);
+}
+
+LogRecord::LogRecord(LogLevel level, std::string_view event) : line_(threadLine())
+{
+    const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::system_clock::now().time_since_epoch()).count();
+    line_.clear();
+    line_.append("{\"ts\":");
+    appendSigned(now);
+    line_.append(",\"level\":\"").append(levelName(level)).append("\",\"thread\":");
+    appendUnsigned(threadBuffer().threadIndex);
+    line_.append(",\"event\":");
+    appendString(line_, event);
+}
+
+LogRecord::~LogRecord()
+{
+    line_.append("}\n");
+    push(threadBuffer(), line_);
+}
+
+LogRecord& LogRecord::field(std::string_view name, std::string_view value)
+{
+    key(name);
+    appendString(line_, value);
+    return *this;
+}
+
+LogRecord& LogRecord::field(std::string_view name, const char* value)
+{
+    return field(name, std::string_view(value == nullptr ? "" : value));
+}
+
+LogRecord& LogRecord::field(std::string_view name, const void* value)
+{
+    key(name);
+    char buffer[2 + 2 * sizeof(void*)] = {'0', 'x'};
+    const auto result = std::to_chars(buffer + 2, std::end(buffer), reinterpret_cast<std::uintptr_t>(value), 16);
+    appendString(line_, std::string_view(buffer, static_cast<std::size_t>(result.ptr - buffer)));
+    return *this;
+}
+
+LogRecord& LogRecord::payload(std::string_view name, std::string_view data)
+{
+    // Ключи задаёт код сервера, экранировать их не нужно.
+    line_.append(",\"").append(name).append("-bytes\":");
+    appendUnsigned(data.size());
+    if (Logger::logPayloads())
+    {
+        field(name, data.substr(0, maxPayloadBytes));
+    }
+    return *this;
+}
+
+void LogRecord::key(std::string_view name)
+{
+    line_.push_back(',');
+    appendString(line_, name);
+    line_.push_back(':');
+}
+
+void LogRecord::appendBool(bool value)
+{
+    line_.append(value ? "true" : "false");
+}
+
+void LogRecord::appendUnsigned(std::uint64_t value)
+{
+    char buffer[20];
+    const auto result = std::to_chars(std::begin(buffer), std::end(buffer), value);
+    line_.append(buffer, result.ptr);
+}
+
+void LogRecord::appendSigned(std::int64_t value)
+{
+    char buffer[20];
+    const auto result = std::to_chars(std::begin(buffer), std::end(buffer), value);
+    line_.append(buffer, result.ptr);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+enum class LogLevel : std::uint8_t
+{
+    Debug,
+    Info,
+    Warning,
+    Error,
+    Off
+};
+
+// Самый низкий уровень, который попадает в сборку (0 -- Debug ... 4 -- Off); записи ниже вырезаются компилятором.
+// Задаётся из CMake через CHAT_LOG_MIN_LEVEL.
+#ifndef CHAT_LOG_MIN_LEVEL
+#define CHAT_LOG_MIN_LEVEL 0
+#endif
+
+inline constexpr int logMinLevel = CHAT_LOG_MIN_LEVEL;
+
+constexpr bool logLevelCompiledIn(LogLevel level)
+{
+    return static_cast<int>(level) >= logMinLevel;
+}
+
+// "debug", "info", "warning", "error", "off".
+std::optional<LogLevel> parseLogLevel(std::string_view name);
+
+struct LoggerOptions
+{
+    LogLevel level = LogLevel::Info;
+    // Тексты сообщений и сырые кадры клиентов. Выключено: переписка пользователей не должна попадать в журнал.
+    bool logPayloads = false;
+    std::filesystem::path file;                 // Пусто -- stderr.
+    std::size_t threadBufferBytes = 256 * 1024; // Кольцевой буфер каждого пишущего потока.
+};
+
+// Асинхронный журнал в формате JSON lines.
+// Строка собирается в потоке вызова и кладётся в кольцевой буфер этого потока без блокировок;
+// один фоновый поток забирает строки из всех буферов и пишет их пачкой. Поток вызова никогда не ждёт
+// записи: если его буфер полон, запись отбрасывается и учитывается в dropped().
+// До start() записи копятся в буферах, stop() дописывает всё накопленное.
+class Logger
+{
+public:
+    static void start(LoggerOptions options);
+    static void stop();
+
+    static void setLevel(LogLevel level);
+    [[nodiscard]] static bool enabled(LogLevel level);
+    [[nodiscard]] static bool logPayloads();
+    [[nodiscard]] static std::uint64_t dropped();
+};
+
+// Одна запись журнала: {"ts":...,"level":...,"thread":...,"event":...,<поля>}. Уходит в буфер в деструкторе.
+// Создаётся макросами CHAT_LOG_*, которые проверяют уровень до вычисления полей.
+class LogRecord
+{
+public:
+    LogRecord(LogLevel level, std::string_view event);
+    ~LogRecord();
+
+    LogRecord(const LogRecord&) = delete;
+    LogRecord& operator=(const LogRecord&) = delete;
+
+    LogRecord& field(std::string_view key, std::string_view value);
+    LogRecord& field(std::string_view key, const char* value);
+    LogRecord& field(std::string_view key, const void* value);
+    template<std::integral T>
+    LogRecord& field(std::string_view key, T value);
+    // Содержимое пишется только при LoggerOptions::logPayloads (первые maxPayloadBytes), длина -- всегда.
+    LogRecord& payload(std::string_view key, std::string_view data);
+
+    static constexpr std::size_t maxPayloadBytes = 1024;
+
+private:
+    void key(std::string_view name);
+    void appendBool(bool value);
+    void appendUnsigned(std::uint64_t value);
+    void appendSigned(std::int64_t value);
+
+private:
+    std::string& line_;
+};
+
+template<std::integral T>
+LogRecord& LogRecord::field(std::string_view name, T value)
+{
+    key(name);
+    if constexpr (std::same_as<T, bool>)
+        appendBool(value);
+    else if constexpr (std::signed_integral<T>)
+        appendSigned(value);
+    else
+        appendUnsigned(value);
+    return *this;
+}
+
+// switch замыкает цепочку if внутри макроса: запись -- одна инструкция, и else вызывающего
+// (if (x) CHAT_LOG_INFO("e").field(...); else ...) относится к его собственному if.
+#define CHAT_LOG(level, event)                                     \
+    switch (0)                                                     \
+    case 0:                                                        \
+    default:                                                       \
+        if constexpr (!logLevelCompiledIn(level)) {}               \
+        else if (!Logger::enabled(level)) {}                       \
+        else LogRecord(level, event)
+
+#define CHAT_LOG_DEBUG(event) CHAT_LOG(LogLevel::Debug, event)
+#define CHAT_LOG_INFO(event) CHAT_LOG(LogLevel::Info, event)
+#define CHAT_LOG_WARNING(event) CHAT_LOG(LogLevel::Warning, event)
+#define CHAT_LOG_ERROR(event) CHAT_LOG(LogLevel::Error, event)
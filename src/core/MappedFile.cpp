@@ -0,0 +1,279 @@
+#include "core/MappedFile.hpp"
+
+#include <algorithm>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+[[noreturn]] void throwLastError(const char* what)
+{
+#ifdef _WIN32
+    throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), what);
+#else
+    throw std::system_error(errno, std::generic_category(), what);
+#endif
+}
+
+} // namespace
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& path, std::uint64_t minimumSize)
+{
+    // FILE_SHARE_DELETE: сегмент удаляется по сроку хранения, даже если он ещё открыт.
+    const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throwLastError("CreateFileW");
+    }
+    file_ = file;
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file, &size))
+    {
+        const auto error = GetLastError();
+        CloseHandle(file);
+        throw std::system_error(static_cast<int>(error), std::system_category(), "GetFileSizeEx");
+    }
+    size_ = static_cast<std::uint64_t>(size.QuadPart);
+    try
+    {
+        if (size_ < minimumSize)
+        {
+            resize(minimumSize);
+        }
+        map();
+    }
+    catch (...)
+    {
+        CloseHandle(file);
+        throw;
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+    if (file_ != nullptr)
+    {
+        CloseHandle(static_cast<HANDLE>(file_));
+    }
+}
+
+void MappedFile::write(std::uint64_t offset, std::string_view data)
+{
+    while (!data.empty())
+    {
+        OVERLAPPED position{};
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        const auto chunk = static_cast<DWORD>(std::min<std::size_t>(data.size(), 1u << 30));
+        DWORD written = 0;
+        if (!WriteFile(static_cast<HANDLE>(file_), data.data(), chunk, &written, &position))
+        {
+            throwLastError("WriteFile");
+        }
+        offset += written;
+        data.remove_prefix(written);
+    }
+}
+
+void MappedFile::sync()
+{
+    if (!FlushFileBuffers(static_cast<HANDLE>(file_)))
+    {
+        throwLastError("FlushFileBuffers");
+    }
+}
+
+void MappedFile::resize(std::uint64_t size)
+{
+    FILE_END_OF_FILE_INFO end{};
+    end.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFileInformationByHandle(static_cast<HANDLE>(file_), FileEndOfFileInfo, &end, sizeof(end)))
+    {
+        throwLastError("SetFileInformationByHandle");
+    }
+    size_ = size;
+}
+
+void MappedFile::map()
+{
+    if (size_ == 0)
+    {
+        return;
+    }
+    mapping_ = CreateFileMappingW(static_cast<HANDLE>(file_), nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ == nullptr)
+    {
+        throwLastError("CreateFileMappingW");
+    }
+    data_ = static_cast<const char*>(MapViewOfFile(static_cast<HANDLE>(mapping_), FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr)
+    {
+        const auto error = GetLastError();
+        CloseHandle(static_cast<HANDLE>(mapping_));
+        mapping_ = nullptr;
+        throw std::system_error(static_cast<int>(error), std::system_category(), "MapViewOfFile");
+    }
+}
+
+void MappedFile::unmap()
+{
+    if (data_ != nullptr)
+    {
+        UnmapViewOfFile(data_);
+        data_ = nullptr;
+    }
+    if (mapping_ != nullptr)
+    {
+        CloseHandle(static_cast<HANDLE>(mapping_));
+        mapping_ = nullptr;
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path, std::uint64_t minimumSize)
+{
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+    {
+        throwLastError("open");
+    }
+
+    try
+    {
+        struct stat status{};
+        if (::fstat(fd_, &status) != 0)
+        {
+            throwLastError("fstat");
+        }
+        size_ = static_cast<std::uint64_t>(status.st_size);
+        if (size_ < minimumSize)
+        {
+            resize(minimumSize);
+        }
+        map();
+    }
+    catch (...)
+    {
+        ::close(fd_);
+        throw;
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+void MappedFile::write(std::uint64_t offset, std::string_view data)
+{
+    while (!data.empty())
+    {
+        const auto written = ::pwrite(fd_, data.data(), data.size(), static_cast<off_t>(offset));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throwLastError("pwrite");
+        }
+        offset += static_cast<std::uint64_t>(written);
+        data.remove_prefix(static_cast<std::size_t>(written));
+    }
+}
+
+void MappedFile::sync()
+{
+#ifdef __APPLE__
+    const int result = ::fsync(fd_);
+#else
+    const int result = ::fdatasync(fd_);
+#endif
+    if (result != 0)
+    {
+        throwLastError("fdatasync");
+    }
+}
+
+void MappedFile::resize(std::uint64_t size)
+{
+    if (::ftruncate(fd_, static_cast<off_t>(size)) != 0)
+    {
+        throwLastError("ftruncate");
+    }
+    size_ = size;
+}
+
+void MappedFile::map()
+{
+    if (size_ == 0)
+    {
+        return;
+    }
+    void* data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED)
+    {
+        throwLastError("mmap");
+    }
+    data_ = static_cast<const char*>(data);
+}
+
+void MappedFile::unmap()
+{
+    if (data_ != nullptr)
+    {
+        ::munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+    }
+}
+
+#endif
+
+void MappedFile::zeroFrom(std::uint64_t offset)
+{
+    if (offset >= size_)
+    {
+        return;
+    }
+    // Усечение и повторное расширение обнуляют хвост без записи нулей (и остаются разреженными).
+    const auto size = size_;
+    unmap();
+    resize(offset);
+    resize(size);
+    map();
+}
+
+std::string_view MappedFile::view() const
+{
+    return {data_, data_ == nullptr ? 0 : static_cast<std::size_t>(size_)};
+}
+
+std::uint64_t MappedFile::size() const
+{
+    return size_;
+}
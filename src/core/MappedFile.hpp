@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+// Файл фиксированного размера, открытый на запись и целиком отображённый в память только для чтения.
+// Запись идёт обычным write по смещению и сразу видна через view(): отображение и запись используют
+// один страничный кэш. Файл создаётся разреженным, поэтому незаписанный хвост не занимает диск (POSIX).
+// Ошибки ввода-вывода -- std::system_error.
+class MappedFile
+{
+public:
+    // Открывает или создаёт файл; если он короче minimumSize, расширяет нулями.
+    MappedFile(const std::filesystem::path& path, std::uint64_t minimumSize);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void write(std::uint64_t offset, std::string_view data);
+    // Сбрасывает записанное на диск (fdatasync / FlushFileBuffers).
+    void sync();
+    // Обнуляет файл начиная с offset, размер не меняется. Пересоздаёт отображение,
+    // поэтому вызывается только когда из view() никто не читает (при восстановлении).
+    void zeroFrom(std::uint64_t offset);
+
+    [[nodiscard]] std::string_view view() const;
+    [[nodiscard]] std::uint64_t size() const;
+
+private:
+    void resize(std::uint64_t size);
+    void map();
+    void unmap();
+
+private:
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+    const char* data_ = nullptr;
+    std::uint64_t size_ = 0;
+};
@@ -0,0 +1,50 @@
+#include "core/MemoryPool.hpp"
+
+#include <array>
+#include <cstddef>
+
+namespace
+{
+
+struct ThreadArena
+{
+    std::array<std::byte, MessageArena::initialBytes> buffer;
+    std::pmr::monotonic_buffer_resource resource{buffer.data(), buffer.size(), std::pmr::new_delete_resource()};
+    std::size_t depth = 0;
+};
+
+// Буфер выделяется при первом сообщении потока, а не в TLS каждого потока процесса.
+ThreadArena& threadArena()
+{
+    thread_local const auto arena = std::make_unique<ThreadArena>();
+    return *arena;
+}
+
+} // namespace
+
+std::pmr::memory_resource* ObjectPool::resource()
+{
+    // Не разрушается: объекты из пула могут жить до самого выхода из процесса.
+    static auto* const pool = new std::pmr::synchronized_pool_resource();
+    return pool;
+}
+
+MessageArena::Scope::Scope()
+{
+    ++threadArena().depth;
+}
+
+MessageArena::Scope::~Scope()
+{
+    auto& arena = threadArena();
+    if (--arena.depth == 0)
+    {
+        arena.resource.release();
+    }
+}
+
+std::pmr::memory_resource* MessageArena::resource()
+{
+    auto& arena = threadArena();
+    return arena.depth != 0 ? &arena.resource : std::pmr::new_delete_resource();
+}
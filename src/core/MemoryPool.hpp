@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <utility>
+
+// Пул для долгоживущих объектов сервера: UserContext, Room, очереди соединений.
+// Блоки одного размера переиспользуются внутри пула, malloc вызывается только за новыми кусками.
+// Потокобезопасен: объект можно освободить в другом потоке, чем создан.
+class ObjectPool
+{
+public:
+    [[nodiscard]] static std::pmr::memory_resource* resource();
+
+    // Объект и счётчик ссылок -- одним блоком из пула.
+    template<typename T, typename... Args>
+    [[nodiscard]] static std::shared_ptr<T> makeShared(Args&&... args)
+    {
+        return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(resource()), std::forward<Args>(args)...);
+    }
+};
+
+// Арена для временных данных одного входящего кадра, своя у каждого потока: служебных буферов
+// FastJsonObject и MsgPackObject и временных контейнеров обработчика.
+// Выделение -- сдвиг указателя в заранее выделенном буфере, освобождение -- сброс всей арены,
+// когда разрушается внешний Scope. Выделенное из арены не должно переживать кадр.
+// Поля разобранных запросов и упакованные ответы -- обычные std::string: ответы уходят в Crow
+// или в SharedPayload рассылки и живут дольше кадра, поэтому арена их не касается.
+class MessageArena
+{
+public:
+    class Scope
+    {
+    public:
+        Scope();
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // Внутри Scope -- арена потока, вне его -- обычная куча.
+    [[nodiscard]] static std::pmr::memory_resource* resource();
+
+    // Начальный буфер; что не поместилось, арена берёт из кучи и отдаёт при сбросе.
+    static constexpr std::size_t initialBytes = 32 * 1024;
+};
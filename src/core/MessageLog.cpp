@@ -0,0 +1,512 @@
+#include "core/MessageLog.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <optional>
+#include <system_error>
+
+#include <zlib.h>
+
+#include "core/Logger.hpp"
+
+namespace
+{
+
+// Запись: заголовок и байты имени и текста. Числа -- little-endian.
+//  0 u32 размер записи с заголовком (0 -- дальше записей нет)
+//  4 u32 crc32 байтов с 8-го до конца записи
+//  8 u64 server-message-id
+// 16 u32 chat-id
+// 20 u32 user-id
+// 24 i64 время, мс
+// 32 u32 длина имени
+// 36 u32 длина текста
+constexpr std::size_t headerSize = 40;
+
+constexpr std::uint64_t minSegmentBytes = 64ull << 10;
+// Смещение записи в индексе 32-битное.
+constexpr std::uint64_t maxSegmentBytes = 1ull << 30;
+
+// Как часто проверять срок хранения, если новых сообщений нет.
+constexpr auto retentionCheckInterval = std::chrono::minutes(1);
+
+constexpr std::string_view segmentExtension = ".log";
+constexpr std::size_t segmentNameDigits = 10;
+
+template<typename T>
+void putLittleEndian(char* out, T value)
+{
+    auto bits = static_cast<std::make_unsigned_t<T>>(value);
+    for (std::size_t i = 0; i < sizeof(T); ++i)
+    {
+        out[i] = static_cast<char>(bits & 0xFF);
+        bits = static_cast<decltype(bits)>(bits >> 8);
+    }
+}
+
+template<typename T>
+T getLittleEndian(const char* in)
+{
+    std::make_unsigned_t<T> bits = 0;
+    for (std::size_t i = sizeof(T); i-- > 0;)
+    {
+        bits = static_cast<decltype(bits)>((bits << 8) | static_cast<unsigned char>(in[i]));
+    }
+    return static_cast<T>(bits);
+}
+
+std::uint32_t checksum(std::string_view bytes)
+{
+    return static_cast<std::uint32_t>(
+        crc32(0, reinterpret_cast<const Bytef*>(bytes.data()), static_cast<uInt>(bytes.size())));
+}
+
+void encodeRecord(const StoredMessage& message, std::string& out)
+{
+    const std::size_t begin = out.size();
+    const std::size_t size = headerSize + message.username.size() + message.message.size();
+    out.resize(begin + headerSize);
+    char* header = out.data() + begin;
+    putLittleEndian(header + 0, static_cast<std::uint32_t>(size));
+    putLittleEndian(header + 8, message.serverMessageId);
+    putLittleEndian(header + 16, message.chatId);
+    putLittleEndian(header + 20, message.userId);
+    putLittleEndian(header + 24, message.timestamp);
+    putLittleEndian(header + 32, static_cast<std::uint32_t>(message.username.size()));
+    putLittleEndian(header + 36, static_cast<std::uint32_t>(message.message.size()));
+    out += message.username;
+    out += message.message;
+    const auto crc = checksum(std::string_view(out).substr(begin + 8));
+    putLittleEndian(out.data() + begin + 4, crc);
+}
+
+// Разбор записи по смещению; проверки контрольной суммы нет, она делается только при восстановлении.
+StoredMessage decodeRecord(std::string_view data, std::uint64_t offset)
+{
+    const char* header = data.data() + offset;
+    StoredMessage message;
+    message.serverMessageId = getLittleEndian<std::uint64_t>(header + 8);
+    message.chatId = getLittleEndian<std::uint32_t>(header + 16);
+    message.userId = getLittleEndian<std::uint32_t>(header + 20);
+    message.timestamp = getLittleEndian<std::int64_t>(header + 24);
+    const auto usernameSize = getLittleEndian<std::uint32_t>(header + 32);
+    const auto messageSize = getLittleEndian<std::uint32_t>(header + 36);
+    message.username.assign(header + headerSize, usernameSize);
+    message.message.assign(header + headerSize + usernameSize, messageSize);
+    return message;
+}
+
+// Размер корректной записи по смещению; 0 -- конец данных, nullopt -- запись повреждена.
+std::optional<std::uint32_t> validateRecord(std::string_view data, std::uint64_t offset)
+{
+    if (data.size() - offset < headerSize)
+    {
+        return data.substr(offset).find_first_not_of('\0') == std::string_view::npos ? std::optional<std::uint32_t>(0)
+                                                                                      : std::nullopt;
+    }
+    const char* header = data.data() + offset;
+    const auto size = getLittleEndian<std::uint32_t>(header);
+    if (size == 0)
+    {
+        return 0;
+    }
+    const std::uint64_t payload =
+        std::uint64_t{getLittleEndian<std::uint32_t>(header + 32)} + getLittleEndian<std::uint32_t>(header + 36);
+    if (size < headerSize || size > data.size() - offset || size != headerSize + payload)
+    {
+        return std::nullopt;
+    }
+    if (checksum(data.substr(offset + 8, size - 8)) != getLittleEndian<std::uint32_t>(header + 4))
+    {
+        return std::nullopt;
+    }
+    return size;
+}
+
+std::string segmentFileName(std::uint32_t sequence)
+{
+    std::string name(segmentNameDigits, '0');
+    std::array<char, segmentNameDigits> digits{};
+    const auto result = std::to_chars(digits.data(), digits.data() + digits.size(), sequence);
+    const auto length = static_cast<std::size_t>(result.ptr - digits.data());
+    name.replace(segmentNameDigits - length, length, digits.data(), length);
+    return name + std::string(segmentExtension);
+}
+
+std::optional<std::uint32_t> parseSegmentFileName(const std::filesystem::path& path)
+{
+    const auto name = path.filename().string();
+    if (name.size() != segmentNameDigits + segmentExtension.size() || !name.ends_with(segmentExtension))
+    {
+        return std::nullopt;
+    }
+    std::uint32_t sequence = 0;
+    const auto result = std::from_chars(name.data(), name.data() + segmentNameDigits, sequence);
+    if (result.ec != std::errc{} || result.ptr != name.data() + segmentNameDigits)
+    {
+        return std::nullopt;
+    }
+    return sequence;
+}
+
+} // namespace
+
+MessageLog::MessageLog(HistoryOptions options) : options_(std::move(options))
+{
+    options_.segmentBytes = std::clamp(options_.segmentBytes, minSegmentBytes, maxSegmentBytes);
+    recover();
+    writer_ = std::thread([this]() { run(); });
+}
+
+MessageLog::~MessageLog()
+{
+    stop();
+}
+
+void MessageLog::append(StoredMessage message)
+{
+    {
+        std::scoped_lock lock(queueMutex_);
+        if (stopped_)
+        {
+            return;
+        }
+        lastMessageId_ = std::max(lastMessageId_, message.serverMessageId);
+        lastChatId_ = std::max(lastChatId_, message.chatId);
+        pending_.push_back(std::move(message));
+        ++appendedCount_;
+    }
+    wakeup_.notify_one();
+}
+
+void MessageLog::flush()
+{
+    std::unique_lock lock(queueMutex_);
+    const auto target = appendedCount_;
+    wakeup_.notify_one();
+    committed_.wait(lock, [&]() { return committedCount_ >= target; });
+}
+
+void MessageLog::stop()
+{
+    {
+        std::scoped_lock lock(queueMutex_);
+        stopped_ = true;
+    }
+    wakeup_.notify_one();
+    if (writer_.joinable())
+    {
+        writer_.join();
+    }
+}
+
+std::vector<StoredMessage> MessageLog::readAfter(IDType chatId, std::uint64_t afterId, std::size_t limit) const
+{
+    std::shared_lock lock(indexMutex_);
+    const auto room = rooms_.find(chatId);
+    if (room == rooms_.end())
+    {
+        return {};
+    }
+    const auto& entries = room->second;
+    const auto it = std::upper_bound(entries.begin(), entries.end(), afterId,
+                                     [](std::uint64_t id, const IndexEntry& entry) { return id < entry.serverMessageId; });
+    const auto first = static_cast<std::size_t>(it - entries.begin());
+    return readRange(entries, first, first + std::min(limit, entries.size() - first));
+}
+
+std::vector<StoredMessage> MessageLog::readBefore(IDType chatId, std::uint64_t beforeId, std::size_t limit) const
+{
+    std::shared_lock lock(indexMutex_);
+    const auto room = rooms_.find(chatId);
+    if (room == rooms_.end())
+    {
+        return {};
+    }
+    const auto& entries = room->second;
+    auto last = entries.size();
+    if (beforeId != 0)
+    {
+        const auto it = std::lower_bound(entries.begin(), entries.end(), beforeId,
+                                         [](const IndexEntry& entry, std::uint64_t id) { return entry.serverMessageId < id; });
+        last = static_cast<std::size_t>(it - entries.begin());
+    }
+    return readRange(entries, last - std::min(limit, last), last);
+}
+
+std::uint64_t MessageLog::lastMessageId() const
+{
+    std::scoped_lock lock(queueMutex_);
+    return lastMessageId_;
+}
+
+IDType MessageLog::lastChatId() const
+{
+    std::scoped_lock lock(queueMutex_);
+    return lastChatId_;
+}
+
+std::int64_t MessageLog::now()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+void MessageLog::recover()
+{
+    std::filesystem::create_directories(options_.directory);
+
+    std::vector<std::uint32_t> sequences;
+    for (const auto& entry : std::filesystem::directory_iterator(options_.directory))
+    {
+        if (!entry.is_regular_file())
+            continue;
+        if (const auto sequence = parseSegmentFileName(entry.path()))
+            sequences.push_back(*sequence);
+    }
+    std::sort(sequences.begin(), sequences.end());
+
+    if (sequences.empty())
+    {
+        openSegment(1, options_.segmentBytes);
+        return;
+    }
+
+    for (std::size_t i = 0; i < sequences.size(); ++i)
+    {
+        const bool active = i + 1 == sequences.size();
+        // Активный сегмент дорастает до полного размера, закрытые открываются как есть.
+        openSegment(sequences[i], active ? options_.segmentBytes : 0);
+        recoverSegment(segments_.back(), active);
+    }
+    enforceRetention();
+}
+
+void MessageLog::recoverSegment(Segment& segment, bool active)
+{
+    const auto data = segment.file->view();
+    std::uint64_t offset = 0;
+    bool damaged = false;
+    while (offset < data.size())
+    {
+        const auto size = validateRecord(data, offset);
+        if (!size.has_value())
+        {
+            damaged = true;
+            break;
+        }
+        if (*size == 0)
+        {
+            break;
+        }
+
+        const auto message = decodeRecord(data, offset);
+        index(message, segment.sequence, static_cast<std::uint32_t>(offset));
+        segment.newestTimestamp = std::max(segment.newestTimestamp, message.timestamp);
+        lastMessageId_ = std::max(lastMessageId_, message.serverMessageId);
+        lastChatId_ = std::max(lastChatId_, message.chatId);
+        offset += *size;
+    }
+    segment.used = offset;
+    totalBytes_ += offset;
+
+    if (damaged)
+    {
+        CHAT_LOG_WARNING("history-segment-damaged").field("path", segment.path.string()).field("offset", offset);
+        // В активный сегмент запись продолжится с этого места: остатки старых байтов не должны
+        // читаться после новых записей.
+        if (active)
+        {
+            segment.file->zeroFrom(offset);
+        }
+    }
+}
+
+void MessageLog::openSegment(std::uint32_t sequence, std::uint64_t minimumSize)
+{
+    Segment segment;
+    segment.sequence = sequence;
+    segment.path = options_.directory / segmentFileName(sequence);
+    segment.file = std::make_unique<MappedFile>(segment.path, minimumSize);
+    std::unique_lock lock(indexMutex_);
+    segments_.push_back(std::move(segment));
+}
+
+void MessageLog::run()
+{
+    std::vector<StoredMessage> batch;
+    while (true)
+    {
+        {
+            std::unique_lock lock(queueMutex_);
+            wakeup_.wait_for(lock, retentionCheckInterval, [this]() { return stopped_ || !pending_.empty(); });
+            if (pending_.empty() && stopped_)
+            {
+                return;
+            }
+            // Всё, что накопилось, пока шла предыдущая запись, уходит одной пачкой с одним fsync.
+            batch.swap(pending_);
+        }
+
+        try
+        {
+            if (!batch.empty())
+            {
+                writeBatch(batch);
+            }
+            enforceRetention();
+        }
+        catch (const std::exception& error)
+        {
+            CHAT_LOG_ERROR("history-write-failed").field("lost", batch.size()).field("error", error.what());
+        }
+
+        {
+            std::scoped_lock lock(queueMutex_);
+            committedCount_ += batch.size();
+        }
+        committed_.notify_all();
+        batch.clear();
+    }
+}
+
+void MessageLog::writeBatch(const std::vector<StoredMessage>& batch)
+{
+    std::string buffer;
+    std::vector<Placement> placements;
+    placements.reserve(batch.size());
+    for (const auto& message : batch)
+    {
+        const std::uint64_t size = headerSize + message.username.size() + message.message.size();
+        if (size > maxSegmentBytes)
+        {
+            CHAT_LOG_WARNING("history-record-too-large")
+                .field("bytes", size)
+                .field("server-message-id", message.serverMessageId);
+            continue;
+        }
+
+        const auto& active = segments_.back();
+        if (active.used + buffer.size() + size > active.file->size())
+        {
+            commit(buffer, placements);
+            // Активный сегмент уже на диске, дальше он только читается.
+            openSegment(active.sequence + 1, std::max(options_.segmentBytes, size));
+        }
+
+        placements.emplace_back(&message, static_cast<std::uint32_t>(segments_.back().used + buffer.size()));
+        encodeRecord(message, buffer);
+    }
+    commit(buffer, placements);
+}
+
+void MessageLog::commit(std::string& buffer, std::vector<Placement>& placements)
+{
+    if (buffer.empty())
+    {
+        return;
+    }
+    auto& active = segments_.back();
+    active.file->write(active.used, buffer);
+    active.file->sync();
+
+    std::unique_lock lock(indexMutex_);
+    for (const auto& [message, offset] : placements)
+    {
+        index(*message, active.sequence, offset);
+        active.newestTimestamp = std::max(active.newestTimestamp, message->timestamp);
+    }
+    active.used += buffer.size();
+    totalBytes_ += buffer.size();
+    buffer.clear();
+    placements.clear();
+}
+
+void MessageLog::enforceRetention()
+{
+    const auto ageLimit = std::chrono::duration_cast<std::chrono::milliseconds>(options_.retentionAge).count();
+    const auto oldestAllowed = now() - ageLimit;
+
+    std::vector<std::filesystem::path> removed;
+    {
+        std::unique_lock lock(indexMutex_);
+        // Активный сегмент не удаляется никогда.
+        while (segments_.size() > 1)
+        {
+            const auto& oldest = segments_.front();
+            const bool overSize = options_.retentionBytes != 0 && totalBytes_ > options_.retentionBytes;
+            const bool expired = ageLimit != 0 && oldest.newestTimestamp < oldestAllowed;
+            if (!overSize && !expired)
+            {
+                break;
+            }
+
+            // Записи удаляемого сегмента могут стоять где угодно в индексе комнаты: сообщения других
+            // экземпляров вставляются по ID, а не в конец.
+            for (auto it = rooms_.begin(); it != rooms_.end();)
+            {
+                auto& entries = it->second;
+                std::erase_if(entries, [&](const IndexEntry& entry) { return entry.segment == oldest.sequence; });
+                it = entries.empty() ? rooms_.erase(it) : std::next(it);
+            }
+            totalBytes_ -= oldest.used;
+            removed.push_back(oldest.path);
+            segments_.pop_front();
+        }
+    }
+
+    for (const auto& path : removed)
+    {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+        if (error)
+        {
+            CHAT_LOG_WARNING("history-segment-remove-failed").field("path", path.string()).field("error", error.message());
+        }
+    }
+}
+
+void MessageLog::index(const StoredMessage& message, std::uint32_t segment, std::uint32_t offset)
+{
+    auto& entries = rooms_[message.chatId];
+    const IndexEntry entry{message.serverMessageId, segment, offset};
+    if (entries.empty() || entries.back().serverMessageId < entry.serverMessageId)
+    {
+        entries.push_back(entry);
+        return;
+    }
+    // Сообщение другого экземпляра сервера, пришедшее позже более новых.
+    const auto position = std::lower_bound(entries.begin(), entries.end(), entry.serverMessageId,
+                                           [](const IndexEntry& current, std::uint64_t id) { return current.serverMessageId < id; });
+    entries.insert(position, entry);
+}
+
+const MessageLog::Segment* MessageLog::findSegment(std::uint32_t sequence) const
+{
+    const auto it = std::lower_bound(segments_.begin(), segments_.end(), sequence,
+                                     [](const Segment& segment, std::uint32_t value) { return segment.sequence < value; });
+    return it != segments_.end() && it->sequence == sequence ? &*it : nullptr;
+}
+
+std::vector<StoredMessage> MessageLog::readRange(const std::vector<IndexEntry>& entries, std::size_t first,
+                                                 std::size_t last) const
+{
+    std::vector<StoredMessage> result;
+    result.reserve(last - first);
+    const Segment* segment = nullptr;
+    for (std::size_t i = first; i < last; ++i)
+    {
+        const auto& entry = entries[i];
+        if (segment == nullptr || segment->sequence != entry.segment)
+        {
+            segment = findSegment(entry.segment);
+        }
+        if (segment == nullptr)
+        {
+            continue;
+        }
+        result.push_back(decodeRecord(segment->file->view(), entry.offset));
+    }
+    return result;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "core/MappedFile.hpp"
+#include "core/Types.hpp"
+
+// Настройки хранения истории сообщений.
+struct HistoryOptions
+{
+    std::filesystem::path directory;                  // Пусто -- история не сохраняется.
+    std::uint64_t segmentBytes = 64ull << 20;         // Размер сегмента, после которого начинается новый.
+    std::uint64_t retentionBytes = 4ull << 30;        // Предел объёма всех сегментов, 0 -- без ограничения.
+    std::chrono::hours retentionAge{24 * 30};         // Срок хранения сегмента, 0 -- без ограничения.
+    std::size_t recentMessagesPerRoom = 256;          // Последние сообщения комнаты в памяти (есть и без directory).
+};
+
+struct StoredMessage
+{
+    std::uint64_t serverMessageId = 0;
+    IDType chatId = 0;
+    IDType userId = 0;
+    std::int64_t timestamp = 0;  // Время приёма сервером, мс от эпохи Unix.
+    std::string username;
+    std::string message;
+};
+
+// Журнал сообщений всех комнат: только дописывание, файлы-сегменты в directory, отображённые в память.
+// append() не ждёт диска: записи копятся в очереди, фоновый поток пишет их пачкой и делает один fsync
+// на пачку (group commit). Читателю запись видна после того, как попала в файл.
+// Для каждой комнаты в памяти держится индекс server-message-id -> место записи.
+// Старые сегменты удаляются целиком, когда общий объём или возраст превышает пределы.
+class MessageLog
+{
+public:
+    // Открывает каталог и восстанавливает индекс по существующим сегментам; оборванная запись
+    // в конце сегмента (падение во время записи) отбрасывается. Ошибки ввода-вывода -- std::system_error.
+    explicit MessageLog(HistoryOptions options);
+    ~MessageLog();
+
+    MessageLog(const MessageLog&) = delete;
+    MessageLog& operator=(const MessageLog&) = delete;
+
+    // Внутри одной комнаты сообщения обычно добавляются по возрастанию server-message-id; сообщения
+    // других экземпляров сервера могут прийти позже более новых и встают в индексе на своё место.
+    void append(StoredMessage message);
+    // Ждёт, пока всё добавленное до вызова окажется на диске.
+    void flush();
+    // Дописывает очередь и останавливает фоновый поток; после этого append() ничего не делает.
+    void stop();
+
+    // До limit сообщений комнаты с ID больше afterId, по возрастанию ID.
+    [[nodiscard]] std::vector<StoredMessage> readAfter(IDType chatId, std::uint64_t afterId, std::size_t limit) const;
+    // До limit последних сообщений комнаты с ID меньше beforeId (0 -- самые новые), по возрастанию ID.
+    [[nodiscard]] std::vector<StoredMessage> readBefore(IDType chatId, std::uint64_t beforeId, std::size_t limit) const;
+
+    // Наибольшие ID из журнала, включая ещё не записанные сообщения; 0, если журнал пуст.
+    [[nodiscard]] std::uint64_t lastMessageId() const;
+    [[nodiscard]] IDType lastChatId() const;
+
+    // Текущее время в единицах StoredMessage::timestamp.
+    [[nodiscard]] static std::int64_t now();
+
+private:
+    struct Segment
+    {
+        std::uint32_t sequence = 0;  // Номер сегмента, он же имя файла.
+        std::filesystem::path path;
+        std::unique_ptr<MappedFile> file;
+        std::uint64_t used = 0;      // Байт записей; дальше файл заполнен нулями.
+        std::int64_t newestTimestamp = 0;
+    };
+
+    struct IndexEntry
+    {
+        std::uint64_t serverMessageId = 0;
+        std::uint32_t segment = 0;  // Номер сегмента.
+        std::uint32_t offset = 0;
+    };
+
+    // Записанное, но ещё не проиндексированное: сообщение и его смещение в активном сегменте.
+    using Placement = std::pair<const StoredMessage*, std::uint32_t>;
+
+    void recover();
+    void recoverSegment(Segment& segment, bool active);
+    void openSegment(std::uint32_t sequence, std::uint64_t minimumSize);
+
+    void run();
+    void writeBatch(const std::vector<StoredMessage>& batch);
+    void commit(std::string& buffer, std::vector<Placement>& placements);
+    void enforceRetention();
+    void index(const StoredMessage& message, std::uint32_t segment, std::uint32_t offset);
+    [[nodiscard]] const Segment* findSegment(std::uint32_t sequence) const;
+    // Записи сегментов, которых уже нет, пропускаются.
+    [[nodiscard]] std::vector<StoredMessage> readRange(const std::vector<IndexEntry>& entries, std::size_t first,
+                                                      std::size_t last) const;
+
+private:
+    HistoryOptions options_;
+
+    // Сегменты и индекс: фоновый поток меняет их под unique_lock, читатели -- под shared_lock.
+    mutable std::shared_mutex indexMutex_;
+    std::deque<Segment> segments_;  // По возрастанию номера; последний -- активный, в него идёт запись.
+    std::uint64_t totalBytes_ = 0;
+    std::unordered_map<IDType, std::vector<IndexEntry>> rooms_;
+
+    // Очередь на запись.
+    mutable std::mutex queueMutex_;
+    std::condition_variable wakeup_;
+    std::condition_variable committed_;
+    std::vector<StoredMessage> pending_;
+    std::uint64_t appendedCount_ = 0;
+    std::uint64_t committedCount_ = 0;
+    std::uint64_t lastMessageId_ = 0;
+    IDType lastChatId_ = 0;
+    bool stopped_ = false;
+
+    std::thread writer_;
+};
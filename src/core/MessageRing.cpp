@@ -0,0 +1,119 @@
+#include "core/MessageRing.hpp"
+
+#include <algorithm>
+
+MessageRing::MessageRing(std::size_t capacity) : capacity_(std::max<std::size_t>(1, capacity))
+{
+}
+
+void MessageRing::push(StoredMessage message)
+{
+    if (!buffer_.empty() && message.serverMessageId < at(size() - 1).serverMessageId)
+    {
+        insertOutOfOrder(std::move(message));
+        return;
+    }
+    if (buffer_.size() < capacity_)
+    {
+        buffer_.push_back(std::move(message));
+        return;
+    }
+    coveredFrom_ = buffer_[head_].serverMessageId + 1;
+    buffer_[head_] = std::move(message);
+    head_ = (head_ + 1) % capacity_;
+}
+
+void MessageRing::insertOutOfOrder(StoredMessage message)
+{
+    std::rotate(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(head_), buffer_.end());
+    head_ = 0;
+    const auto position = lowerBound(message.serverMessageId);
+    if (position == 0 && buffer_.size() == capacity_)
+    {
+        // Старше всего полного кольца: остаётся только в журнале.
+        coveredFrom_ = buffer_.front().serverMessageId;
+        return;
+    }
+    buffer_.insert(buffer_.begin() + static_cast<std::ptrdiff_t>(position), std::move(message));
+    if (buffer_.size() > capacity_)
+    {
+        coveredFrom_ = buffer_.front().serverMessageId + 1;
+        buffer_.erase(buffer_.begin());
+    }
+}
+
+void MessageRing::setCoveredFrom(std::uint64_t id)
+{
+    coveredFrom_ = id;
+}
+
+MessageRing::Page MessageRing::after(std::uint64_t afterId, std::size_t limit) const
+{
+    Page page;
+    page.truncated = coveredFrom_ != 0 && afterId + 1 < coveredFrom_;
+    const auto first = page.truncated ? 0 : lowerBound(afterId + 1);
+    const auto last = first + std::min(limit, size() - first);
+    page.messages = copy(first, last);
+    page.complete = !page.truncated;
+    page.hasMore = last < size();
+    return page;
+}
+
+MessageRing::Page MessageRing::before(std::uint64_t beforeId, std::size_t limit) const
+{
+    Page page;
+    const auto last = beforeId == 0 ? size() : lowerBound(beforeId);
+    const auto first = last - std::min(limit, last);
+    page.messages = copy(first, last);
+    if (page.messages.size() == limit)
+    {
+        page.complete = true;
+        page.hasMore = first > 0 || coveredFrom_ != 0;
+    }
+    else
+    {
+        page.complete = coveredFrom_ == 0;
+    }
+    return page;
+}
+
+std::size_t MessageRing::size() const
+{
+    return buffer_.size();
+}
+
+const StoredMessage& MessageRing::at(std::size_t index) const
+{
+    return buffer_[(head_ + index) % buffer_.size()];
+}
+
+std::size_t MessageRing::lowerBound(std::uint64_t id) const
+{
+    std::size_t first = 0;
+    std::size_t count = size();
+    while (count > 0)
+    {
+        const auto step = count / 2;
+        if (at(first + step).serverMessageId < id)
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+    return first;
+}
+
+std::vector<StoredMessage> MessageRing::copy(std::size_t first, std::size_t last) const
+{
+    std::vector<StoredMessage> result;
+    result.reserve(last - first);
+    for (std::size_t i = first; i < last; ++i)
+    {
+        result.push_back(at(i));
+    }
+    return result;
+}
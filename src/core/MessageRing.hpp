@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "core/MessageLog.hpp"
+
+// Последние сообщения комнаты в памяти: кольцевой буфер фиксированного размера по возрастанию
+// server-message-id, новое сообщение вытесняет самое старое. Синхронизации нет, её обеспечивает Room.
+class MessageRing
+{
+public:
+    struct Page
+    {
+        std::vector<StoredMessage> messages;  // По возрастанию ID.
+        bool complete = false;                // Кольцо ответило полностью, журнал не нужен.
+        bool hasMore = false;                 // При complete: в направлении запроса есть ещё сообщения.
+        // Между курсором after и первым сообщением страницы были сообщения, вытесненные из кольца;
+        // страница начинается с самого старого сообщения кольца.
+        bool truncated = false;
+    };
+
+    explicit MessageRing(std::size_t capacity);
+
+    // Сообщение другого экземпляра сервера может прийти с ID меньше последнего: оно встаёт на своё место.
+    void push(StoredMessage message);
+    // Сообщения с ID меньше id могут существовать вне кольца (в журнале прошлого запуска).
+    void setCoveredFrom(std::uint64_t id);
+
+    // До limit самых старых сообщений с ID больше afterId. Если часть из них уже вытеснена, страница
+    // неполная (complete = false, truncated = true) и начинается с начала кольца.
+    [[nodiscard]] Page after(std::uint64_t afterId, std::size_t limit) const;
+    // До limit самых новых сообщений с ID меньше beforeId (0 -- без ограничения).
+    // Неполная страница содержит то, что есть в кольце; недостающие более старые сообщения -- в журнале.
+    [[nodiscard]] Page before(std::uint64_t beforeId, std::size_t limit) const;
+
+    [[nodiscard]] std::size_t size() const;
+
+private:
+    void insertOutOfOrder(StoredMessage message);
+    [[nodiscard]] const StoredMessage& at(std::size_t index) const;
+    // Позиция первого сообщения с ID не меньше id.
+    [[nodiscard]] std::size_t lowerBound(std::uint64_t id) const;
+    [[nodiscard]] std::vector<StoredMessage> copy(std::size_t first, std::size_t last) const;
+
+private:
+    std::vector<StoredMessage> buffer_;
+    std::size_t capacity_;
+    std::size_t head_ = 0;  // Позиция самого старого сообщения в buffer_.
+    // Все сообщения комнаты с ID не меньше coveredFrom_ лежат в кольце; 0 -- вся история комнаты в кольце.
+    std::uint64_t coveredFrom_ = 0;
+};
@@ -0,0 +1,210 @@
+#include "core/Metrics.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <iterator>
+#include <utility>
+
+std::uint64_t Counter::value() const
+{
+    std::uint64_t result = 0;
+    for (const auto& slot : slots_)
+    {
+        result += slot.value.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+Histogram::Snapshot Histogram::snapshot() const
+{
+    Snapshot result;
+    for (const auto& slot : slots_)
+    {
+        for (std::size_t i = 0; i < bucketCount; ++i)
+        {
+            result.buckets[i] += slot.buckets[i].load(std::memory_order_relaxed);
+        }
+        result.sum += slot.sum.load(std::memory_order_relaxed);
+    }
+    for (const auto bucket : result.buckets)
+    {
+        result.count += bucket;
+    }
+    return result;
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot result;
+    for (const auto& slot : slots_)
+    {
+        for (std::size_t i = 0; i < bucketCount; ++i)
+        {
+            result.buckets[i] += slot.buckets[i].load(std::memory_order_relaxed);
+        }
+        result.sum += slot.sum.load(std::memory_order_relaxed);
+    }
+    for (const auto bucket : result.buckets)
+    {
+        result.count += bucket;
+    }
+    return result;
+}
+
+std::uint64_t LatencyHistogram::Snapshot::percentile(double quantile) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(quantile * static_cast<double>(count))));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucketCount; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return highestValue(i);
+        }
+    }
+    return highestValue(bucketCount - 1);
+}
+
+std::uint64_t LatencyHistogram::Snapshot::max() const
+{
+    for (std::size_t i = bucketCount; i > 0; --i)
+    {
+        if (buckets[i - 1] != 0)
+        {
+            return highestValue(i - 1);
+        }
+    }
+    return 0;
+}
+
+void MetricsWriter::family(std::string_view name, std::string_view type, std::string_view help)
+{
+    out_.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out_.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void MetricsWriter::sample(std::string_view name, std::uint64_t value)
+{
+    out_.append(name).append(" ");
+    this->value(value);
+}
+
+void MetricsWriter::sample(std::string_view name, std::initializer_list<MetricLabel> labels, std::uint64_t value)
+{
+    this->labels(name, labels);
+    this->value(value);
+}
+
+void MetricsWriter::sample(std::string_view name, std::initializer_list<MetricLabel> labels, double value)
+{
+    this->labels(name, labels);
+    this->value(value);
+}
+
+void MetricsWriter::histogram(std::string_view name, const Histogram::Snapshot& snapshot)
+{
+    histogram(name, nullptr, snapshot);
+}
+
+void MetricsWriter::histogram(std::string_view name, MetricLabel label, const Histogram::Snapshot& snapshot)
+{
+    histogram(name, &label, snapshot);
+}
+
+void MetricsWriter::histogram(std::string_view name, const MetricLabel* label, const Histogram::Snapshot& snapshot)
+{
+    const std::string bucketName = std::string(name) + "_bucket";
+    const auto bucket = [&](std::string_view bound, std::uint64_t count) {
+        if (label != nullptr)
+            sample(bucketName, {*label, {"le", bound}}, count);
+        else
+            sample(bucketName, {{"le", bound}}, count);
+    };
+    std::uint64_t cumulative = 0;
+    for (std::size_t i = 0; i < Histogram::bucketCount; ++i)
+    {
+        cumulative += snapshot.buckets[i];
+        if (i + 1 == Histogram::bucketCount)
+        {
+            bucket("+Inf", cumulative);
+            break;
+        }
+        char bound[20];
+        const auto result = std::to_chars(std::begin(bound), std::end(bound), Histogram::upperBound(i));
+        bucket(std::string_view(bound, static_cast<std::size_t>(result.ptr - bound)), cumulative);
+    }
+    if (label != nullptr)
+    {
+        sample(std::string(name) + "_sum", {*label}, snapshot.sum);
+        sample(std::string(name) + "_count", {*label}, snapshot.count);
+    }
+    else
+    {
+        sample(std::string(name) + "_sum", snapshot.sum);
+        sample(std::string(name) + "_count", snapshot.count);
+    }
+}
+
+void MetricsWriter::latencySummary(std::string_view name, MetricLabel label, const LatencyHistogram::Snapshot& snapshot)
+{
+    constexpr double nanosecondsPerSecond = 1e9;
+    for (const auto& [quantile, text] : {std::pair{0.5, "0.5"}, std::pair{0.9, "0.9"}, std::pair{0.99, "0.99"},
+                                         std::pair{0.999, "0.999"}})
+    {
+        sample(name, {label, {"quantile", text}},
+               static_cast<double>(snapshot.percentile(quantile)) / nanosecondsPerSecond);
+    }
+    sample(std::string(name) + "_sum", {label}, static_cast<double>(snapshot.sum) / nanosecondsPerSecond);
+    sample(std::string(name) + "_count", {label}, snapshot.count);
+}
+
+std::string MetricsWriter::take()
+{
+    return std::exchange(out_, {});
+}
+
+void MetricsWriter::labels(std::string_view name, std::initializer_list<MetricLabel> labels)
+{
+    out_.append(name).append("{");
+    bool first = true;
+    for (const auto& label : labels)
+    {
+        if (!first)
+            out_.push_back(',');
+        first = false;
+        out_.append(label.name).append("=\"");
+        for (const char c : label.value)
+        {
+            if (c == '\\' || c == '"')
+                out_.push_back('\\');
+            if (c == '\n')
+            {
+                out_.append("\\n");
+                continue;
+            }
+            out_.push_back(c);
+        }
+        out_.push_back('"');
+    }
+    out_.append("} ");
+}
+
+void MetricsWriter::value(std::uint64_t value)
+{
+    char buffer[20];
+    const auto result = std::to_chars(std::begin(buffer), std::end(buffer), value);
+    out_.append(buffer, result.ptr).append("\n");
+}
+
+void MetricsWriter::value(double value)
+{
+    char buffer[32];
+    const auto result = std::to_chars(std::begin(buffer), std::end(buffer), value);
+    out_.append(buffer, result.ptr).append("\n");
+}
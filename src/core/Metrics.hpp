@@ -0,0 +1,190 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+
+// Счётчики для /metrics.
+// Каждый счётчик разбит на слоты по кэш-линии, поток пишет только в свой слот одной relaxed-операцией:
+// потоки, считающие одно и то же, не делят строку кэша. Чтение суммирует слоты и может слегка отставать.
+inline constexpr std::size_t metricSlotCount = 32;
+
+// Слот текущего потока: потоки получают слоты по очереди при первой записи.
+inline std::size_t metricSlot()
+{
+    static std::atomic<std::size_t> nextSlot{0};
+    thread_local const std::size_t slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % metricSlotCount;
+    return slot;
+}
+
+class Counter
+{
+public:
+    void add(std::uint64_t value = 1)
+    {
+        slots_[metricSlot()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] std::uint64_t value() const;
+
+private:
+    struct alignas(64) Slot
+    {
+        std::atomic<std::uint64_t> value{0};
+    };
+
+    std::array<Slot, metricSlotCount> slots_;
+};
+
+// Гистограмма с границами корзин 1, 2, 4 ... 2^(bucketCount - 2) и +Inf.
+class Histogram
+{
+public:
+    static constexpr std::size_t bucketCount = 18;
+
+    struct Snapshot
+    {
+        std::array<std::uint64_t, bucketCount> buckets{};  // Не накопительные.
+        std::uint64_t count = 0;
+        std::uint64_t sum = 0;
+    };
+
+    void record(std::uint64_t value)
+    {
+        auto& slot = slots_[metricSlot()];
+        slot.buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+        slot.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] Snapshot snapshot() const;
+
+    // Верхняя граница корзины; у последней её нет (+Inf).
+    [[nodiscard]] static constexpr std::uint64_t upperBound(std::size_t bucket)
+    {
+        return std::uint64_t{1} << bucket;
+    }
+
+    [[nodiscard]] static constexpr std::size_t bucketFor(std::uint64_t value)
+    {
+        const auto bucket = value <= 1 ? std::size_t{0} : static_cast<std::size_t>(std::bit_width(value - 1));
+        return bucket < bucketCount ? bucket : bucketCount - 1;
+    }
+
+private:
+    struct alignas(64) Slot
+    {
+        std::array<std::atomic<std::uint64_t>, bucketCount> buckets{};
+        std::atomic<std::uint64_t> sum{0};
+    };
+
+    std::array<Slot, metricSlotCount> slots_;
+};
+
+// Гистограмма задержек в наносекундах с логарифмически-линейными корзинами, как в HDR Histogram:
+// до 16 нс -- по корзине на наносекунду, дальше по 8 корзин на каждую степень двойки (погрешность не больше 12.5%),
+// всё от 2^40 нс (~18 минут) попадает в последнюю корзину.
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned subBucketBits = 3;
+    static constexpr std::size_t subBucketCount = std::size_t{1} << subBucketBits;
+    static constexpr unsigned maxExponent = 40;
+    static constexpr std::size_t bucketCount = (maxExponent - subBucketBits + 1) * subBucketCount;
+
+    struct Snapshot
+    {
+        std::array<std::uint64_t, bucketCount> buckets{};
+        std::uint64_t count = 0;
+        std::uint64_t sum = 0;
+
+        // Наибольшее значение, которое не превышают доля quantile записей (с точностью до корзины); 0, если записей нет.
+        [[nodiscard]] std::uint64_t percentile(double quantile) const;
+        [[nodiscard]] std::uint64_t max() const;
+    };
+
+    void record(std::uint64_t nanoseconds)
+    {
+        auto& slot = slots_[metricSlot()];
+        slot.buckets[bucketFor(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        slot.sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] Snapshot snapshot() const;
+
+    [[nodiscard]] static constexpr std::size_t bucketFor(std::uint64_t value)
+    {
+        if (value < 2 * subBucketCount)
+        {
+            return static_cast<std::size_t>(value);
+        }
+        const auto exponent = static_cast<unsigned>(std::bit_width(value)) - 1;
+        if (exponent >= maxExponent)
+        {
+            return bucketCount - 1;
+        }
+        const auto subBucket = static_cast<std::size_t>(value >> (exponent - subBucketBits)) & (subBucketCount - 1);
+        return (exponent - subBucketBits + 1) * subBucketCount + subBucket;
+    }
+
+    // Наибольшее значение, попадающее в корзину.
+    [[nodiscard]] static constexpr std::uint64_t highestValue(std::size_t bucket)
+    {
+        if (bucket < 2 * subBucketCount)
+        {
+            return bucket;
+        }
+        const auto exponent = static_cast<unsigned>(bucket / subBucketCount) + subBucketBits - 1;
+        const auto lowest = static_cast<std::uint64_t>(subBucketCount + bucket % subBucketCount) << (exponent - subBucketBits);
+        return lowest + (std::uint64_t{1} << (exponent - subBucketBits)) - 1;
+    }
+
+private:
+    struct alignas(64) Slot
+    {
+        std::array<std::atomic<std::uint64_t>, bucketCount> buckets{};
+        std::atomic<std::uint64_t> sum{0};
+    };
+
+    std::array<Slot, metricSlotCount> slots_;
+};
+
+struct MetricLabel
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+// Текст в формате Prometheus (text exposition 0.0.4).
+// Имена метрик и меток задаёт код сервера; значения меток экранируются.
+class MetricsWriter
+{
+public:
+    static constexpr std::string_view contentType = "text/plain; version=0.0.4; charset=utf-8";
+
+    // type -- "counter", "gauge", "histogram" или "summary"; сэмплы семейства пишутся сразу после заголовка.
+    void family(std::string_view name, std::string_view type, std::string_view help);
+    void sample(std::string_view name, std::uint64_t value);
+    void sample(std::string_view name, std::initializer_list<MetricLabel> labels, std::uint64_t value);
+    void sample(std::string_view name, std::initializer_list<MetricLabel> labels, double value);
+    void histogram(std::string_view name, const Histogram::Snapshot& snapshot);
+    // То же с меткой label у всех сэмплов, для нескольких гистограмм одного семейства.
+    void histogram(std::string_view name, MetricLabel label, const Histogram::Snapshot& snapshot);
+    // Семейство "summary" в секундах: квантили 0.5, 0.9, 0.99, 0.999 и _sum/_count, все с меткой label.
+    void latencySummary(std::string_view name, MetricLabel label, const LatencyHistogram::Snapshot& snapshot);
+
+    [[nodiscard]] std::string take();
+
+private:
+    void histogram(std::string_view name, const MetricLabel* label, const Histogram::Snapshot& snapshot);
+    void labels(std::string_view name, std::initializer_list<MetricLabel> labels);
+    void value(std::uint64_t value);
+    void value(double value);
+
+private:
+    std::string out_;
+};
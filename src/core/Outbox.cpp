@@ -0,0 +1,261 @@
+#include "core/Outbox.hpp"
+
+#include <algorithm>
+#include <unordered_set>
+
+void Outbox::setLimits(const OutboxLimits& limits)
+{
+    std::scoped_lock lock(mutex_);
+    limits_ = limits;
+}
+
+Outbox::PushResult Outbox::push(SharedPayload payload, MessageKind kind, std::uint64_t coalesceKey)
+{
+    if (payload == nullptr)
+    {
+        return PushResult::Dropped;
+    }
+
+    std::scoped_lock lock(mutex_);
+    if (closed_)
+    {
+        return PushResult::Dropped;
+    }
+
+    const auto result = pushLocked(std::move(payload), kind, coalesceKey);
+    if (result != PushResult::Queued || flushScheduled_)
+    {
+        return result;
+    }
+    flushScheduled_ = true;
+    return PushResult::FlushNeeded;
+}
+
+std::optional<Outbox::PushResult> Outbox::pushBehindPending(SharedPayload payload)
+{
+    std::scoped_lock lock(mutex_);
+    if (closed_)
+    {
+        return PushResult::Dropped;
+    }
+    if (!flushScheduled_)
+    {
+        return std::nullopt;
+    }
+    return pushLocked(std::move(payload), MessageKind::Regular, 0);
+}
+
+bool Outbox::flushPending() const
+{
+    std::scoped_lock lock(mutex_);
+    return flushScheduled_;
+}
+
+Outbox::TakeResult Outbox::takeBatch(std::vector<Entry>& batch, Clock::time_point now)
+{
+    std::scoped_lock lock(mutex_);
+    if (queue_.empty() || closed_)
+    {
+        flushScheduled_ = false;
+        return TakeResult::Drained;
+    }
+
+    std::size_t budget = bytes_;
+    if (limits_.drainBytesPerSecond != 0)
+    {
+        drainLocked(now);
+        if (inFlight_ >= limits_.maxInFlightBytes)
+        {
+            return TakeResult::Throttled;
+        }
+        // Первый кадр уходит всегда, даже если он один больше остатка окна.
+        budget = limits_.maxInFlightBytes - inFlight_;
+    }
+    std::size_t taken = 0;
+    while (!queue_.empty())
+    {
+        const std::size_t size = queue_.front().payload->size();
+        if (taken != 0 && taken + size > budget)
+        {
+            break;
+        }
+        taken += size;
+        bytes_ -= size;
+        batch.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+    }
+    publishDepthLocked();
+    return TakeResult::Batch;
+}
+
+void Outbox::recordSent(std::size_t bytes, Clock::time_point now)
+{
+    std::scoped_lock lock(mutex_);
+    if (limits_.drainBytesPerSecond == 0)
+    {
+        return;
+    }
+    drainLocked(now);
+    inFlight_ += bytes;
+    inFlightBytes_.store(inFlight_, std::memory_order_relaxed);
+}
+
+void Outbox::close()
+{
+    std::scoped_lock lock(mutex_);
+    closed_ = true;
+    queue_.clear();
+    bytes_ = 0;
+    publishDepthLocked();
+}
+
+Outbox::Stats Outbox::stats() const
+{
+    Stats result;
+    result.queuedBytes = queuedBytes_.load(std::memory_order_relaxed);
+    result.queuedMessages = queuedMessages_.load(std::memory_order_relaxed);
+    result.inFlightBytes = inFlightBytes_.load(std::memory_order_relaxed);
+    result.peakBytes = peakBytes_.load(std::memory_order_relaxed);
+    result.droppedMessages = droppedMessages_.load(std::memory_order_relaxed);
+    result.coalescedMessages = coalescedMessages_.load(std::memory_order_relaxed);
+    result.overflowed = overflowed_.load(std::memory_order_relaxed);
+    return result;
+}
+
+void Outbox::drainLocked(Clock::time_point now)
+{
+    if (inFlight_ == 0)
+    {
+        drainedAt_ = now;
+        return;
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - drainedAt_).count();
+    const auto drained = static_cast<std::size_t>(elapsed) * limits_.drainBytesPerSecond / 1'000'000;
+    // Пока не набралось ни байта, drainedAt_ не сдвигается: частые вызовы не теряют дробные доли.
+    if (elapsed <= 0 || drained == 0)
+    {
+        return;
+    }
+    inFlight_ -= std::min(inFlight_, drained);
+    drainedAt_ = now;
+}
+
+Outbox::PushResult Outbox::pushLocked(SharedPayload payload, MessageKind kind, std::uint64_t coalesceKey)
+{
+    bytes_ += payload->size();
+    queue_.push_back(Entry{std::move(payload), kind, coalesceKey});
+
+    if (overLimitsLocked() && !enforceLimitsLocked())
+    {
+        closed_ = true;
+        overflowed_.store(true, std::memory_order_relaxed);
+        droppedMessages_.fetch_add(queue_.size(), std::memory_order_relaxed);
+        queue_.clear();
+        bytes_ = 0;
+        publishDepthLocked();
+        return PushResult::Overflow;
+    }
+    publishDepthLocked();
+    return PushResult::Queued;
+}
+
+bool Outbox::enforceLimitsLocked()
+{
+    switch (limits_.policy)
+    {
+    case OverflowPolicy::DropOldest:
+        // Последнее сообщение оставляем всегда, даже если оно одно больше лимита.
+        while (queue_.size() > 1 && overLimitsLocked())
+        {
+            popFrontLocked();
+            droppedMessages_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    case OverflowPolicy::CoalescePresence:
+        coalescePresenceLocked();
+        dropOldestPresenceLocked();
+        return queue_.size() <= 1 || !overLimitsLocked();
+    case OverflowPolicy::Disconnect:
+        break;
+    }
+    return false;
+}
+
+void Outbox::coalescePresenceLocked()
+{
+    // Идём с конца: для каждого ключа остаётся только самое свежее изменение.
+    std::unordered_set<std::uint64_t> seen;
+    std::vector<bool> superseded(queue_.size());
+    std::size_t removed = 0;
+    for (std::size_t i = queue_.size(); i-- > 0;)
+    {
+        const auto& entry = queue_[i];
+        if (entry.kind == MessageKind::Presence && !seen.insert(entry.coalesceKey).second)
+        {
+            superseded[i] = true;
+            bytes_ -= entry.payload->size();
+            ++removed;
+        }
+    }
+    if (removed == 0)
+    {
+        return;
+    }
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < queue_.size(); ++i)
+    {
+        if (!superseded[i])
+        {
+            if (kept != i)
+                queue_[kept] = std::move(queue_[i]);
+            ++kept;
+        }
+    }
+    queue_.resize(kept);
+    coalescedMessages_.fetch_add(removed, std::memory_order_relaxed);
+}
+
+void Outbox::dropOldestPresenceLocked()
+{
+    // Уведомления о пользователях можно потерять: список клиент всегда может запросить заново.
+    // Сообщения чатов остаются на месте, порядок оставшихся кадров не меняется.
+    std::size_t count = queue_.size();
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < queue_.size(); ++i)
+    {
+        const bool over = bytes_ > limits_.maxBytes || count > limits_.maxMessages;
+        if (over && count > 1 && queue_[i].kind == MessageKind::Presence)
+        {
+            bytes_ -= queue_[i].payload->size();
+            --count;
+            droppedMessages_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (kept != i)
+            queue_[kept] = std::move(queue_[i]);
+        ++kept;
+    }
+    queue_.resize(kept);
+}
+
+void Outbox::popFrontLocked()
+{
+    bytes_ -= queue_.front().payload->size();
+    queue_.pop_front();
+}
+
+bool Outbox::overLimitsLocked() const
+{
+    return bytes_ > limits_.maxBytes || queue_.size() > limits_.maxMessages;
+}
+
+void Outbox::publishDepthLocked()
+{
+    queuedBytes_.store(bytes_, std::memory_order_relaxed);
+    queuedMessages_.store(queue_.size(), std::memory_order_relaxed);
+    if (bytes_ > peakBytes_.load(std::memory_order_relaxed))
+    {
+        peakBytes_.store(bytes_, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "core/MemoryPool.hpp"
+#include "core/SharedPayload.hpp"
+
+// Что делать, когда очередь исходящих сообщений соединения переполнена.
+enum class OverflowPolicy : std::uint8_t
+{
+    DropOldest,        // Выбросить самые старые сообщения, в том числе сообщения чатов.
+    CoalescePresence,  // Выбросить устаревшие user-change по тем же пользователям, затем самые старые уведомления
+                       // о пользователях; если не хватило -- как Disconnect. Сообщения чатов не выбрасываются.
+    Disconnect         // Закрыть соединение с кодом Outbox::slowConsumerCloseCode.
+};
+
+struct OutboxLimits
+{
+    // Сколько байт держать в Crow непрочитанными клиентом: сверх этого кадры ждут в очереди Outbox.
+    std::size_t maxInFlightBytes = 1024 * 1024;
+    // Скорость, с которой клиент считается читающим; по ней оценивается, сколько переданного в Crow ещё не ушло.
+    // Клиент, читающий быстрее, только ждёт в очереди; закрыт он будет, лишь если рассылки для него дольше
+    // нескольких секунд идут быстрее этой скорости. 0 -- оценка выключена, кадры передаются в Crow сразу,
+    // очередь не копится и лимиты ниже не действуют.
+    std::size_t drainBytesPerSecond = 1024 * 1024;
+    // Лимиты очереди Outbox; при превышении действует policy.
+    std::size_t maxBytes = 8 * 1024 * 1024;
+    std::size_t maxMessages = 16384;
+    OverflowPolicy policy = OverflowPolicy::CoalescePresence;
+};
+
+// Ограниченная очередь исходящих рассылок одного соединения.
+// Производители (потоки рассылки) кладут указатели на общие payload; отправляет их тот, чей push застал
+// очередь пустой, пачкой за один захват мьютекса соединения, поэтому кадры уходят в Crow по порядку.
+// Crow принимает любой объём и не сообщает ни сколько из него ушло в сокет, ни когда завершилась запись,
+// поэтому в Crow кадры передаются только пока оценка непрочитанного (переданное минус drainBytesPerSecond
+// за прошедшее время) меньше maxInFlightBytes. Остальное копится здесь, и к этой очереди применяются
+// лимиты и policy: клиент, переставший читать, держит не больше maxInFlightBytes + maxBytes.
+// Ответы самому соединению идут в ту же очередь, пока она не отправлена (pushBehindPending), поэтому
+// клиент получает кадры в том порядке, в каком сервер их отправил.
+class Outbox
+{
+public:
+    // Код закрытия из диапазона private use (RFC 6455, 7.4.2) для медленного клиента.
+    static constexpr std::uint16_t slowConsumerCloseCode = 4008;
+    // Как часто отправитель возвращается к очереди, которую придержала оценка непрочитанного.
+    static constexpr std::chrono::milliseconds retryInterval{10};
+
+    using Clock = std::chrono::steady_clock;
+
+    enum class MessageKind : std::uint8_t
+    {
+        Regular,
+        Presence  // Более поздний кадр с тем же coalesceKey заменяет более ранний.
+    };
+
+    enum class PushResult : std::uint8_t
+    {
+        Queued,       // Отправитель уже запланирован.
+        FlushNeeded,  // Очередь была пуста, вызывающий должен вызвать UserContext::flushOutbox.
+        Dropped,      // Соединение закрыто или признано медленным, сообщение отброшено.
+        Overflow      // Лимит не удержать без потери сообщений чатов, соединение нужно закрыть.
+    };
+
+    enum class TakeResult : std::uint8_t
+    {
+        Batch,     // batch дополнен, после отправки вызвать takeBatch снова.
+        Drained,   // Очередь пуста, отправка снята с плана.
+        Throttled  // Клиент не успевает читать: повторить через retryInterval, отправка остаётся за вызывающим.
+    };
+
+    struct Entry
+    {
+        SharedPayload payload;
+        MessageKind kind = MessageKind::Regular;
+        std::uint64_t coalesceKey = 0;
+    };
+
+    struct Stats
+    {
+        std::size_t queuedBytes = 0;
+        std::size_t queuedMessages = 0;
+        std::size_t inFlightBytes = 0;      // Оценка на момент последней отправки.
+        std::size_t peakBytes = 0;
+        std::uint64_t droppedMessages = 0;  // Отброшены по лимитам; после close() не считаются.
+        std::uint64_t coalescedMessages = 0;
+        bool overflowed = false;            // Соединение закрыто кодом slowConsumerCloseCode.
+    };
+
+    void setLimits(const OutboxLimits& limits);
+
+    PushResult push(SharedPayload payload, MessageKind kind = MessageKind::Regular, std::uint64_t coalesceKey = 0);
+    // Ставит ответ соединению в очередь, если её отправка запланирована и ещё не закончена;
+    // nullopt -- очередь пуста и никем не отправляется, ответ можно передать в Crow сразу.
+    std::optional<PushResult> pushBehindPending(SharedPayload payload);
+    [[nodiscard]] bool flushPending() const;
+    // Переносит в batch столько кадров из начала очереди, сколько позволяет оценка непрочитанного.
+    TakeResult takeBatch(std::vector<Entry>& batch, Clock::time_point now = Clock::now());
+    // Учитывает байты, переданные в Crow, включая ответы, отправленные сразу.
+    void recordSent(std::size_t bytes, Clock::time_point now = Clock::now());
+    // Соединение закрыто: очередь очищается, новые сообщения отбрасываются.
+    void close();
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    // Вызываются под mutex_.
+    void drainLocked(Clock::time_point now);
+    // false -- лимиты не удержать, соединение закрыто.
+    [[nodiscard]] bool enforceLimitsLocked();
+    PushResult pushLocked(SharedPayload payload, MessageKind kind, std::uint64_t coalesceKey);
+    void coalescePresenceLocked();
+    void dropOldestPresenceLocked();
+    void popFrontLocked();
+    [[nodiscard]] bool overLimitsLocked() const;
+    void publishDepthLocked();
+
+private:
+    mutable std::mutex mutex_;
+    OutboxLimits limits_;
+    // Блоки очереди -- из общего пула: соединения открываются и закрываются без malloc на очередь.
+    std::pmr::deque<Entry> queue_{ObjectPool::resource()};
+    std::size_t bytes_ = 0;
+    std::size_t inFlight_ = 0;
+    Clock::time_point drainedAt_{};
+    bool flushScheduled_ = false;
+    bool closed_ = false;
+
+    // Копии счётчиков для чтения без блокировки (метрики, отладка).
+    std::atomic<std::size_t> queuedBytes_{0};
+    std::atomic<std::size_t> queuedMessages_{0};
+    std::atomic<std::size_t> inFlightBytes_{0};
+    std::atomic<std::size_t> peakBytes_{0};
+    std::atomic<std::uint64_t> droppedMessages_{0};
+    std::atomic<std::uint64_t> coalescedMessages_{0};
+    std::atomic<bool> overflowed_{false};
+};
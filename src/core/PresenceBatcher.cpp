@@ -0,0 +1,53 @@
+#include "core/PresenceBatcher.hpp"
+
+#include <algorithm>
+#include <utility>
+
+std::optional<PresenceScope> parsePresenceScope(std::string_view name)
+{
+    if (name.empty() || name == "all")
+        return PresenceScope::All;
+    if (name == "rooms")
+        return PresenceScope::Rooms;
+    if (name == "none")
+        return PresenceScope::None;
+    return std::nullopt;
+}
+
+bool PresenceBatcher::add(Change change)
+{
+    std::scoped_lock lock(mutex_);
+    const auto [it, inserted] = changes_.try_emplace(change.userId);
+    if (!inserted && it->second.kind != change.kind)
+    {
+        // Противоположное событие в том же окне: для получателей ничего не изменилось.
+        changes_.erase(it);
+    }
+    else
+    {
+        it->second = std::move(change);
+    }
+    return !std::exchange(scheduled_, true);
+}
+
+std::vector<PresenceBatcher::Change> PresenceBatcher::take()
+{
+    std::vector<Change> changes;
+    {
+        std::scoped_lock lock(mutex_);
+        scheduled_ = false;
+        changes.reserve(changes_.size());
+        for (auto& [userId, change] : changes_)
+            changes.push_back(std::move(change));
+        changes_.clear();
+    }
+    std::sort(changes.begin(), changes.end(),
+              [](const Change& left, const Change& right) { return left.userId < right.userId; });
+    return changes;
+}
+
+std::size_t PresenceBatcher::pending() const
+{
+    std::scoped_lock lock(mutex_);
+    return changes_.size();
+}
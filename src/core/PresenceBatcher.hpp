@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "core/Types.hpp"
+
+// О чьих входах и выходах соединение получает user-changes.
+enum class PresenceScope : std::uint8_t
+{
+    All,    // Обо всех пользователях сервера.
+    Rooms,  // Только о тех, с кем есть общая комната.
+    None    // Ни о ком.
+};
+
+// "all", "rooms", "none"; пустая строка -- All.
+std::optional<PresenceScope> parsePresenceScope(std::string_view name);
+
+// Накопитель изменений присутствия за окно рассылки.
+// События одного пользователя схлопываются: вход и выход в одном окне взаимно уничтожаются,
+// поэтому получатели не видят пользователей, которые успели войти и выйти между рассылками.
+class PresenceBatcher
+{
+public:
+    enum class Kind : std::uint8_t
+    {
+        Registered,
+        Logout
+    };
+
+    struct Change
+    {
+        IDType userId = 0;
+        Kind kind = Kind::Registered;
+        std::string username;
+        std::vector<IDType> roomIds;  // Комнаты пользователя в момент события, по возрастанию: для PresenceScope::Rooms.
+    };
+
+    // true, если рассылка ещё не запланирована: вызывающий планирует take() через окно.
+    bool add(Change change);
+    // Забирает накопленное, по возрастанию userId; следующий add() начнёт новое окно.
+    std::vector<Change> take();
+
+    [[nodiscard]] std::size_t pending() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<IDType, Change> changes_;
+    bool scheduled_ = false;
+};
@@ -1,48 +1,175 @@
 #include "core/Room.hpp"
+
+#include <algorithm>
+#include <atomic>
+
 #include "Types.hpp"
 
-Room::Room(IDType roomId, Type type, const std::string& name) : roomId_(roomId), type_(type), name_(name)
+Room::Room(IDType roomId, Type type, const std::string& name, bool persistent, std::size_t recentMessages)
+    : roomId_(roomId), type_(type), persistent_(persistent), name_(name), recent_(recentMessages)
 {
+    members_->keepAlive = generation_;
 }
 
-void Room::broadcast(const std::string& message) const
+Room::Generation::~Generation()
 {
-    for (const auto& user : users_)
+    // Цепочка может быть длинной, пока медленная рассылка держит старый снимок: разбираем её без рекурсии.
+    while (next != nullptr && next.use_count() == 1)
     {
-        if (user != nullptr && user->connection != nullptr)
+        next = std::move(next->next);
+    }
+}
+
+RecipientList Room::snapshot() const
+{
+    std::scoped_lock lock(mutex_);
+    return members_;
+}
+
+Recipients& Room::mutableMembersLocked()
+{
+    // Новые ссылки на members_ появляются только под mutex_, поэтому use_count() == 1 значит,
+    // что рассылок с этим снимком не осталось. Барьер упорядочивает их последние чтения с нашей записью.
+    if (members_.use_count() != 1)
+    {
+        members_ = std::make_shared<Recipients>(*members_);
+    }
+    else
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return *members_;
+}
+
+WireFormatSet Room::formatsLocked() const
+{
+    WireFormatSet formats;
+    for (std::size_t index = 0; index < formatCounts_.size(); ++index)
+    {
+        if (formatCounts_[index] != 0)
         {
-            user->connection->send_text(message);
+            formats.insert(WireFormat{static_cast<WireCodec>(index / 2), index % 2 != 0});
         }
     }
+    return formats;
+}
+
+void Room::countFormatLocked(const UserContextPtr& user, std::int32_t delta)
+{
+    formatCounts_[user->format.index()] += static_cast<std::uint32_t>(delta);
+}
+
+void Room::rememberMessage(StoredMessage message)
+{
+    std::scoped_lock lock(recentMutex_);
+    recent_.push(std::move(message));
+}
+
+void Room::seedRecentMessages(std::vector<StoredMessage> messages, bool olderExist)
+{
+    std::scoped_lock lock(recentMutex_);
+    if (olderExist && !messages.empty())
+    {
+        recent_.setCoveredFrom(messages.front().serverMessageId);
+    }
+    for (auto& message : messages)
+    {
+        recent_.push(std::move(message));
+    }
+}
+
+MessageRing::Page Room::recentAfter(std::uint64_t afterId, std::size_t limit) const
+{
+    std::scoped_lock lock(recentMutex_);
+    return recent_.after(afterId, limit);
+}
+
+MessageRing::Page Room::recentBefore(std::uint64_t beforeId, std::size_t limit) const
+{
+    std::scoped_lock lock(recentMutex_);
+    return recent_.before(beforeId, limit);
 }
 
 void Room::setName(const std::string& name)
 {
+    std::scoped_lock lock(mutex_);
     name_ = name;
 }
-const std::string& Room::getName() const
+std::string Room::getName() const
 {
+    std::scoped_lock lock(mutex_);
     return name_;
 }
 
-void Room::addUser(const UserContextPtr& user)
+bool Room::addUser(const UserContextPtr& user)
 {
-    users_.insert(user);
+    std::scoped_lock lock(mutex_);
+    if (closed_)
+    {
+        return false;
+    }
+    const auto& users = members_->users;
+    const auto it = std::lower_bound(users.begin(), users.end(), user.get());
+    if (it != users.end() && *it == user.get())
+    {
+        return true;
+    }
+    const auto offset = it - users.begin();
+    auto& members = mutableMembersLocked();
+    members.users.insert(members.users.begin() + offset, user.get());
+    owners_.insert(owners_.begin() + offset, user);
+    countFormatLocked(user, 1);
+    return true;
 }
 
-void Room::removeUser(const UserContextPtr& user)
+bool Room::removeUser(const UserContextPtr& user)
 {
-    users_.erase(user);
+    std::scoped_lock lock(mutex_);
+    const auto& users = members_->users;
+    const auto it = std::lower_bound(users.begin(), users.end(), user.get());
+    if (it != users.end() && *it == user.get())
+    {
+        const auto offset = it - users.begin();
+        auto& members = mutableMembersLocked();
+        members.users.erase(members.users.begin() + offset);
+        auto owner = std::move(owners_[offset]);
+        owners_.erase(owners_.begin() + offset);
+        countFormatLocked(user, -1);
+
+        // Поколение держат только комната и её снимок -- ни одна рассылка не видит удалённого,
+        // и ссылку можно отпустить. Иначе она уходит в это поколение, а комната начинает новое.
+        if (generation_.use_count() > 2)
+        {
+            auto next = std::make_shared<Generation>();
+            generation_->retired.push_back(std::move(owner));
+            generation_->next = next;
+            generation_ = std::move(next);
+            members.keepAlive = generation_;
+        }
+        else
+        {
+            // Как в mutableMembersLocked: последние обращения рассылок к участнику -- до его удаления.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+    }
+    if (!persistent_ && members_->users.empty())
+    {
+        closed_ = true;
+    }
+    return closed_;
 }
 
 bool Room::hasUser(const UserContextPtr& user) const
 {
-    return users_.contains(user);
+    std::scoped_lock lock(mutex_);
+    const auto& users = members_->users;
+    return std::binary_search(users.begin(), users.end(), user.get());
 }
 
 bool Room::empty() const
 {
-    return users_.empty();
+    std::scoped_lock lock(mutex_);
+    return members_->users.empty();
 }
 
 IDType Room::id() const
@@ -54,4 +181,3 @@ Room::Type Room::type() const
 {
     return type_;
 }
-
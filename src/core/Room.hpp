@@ -1,14 +1,18 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <memory>
-#include <set>
+#include <mutex>
 #include <string>
+#include <vector>
 
+#include "core/FanoutExecutor.hpp"
+#include "core/Latency.hpp"
+#include "core/MessageRing.hpp"
 #include "core/Types.hpp"
 #include "core/UserContext.hpp"
 
-using UserContextPtr = std::shared_ptr<UserContext>;
-
 class Room
 {
 public:
@@ -18,25 +22,91 @@ public:
         Public
     };
 
-    Room() = default;
-    Room(IDType roomId, Type type, const std::string& name);
+    Room() : Room(0, Type::Public, std::string{}) {}
+    // persistent-комната не закрывается, когда из неё выходит последний пользователь.
+    // recentMessages -- сколько последних сообщений держать в памяти для запросов истории.
+    Room(IDType roomId, Type type, const std::string& name, bool persistent = false,
+         std::size_t recentMessages = HistoryOptions{}.recentMessagesPerRoom);
+
+    // makeMessage(WireFormatSet) вызывается под блокировкой комнаты с набором форматов участников
+    // и возвращает WirePayloads: порядок постановки в очередь рассылки совпадает с порядком,
+    // в котором сообщения получили свои server-message-id.
+    // Сама доставка выполняется потоком executor, блокировка держится только на время снимка.
+    // receivedAt -- когда получен кадр, вызвавший рассылку: от него считается задержка до последнего получателя.
+    // Возвращает число получателей.
+    template<typename MakeMessage>
+    std::size_t broadcast(FanoutExecutor& executor, MakeMessage&& makeMessage,
+                          LatencyStats::Clock::time_point receivedAt = {}) const
+    {
+        const auto lockRequestedAt = LatencyStats::Clock::now();
+        std::scoped_lock lock(mutex_);
+        const auto lockedAt = LatencyStats::Clock::now();
+        LatencyStats::record(LatencyStage::LockWait, lockRequestedAt, lockedAt);
+
+        const auto recipients = members_->users.size();
+        auto message = makeMessage(formatsLocked());
+        LatencyStats::record(LatencyStage::Serialize, lockedAt, LatencyStats::Clock::now());
+        executor.post(roomId_, members_, std::move(message), Outbox::MessageKind::Regular, 0, receivedAt);
+        return recipients;
+    }
 
-    void broadcast(const std::string& message) const;
-    void addUser(const UserContextPtr& user);
-    void removeUser(const UserContextPtr& user);
+    [[nodiscard]] RecipientList snapshot() const;
+    // false, если комната уже закрыта и удаляется.
+    bool addUser(const UserContextPtr& user);
+    // true, если пользователь был последним и комната закрылась.
+    bool removeUser(const UserContextPtr& user);
     
+    // Запоминает сообщение в кольце последних; можно вызывать из makeMessage внутри broadcast.
+    void rememberMessage(StoredMessage message);
+    // Начальное содержимое кольца: messages по возрастанию ID, более старые сообщения -- только в журнале.
+    void seedRecentMessages(std::vector<StoredMessage> messages, bool olderExist);
+    [[nodiscard]] MessageRing::Page recentAfter(std::uint64_t afterId, std::size_t limit) const;
+    [[nodiscard]] MessageRing::Page recentBefore(std::uint64_t beforeId, std::size_t limit) const;
+
     void setName(const std::string& name);
-    const std::string& getName() const;
+    std::string getName() const;
 
     [[nodiscard]] bool hasUser(const UserContextPtr& user) const;
     [[nodiscard]] bool empty() const;
     [[nodiscard]] IDType id() const;
     [[nodiscard]] Type type() const;
 
+private:
+    // Снимок участников, который можно менять: если он ещё у рассылки, сначала копируется.
+    Recipients& mutableMembersLocked();
+    WireFormatSet formatsLocked() const;
+    void countFormatLocked(const UserContextPtr& user, std::int32_t delta);
+
 private:
     IDType roomId_ = 0;
-    std::string name_;
     Type type_ = Type::Public;
-    std::set<UserContextPtr> users_;
+    bool persistent_ = false;
+    bool closed_ = false;
+    std::string name_;
+    // Снимки участников, отданные рассылкам, держат поколение, в котором их сменил следующий снимок.
+    // Удалённый участник попадает в retired текущего поколения, а поколения связаны цепочкой next:
+    // он жив, пока жив любой снимок, в котором он ещё был.
+    struct Generation
+    {
+        std::vector<UserContextPtr> retired;
+        std::shared_ptr<Generation> next;
+
+        ~Generation();
+    };
+
+    // Участники, упорядоченные по адресу UserContext: поиск -- бинарный по непрерывному массиву
+    // без разыменования. Этот же вектор отдаётся рассылкам как снимок (copy-on-write); в нём
+    // только указатели, поэтому копия -- memcpy без счётчиков ссылок.
+    std::shared_ptr<Recipients> members_ = std::make_shared<Recipients>();
+    // Владеющие ссылки на участников, в том же порядке, что members_->users. Не копируется.
+    std::vector<UserContextPtr> owners_;
+    std::shared_ptr<Generation> generation_ = std::make_shared<Generation>();
+    // Число участников каждого формата; формат пользователя не меняется после регистрации.
+    std::array<std::uint32_t, wireFormatCount> formatCounts_{};
+    mutable std::mutex mutex_;
+    // Отдельный мьютекс: история читается без блокировки рассылок комнаты.
+    MessageRing recent_;
+    mutable std::mutex recentMutex_;
 };
 
+using RoomPtr = std::shared_ptr<Room>;
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+
+// Хеш-таблица, разбитая на шарды со своим shared_mutex.
+// Читатели разных ключей не мешают друг другу, писатель блокирует только свой шард.
+template<typename Key, typename Value, std::size_t ShardCount = 16, typename Hash = std::hash<Key>>
+class ShardedMap
+{
+    static_assert(ShardCount > 0 && (ShardCount & (ShardCount - 1)) == 0, "ShardCount must be a power of two");
+
+public:
+    [[nodiscard]] std::optional<Value> find(const Key& key) const
+    {
+        const auto& shard = shardFor(key);
+        std::shared_lock lock(shard.mutex);
+        const auto it = shard.map.find(key);
+        if (it == shard.map.end())
+        {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    [[nodiscard]] bool contains(const Key& key) const
+    {
+        const auto& shard = shardFor(key);
+        std::shared_lock lock(shard.mutex);
+        return shard.map.contains(key);
+    }
+
+    void insertOrAssign(const Key& key, Value value)
+    {
+        auto& shard = shardFor(key);
+        std::unique_lock lock(shard.mutex);
+        shard.map.insert_or_assign(key, std::move(value));
+    }
+
+    // false, если ключ уже занят.
+    bool tryInsert(const Key& key, Value value)
+    {
+        auto& shard = shardFor(key);
+        std::unique_lock lock(shard.mutex);
+        return shard.map.try_emplace(key, std::move(value)).second;
+    }
+
+    std::optional<Value> erase(const Key& key)
+    {
+        auto& shard = shardFor(key);
+        std::unique_lock lock(shard.mutex);
+        const auto it = shard.map.find(key);
+        if (it == shard.map.end())
+        {
+            return std::nullopt;
+        }
+        auto value = std::move(it->second);
+        shard.map.erase(it);
+        return value;
+    }
+
+    // Удаляет ключ, только если predicate(value) вернул true под блокировкой шарда.
+    template<typename Predicate>
+    bool eraseIf(const Key& key, Predicate&& predicate)
+    {
+        auto& shard = shardFor(key);
+        std::unique_lock lock(shard.mutex);
+        const auto it = shard.map.find(key);
+        if (it == shard.map.end() || !predicate(it->second))
+        {
+            return false;
+        }
+        shard.map.erase(it);
+        return true;
+    }
+
+    // Заменяет значение, только если ключ есть и predicate(value) вернул true под блокировкой шарда.
+    template<typename Predicate>
+    bool assignIf(const Key& key, Predicate&& predicate, Value value)
+    {
+        auto& shard = shardFor(key);
+        std::unique_lock lock(shard.mutex);
+        const auto it = shard.map.find(key);
+        if (it == shard.map.end() || !predicate(it->second))
+        {
+            return false;
+        }
+        it->second = std::move(value);
+        return true;
+    }
+
+    // Обход по шардам: каждый шард блокируется на чтение по очереди,
+    // поэтому обход не является атомарным снимком всей таблицы.
+    template<typename Func>
+    void forEach(Func&& func) const
+    {
+        for (const auto& shard : shards_)
+        {
+            std::shared_lock lock(shard.mutex);
+            for (const auto& [key, value] : shard.map)
+            {
+                func(key, value);
+            }
+        }
+    }
+
+    [[nodiscard]] std::size_t size() const
+    {
+        std::size_t result = 0;
+        for (const auto& shard : shards_)
+        {
+            std::shared_lock lock(shard.mutex);
+            result += shard.map.size();
+        }
+        return result;
+    }
+
+private:
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<Key, Value, Hash> map;
+    };
+
+    Shard& shardFor(const Key& key)
+    {
+        return shards_[mix(Hash{}(key)) & (ShardCount - 1)];
+    }
+
+    const Shard& shardFor(const Key& key) const
+    {
+        return shards_[mix(Hash{}(key)) & (ShardCount - 1)];
+    }
+
+    // std::hash для указателей и целых -- тождественная функция, младшие биты плохо распределены.
+    static std::size_t mix(std::size_t value)
+    {
+        value ^= value >> 33;
+        value *= 0xff51afd7ed558ccdULL;
+        value ^= value >> 33;
+        return value;
+    }
+
+private:
+    std::array<Shard, ShardCount> shards_;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+
+#include "protocol/WireCodec.hpp"
+
+// Неизменяемое сериализованное сообщение, общее для всех получателей рассылки.
+// Сериализуется один раз, дальше по очередям передаётся только указатель.
+using SharedPayload = std::shared_ptr<const std::string>;
+
+[[nodiscard]] inline SharedPayload makeSharedPayload(std::string&& message)
+{
+    return std::make_shared<const std::string>(std::move(message));
+}
+
+// Одна рассылка в форматах её получателей: каждая кодировка сериализуется и сжимается не более одного раза,
+// получатель берёт указатель на payload своего формата.
+struct WirePayloads
+{
+    std::array<SharedPayload, wireFormatCount> byFormat;
+
+    [[nodiscard]] const SharedPayload& forFormat(WireFormat format) const
+    {
+        return byFormat[format.index()];
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        for (const auto& payload : byFormat)
+        {
+            if (payload != nullptr)
+                return false;
+        }
+        return true;
+    }
+};
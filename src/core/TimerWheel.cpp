@@ -0,0 +1,162 @@
+#include "core/TimerWheel.hpp"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick)
+    : tick_(std::max(tick, std::chrono::milliseconds(1))), start_(Clock::now())
+{
+    worker_ = std::thread([this]() { run(); });
+}
+
+TimerWheel::~TimerWheel()
+{
+    stop();
+}
+
+TimerWheel::TimerId TimerWheel::schedule(std::chrono::milliseconds delay, Callback callback)
+{
+    const auto ticks = std::max<std::uint64_t>(1, (delay.count() + tick_.count() - 1) / tick_.count());
+
+    std::scoped_lock lock(mutex_);
+    if (stopped_)
+    {
+        return invalidTimer;
+    }
+
+    const TimerId id = nextId_++;
+    Slot staging;
+    staging.push_back(Timer{id, currentTick_ + ticks, std::move(callback)});
+    place(staging, staging.begin());
+    return id;
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+    std::scoped_lock lock(mutex_);
+    const auto it = index_.find(id);
+    if (it == index_.end())
+    {
+        return false;
+    }
+    it->second.slot->erase(it->second.it);
+    index_.erase(it);
+    return true;
+}
+
+void TimerWheel::stop()
+{
+    {
+        std::scoped_lock lock(mutex_);
+        if (stopped_)
+        {
+            return;
+        }
+        stopped_ = true;
+        for (auto& level : levels_)
+        {
+            for (auto& slot : level)
+            {
+                slot.clear();
+            }
+        }
+        index_.clear();
+    }
+    wakeup_.notify_all();
+    if (worker_.joinable() && worker_.get_id() != std::this_thread::get_id())
+    {
+        worker_.join();
+    }
+}
+
+std::size_t TimerWheel::pending() const
+{
+    std::scoped_lock lock(mutex_);
+    return index_.size();
+}
+
+void TimerWheel::run()
+{
+    std::vector<Callback> expired;
+    std::unique_lock lock(mutex_);
+    while (!stopped_)
+    {
+        const auto nextTickTime = start_ + tick_ * (currentTick_ + 1);
+        if (wakeup_.wait_until(lock, nextTickTime, [this]() { return stopped_; }))
+        {
+            break;
+        }
+
+        // После долгого простоя догоняем все пропущенные тики разом.
+        const auto now = Clock::now();
+        while (start_ + tick_ * (currentTick_ + 1) <= now)
+        {
+            advance(expired);
+        }
+
+        if (expired.empty())
+        {
+            continue;
+        }
+
+        lock.unlock();
+        for (auto& callback : expired)
+        {
+            callback();
+        }
+        expired.clear();
+        lock.lock();
+    }
+}
+
+void TimerWheel::advance(std::vector<Callback>& expired)
+{
+    ++currentTick_;
+
+    // Когда младший уровень совершает полный оборот, переносим ближайший слот старшего уровня вниз.
+    for (std::size_t level = 1; level < levelCount; ++level)
+    {
+        if ((currentTick_ & ((std::uint64_t{1} << (levelBits * level)) - 1)) != 0)
+        {
+            break;
+        }
+        cascade(level);
+    }
+
+    auto& slot = levels_[0][currentTick_ & (slotsPerLevel - 1)];
+    for (auto& timer : slot)
+    {
+        index_.erase(timer.id);
+        expired.push_back(std::move(timer.callback));
+    }
+    slot.clear();
+}
+
+void TimerWheel::cascade(std::size_t level)
+{
+    auto& slot = levels_[level][(currentTick_ >> (levelBits * level)) & (slotsPerLevel - 1)];
+    while (!slot.empty())
+    {
+        place(slot, slot.begin());
+    }
+}
+
+void TimerWheel::place(Slot& source, Slot::iterator it)
+{
+    const auto expiry = std::max(it->expiryTick, currentTick_);
+    const auto delta = expiry - currentTick_;
+
+    std::size_t level = 0;
+    while (level + 1 < levelCount && delta >= (std::uint64_t{1} << (levelBits * (level + 1))))
+    {
+        ++level;
+    }
+
+    // Таймеры дальше горизонта колеса ждут в последнем уровне и перекладываются при каждом обороте.
+    const auto slotTick = level + 1 == levelCount && delta >= (std::uint64_t{1} << (levelBits * levelCount))
+        ? currentTick_ + (std::uint64_t{1} << (levelBits * level)) * (slotsPerLevel - 1)
+        : expiry;
+
+    auto& target = levels_[level][(slotTick >> (levelBits * level)) & (slotsPerLevel - 1)];
+    target.splice(target.end(), source, it);
+    index_[it->id] = Location{&target, it};
+}
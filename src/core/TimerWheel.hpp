@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Иерархическое колесо таймеров с одним фоновым потоком.
+// Постановка и отмена таймера -- O(1), колбэки выполняются в потоке колеса.
+// Деструктор останавливает поток, поэтому после него ни один колбэк уже не будет вызван.
+class TimerWheel
+{
+public:
+    using TimerId = std::uint64_t;
+    using Callback = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr TimerId invalidTimer = 0;
+
+    explicit TimerWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(100));
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    TimerId schedule(std::chrono::milliseconds delay, Callback callback);
+    // true, если таймер был снят до срабатывания.
+    bool cancel(TimerId id);
+    void stop();
+
+    [[nodiscard]] std::size_t pending() const;
+
+private:
+    static constexpr std::size_t levelBits = 6;
+    static constexpr std::size_t slotsPerLevel = std::size_t{1} << levelBits;
+    static constexpr std::size_t levelCount = 4;
+
+    struct Timer
+    {
+        TimerId id = invalidTimer;
+        std::uint64_t expiryTick = 0;
+        Callback callback;
+    };
+    using Slot = std::list<Timer>;
+
+    struct Location
+    {
+        Slot* slot = nullptr;
+        Slot::iterator it;
+    };
+
+    void run();
+    void advance(std::vector<Callback>& expired);
+    void place(Slot& source, Slot::iterator it);
+    void cascade(std::size_t level);
+
+private:
+    const std::chrono::milliseconds tick_;
+    const Clock::time_point start_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stopped_ = false;
+
+    std::uint64_t currentTick_ = 0;
+    TimerId nextId_ = 1;
+    std::array<std::array<Slot, slotsPerLevel>, levelCount> levels_;
+    std::unordered_map<TimerId, Location> index_;
+
+    std::thread worker_;
+};
@@ -0,0 +1,173 @@
+#include "core/UserContext.hpp"
+
+#include <algorithm>
+#include <utility>
+
+bool UserContext::send(std::string message)
+{
+    std::scoped_lock lock(mutex_);
+    if (detached_ || connection == nullptr)
+    {
+        return false;
+    }
+    if (outbox.flushPending())
+    {
+        return sendBehindOutboxLocked(makeSharedPayload(std::move(message)), false);
+    }
+    outbox.recordSent(sendLocked(std::move(message), false));
+    return true;
+}
+
+void UserContext::close(const std::string& reason, std::uint16_t closeCode)
+{
+    std::scoped_lock lock(mutex_);
+    if (!detached_ && connection != nullptr)
+    {
+        connection->close(reason, closeCode);
+    }
+}
+
+bool UserContext::send(const SharedPayload& message)
+{
+    std::scoped_lock lock(mutex_);
+    if (detached_ || connection == nullptr || message == nullptr)
+    {
+        return false;
+    }
+    if (outbox.flushPending())
+    {
+        return sendBehindOutboxLocked(message, false);
+    }
+    outbox.recordSent(sendLocked(*message, false));
+    return true;
+}
+
+bool UserContext::send(const WirePayloads& message)
+{
+    std::scoped_lock lock(mutex_);
+    const auto& payload = message.forFormat(format);
+    if (detached_ || connection == nullptr || payload == nullptr)
+    {
+        return false;
+    }
+    if (outbox.flushPending())
+    {
+        return sendBehindOutboxLocked(payload, format.sharedDeflate);
+    }
+    outbox.recordSent(sendLocked(*payload, format.sharedDeflate));
+    return true;
+}
+
+bool UserContext::flushOutbox()
+{
+    // Один вектор на поток рассылки: пачки не выделяют память заново для каждого соединения.
+    thread_local std::vector<Outbox::Entry> batch;
+    while (true)
+    {
+        const auto result = outbox.takeBatch(batch);
+        if (result != Outbox::TakeResult::Batch)
+        {
+            return result == Outbox::TakeResult::Throttled;
+        }
+        {
+            std::scoped_lock lock(mutex_);
+            if (!detached_ && connection != nullptr)
+            {
+                std::size_t sent = 0;
+                for (const auto& entry : batch)
+                {
+                    // Рассылки приходят в формате format: при общем сжатии уже сжатыми.
+                    sent += sendLocked(*entry.payload, format.sharedDeflate);
+                }
+                outbox.recordSent(sent);
+            }
+        }
+        batch.clear();
+    }
+}
+
+bool UserContext::sendBehindOutboxLocked(SharedPayload message, bool compressed)
+{
+    // Очередь отправляется с compressed = format.sharedDeflate: при общем сжатии ответ сжимается здесь,
+    // собственный компрессор соединения сжимает кадры при отправке, в порядке очереди.
+    if (format.sharedDeflate && !compressed && compressor != nullptr)
+    {
+        message = makeSharedPayload(compressor->compress(*message));
+    }
+    const auto result = outbox.pushBehindPending(message);
+    if (!result.has_value())
+    {
+        // Отправитель успел опустошить очередь: кадры до ответа уже в Crow.
+        outbox.recordSent(sendLocked(*message, format.sharedDeflate));
+        return true;
+    }
+    if (*result == Outbox::PushResult::Overflow)
+    {
+        connection->close("slow consumer", Outbox::slowConsumerCloseCode);
+    }
+    return *result == Outbox::PushResult::Queued;
+}
+
+std::size_t UserContext::sendLocked(std::string message, bool compressed)
+{
+    if (compressor != nullptr && !compressed)
+    {
+        message = compressor->compress(message);
+    }
+    const auto size = message.size();
+    if (compressor != nullptr || isBinaryCodec(format.codec))
+    {
+        connection->send_binary(std::move(message));
+    }
+    else
+    {
+        connection->send_text(std::move(message));
+    }
+    return size;
+}
+
+bool UserContext::joinRoom(IDType roomId)
+{
+    std::scoped_lock lock(mutex_);
+    if (detached_)
+    {
+        return false;
+    }
+    const auto it = std::lower_bound(roomIds_.begin(), roomIds_.end(), roomId);
+    if (it == roomIds_.end() || *it != roomId)
+    {
+        roomIds_.insert(it, roomId);
+    }
+    return true;
+}
+
+void UserContext::leaveRoom(IDType roomId)
+{
+    std::scoped_lock lock(mutex_);
+    const auto it = std::lower_bound(roomIds_.begin(), roomIds_.end(), roomId);
+    if (it != roomIds_.end() && *it == roomId)
+    {
+        roomIds_.erase(it);
+    }
+}
+
+bool UserContext::inRoom(IDType roomId) const
+{
+    std::scoped_lock lock(mutex_);
+    return std::binary_search(roomIds_.begin(), roomIds_.end(), roomId);
+}
+
+std::vector<IDType> UserContext::rooms() const
+{
+    std::scoped_lock lock(mutex_);
+    return roomIds_;
+}
+
+std::vector<IDType> UserContext::detach()
+{
+    std::scoped_lock lock(mutex_);
+    detached_ = true;
+    connection = nullptr;
+    outbox.close();
+    return std::exchange(roomIds_, {});
+}
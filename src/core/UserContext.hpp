@@ -2,23 +2,84 @@
 
 #include <atomic>
 #include <chrono>
-#include <set>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <crow/websocket.h>
 
+#include "core/Outbox.hpp"
+#include "core/PresenceBatcher.hpp"
+#include "core/SharedPayload.hpp"
+#include "core/TimerWheel.hpp"
 #include "core/Types.hpp"
+#include "protocol/DeflateCompressor.hpp"
+#include "protocol/WireCodec.hpp"
 
-struct UserContext
+struct UserContext : std::enable_shared_from_this<UserContext>
 {
     crow::websocket::connection* connection = nullptr;
     std::chrono::steady_clock::time_point connectionTime = std::chrono::steady_clock::now();
 
+    // Заполняются один раз при регистрации до authorized.store(true),
+    // читать их из чужих потоков можно только после проверки authorized.
     IDType userId = 0;
     std::string username;
     std::string password;
     std::string publicKey;
-    std::set<IDType> roomIds;
+    // Токен сессии из register-result; пусто, если сессии выключены.
+    std::string sessionToken;
+    // Кодировка и общее сжатие сообщений сервера; до регистрации всегда JSON без сжатия.
+    WireFormat format;
+    // Сжатие исходящих сообщений: nullptr -- без сжатия. При format.sharedDeflate это общий
+    // компрессор сервера (рассылки приходят уже сжатыми), иначе -- собственный компрессор соединения.
+    std::shared_ptr<DeflateCompressor> compressor;
+    // О ком соединение получает уведомления о пользователях.
+    PresenceScope presenceScope = PresenceScope::All;
+    // true -- пачкой user-changes, false -- прежними user-change по одному (клиент не просил user-changes).
+    bool presenceBatched = false;
     std::atomic_bool authorized = false;
     std::atomic_bool closing = false;
+    // Таймер ожидания регистрации; меняется только в потоке соединения.
+    TimerWheel::TimerId registrationTimer = TimerWheel::invalidTimer;
+
+    // Очередь рассылок; отправляется в соединение пачками через flushOutbox().
+    Outbox outbox;
+
+    // Отправка несжатого сообщения в кодировке format.codec: при необходимости сжимается здесь,
+    // кадр бинарный для MessagePack и для любого сжатого сообщения. После detach() сообщения молча отбрасываются.
+    // Пока outbox не отправлен, ответы встают в него за рассылками.
+    bool send(std::string message);
+    // Копия делается только здесь, при передаче в Crow: send_text/send_binary принимают строку по значению.
+    bool send(const SharedPayload& message);
+    // Берёт payload своего формата; при общем сжатии он уже сжат.
+    bool send(const WirePayloads& message);
+    // Отправляет накопленное в outbox; вызывается тем, кому push вернул FlushNeeded.
+    // true -- клиент не успевает читать и часть осталась в очереди: вызывающий повторяет через Outbox::retryInterval.
+    [[nodiscard]] bool flushOutbox();
+    void close(const std::string& reason, std::uint16_t closeCode);
+
+    bool joinRoom(IDType roomId);
+    void leaveRoom(IDType roomId);
+    [[nodiscard]] bool inRoom(IDType roomId) const;
+    [[nodiscard]] std::vector<IDType> rooms() const;
+
+    // Отвязывает соединение (вызывается из onWebSocketClose) и возвращает комнаты пользователя.
+    std::vector<IDType> detach();
+
+private:
+    // Вызывается под mutex_. Возвращает число байт, переданных в Crow.
+    std::size_t sendLocked(std::string message, bool compressed);
+    // Вызывается под mutex_, когда у outbox есть отправитель: ответ встаёт за рассылками,
+    // чтобы не обогнать их в соединении.
+    bool sendBehindOutboxLocked(SharedPayload message, bool compressed);
+
+private:
+    mutable std::mutex mutex_;
+    // Комнаты пользователя, по возрастанию ID: их немного, плоский вектор быстрее дерева.
+    std::vector<IDType> roomIds_;
+    bool detached_ = false;
 };
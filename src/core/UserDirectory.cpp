@@ -0,0 +1,153 @@
+#include "core/UserDirectory.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+
+#include "core/UsernameIndex.hpp"
+
+void UserDirectory::add(IDType userId, std::string username)
+{
+    std::scoped_lock lock(writeMutex_);
+    pending_.insert_or_assign(userId, std::move(username));
+}
+
+void UserDirectory::remove(IDType userId)
+{
+    std::scoped_lock lock(writeMutex_);
+    pending_.insert_or_assign(userId, std::nullopt);
+}
+
+void UserDirectory::publish()
+{
+    // Блокировка держится всю пересборку: два publish() не должны потерять изменения друг друга.
+    std::scoped_lock lock(writeMutex_);
+    if (pending_.empty())
+    {
+        return;
+    }
+
+    std::vector<std::pair<IDType, std::optional<std::string>>> changes(std::make_move_iterator(pending_.begin()),
+                                                                      std::make_move_iterator(pending_.end()));
+    pending_.clear();
+    std::sort(changes.begin(), changes.end(), [](const auto& left, const auto& right) { return left.first < right.first; });
+
+    const auto current = snapshot_.load();
+    auto next = std::make_shared<Snapshot>();
+
+    // Оба списка упорядочены по ID: слияние за один проход.
+    next->byId.reserve(current->byId.size() + changes.size());
+    auto change = changes.begin();
+    for (const auto& entry : current->byId)
+    {
+        for (; change != changes.end() && change->first < entry.userId; ++change)
+        {
+            if (change->second.has_value())
+                next->byId.push_back({change->first, *change->second});
+        }
+        if (change != changes.end() && change->first == entry.userId)
+        {
+            if (change->second.has_value())
+                next->byId.push_back({change->first, *change->second});
+            ++change;
+            continue;
+        }
+        next->byId.push_back(entry);
+    }
+    for (; change != changes.end(); ++change)
+    {
+        if (change->second.has_value())
+            next->byId.push_back({change->first, *change->second});
+    }
+
+    // Индекс имён: старые ключи без изменённых пользователей, слитые с отсортированными новыми.
+    const auto byFoldedName = [](const NameKey& left, const NameKey& right) {
+        return std::tie(left.folded, left.userId) < std::tie(right.folded, right.userId);
+    };
+    std::vector<IDType> changedIds;
+    std::vector<NameKey> added;
+    changedIds.reserve(changes.size());
+    for (const auto& [userId, username] : changes)
+    {
+        changedIds.push_back(userId);
+        if (username.has_value())
+            added.push_back({UsernameIndex::fold(*username), userId});
+    }
+    std::sort(added.begin(), added.end(), byFoldedName);
+    std::vector<NameKey> kept;
+    kept.reserve(current->byName.size());
+    std::copy_if(current->byName.begin(), current->byName.end(), std::back_inserter(kept), [&changedIds](const NameKey& key) {
+        return !std::binary_search(changedIds.begin(), changedIds.end(), key.userId);
+    });
+    next->byName.reserve(kept.size() + added.size());
+    std::merge(std::make_move_iterator(kept.begin()), std::make_move_iterator(kept.end()),
+               std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()),
+               std::back_inserter(next->byName), byFoldedName);
+
+    snapshot_.store(std::move(next));
+}
+
+UserDirectory::Page UserDirectory::page(IDType afterId, std::string_view prefix, std::size_t limit, IDType excludeId) const
+{
+    const auto snapshot = snapshot_.load();
+    Page page;
+    if (prefix.empty())
+    {
+        auto it = std::upper_bound(snapshot->byId.begin(), snapshot->byId.end(), afterId,
+                                   [](IDType userId, const Entry& entry) { return userId < entry.userId; });
+        for (; it != snapshot->byId.end(); ++it)
+        {
+            if (it->userId == excludeId)
+                continue;
+            if (page.users.size() == limit)
+            {
+                page.hasMore = true;
+                break;
+            }
+            page.users.emplace_back(it->userId, it->username);
+        }
+        return page;
+    }
+
+    // Совпадения по началу имени -- непрерывный диапазон индекса имён; из него нужны limit наименьших ID.
+    const auto folded = UsernameIndex::fold(prefix);
+    const auto first = std::lower_bound(snapshot->byName.begin(), snapshot->byName.end(), folded,
+                                        [](const NameKey& key, const std::string& value) { return key.folded < value; });
+    std::vector<IDType> matches;
+    for (auto it = first; it != snapshot->byName.end() && it->folded.starts_with(folded); ++it)
+    {
+        if (it->userId > afterId && it->userId != excludeId)
+            matches.push_back(it->userId);
+    }
+    page.hasMore = matches.size() > limit;
+    if (page.hasMore)
+    {
+        std::nth_element(matches.begin(), matches.begin() + static_cast<std::ptrdiff_t>(limit), matches.end());
+        matches.resize(limit);
+    }
+    std::sort(matches.begin(), matches.end());
+    page.users.reserve(matches.size());
+    for (const auto userId : matches)
+    {
+        if (const auto* username = findName(*snapshot, userId))
+            page.users.emplace_back(userId, *username);
+    }
+    return page;
+}
+
+bool UserDirectory::contains(IDType userId) const
+{
+    return findName(*snapshot_.load(), userId) != nullptr;
+}
+
+std::size_t UserDirectory::size() const
+{
+    return snapshot_.load()->byId.size();
+}
+
+const std::string* UserDirectory::findName(const Snapshot& snapshot, IDType userId)
+{
+    const auto it = std::lower_bound(snapshot.byId.begin(), snapshot.byId.end(), userId,
+                                     [](const Entry& entry, IDType value) { return entry.userId < value; });
+    return it != snapshot.byId.end() && it->userId == userId ? &it->username : nullptr;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "core/Types.hpp"
+
+// Список пользователей для data-request "users": страницы по user-id и поиск по началу имени.
+// Читатели берут неизменяемый снимок без блокировок; изменения копятся и публикуются новым снимком
+// (copy-on-write) в publish(), поэтому цена пересборки платится раз на пачку изменений, а не на каждое.
+class UserDirectory
+{
+public:
+    struct Page
+    {
+        std::vector<std::pair<IDType, std::string>> users;  // По возрастанию user-id.
+        bool hasMore = false;
+    };
+
+    // Изменения видны читателям после publish(), в порядке вызовов.
+    void add(IDType userId, std::string username);
+    void remove(IDType userId);
+    void publish();
+
+    // До limit пользователей с ID больше afterId, кроме excludeId; prefix сравнивается без учёта регистра.
+    [[nodiscard]] Page page(IDType afterId, std::string_view prefix, std::size_t limit, IDType excludeId) const;
+    [[nodiscard]] bool contains(IDType userId) const;
+    [[nodiscard]] std::size_t size() const;
+
+private:
+    struct Entry
+    {
+        IDType userId = 0;
+        std::string username;
+    };
+
+    struct NameKey
+    {
+        std::string folded;  // UsernameIndex::fold(username).
+        IDType userId = 0;
+    };
+
+    struct Snapshot
+    {
+        std::vector<Entry> byId;       // По возрастанию userId.
+        std::vector<NameKey> byName;   // По возрастанию (folded, userId).
+    };
+
+    [[nodiscard]] static const std::string* findName(const Snapshot& snapshot, IDType userId);
+
+private:
+    std::atomic<std::shared_ptr<const Snapshot>> snapshot_{std::make_shared<const Snapshot>()};
+
+    // Неопубликованные изменения: userId -> имя, nullopt -- удалён.
+    std::mutex writeMutex_;
+    std::unordered_map<IDType, std::optional<std::string>> pending_;
+};
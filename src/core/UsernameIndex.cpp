@@ -0,0 +1,69 @@
+#include "core/UsernameIndex.hpp"
+
+bool UsernameIndex::tryClaim(std::string_view username, const std::shared_ptr<UserContext>& user)
+{
+    return owners_.tryInsert(fold(username), user);
+}
+
+void UsernameIndex::release(std::string_view username, const std::shared_ptr<UserContext>& user)
+{
+    owners_.eraseIf(fold(username), [&](const std::shared_ptr<UserContext>& owner) {
+        return owner == user;
+    });
+}
+
+bool UsernameIndex::transfer(std::string_view username, const std::shared_ptr<UserContext>& from,
+                             const std::shared_ptr<UserContext>& to)
+{
+    return owners_.assignIf(fold(username), [&](const std::shared_ptr<UserContext>& owner) { return owner == from; }, to);
+}
+
+std::shared_ptr<UserContext> UsernameIndex::find(std::string_view username) const
+{
+    return owners_.find(fold(username)).value_or(nullptr);
+}
+
+std::size_t UsernameIndex::size() const
+{
+    return owners_.size();
+}
+
+std::string UsernameIndex::fold(std::string_view username)
+{
+    std::string result(username);
+    for (std::size_t i = 0; i < result.size(); ++i)
+    {
+        auto& byte = reinterpret_cast<unsigned char&>(result[i]);
+        if (byte >= 'A' && byte <= 'Z')
+        {
+            byte = static_cast<unsigned char>(byte + ('a' - 'A'));
+            continue;
+        }
+        if (byte != 0xD0 || i + 1 == result.size())
+        {
+            continue;
+        }
+
+        // Заглавные кириллицы U+0400..U+042F кодируются как D0 80..D0 AF.
+        auto& next = reinterpret_cast<unsigned char&>(result[i + 1]);
+        if (next >= 0x80 && next <= 0x8F)
+        {
+            // Ѐ..Џ -> ѐ..џ (U+0450..U+045F, D1 90..D1 9F).
+            byte = 0xD1;
+            next = static_cast<unsigned char>(next + 0x10);
+        }
+        else if (next >= 0x90 && next <= 0x9F)
+        {
+            // А..П -> а..п (U+0430..U+043F, D0 B0..D0 BF).
+            next = static_cast<unsigned char>(next + 0x20);
+        }
+        else if (next >= 0xA0 && next <= 0xAF)
+        {
+            // Р..Я -> р..я (U+0440..U+044F, D1 80..D1 8F).
+            byte = 0xD1;
+            next = static_cast<unsigned char>(next - 0x20);
+        }
+        ++i;
+    }
+    return result;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "core/ShardedMap.hpp"
+
+struct UserContext;
+
+// Индекс занятых имён пользователей без учёта регистра.
+// Имя занимает первый успешно зарегистрированный пользователь и держит его до отключения.
+// Потокобезопасен; один индекс может быть общим у нескольких серверов процесса (шардов).
+class UsernameIndex
+{
+public:
+    // false, если имя уже занято другим пользователем.
+    bool tryClaim(std::string_view username, const std::shared_ptr<UserContext>& user);
+    // Освобождает имя, только если его держит именно user.
+    void release(std::string_view username, const std::shared_ptr<UserContext>& user);
+    // Передаёт имя от from к to одним шагом: между ними имя не бывает свободным. false, если его держит не from.
+    bool transfer(std::string_view username, const std::shared_ptr<UserContext>& from,
+                  const std::shared_ptr<UserContext>& to);
+    [[nodiscard]] std::shared_ptr<UserContext> find(std::string_view username) const;
+    [[nodiscard]] std::size_t size() const;
+
+    // Ключ индекса: ASCII и кириллица приводятся к нижнему регистру, остальные байты не меняются.
+    [[nodiscard]] static std::string fold(std::string_view username);
+
+private:
+    ShardedMap<std::string, std::shared_ptr<UserContext>> owners_;
+};
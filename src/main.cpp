@@ -1,9 +1,125 @@
+#include <algorithm>
 #include <chrono>
+#include <csignal>
+#include <cstdint>
 #include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "ChatServer.hpp"
+#include "ShardListener.hpp"
 
+#include "core/CpuAffinity.hpp"
 #include "core/KeyGenerator.hpp"
+#include "core/Latency.hpp"
+#include "core/LocalSocketBus.hpp"
+#include "core/Logger.hpp"
+#include "core/UsernameIndex.hpp"
+
+namespace
+{
+
+// Журнал настраивается переменными окружения CHAT_LOG_LEVEL, CHAT_LOG_FILE и CHAT_LOG_PAYLOADS=1.
+LoggerOptions loggerOptionsFromEnvironment()
+{
+    LoggerOptions options;
+    if (const char* level = std::getenv("CHAT_LOG_LEVEL"))
+    {
+        options.level = parseLogLevel(level).value_or(options.level);
+    }
+    if (const char* file = std::getenv("CHAT_LOG_FILE"))
+    {
+        options.file = file;
+    }
+    if (const char* payloads = std::getenv("CHAT_LOG_PAYLOADS"))
+    {
+        options.logPayloads = std::string_view(payloads) == "1";
+    }
+    return options;
+}
+
+std::uint32_t numberFromEnvironment(const char* name, std::uint32_t fallback)
+{
+    const char* value = std::getenv(name);
+    return value != nullptr ? static_cast<std::uint32_t>(std::strtoul(value, nullptr, 10)) : fallback;
+}
+
+// CHAT_OUTBOX_DRAIN_KIB -- скорость чтения клиента в КиБ/с, по которой оценивается непрочитанное
+// (OutboxLimits::drainBytesPerSecond); 0 выключает оценку и лимиты очередей соединений.
+OutboxLimits outboxLimitsFromEnvironment()
+{
+    OutboxLimits limits;
+    const auto defaultKib = static_cast<std::uint32_t>(limits.drainBytesPerSecond / 1024);
+    limits.drainBytesPerSecond = std::size_t{numberFromEnvironment("CHAT_OUTBOX_DRAIN_KIB", defaultKib)} * 1024;
+    return limits;
+}
+
+// История сообщений на диске включается переменной CHAT_HISTORY_DIR; без неё у комнат есть только последние
+// сообщения в памяти. Экземпляру шины и шарду нужен свой журнал: instance -- имя подкаталога.
+HistoryOptions historyOptionsFromEnvironment(std::optional<std::uint32_t> instance)
+{
+    HistoryOptions options;
+    const char* directory = std::getenv("CHAT_HISTORY_DIR");
+    if (directory == nullptr || *directory == '\0')
+    {
+        return options;
+    }
+    options.directory = directory;
+    if (instance.has_value())
+    {
+        options.directory /= std::to_string(*instance);
+    }
+    return options;
+}
+
+// Несколько экземпляров на одной машине: общий каталог сокетов шины CHAT_BUS_DIR,
+// номер экземпляра CHAT_INSTANCE_ID (с 0) и их число CHAT_INSTANCE_COUNT.
+ClusterOptions clusterOptionsFromEnvironment()
+{
+    ClusterOptions options;
+    const char* directory = std::getenv("CHAT_BUS_DIR");
+    if (directory == nullptr)
+    {
+        return options;
+    }
+    options.bus = std::make_shared<LocalSocketBus>(directory, numberFromEnvironment("CHAT_INSTANCE_ID", 0));
+    options.instanceCount = numberFromEnvironment("CHAT_INSTANCE_COUNT", 1);
+    return options;
+}
+
+// CHAT_SHARDS=N: N серверов в одном процессе на общем порту (ShardListener). Каждый шард работает на своём ядре
+// с одним потоком соединений и одним потоком рассылки, его пользователи и комнаты не разделяются с другими
+// шардами; общие комнаты и присутствие идут между шардами через InProcessBus. Индекс имён общий: имя
+// уникально во всём процессе. Сессия продолжается только на шарде, где началась: новое соединение попадает
+// на любой шард, и с другого шарда клиент получает invalid-session и регистрируется заново.
+void runShards(std::uint16_t port, std::uint32_t shardCount)
+{
+    const auto hub = InProcessBus::makeHub();
+    const auto usernames = std::make_shared<UsernameIndex>();
+    const auto cpuCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::unique_ptr<ChatServer>> shards(shardCount);
+    for (std::uint32_t i = 0; i < shardCount; ++i)
+    {
+        // Сервер создаётся в привязанном потоке: его потоки рассылки, таймеров и шины наследуют привязку.
+        std::thread([&shards, &hub, &usernames, i, shardCount, cpuCount]() {
+            pinCurrentThreadToCpu(i % cpuCount);
+            ClusterOptions cluster{std::make_shared<InProcessBus>(hub, i), shardCount, usernames};
+            shards[i] = std::make_unique<ChatServer>("Messenger2 Server", "server-public-key-stub", std::chrono::seconds(20),
+                                                     outboxLimitsFromEnvironment(), CompressionOptions{},
+                                                     historyOptionsFromEnvironment(i), std::chrono::seconds(60),
+                                                     std::chrono::milliseconds(100), std::move(cluster), ThreadOptions{1, 1});
+        }).join();
+    }
+    ShardListener listener(std::move(shards));
+    listener.run(port);
+}
+
+} // namespace
 
 int main()
 {
@@ -11,9 +127,28 @@ int main()
     std::system("chcp 65001 > nul");
 #endif
 
-    ChatServer server("Messenger2 Server", "server-public-key-stub", std::chrono::seconds(20));
-    std::cout << "Server key: " << KeyGenerator::generateKey("10.241.69.217", 18080) << '\n';
-    server.run(18080);
+    Logger::start(loggerOptionsFromEnvironment());
+#ifdef SIGUSR1
+    // kill -USR1 <pid>: сводка задержек по этапам в журнал.
+    std::signal(SIGUSR1, [](int) { LatencyStats::requestReport(); });
+#endif
+    const auto port = static_cast<std::uint16_t>(numberFromEnvironment("CHAT_PORT", 18080));
+    if (const auto shardCount = numberFromEnvironment("CHAT_SHARDS", 1); shardCount > 1)
+    {
+        std::cout << "Server key: " << KeyGenerator::generateKey("10.241.69.217", port) << '\n';
+        runShards(port, shardCount);
+    }
+    else
+    {
+        auto cluster = clusterOptionsFromEnvironment();
+        auto history = historyOptionsFromEnvironment(
+            cluster.bus != nullptr ? std::optional<std::uint32_t>(cluster.bus->instanceId()) : std::nullopt);
+        ChatServer server("Messenger2 Server", "server-public-key-stub", std::chrono::seconds(20), outboxLimitsFromEnvironment(),
+                          {}, std::move(history), std::chrono::seconds(60), std::chrono::milliseconds(100), std::move(cluster));
+        std::cout << "Server key: " << KeyGenerator::generateKey("10.241.69.217", port) << '\n';
+        server.run(port);
+    }
+    Logger::stop();
 
     return 0;
-}
\ No newline at end of file
+}
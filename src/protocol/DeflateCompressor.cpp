@@ -0,0 +1,166 @@
+#include "protocol/DeflateCompressor.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <zlib.h>
+
+namespace
+{
+
+// Порядок важен: deflate ищет совпадения тем дешевле, чем ближе они к концу словаря,
+// поэтому самые частые сообщения (chat-msg, user-change) стоят в конце.
+constexpr std::string_view dictionaryText =
+    "{\"code\":\"\",\"message\":\"\",\"type\":\"error\"}"
+    "{\"type\":\"register-error\"}"
+    "{\"chat-id\":,\"left\":true,\"type\":\"room-left\",\"user-id\":}"
+    "{\"chat-id\":,\"chatname\":\"\",\"created\":true,\"name\":\"\",\"participant-user-ids\":[],\"type\":\"room-created\"}"
+    "{\"chats\":{},\"type\":\"chats-payload\"}"
+    "{\"type\":\"users-payload\",\"users\":{}}"
+    "{\"change-type\":\"registered\",\"logout\",\"connection\",\"type\":\"user-change\",\"user-id\":,\"username\":\"\"}"
+    "{\"chat-id\":1,\"message\":\"\",\"server-message-id\":,\"type\":\"chat-msg\",\"user-id\":,\"username\":\"\"}";
+
+} // namespace
+
+struct DeflateCompressor::Stream
+{
+    z_stream z{};
+    bool initialized = false;
+    int windowBits = 0;
+    int level = 0;
+    int memLevel = 0;
+
+    Stream() = default;
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+
+    ~Stream()
+    {
+        if (initialized)
+        {
+            deflateEnd(&z);
+        }
+    }
+
+    void init(int bits, int compressionLevel, int memoryLevel)
+    {
+        if (initialized)
+        {
+            deflateEnd(&z);
+            initialized = false;
+        }
+        z = z_stream{};
+        // Отрицательное окно -- raw deflate без заголовка и контрольной суммы zlib.
+        if (deflateInit2(&z, compressionLevel, Z_DEFLATED, -bits, memoryLevel, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            throw std::runtime_error("deflateInit2 failed");
+        }
+        initialized = true;
+        windowBits = bits;
+        level = compressionLevel;
+        memLevel = memoryLevel;
+        setDictionary();
+    }
+
+    void reset()
+    {
+        deflateReset(&z);
+        setDictionary();
+    }
+
+    void setDictionary()
+    {
+        deflateSetDictionary(&z, reinterpret_cast<const Bytef*>(dictionaryText.data()),
+                             static_cast<uInt>(dictionaryText.size()));
+    }
+
+    std::string compress(std::string_view message)
+    {
+        // Сообщения чата короткие, поэтому хватает одного буфера с запасом под блоки sync flush.
+        std::string out(deflateBound(&z, static_cast<uLong>(message.size())) + 16, '\0');
+        z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(message.data()));
+        z.avail_in = static_cast<uInt>(message.size());
+        std::size_t written = 0;
+        while (true)
+        {
+            z.next_out = reinterpret_cast<Bytef*>(out.data() + written);
+            z.avail_out = static_cast<uInt>(out.size() - written);
+            const int result = deflate(&z, Z_SYNC_FLUSH);
+            if (result != Z_OK && result != Z_BUF_ERROR)
+            {
+                throw std::runtime_error("deflate failed");
+            }
+            written = out.size() - z.avail_out;
+            if (z.avail_out != 0)
+            {
+                break;
+            }
+            out.resize(out.size() * 2);
+        }
+        out.resize(written);
+
+        // RFC 7692, 7.2.1: пустой блок 00 00 FF FF от Z_SYNC_FLUSH не передаётся.
+        if (out.size() >= 4 && out.compare(out.size() - 4, 4, "\x00\x00\xFF\xFF", 4) == 0)
+        {
+            out.resize(out.size() - 4);
+        }
+        return out;
+    }
+};
+
+DeflateCompressor::DeflateCompressor(int windowBits, bool contextTakeover, int level, int memLevel)
+    : windowBits_(clampWindowBits(windowBits)),
+      contextTakeover_(contextTakeover),
+      level_(std::clamp(level, 1, 9)),
+      memLevel_(std::clamp(memLevel, 1, 9))
+{
+    if (contextTakeover_)
+    {
+        stream_ = std::make_unique<Stream>();
+        stream_->init(windowBits_, level_, memLevel_);
+    }
+}
+
+DeflateCompressor::~DeflateCompressor() = default;
+
+std::string DeflateCompressor::compress(std::string_view message)
+{
+    if (contextTakeover_)
+    {
+        return stream_->compress(message);
+    }
+
+    // Без сохранения контекста поток сбрасывается перед каждым сообщением, поэтому его можно
+    // держать один на поток выполнения и не выделять окно zlib на каждое соединение.
+    thread_local Stream stream;
+    if (!stream.initialized || stream.windowBits != windowBits_ || stream.level != level_ ||
+        stream.memLevel != memLevel_)
+    {
+        stream.init(windowBits_, level_, memLevel_);
+    }
+    else
+    {
+        stream.reset();
+    }
+    return stream.compress(message);
+}
+
+int DeflateCompressor::windowBits() const
+{
+    return windowBits_;
+}
+
+bool DeflateCompressor::contextTakeover() const
+{
+    return contextTakeover_;
+}
+
+std::string_view DeflateCompressor::dictionary()
+{
+    return dictionaryText;
+}
+
+int DeflateCompressor::clampWindowBits(int windowBits)
+{
+    return std::clamp(windowBits, 9, 15);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Настройки сжатия исходящих сообщений на стороне сервера.
+struct CompressionOptions
+{
+    bool enabled = true;
+    int windowBits = 15;               // 9..15; окно компрессора, общего для всех соединений без сохранения контекста.
+    bool allowContextTakeover = true;  // Разрешать клиентам сжатие с сохранением контекста между сообщениями.
+    int level = 6;                     // Уровень zlib, 1..9.
+    int memLevel = 8;                  // Память zlib на поток, 1..9; при сохранении контекста -- на каждое соединение.
+};
+
+// Сжатие сообщений в raw deflate по схеме RFC 7692 (7.2.1): каждое сообщение завершается Z_SYNC_FLUSH,
+// хвост 00 00 FF FF отбрасывается. Окно компрессора начинается с общего словаря dictionary().
+// Без сохранения контекста каждое сообщение сжимается независимо, объект не имеет состояния и может
+// использоваться из любых потоков одновременно. С сохранением контекста объект принадлежит одному
+// соединению, и вызовы compress() должны идти в порядке отправки кадров.
+class DeflateCompressor
+{
+public:
+    DeflateCompressor(int windowBits, bool contextTakeover, int level = 6, int memLevel = 8);
+    ~DeflateCompressor();
+
+    DeflateCompressor(const DeflateCompressor&) = delete;
+    DeflateCompressor& operator=(const DeflateCompressor&) = delete;
+
+    [[nodiscard]] std::string compress(std::string_view message);
+
+    [[nodiscard]] int windowBits() const;
+    [[nodiscard]] bool contextTakeover() const;
+
+    // Словарь из ключей и типовых значений протокола, одинаковый на сервере и клиенте.
+    [[nodiscard]] static std::string_view dictionary();
+    // Окно в допустимых для raw deflate пределах (9..15); 8 из RFC 7692 zlib заменяет на 9.
+    [[nodiscard]] static int clampWindowBits(int windowBits);
+
+private:
+    struct Stream;
+
+    int windowBits_;
+    bool contextTakeover_;
+    int level_;
+    int memLevel_;
+    // Только при сохранении контекста; без него используется поток из thread_local кэша.
+    std::unique_ptr<Stream> stream_;
+};
@@ -0,0 +1,804 @@
+#include "protocol/FastJsonReader.hpp"
+
+#include <bit>
+#include <charconv>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CHAT_FAST_JSON_SSE2 1
+#elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define CHAT_FAST_JSON_NEON 1
+#endif
+
+namespace
+{
+
+// false только при переполнении double; потеря точности и уход в ноль допустимы.
+bool isFiniteDouble(std::string_view text)
+{
+    double value = 0.0;
+    const auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec != std::errc::result_out_of_range)
+    {
+        return true;
+    }
+
+    // from_chars не различает переполнение и исчезновение порядка, оцениваем десятичный порядок сами.
+    std::size_t pos = text.front() == '-' ? 1 : 0;
+    long long magnitude = 0;
+    bool leadingZeros = true;
+    bool fraction = false;
+    for (; pos < text.size() && text[pos] != 'e' && text[pos] != 'E'; ++pos)
+    {
+        if (text[pos] == '.')
+        {
+            fraction = true;
+            continue;
+        }
+        if (leadingZeros && text[pos] == '0')
+        {
+            if (fraction)
+                --magnitude;
+            continue;
+        }
+        if (leadingZeros)
+        {
+            leadingZeros = false;
+            if (fraction)
+                break;
+        }
+        if (!fraction)
+            ++magnitude;
+    }
+    if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E'))
+    {
+        long long exponent = 0;
+        const char* expBegin = text.data() + pos + 1;
+        if (*expBegin == '+')
+            ++expBegin;
+        if (std::from_chars(expBegin, text.data() + text.size(), exponent).ec != std::errc())
+        {
+            // Показатель не помещается даже в long long.
+            return text[pos + 1] == '-';
+        }
+        magnitude += exponent;
+    }
+    return magnitude <= 0;
+}
+
+class Scanner
+{
+public:
+    explicit Scanner(std::string_view input) : pos_(input.data()), end_(input.data() + input.size())
+    {
+    }
+
+    [[nodiscard]] bool atEnd() const
+    {
+        return pos_ == end_;
+    }
+
+    [[nodiscard]] char peek() const
+    {
+        return *pos_;
+    }
+
+    [[nodiscard]] const char* position() const
+    {
+        return pos_;
+    }
+
+    void advance()
+    {
+        ++pos_;
+    }
+
+    void skipBom()
+    {
+        if (end_ - pos_ >= 3 && std::memcmp(pos_, "\xEF\xBB\xBF", 3) == 0)
+        {
+            pos_ += 3;
+        }
+    }
+
+    void skipWhitespace()
+    {
+        while (pos_ != end_ && (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t'))
+        {
+            ++pos_;
+        }
+    }
+
+    bool consume(char expected)
+    {
+        skipWhitespace();
+        if (pos_ == end_ || *pos_ != expected)
+        {
+            return false;
+        }
+        ++pos_;
+        return true;
+    }
+
+    // Ожидает открывающую кавычку в текущей позиции. body -- содержимое без кавычек.
+    bool scanString(std::string_view& body, bool& escaped)
+    {
+        if (pos_ == end_ || *pos_ != '"')
+        {
+            return false;
+        }
+        ++pos_;
+        const char* begin = pos_;
+        escaped = false;
+
+        while (true)
+        {
+            skipPlainAscii();
+            if (pos_ == end_)
+            {
+                return false;
+            }
+
+            const auto byte = static_cast<unsigned char>(*pos_);
+            if (byte == '"')
+            {
+                body = std::string_view(begin, static_cast<std::size_t>(pos_ - begin));
+                ++pos_;
+                return true;
+            }
+            if (byte == '\\')
+            {
+                escaped = true;
+                if (!scanEscape())
+                {
+                    return false;
+                }
+                continue;
+            }
+            if (byte < 0x20)
+            {
+                return false;
+            }
+            if (!scanUtf8Sequence())
+            {
+                return false;
+            }
+        }
+    }
+
+    bool scanNumber()
+    {
+        const char* begin = pos_;
+        if (pos_ != end_ && *pos_ == '-')
+        {
+            ++pos_;
+        }
+        if (pos_ == end_)
+        {
+            return false;
+        }
+        if (*pos_ == '0')
+        {
+            ++pos_;
+        }
+        else if (*pos_ >= '1' && *pos_ <= '9')
+        {
+            skipDigits();
+        }
+        else
+        {
+            return false;
+        }
+
+        if (pos_ != end_ && *pos_ == '.')
+        {
+            ++pos_;
+            if (!skipDigits())
+            {
+                return false;
+            }
+        }
+        if (pos_ != end_ && (*pos_ == 'e' || *pos_ == 'E'))
+        {
+            ++pos_;
+            if (pos_ != end_ && (*pos_ == '+' || *pos_ == '-'))
+            {
+                ++pos_;
+            }
+            if (!skipDigits())
+            {
+                return false;
+            }
+        }
+
+        // nlohmann отвергает числа, которые не помещаются в double; короткие целые проверять незачем.
+        const std::string_view text(begin, static_cast<std::size_t>(pos_ - begin));
+        if (text.size() > 18 || text.find_first_of(".eE") != std::string_view::npos)
+        {
+            return isFiniteDouble(text);
+        }
+        return true;
+    }
+
+    bool scanLiteral(std::string_view literal)
+    {
+        if (static_cast<std::size_t>(end_ - pos_) < literal.size() ||
+            std::memcmp(pos_, literal.data(), literal.size()) != 0)
+        {
+            return false;
+        }
+        pos_ += literal.size();
+        return true;
+    }
+
+    // Проверяет одно значение любого типа. Вложенность обходится без рекурсии.
+    bool scanValue(FastJsonObject::Kind& kind)
+    {
+        skipWhitespace();
+        if (pos_ == end_)
+        {
+            return false;
+        }
+
+        switch (*pos_)
+        {
+        case '"': {
+            std::string_view body;
+            bool escaped = false;
+            kind = FastJsonObject::Kind::String;
+            return scanString(body, escaped);
+        }
+        case 't':
+            kind = FastJsonObject::Kind::True;
+            return scanLiteral("true");
+        case 'f':
+            kind = FastJsonObject::Kind::False;
+            return scanLiteral("false");
+        case 'n':
+            kind = FastJsonObject::Kind::Null;
+            return scanLiteral("null");
+        case '[':
+            kind = FastJsonObject::Kind::Array;
+            return scanContainer();
+        case '{':
+            kind = FastJsonObject::Kind::Object;
+            return scanContainer();
+        default:
+            kind = FastJsonObject::Kind::Number;
+            return scanNumber();
+        }
+    }
+
+private:
+    // Пропускает байты, не требующие отдельной обработки: ASCII без кавычки, '\' и управляющих символов.
+    void skipPlainAscii()
+    {
+#if defined(CHAT_FAST_JSON_SSE2)
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i space = _mm_set1_epi8(0x20);
+        while (end_ - pos_ >= 16)
+        {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos_));
+            // Знаковое сравнение "< 0x20" ловит сразу и управляющие символы, и байты >= 0x80.
+            const __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                                 _mm_cmplt_epi8(chunk, space));
+            const auto mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+            if (mask != 0)
+            {
+                pos_ += std::countr_zero(mask);
+                return;
+            }
+            pos_ += 16;
+        }
+#elif defined(CHAT_FAST_JSON_NEON)
+        const int8x16_t quote = vdupq_n_s8('"');
+        const int8x16_t backslash = vdupq_n_s8('\\');
+        const int8x16_t space = vdupq_n_s8(0x20);
+        while (end_ - pos_ >= 16)
+        {
+            const int8x16_t chunk = vld1q_s8(reinterpret_cast<const std::int8_t*>(pos_));
+            const uint8x16_t special =
+                vorrq_u8(vorrq_u8(vceqq_s8(chunk, quote), vceqq_s8(chunk, backslash)), vcltq_s8(chunk, space));
+            if (vmaxvq_u8(special) != 0)
+            {
+                break;
+            }
+            pos_ += 16;
+        }
+#endif
+        while (pos_ != end_)
+        {
+            const auto byte = static_cast<unsigned char>(*pos_);
+            if (byte == '"' || byte == '\\' || byte < 0x20 || byte >= 0x80)
+            {
+                return;
+            }
+            ++pos_;
+        }
+    }
+
+    bool skipDigits()
+    {
+        const char* begin = pos_;
+        while (pos_ != end_ && *pos_ >= '0' && *pos_ <= '9')
+        {
+            ++pos_;
+        }
+        return pos_ != begin;
+    }
+
+    bool scanHex4(std::uint32_t& codepoint)
+    {
+        if (end_ - pos_ < 4)
+        {
+            return false;
+        }
+        codepoint = 0;
+        for (int i = 0; i < 4; ++i, ++pos_)
+        {
+            const char c = *pos_;
+            codepoint <<= 4;
+            if (c >= '0' && c <= '9')
+                codepoint |= static_cast<std::uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f')
+                codepoint |= static_cast<std::uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F')
+                codepoint |= static_cast<std::uint32_t>(c - 'A' + 10);
+            else
+                return false;
+        }
+        return true;
+    }
+
+    bool scanEscape()
+    {
+        ++pos_;
+        if (pos_ == end_)
+        {
+            return false;
+        }
+        switch (*pos_++)
+        {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            return true;
+        case 'u': {
+            std::uint32_t codepoint = 0;
+            if (!scanHex4(codepoint))
+            {
+                return false;
+            }
+            if (codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+            {
+                return false;
+            }
+            if (codepoint >= 0xD800 && codepoint <= 0xDBFF)
+            {
+                // Старший суррогат обязан идти в паре с младшим.
+                std::uint32_t low = 0;
+                if (!scanLiteral("\\u") || !scanHex4(low) || low < 0xDC00 || low > 0xDFFF)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    // Проверка многобайтовой последовательности UTF-8 по RFC 3629.
+    bool scanUtf8Sequence()
+    {
+        const auto lead = static_cast<unsigned char>(*pos_);
+        std::size_t length = 0;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF)
+        {
+            length = 2;
+        }
+        else if (lead >= 0xE0 && lead <= 0xEF)
+        {
+            length = 3;
+            if (lead == 0xE0)
+                low = 0xA0;
+            else if (lead == 0xED)
+                high = 0x9F;
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4)
+        {
+            length = 4;
+            if (lead == 0xF0)
+                low = 0x90;
+            else if (lead == 0xF4)
+                high = 0x8F;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (static_cast<std::size_t>(end_ - pos_) < length)
+        {
+            return false;
+        }
+        for (std::size_t i = 1; i < length; ++i)
+        {
+            const auto byte = static_cast<unsigned char>(pos_[i]);
+            const unsigned char min = i == 1 ? low : 0x80;
+            const unsigned char max = i == 1 ? high : 0xBF;
+            if (byte < min || byte > max)
+            {
+                return false;
+            }
+        }
+        pos_ += length;
+        return true;
+    }
+
+    // Массив или объект произвольной вложенности; стек контейнеров вместо рекурсии.
+    bool scanContainer()
+    {
+        std::vector<char> stack;
+        stack.push_back(*pos_ == '[' ? ']' : '}');
+        ++pos_;
+        bool expectValue = true;
+        bool first = true;
+
+        while (!stack.empty())
+        {
+            skipWhitespace();
+            if (pos_ == end_)
+            {
+                return false;
+            }
+
+            if (first && *pos_ == stack.back())
+            {
+                ++pos_;
+                stack.pop_back();
+                first = false;
+                expectValue = false;
+                continue;
+            }
+
+            if (!expectValue)
+            {
+                if (*pos_ == stack.back())
+                {
+                    ++pos_;
+                    stack.pop_back();
+                    continue;
+                }
+                if (*pos_ != ',')
+                {
+                    return false;
+                }
+                ++pos_;
+                expectValue = true;
+                first = false;
+                continue;
+            }
+
+            if (stack.back() == '}')
+            {
+                std::string_view key;
+                bool escaped = false;
+                if (!scanString(key, escaped) || !consume(':'))
+                {
+                    return false;
+                }
+                skipWhitespace();
+                if (pos_ == end_)
+                {
+                    return false;
+                }
+            }
+
+            first = false;
+            if (*pos_ == '[' || *pos_ == '{')
+            {
+                stack.push_back(*pos_ == '[' ? ']' : '}');
+                ++pos_;
+                first = true;
+                continue;
+            }
+
+            FastJsonObject::Kind kind{};
+            if (!scanValue(kind))
+            {
+                return false;
+            }
+            expectValue = false;
+        }
+        return true;
+    }
+
+private:
+    const char* pos_;
+    const char* end_;
+};
+
+template<typename String>
+void appendUtf8(String& out, std::uint32_t codepoint)
+{
+    if (codepoint < 0x80)
+    {
+        out.push_back(static_cast<char>(codepoint));
+    }
+    else if (codepoint < 0x800)
+    {
+        out.push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    }
+    else if (codepoint < 0x10000)
+    {
+        out.push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    }
+    else
+    {
+        out.push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    }
+}
+
+std::uint32_t readHex4(const char* text)
+{
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        const char c = text[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= static_cast<std::uint32_t>(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            value |= static_cast<std::uint32_t>(c - 'a' + 10);
+        else
+            value |= static_cast<std::uint32_t>(c - 'A' + 10);
+    }
+    return value;
+}
+
+// Вход уже проверен сканером, поэтому здесь ошибки не обрабатываются.
+template<typename String = std::string>
+String unescape(std::string_view body, typename String::allocator_type allocator = {})
+{
+    String result(allocator);
+    result.reserve(body.size());
+    for (std::size_t i = 0; i < body.size(); ++i)
+    {
+        if (body[i] != '\\')
+        {
+            result.push_back(body[i]);
+            continue;
+        }
+        switch (body[++i])
+        {
+        case 'b':
+            result.push_back('\b');
+            break;
+        case 'f':
+            result.push_back('\f');
+            break;
+        case 'n':
+            result.push_back('\n');
+            break;
+        case 'r':
+            result.push_back('\r');
+            break;
+        case 't':
+            result.push_back('\t');
+            break;
+        case 'u': {
+            std::uint32_t codepoint = readHex4(body.data() + i + 1);
+            i += 4;
+            if (codepoint >= 0xD800 && codepoint <= 0xDBFF)
+            {
+                const std::uint32_t low = readHex4(body.data() + i + 3);
+                i += 6;
+                codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+            }
+            appendUtf8(result, codepoint);
+            break;
+        }
+        default:
+            result.push_back(body[i]);
+            break;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+std::optional<FastJsonObject> FastJsonObject::parse(std::string_view payload)
+{
+    Scanner scanner(payload);
+    scanner.skipBom();
+    if (!scanner.consume('{'))
+    {
+        return std::nullopt;
+    }
+
+    FastJsonObject object;
+    scanner.skipWhitespace();
+    if (!scanner.atEnd() && scanner.peek() == '}')
+    {
+        scanner.advance();
+    }
+    else
+    {
+        while (true)
+        {
+            Field field;
+            scanner.skipWhitespace();
+            if (!scanner.scanString(field.key, field.keyEscaped) || !scanner.consume(':'))
+            {
+                return std::nullopt;
+            }
+
+            scanner.skipWhitespace();
+            const char* valueBegin = scanner.position();
+            if (!scanner.scanValue(field.kind))
+            {
+                return std::nullopt;
+            }
+            field.value = std::string_view(valueBegin, static_cast<std::size_t>(scanner.position() - valueBegin));
+            if (field.kind == Kind::String)
+            {
+                field.value = field.value.substr(1, field.value.size() - 2);
+                field.valueEscaped = field.value.find('\\') != std::string_view::npos;
+            }
+            object.addField(field);
+
+            if (scanner.consume(','))
+            {
+                continue;
+            }
+            if (scanner.consume('}'))
+            {
+                break;
+            }
+            return std::nullopt;
+        }
+    }
+
+    scanner.skipWhitespace();
+    if (!scanner.atEnd())
+    {
+        return std::nullopt;
+    }
+    return object;
+}
+
+const FastJsonObject::Field* FastJsonObject::find(std::string_view key) const
+{
+    const Field* result = nullptr;
+    for (std::size_t i = 0; i < fieldCount_; ++i)
+    {
+        const Field& field = i < inlineFieldCount ? inlineFields_[i] : extraFields_[i - inlineFieldCount];
+        if (field.keyEscaped ? unescape<std::pmr::string>(field.key, MessageArena::resource()) == key : field.key == key)
+        {
+            result = &field;
+        }
+    }
+    return result;
+}
+
+std::size_t FastJsonObject::size() const
+{
+    return fieldCount_;
+}
+
+std::optional<std::string_view> FastJsonObject::getStringView(std::string_view key) const
+{
+    const Field* field = find(key);
+    if (field == nullptr || field->kind != Kind::String)
+    {
+        return std::nullopt;
+    }
+    if (!field->valueEscaped)
+    {
+        return field->value;
+    }
+    decoded_.push_front(unescape<std::pmr::string>(field->value, decoded_.get_allocator()));
+    return std::string_view(decoded_.front());
+}
+
+void FastJsonObject::addField(const Field& field)
+{
+    if (fieldCount_ < inlineFieldCount)
+    {
+        inlineFields_[fieldCount_] = field;
+    }
+    else
+    {
+        extraFields_.push_back(field);
+    }
+    ++fieldCount_;
+}
+
+std::string FastJsonObject::decodeString(const Field& field)
+{
+    if (!field.valueEscaped)
+    {
+        return std::string(field.value);
+    }
+    return unescape(field.value);
+}
+
+std::optional<std::vector<IDType>> FastJsonObject::decodeIdArray(std::string_view rawArray)
+{
+    std::vector<IDType> result;
+    Scanner scanner(rawArray);
+    scanner.consume('[');
+    scanner.skipWhitespace();
+    if (!scanner.atEnd() && scanner.peek() == ']')
+    {
+        return result;
+    }
+
+    while (true)
+    {
+        scanner.skipWhitespace();
+        const char* begin = scanner.position();
+        Kind kind{};
+        scanner.scanValue(kind);
+        const auto item = toArithmetic<IDType>(kind, std::string_view(begin, static_cast<std::size_t>(scanner.position() - begin)));
+        if (!item.has_value())
+        {
+            return std::nullopt;
+        }
+        result.push_back(*item);
+        if (!scanner.consume(','))
+        {
+            break;
+        }
+    }
+    return result;
+}
+
+FastJsonObject::Number FastJsonObject::decodeNumber(std::string_view raw)
+{
+    Number number;
+    const char* begin = raw.data();
+    const char* end = raw.data() + raw.size();
+    const bool isInteger = raw.find_first_of(".eE") == std::string_view::npos;
+
+    // Как в nlohmann: целое, не помещающееся в 64 бита, хранится как число с плавающей точкой.
+    if (isInteger)
+    {
+        if (raw.front() == '-')
+        {
+            if (std::from_chars(begin, end, number.integerValue).ec == std::errc())
+            {
+                number.type = Number::Type::Integer;
+                return number;
+            }
+        }
+        else if (std::from_chars(begin, end, number.unsignedValue).ec == std::errc())
+        {
+            number.type = Number::Type::Unsigned;
+            return number;
+        }
+    }
+
+    number.type = Number::Type::Float;
+    std::from_chars(begin, end, number.floatValue);
+    return number;
+}
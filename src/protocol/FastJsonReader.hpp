@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <forward_list>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "core/MemoryPool.hpp"
+#include "core/Types.hpp"
+
+// nlohmann::json::get<T>() приводит true/false к 1/0 для всех чисел, кроме собственных типов чисел json
+// (uint64_t, int64_t, double): для них он бросает type_error. Оба разборщика повторяют это правило.
+template<typename T>
+inline constexpr bool jsonBooleanAsNumber = std::is_arithmetic_v<T> && !std::is_same_v<T, bool> &&
+                                            !std::is_same_v<T, std::uint64_t> && !std::is_same_v<T, std::int64_t> &&
+                                            !std::is_same_v<T, double>;
+
+// Разбор JSON-объекта верхнего уровня без построения DOM.
+// Вход полностью проверяется по грамматике JSON (включая UTF-8 и escape-последовательности),
+// а для полей первого уровня запоминаются только границы ключа и значения в исходной строке.
+// Значения декодируются по запросу, с теми же правилами приведения типов, что и getJsonField для nlohmann::json.
+// Объект ссылается на исходную строку и не должен её переживать. Разобранный внутри MessageArena::Scope
+// держит служебные буферы в арене сообщения и не должен переживать и этот Scope.
+class FastJsonObject
+{
+public:
+    enum class Kind : std::uint8_t
+    {
+        String,
+        Number,
+        True,
+        False,
+        Null,
+        Array,
+        Object
+    };
+
+    struct Field
+    {
+        std::string_view key;    // Без кавычек, как в исходной строке.
+        std::string_view value;  // Для строк -- без кавычек, для остальных -- исходный текст значения.
+        Kind kind = Kind::Null;
+        bool keyEscaped = false;
+        bool valueEscaped = false;
+    };
+
+    // nullopt, если вход не является корректным JSON или верхний уровень -- не объект.
+    [[nodiscard]] static std::optional<FastJsonObject> parse(std::string_view payload);
+
+    // При повторяющихся ключах, как и в nlohmann::json, действует последнее значение.
+    [[nodiscard]] const Field* find(std::string_view key) const;
+    [[nodiscard]] std::size_t size() const;
+
+    // Строка без копирования; при наличии escape-последовательностей декодируется во внутренний буфер объекта.
+    [[nodiscard]] std::optional<std::string_view> getStringView(std::string_view key) const;
+
+    template<typename T>
+    [[nodiscard]] std::optional<T> get(std::string_view key) const
+    {
+        const Field* field = find(key);
+        if (field == nullptr || field->kind == Kind::Null)
+        {
+            return std::nullopt;
+        }
+
+        if constexpr (std::is_same_v<T, std::string>)
+        {
+            if (field->kind != Kind::String)
+                return std::nullopt;
+            return decodeString(*field);
+        }
+        else if constexpr (std::is_same_v<T, bool>)
+        {
+            if (field->kind != Kind::True && field->kind != Kind::False)
+                return std::nullopt;
+            return field->kind == Kind::True;
+        }
+        else if constexpr (std::is_arithmetic_v<T>)
+        {
+            return toArithmetic<T>(field->kind, field->value);
+        }
+        else if constexpr (std::is_same_v<T, std::vector<IDType>>)
+        {
+            if (field->kind != Kind::Array)
+                return std::nullopt;
+            return decodeIdArray(field->value);
+        }
+        else
+        {
+            static_assert(sizeof(T) == 0, "Unsupported field type for FastJsonObject");
+        }
+    }
+
+private:
+    struct Number
+    {
+        enum class Type : std::uint8_t
+        {
+            Unsigned,
+            Integer,
+            Float
+        } type = Type::Unsigned;
+        std::uint64_t unsignedValue = 0;
+        std::int64_t integerValue = 0;
+        double floatValue = 0.0;
+    };
+
+    static constexpr std::size_t inlineFieldCount = 16;
+
+    void addField(const Field& field);
+    static std::string decodeString(const Field& field);
+    static std::optional<std::vector<IDType>> decodeIdArray(std::string_view rawArray);
+    static Number decodeNumber(std::string_view raw);
+
+    // Приведение как у nlohmann::json::get<T>() для числа.
+    template<typename T>
+    static std::optional<T> toArithmetic(Kind kind, std::string_view raw)
+    {
+        if constexpr (jsonBooleanAsNumber<T>)
+        {
+            if (kind == Kind::True || kind == Kind::False)
+                return static_cast<T>(kind == Kind::True);
+        }
+        if (kind != Kind::Number)
+            return std::nullopt;
+
+        const Number number = decodeNumber(raw);
+        switch (number.type)
+        {
+        case Number::Type::Unsigned:
+            return static_cast<T>(number.unsignedValue);
+        case Number::Type::Integer:
+            return static_cast<T>(number.integerValue);
+        case Number::Type::Float:
+            return static_cast<T>(number.floatValue);
+        }
+        return std::nullopt;
+    }
+
+private:
+    // Сообщения клиента почти всегда укладываются в inline-буфер, поэтому разбор не выделяет память.
+    std::array<Field, inlineFieldCount> inlineFields_{};
+    std::pmr::vector<Field> extraFields_{MessageArena::resource()};
+    std::size_t fieldCount_ = 0;
+    mutable std::pmr::forward_list<std::pmr::string> decoded_{MessageArena::resource()};
+};
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 #include <map>
 
@@ -15,6 +17,14 @@ struct ClientRegisterRequest
     std::string username;               // Отображаемое имя; может быть пустым.
     std::string password;               // Пароль пользователя
     std::string clientVersion;          // Версия клиентского приложения; может быть пустой.
+    std::string encoding;               // Кодировка дальнейших сообщений: "json" (по умолчанию) или "msgpack".
+    std::string compression;            // Сжатие сообщений сервера: "" / "none" или "deflate".
+    std::uint32_t compressionWindowBits = 0;  // Максимальное окно deflate сервера (8..15); 0 -- не ограничено.
+    bool compressionContextTakeover = false;  // Клиент готов хранить контекст распаковки между сообщениями.
+    std::string presence;               // Уведомления о пользователях: "all" (по умолчанию), "rooms" или "none".
+    bool userChanges = false;           // Уведомления пачкой user-changes; иначе -- по одному user-change.
+    std::string sessionToken;           // Токен из register-result: продолжить сессию после обрыва соединения.
+    std::optional<std::uint64_t> lastServerMessageId;  // При продолжении сессии: последнее полученное сообщение.
 };
 
 // Клиент -> Сервер: отправка сообщения в комнату.
@@ -30,9 +40,17 @@ struct ClientChatMessageRequest
 // Клиент -> Сервер: запрос на получение данных
 struct ClientDataRequest
 {
-    std::string type = "data-request";  // Тип сообщения: "chat-msg".
-    std::string dataType;               // Тип запрашиваемых данных ("chats", "messanges")
+    std::string type = "data-request";  // Тип сообщения: "data-request".
+    std::string dataType;               // Тип запрашиваемых данных ("chats", "users", "messages")
     IDType userId = 0;                  // ID отправителя, полученный после регистрации.
+    // Только для "messages":
+    IDType chatId = 0;                  // Комната, историю которой запрашивают.
+    std::uint64_t before = 0;           // Самые новые сообщения с server-message-id меньше before; 0 -- самые новые вообще.
+    // Для "messages" и "users":
+    std::optional<std::uint64_t> after; // Сообщения с server-message-id / пользователи с user-id больше after.
+    std::uint32_t limit = 0;            // Размер страницы; 0 -- по умолчанию.
+    // Только для "users":
+    std::string prefix;                 // Только пользователи, чьё имя начинается с prefix (без учёта регистра).
 };
 
 // Клиент -> Сервер: создание новой комнаты с выбранными пользователями.
@@ -71,6 +89,11 @@ struct ServerRegistrationPayload
     std::string serverPublicKey;                            // Заглушка открытого ключа сервера.
     std::string serverName;                                 // Человекочитаемое имя сервера.
     std::string protocolVersion = "1.0";                    // Версия протокола, сейчас "1.0".
+    std::string compression;                                // "deflate", если сжатие согласовано; иначе поля сжатия не передаются.
+    std::uint32_t compressionWindowBits = 0;                // Окно deflate, которым сервер сжимает сообщения.
+    bool compressionContextTakeover = false;                // true -- контекст сжатия сохраняется между сообщениями.
+    bool resumed = false;                                   // true -- продолжена прежняя сессия (тот же user-id и комнаты).
+    std::string sessionToken;                               // Токен для продолжения сессии; пусто, если сессии выключены.
 };
 
 // Сервер -> Клиент: общая ошибка для некорректных запросов.
@@ -122,14 +145,45 @@ struct ServerChatsRequestPayload
 struct ServerUsersRequestPayload
 {
     std::string type = "users-payload";       // Тип сообщения: "request-payload".
-    std::map<IDType, std::string> users;      // {user-id: "user-name"}
+    // {user-id: "user-name"}; по возрастанию user-id. Вектор, а не map: страница берётся из UserDirectory
+    // целиком, без узла дерева на каждого пользователя.
+    std::vector<std::pair<IDType, std::string>> users;
+    bool hasMore = false;                     // Есть пользователи с большими ID: следующая страница с after.
 };
 
-// Сервер -> Клиент: изменение информации о пользователе
+// Сообщение из истории комнаты.
+struct ServerHistoryMessage
+{
+    std::uint64_t serverMessageId = 0;
+    IDType userId = 0;
+    std::string username;
+    std::string message;
+    std::uint64_t timestamp = 0;         // Время приёма сервером, мс от эпохи Unix.
+};
+
+// Сервер -> Клиент: страница истории комнаты в ответ на data-request с data-type "messages".
+struct ServerMessagesPayload
+{
+    std::string type = "messages-payload";       // Тип сообщения: "messages-payload".
+    IDType chatId = 0;
+    std::vector<ServerHistoryMessage> messages;  // По возрастанию server-message-id.
+    bool hasMore = false;                        // В направлении запроса есть ещё сообщения.
+    bool truncated = false;                      // Для after: часть сообщений после курсора уже недоступна.
+};
+
+// Сервер -> Клиент: изменение информации о пользователе (для клиентов без user-changes)
 struct ServerUsersSomeChange
 {
-    std::string type = "user-change";       // Тип сообщения: "request-payload"
-    std::string changeType;                 // "connection", "logout", "rename"
-    IDType userId;
+    std::string type = "user-change";       // Тип сообщения: "user-change"
+    std::string changeType;                 // "registered", "logout"
+    IDType userId = 0;
     std::string username;
+};
+
+// Сервер -> Клиент: изменения списка пользователей, накопленные за окно рассылки.
+struct ServerUserChangesPayload
+{
+    std::string type = "user-changes";        // Тип сообщения: "user-changes".
+    std::map<IDType, std::string> registered; // Вошедшие: {user-id: "user-name"}.
+    std::vector<IDType> logout;               // Вышедшие, по возрастанию ID.
 };
\ No newline at end of file
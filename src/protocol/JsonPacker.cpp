@@ -1,20 +1,56 @@
 #include "protocol/JsonPacker.hpp"
 
+#include <algorithm>
+#include <array>
+#include <charconv>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "protocol/JsonWriter.hpp"
 
 using json = nlohmann::json;
 
 std::string JsonPacker::packRegisterRequest(const ClientRegisterRequest &payload)
 {
-    return json{
+    json result{
         {"type", payload.type},
         {"public-key", payload.publicKey},
         {"password", payload.password},
         {"username", payload.username},
         {"client-version", payload.clientVersion},
+    };
+    if (!payload.encoding.empty())
+    {
+        result["encoding"] = payload.encoding;
     }
-        .dump();
+    if (!payload.compression.empty())
+    {
+        result["compression"] = payload.compression;
+        result["compression-context-takeover"] = payload.compressionContextTakeover;
+        if (payload.compressionWindowBits != 0)
+        {
+            result["compression-window-bits"] = payload.compressionWindowBits;
+        }
+    }
+    if (!payload.presence.empty())
+    {
+        result["presence"] = payload.presence;
+    }
+    if (payload.userChanges)
+    {
+        result["user-changes"] = true;
+    }
+    if (!payload.sessionToken.empty())
+    {
+        result["session-token"] = payload.sessionToken;
+        if (payload.lastServerMessageId.has_value())
+        {
+            result["last-server-message-id"] = *payload.lastServerMessageId;
+        }
+    }
+    return result.dump();
 }
 
 std::string JsonPacker::packChatMessageRequest(const ClientChatMessageRequest &payload)
@@ -31,12 +67,20 @@ std::string JsonPacker::packChatMessageRequest(const ClientChatMessageRequest &p
 
 std::string JsonPacker::packDataRequest(const ClientDataRequest &payload)
 {
-    return json{
+    json result{
         {"type", payload.type},
         {"data-type", payload.dataType},
         {"user-id", payload.userId},
-    }
-        .dump();
+    };
+    if (payload.chatId != 0)
+        result["chat-id"] = payload.chatId;
+    if (payload.before != 0)
+        result["before"] = payload.before;
+    if (payload.after.has_value())
+        result["after"] = *payload.after;
+    if (payload.limit != 0)
+        result["limit"] = payload.limit;
+    return result.dump();
 }
 
 std::string JsonPacker::packCreateRoomRequest(const ClientCreateRoomRequest &payload)
@@ -61,126 +105,311 @@ std::string JsonPacker::packLeaveRoomRequest(const ClientLeaveRoomRequest &paylo
         .dump();
 }
 
+// Ответы сервера пишутся напрямую через JsonWriter. Ключи идут в алфавитном порядке, как их
+// выдаёт nlohmann::json::dump() (объекты в nlohmann упорядочены), поэтому вывод совпадает байт в байт.
+
 std::string JsonPacker::packServerHello(const ServerHelloPayload &payload)
 {
-    return json{
-        {"type", payload.type},
-        {"authorized", payload.authorized},
-        {"registration-timeout-seconds", payload.registrationTimeoutSeconds},
-        {"server-name", payload.serverName},
-    }
-        .dump();
+    std::string out;
+    out.reserve(96 + payload.serverName.size());
+    packServerHello(payload, out);
+    return out;
+}
+
+void JsonPacker::packServerHello(const ServerHelloPayload &payload, std::string &out)
+{
+    JsonWriter(out)
+        .beginObject()
+        .key("authorized").boolean(payload.authorized)
+        .key("registration-timeout-seconds").number(payload.registrationTimeoutSeconds)
+        .key("server-name").string(payload.serverName)
+        .key("type").string(payload.type)
+        .endObject();
 }
 
 std::string JsonPacker::packRegistration(const ServerRegistrationPayload &payload)
 {
-    json res = json{
-        {"type", payload.type},
-        {"registered", payload.registered},
-        {"user-id", payload.userId},
-        {"server-public-key", payload.serverPublicKey},
-        {"server-name", payload.serverName},
-        {"protocol-version", payload.protocolVersion},
-    };
+    std::string out;
+    out.reserve(144 + payload.serverName.size() + payload.serverPublicKey.size() + payload.sessionToken.size());
+    packRegistration(payload, out);
+    return out;
+}
 
-    return res.dump();
+void JsonPacker::packRegistration(const ServerRegistrationPayload &payload, std::string &out)
+{
+    JsonWriter writer(out);
+    writer.beginObject();
+    if (!payload.compression.empty())
+    {
+        writer.key("compression").string(payload.compression)
+            .key("compression-context-takeover").boolean(payload.compressionContextTakeover)
+            .key("compression-window-bits").number(payload.compressionWindowBits);
+    }
+    writer.key("protocol-version").string(payload.protocolVersion)
+        .key("registered").boolean(payload.registered)
+        .key("resumed").boolean(payload.resumed)
+        .key("server-name").string(payload.serverName)
+        .key("server-public-key").string(payload.serverPublicKey);
+    if (!payload.sessionToken.empty())
+    {
+        writer.key("session-token").string(payload.sessionToken);
+    }
+    writer.key("type").string(payload.type)
+        .key("user-id").number(payload.userId)
+        .endObject();
 }
 
 std::string JsonPacker::packError(const ServerErrorPayload &payload)
 {
-    return json{
-        {"type", payload.type},
-        {"code", payload.code},
-        {"message", payload.message},
-    }
-        .dump();
+    std::string out;
+    out.reserve(48 + payload.code.size() + payload.message.size());
+    packError(payload, out);
+    return out;
+}
+
+void JsonPacker::packError(const ServerErrorPayload &payload, std::string &out)
+{
+    JsonWriter(out)
+        .beginObject()
+        .key("code").string(payload.code)
+        .key("message").string(payload.message)
+        .key("type").string(payload.type)
+        .endObject();
 }
 
 std::string JsonPacker::packChatMessage(const ServerChatMessagePayload &payload)
 {
-    return json{
-        {"type", payload.type},
-        {"user-id", payload.userId},
-        {"username", payload.userName},
-        {"chat-id", payload.chatId},
-        {"message", payload.message},
-        {"server-message-id", payload.serverMessageId},
-    }
-        .dump();
+    std::string out;
+    out.reserve(112 + payload.userName.size() + payload.message.size());
+    packChatMessage(payload, out);
+    return out;
+}
+
+void JsonPacker::packChatMessage(const ServerChatMessagePayload &payload, std::string &out)
+{
+    JsonWriter(out)
+        .beginObject()
+        .key("chat-id").number(payload.chatId)
+        .key("message").string(payload.message)
+        .key("server-message-id").number(payload.serverMessageId)
+        .key("type").string(payload.type)
+        .key("user-id").number(payload.userId)
+        .key("username").string(payload.userName)
+        .endObject();
 }
 
 std::string JsonPacker::packRoomCreated(const ServerRoomCreatedPayload &payload)
 {
-    return json{
-        {"type", payload.type},
-        {"created", payload.created},
-        {"chat-id", payload.chatId},
-        {"participant-user-ids", payload.participantUserIds},
-        {"chatname", payload.name},
-        {"name", payload.name}
+    std::string out;
+    out.reserve(112 + 2 * payload.name.size() + 11 * payload.participantUserIds.size());
+    packRoomCreated(payload, out);
+    return out;
+}
+
+void JsonPacker::packRoomCreated(const ServerRoomCreatedPayload &payload, std::string &out)
+{
+    JsonWriter writer(out);
+    writer.beginObject()
+        .key("chat-id").number(payload.chatId)
+        .key("chatname").string(payload.name)
+        .key("created").boolean(payload.created)
+        .key("name").string(payload.name)
+        .key("participant-user-ids").beginArray();
+    for (const auto id : payload.participantUserIds)
+    {
+        writer.number(id);
     }
-        .dump();
+    writer.endArray()
+        .key("type").string(payload.type)
+        .endObject();
 }
 
 std::string JsonPacker::packRoomLeft(const ServerRoomLeftPayload &payload)
 {
-    return json{
-        {"type", payload.type},
-        {"left", payload.left},
-        {"user-id", payload.userId},
-        {"chat-id", payload.chatId},
-    }
-        .dump();
+    std::string out;
+    out.reserve(80);
+    packRoomLeft(payload, out);
+    return out;
+}
+
+void JsonPacker::packRoomLeft(const ServerRoomLeftPayload &payload, std::string &out)
+{
+    JsonWriter(out)
+        .beginObject()
+        .key("chat-id").number(payload.chatId)
+        .key("left").boolean(payload.left)
+        .key("type").string(payload.type)
+        .key("user-id").number(payload.userId)
+        .endObject();
 }
 
 std::string JsonPacker::packServerInfo(bool alive, const std::string &serverName)
 {
-    return json{
-        {"alive", alive},
-        {"server-name", serverName},
-    }
-        .dump();
+    std::string out;
+    out.reserve(40 + serverName.size());
+    JsonWriter(out)
+        .beginObject()
+        .key("alive").boolean(alive)
+        .key("server-name").string(serverName)
+        .endObject();
+    return out;
 }
 
-std::string JsonPacker::packRequestChatsPayload(const ServerChatsRequestPayload &payload)
+namespace
 {
-    json chatsJson = json::object();
-    for (const auto &[chatId, chatName] : payload.chats)
+
+// Ключи-ID в JSON -- строки, nlohmann сортирует их как строки ("10" < "2"), повторяем этот порядок.
+// Entries -- std::map или вектор пар (ID, имя).
+template<typename Entries>
+void writeIdNameObject(JsonWriter &writer, const Entries &entries)
+{
+    struct Entry
     {
-        // JSON object keys are strings by definition.
-        chatsJson[std::to_string(chatId)] = chatName;
+        std::array<char, 10> text;
+        std::size_t length;
+        const std::string *name;
+
+        std::string_view key() const
+        {
+            return {text.data(), length};
+        }
+    };
+
+    std::vector<Entry> sorted;
+    sorted.reserve(entries.size());
+    for (const auto &[id, name] : entries)
+    {
+        Entry entry{};
+        entry.length = static_cast<std::size_t>(std::to_chars(entry.text.data(), entry.text.data() + entry.text.size(), id).ptr - entry.text.data());
+        entry.name = &name;
+        sorted.push_back(entry);
     }
+    std::sort(sorted.begin(), sorted.end(), [](const Entry &lhs, const Entry &rhs) { return lhs.key() < rhs.key(); });
 
-    return json{
-        {"type", payload.type},
-        {"chats", std::move(chatsJson)},
+    writer.beginObject();
+    for (const auto &entry : sorted)
+    {
+        writer.key(entry.key()).string(*entry.name);
     }
-        .dump();
+    writer.endObject();
 }
 
-std::string JsonPacker::packRequestUsersPayload(const ServerUsersRequestPayload& payload)
+template<typename Entries>
+std::size_t estimateIdNameObject(const Entries &entries)
 {
-    json chatsJson = json::object();
-    for (const auto &[chatId, userName] : payload.users)
+    std::size_t size = 2;
+    for (const auto &[id, name] : entries)
     {
-        // JSON object keys are strings by definition.
-        chatsJson[std::to_string(chatId)] = userName;
+        size += 16 + name.size();
     }
+    return size;
+}
 
-    return json{
-        {"type", payload.type},
-        {"users", std::move(chatsJson)},
-    }
-        .dump();
+} // namespace
+
+std::string JsonPacker::packRequestChatsPayload(const ServerChatsRequestPayload &payload)
+{
+    std::string out;
+    out.reserve(32 + estimateIdNameObject(payload.chats));
+    packRequestChatsPayload(payload, out);
+    return out;
+}
+
+void JsonPacker::packRequestChatsPayload(const ServerChatsRequestPayload &payload, std::string &out)
+{
+    JsonWriter writer(out);
+    writer.beginObject().key("chats");
+    writeIdNameObject(writer, payload.chats);
+    writer.key("type").string(payload.type).endObject();
+}
+
+std::string JsonPacker::packRequestUsersPayload(const ServerUsersRequestPayload& payload)
+{
+    std::string out;
+    out.reserve(48 + estimateIdNameObject(payload.users));
+    packRequestUsersPayload(payload, out);
+    return out;
+}
+
+void JsonPacker::packRequestUsersPayload(const ServerUsersRequestPayload &payload, std::string &out)
+{
+    JsonWriter writer(out);
+    writer.beginObject()
+        .key("has-more").boolean(payload.hasMore)
+        .key("type").string(payload.type)
+        .key("users");
+    writeIdNameObject(writer, payload.users);
+    writer.endObject();
 }
 
 std::string JsonPacker::packUserChange(const ServerUsersSomeChange& payload)
 {
-    return json{
-        {"type", payload.type},
-        {"change-type", payload.changeType},
-        {"user-id", payload.userId},
-        {"username", payload.username},
+    std::string out;
+    out.reserve(64 + payload.changeType.size() + payload.username.size());
+    packUserChange(payload, out);
+    return out;
+}
+
+void JsonPacker::packUserChange(const ServerUsersSomeChange &payload, std::string &out)
+{
+    JsonWriter(out)
+        .beginObject()
+        .key("change-type").string(payload.changeType)
+        .key("type").string(payload.type)
+        .key("user-id").number(payload.userId)
+        .key("username").string(payload.username)
+        .endObject();
+}
+
+std::string JsonPacker::packUserChanges(const ServerUserChangesPayload& payload)
+{
+    std::string out;
+    out.reserve(64 + estimateIdNameObject(payload.registered) + 11 * payload.logout.size());
+    packUserChanges(payload, out);
+    return out;
+}
+
+void JsonPacker::packUserChanges(const ServerUserChangesPayload &payload, std::string &out)
+{
+    JsonWriter writer(out);
+    writer.beginObject().key("logout").beginArray();
+    for (const auto userId : payload.logout)
+        writer.number(userId);
+    writer.endArray().key("registered");
+    writeIdNameObject(writer, payload.registered);
+    writer.key("type").string(payload.type).endObject();
+}
+
+std::string JsonPacker::packMessagesPayload(const ServerMessagesPayload& payload)
+{
+    std::size_t estimate = 64;
+    for (const auto& message : payload.messages)
+        estimate += 112 + message.username.size() + message.message.size();
+    std::string out;
+    out.reserve(estimate);
+    packMessagesPayload(payload, out);
+    return out;
+}
+
+void JsonPacker::packMessagesPayload(const ServerMessagesPayload& payload, std::string& out)
+{
+    JsonWriter writer(out);
+    writer.beginObject()
+        .key("chat-id").number(payload.chatId)
+        .key("has-more").boolean(payload.hasMore)
+        .key("messages").beginArray();
+    for (const auto& message : payload.messages)
+    {
+        writer.beginObject()
+            .key("message").string(message.message)
+            .key("server-message-id").number(message.serverMessageId)
+            .key("timestamp").number(message.timestamp)
+            .key("user-id").number(message.userId)
+            .key("username").string(message.username)
+            .endObject();
     }
-        .dump();
+    writer.endArray()
+        .key("truncated").boolean(payload.truncated)
+        .key("type").string(payload.type)
+        .endObject();
 }
@@ -24,6 +24,21 @@ public:
     [[nodiscard]] static std::string packRequestChatsPayload(const ServerChatsRequestPayload& payload);
     [[nodiscard]] static std::string packRequestUsersPayload(const ServerUsersRequestPayload& payload);
     [[nodiscard]] static std::string packUserChange(const ServerUsersSomeChange& payload);
+    [[nodiscard]] static std::string packUserChanges(const ServerUserChangesPayload& payload);
+    [[nodiscard]] static std::string packMessagesPayload(const ServerMessagesPayload& payload);
+
+    // Server -> Client, дописывают в конец out (буфер можно переиспользовать между вызовами)
+    static void packServerHello(const ServerHelloPayload& payload, std::string& out);
+    static void packRegistration(const ServerRegistrationPayload& payload, std::string& out);
+    static void packError(const ServerErrorPayload& payload, std::string& out);
+    static void packChatMessage(const ServerChatMessagePayload& payload, std::string& out);
+    static void packRoomCreated(const ServerRoomCreatedPayload& payload, std::string& out);
+    static void packRoomLeft(const ServerRoomLeftPayload& payload, std::string& out);
+    static void packRequestChatsPayload(const ServerChatsRequestPayload& payload, std::string& out);
+    static void packRequestUsersPayload(const ServerUsersRequestPayload& payload, std::string& out);
+    static void packUserChange(const ServerUsersSomeChange& payload, std::string& out);
+    static void packUserChanges(const ServerUserChangesPayload& payload, std::string& out);
+    static void packMessagesPayload(const ServerMessagesPayload& payload, std::string& out);
 
     // HTTP responses
     [[nodiscard]] static std::string packServerInfo(bool alive, const std::string& serverName);
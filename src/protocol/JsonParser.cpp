@@ -1,50 +1,43 @@
 #include "protocol/JsonParser.hpp"
 
-std::optional<nlohmann::json> JsonParser::parseJson(const std::string& rawPayload)
-{
-    auto payload = nlohmann::json::parse(rawPayload, nullptr, false);
-    if (payload.is_discarded() || !payload.is_object())
-    {
-        return std::nullopt;
-    }
-    return payload;
-}
-std::optional<nlohmann::json> JsonParser::parseJson(const std::string_view rawPayload)
-{
-    auto payload = nlohmann::json::parse(rawPayload, nullptr, false);
-    if (payload.is_discarded() || !payload.is_object())
-    {
-        return std::nullopt;
-    }
-    return payload;
-}
+#include <algorithm>
 
-std::optional<std::string> JsonParser::parseMessageType(const nlohmann::json& payload)
+namespace
 {
-    return getJsonField<std::string>(payload, "type");
-}
 
-std::optional<ClientRegisterRequest> JsonParser::parseRegisterRequest(const nlohmann::json& payload)
+// Разбор клиентских запросов одинаков для nlohmann::json, FastJsonObject и MsgPackObject:
+// поля читаются через перегрузки getJsonField.
+template<typename Document>
+std::optional<ClientRegisterRequest> parseRegisterRequestImpl(const Document& payload)
 {
-    const auto publicKey = getJsonField<std::string>(payload, "public-key");
+    auto publicKey = getJsonField<std::string>(payload, "public-key");
     if (!publicKey.has_value())
     {
         return std::nullopt;
     }
 
     ClientRegisterRequest request;
-    request.publicKey = *publicKey;
+    request.publicKey = std::move(*publicKey);
     request.username = getJsonField<std::string>(payload, "username").value_or("");
     request.clientVersion = getJsonField<std::string>(payload, "client-version").value_or("");
     request.password = getJsonField<std::string>(payload, "password").value_or("");
+    request.encoding = getJsonField<std::string>(payload, "encoding").value_or("");
+    request.compression = getJsonField<std::string>(payload, "compression").value_or("");
+    request.compressionWindowBits = getJsonField<std::uint32_t>(payload, "compression-window-bits").value_or(0);
+    request.compressionContextTakeover = getJsonField<bool>(payload, "compression-context-takeover").value_or(false);
+    request.presence = getJsonField<std::string>(payload, "presence").value_or("");
+    request.userChanges = getJsonField<bool>(payload, "user-changes").value_or(false);
+    request.sessionToken = getJsonField<std::string>(payload, "session-token").value_or("");
+    request.lastServerMessageId = getJsonField<std::uint64_t>(payload, "last-server-message-id");
     return request;
 }
 
-std::optional<ClientChatMessageRequest> JsonParser::parseChatMessageRequest(const nlohmann::json& payload)
+template<typename Document>
+std::optional<ClientChatMessageRequest> parseChatMessageRequestImpl(const Document& payload)
 {
     const auto userId = getJsonField<IDType>(payload, "user-id");
     const auto chatId = getJsonField<IDType>(payload, "chat-id");
-    const auto message = getJsonField<std::string>(payload, "message");
+    auto message = getJsonField<std::string>(payload, "message");
     if (!userId.has_value() || !chatId.has_value() || !message.has_value())
     {
         return std::nullopt;
@@ -53,32 +46,42 @@ std::optional<ClientChatMessageRequest> JsonParser::parseChatMessageRequest(cons
     ClientChatMessageRequest request;
     request.userId = *userId;
     request.chatId = *chatId;
-    request.message = *message;
+    request.message = std::move(*message);
     request.clientMessageId = getJsonField<std::uint64_t>(payload, "client-message-id").value_or(0);
     return request;
 }
 
-std::optional<ClientDataRequest> JsonParser::parseDataRequest(const nlohmann::json& payload)
+template<typename Document>
+std::optional<ClientDataRequest> parseDataRequestImpl(const Document& payload)
 {
     const auto userId = getJsonField<IDType>(payload, "user-id");
-    const auto dataType = getJsonField<std::string>(payload, "data-type").value_or(
-        getJsonField<std::string>(payload, "dataType").value_or(""));
-    if (!userId.has_value() || dataType.empty())
+    auto dataType = getJsonField<std::string>(payload, "data-type");
+    if (!dataType.has_value())
+    {
+        dataType = getJsonField<std::string>(payload, "dataType");
+    }
+    if (!userId.has_value() || !dataType.has_value() || dataType->empty())
     {
         return std::nullopt;
     }
 
     ClientDataRequest request;
     request.userId = *userId;
-    request.dataType = dataType;
+    request.dataType = std::move(*dataType);
+    request.chatId = getJsonField<IDType>(payload, "chat-id").value_or(0);
+    request.before = getJsonField<std::uint64_t>(payload, "before").value_or(0);
+    request.after = getJsonField<std::uint64_t>(payload, "after");
+    request.limit = getJsonField<std::uint32_t>(payload, "limit").value_or(0);
+    request.prefix = getJsonField<std::string>(payload, "prefix").value_or("");
     return request;
 }
 
-std::optional<ClientCreateRoomRequest> JsonParser::parseCreateRoomRequest(const nlohmann::json& payload)
+template<typename Document>
+std::optional<ClientCreateRoomRequest> parseCreateRoomRequestImpl(const Document& payload)
 {
     const auto userId = getJsonField<IDType>(payload, "user-id");
-    const auto participantUserIds = getJsonField<std::vector<IDType>>(payload, "participant-user-ids");
-    const auto name = getJsonField<std::string>(payload, "name");
+    auto participantUserIds = getJsonField<std::vector<IDType>>(payload, "participant-user-ids");
+    auto name = getJsonField<std::string>(payload, "name");
     if (!userId.has_value() || !participantUserIds.has_value() || !name.has_value())
     {
         return std::nullopt;
@@ -86,13 +89,14 @@ std::optional<ClientCreateRoomRequest> JsonParser::parseCreateRoomRequest(const
 
     ClientCreateRoomRequest request;
     request.userId = *userId;
-    request.participantUserIds = *participantUserIds;
-    request.name = *name;
+    request.participantUserIds = std::move(*participantUserIds);
+    request.name = std::move(*name);
     request.isPrivate = getJsonField<bool>(payload, "is-private").value_or(true);
     return request;
 }
 
-std::optional<ClientLeaveRoomRequest> JsonParser::parseLeaveRoomRequest(const nlohmann::json& payload)
+template<typename Document>
+std::optional<ClientLeaveRoomRequest> parseLeaveRoomRequestImpl(const Document& payload)
 {
     const auto userId = getJsonField<IDType>(payload, "user-id");
     const auto chatId = getJsonField<IDType>(payload, "chat-id");
@@ -107,6 +111,136 @@ std::optional<ClientLeaveRoomRequest> JsonParser::parseLeaveRoomRequest(const nl
     return request;
 }
 
+} // namespace
+
+std::optional<JsonParser::InboundDocument> JsonParser::parseInbound(const std::string_view rawPayload)
+{
+#if defined(CHAT_JSON_BACKEND_FAST)
+    return FastJsonObject::parse(rawPayload);
+#else
+    return parseJson(rawPayload);
+#endif
+}
+
+std::optional<nlohmann::json> JsonParser::parseJson(const std::string& rawPayload)
+{
+    auto payload = nlohmann::json::parse(rawPayload, nullptr, false);
+    if (payload.is_discarded() || !payload.is_object())
+    {
+        return std::nullopt;
+    }
+    return payload;
+}
+std::optional<nlohmann::json> JsonParser::parseJson(const std::string_view rawPayload)
+{
+    auto payload = nlohmann::json::parse(rawPayload, nullptr, false);
+    if (payload.is_discarded() || !payload.is_object())
+    {
+        return std::nullopt;
+    }
+    return payload;
+}
+
+std::optional<std::string> JsonParser::parseMessageType(const nlohmann::json& payload)
+{
+    return getJsonField<std::string>(payload, "type");
+}
+
+std::optional<std::string_view> JsonParser::parseMessageTypeView(const nlohmann::json& payload)
+{
+    const auto typeIt = payload.find(std::string_view("type"));
+    if (typeIt == payload.end() || !typeIt->is_string())
+    {
+        return std::nullopt;
+    }
+    return std::string_view(typeIt->get_ref<const std::string&>());
+}
+
+std::optional<std::string_view> JsonParser::parseMessageTypeView(const FastJsonObject& payload)
+{
+    return payload.getStringView("type");
+}
+
+std::optional<std::string_view> JsonParser::parseMessageTypeView(const MsgPackObject& payload)
+{
+    return payload.getStringView("type");
+}
+
+std::optional<ClientRegisterRequest> JsonParser::parseRegisterRequest(const nlohmann::json& payload)
+{
+    return parseRegisterRequestImpl(payload);
+}
+
+std::optional<ClientRegisterRequest> JsonParser::parseRegisterRequest(const FastJsonObject& payload)
+{
+    return parseRegisterRequestImpl(payload);
+}
+
+std::optional<ClientRegisterRequest> JsonParser::parseRegisterRequest(const MsgPackObject& payload)
+{
+    return parseRegisterRequestImpl(payload);
+}
+
+std::optional<ClientChatMessageRequest> JsonParser::parseChatMessageRequest(const nlohmann::json& payload)
+{
+    return parseChatMessageRequestImpl(payload);
+}
+
+std::optional<ClientChatMessageRequest> JsonParser::parseChatMessageRequest(const FastJsonObject& payload)
+{
+    return parseChatMessageRequestImpl(payload);
+}
+
+std::optional<ClientChatMessageRequest> JsonParser::parseChatMessageRequest(const MsgPackObject& payload)
+{
+    return parseChatMessageRequestImpl(payload);
+}
+
+std::optional<ClientDataRequest> JsonParser::parseDataRequest(const nlohmann::json& payload)
+{
+    return parseDataRequestImpl(payload);
+}
+
+std::optional<ClientDataRequest> JsonParser::parseDataRequest(const FastJsonObject& payload)
+{
+    return parseDataRequestImpl(payload);
+}
+
+std::optional<ClientDataRequest> JsonParser::parseDataRequest(const MsgPackObject& payload)
+{
+    return parseDataRequestImpl(payload);
+}
+
+std::optional<ClientCreateRoomRequest> JsonParser::parseCreateRoomRequest(const nlohmann::json& payload)
+{
+    return parseCreateRoomRequestImpl(payload);
+}
+
+std::optional<ClientCreateRoomRequest> JsonParser::parseCreateRoomRequest(const FastJsonObject& payload)
+{
+    return parseCreateRoomRequestImpl(payload);
+}
+
+std::optional<ClientCreateRoomRequest> JsonParser::parseCreateRoomRequest(const MsgPackObject& payload)
+{
+    return parseCreateRoomRequestImpl(payload);
+}
+
+std::optional<ClientLeaveRoomRequest> JsonParser::parseLeaveRoomRequest(const nlohmann::json& payload)
+{
+    return parseLeaveRoomRequestImpl(payload);
+}
+
+std::optional<ClientLeaveRoomRequest> JsonParser::parseLeaveRoomRequest(const FastJsonObject& payload)
+{
+    return parseLeaveRoomRequestImpl(payload);
+}
+
+std::optional<ClientLeaveRoomRequest> JsonParser::parseLeaveRoomRequest(const MsgPackObject& payload)
+{
+    return parseLeaveRoomRequestImpl(payload);
+}
+
 std::optional<ServerHelloPayload> JsonParser::parseServerHelloPayload(const nlohmann::json& payload)
 {
     const auto type = getJsonField<std::string>(payload, "type");
@@ -146,6 +280,11 @@ std::optional<ServerRegistrationPayload> JsonParser::parseServerRegistrationPayl
     result.serverPublicKey = *serverPublicKey;
     result.serverName = *serverName;
     result.protocolVersion = getJsonField<std::string>(payload, "protocol-version").value_or("1.0");
+    result.compression = getJsonField<std::string>(payload, "compression").value_or("");
+    result.compressionWindowBits = getJsonField<std::uint32_t>(payload, "compression-window-bits").value_or(0);
+    result.compressionContextTakeover = getJsonField<bool>(payload, "compression-context-takeover").value_or(false);
+    result.resumed = getJsonField<bool>(payload, "resumed").value_or(false);
+    result.sessionToken = getJsonField<std::string>(payload, "session-token").value_or("");
     return result;
 }
 
@@ -280,6 +419,7 @@ std::optional<ServerUsersRequestPayload> JsonParser::parseServerUsersRequestPayl
 
     ServerUsersRequestPayload result{};
     result.type = *type;
+    result.hasMore = getJsonField<bool>(payload, "has-more").value_or(false);
 
     for (const auto& [key, value] : usersIt->items())
     {
@@ -290,13 +430,15 @@ std::optional<ServerUsersRequestPayload> JsonParser::parseServerUsersRequestPayl
         try
         {
             const auto chatId = static_cast<IDType>(std::stoul(key));
-            result.users.emplace(chatId, value.get<std::string>());
+            result.users.emplace_back(chatId, value.get<std::string>());
         }
         catch (...)
         {
             continue;
         }
     }
+    // Ключи объекта идут в строковом порядке ("10" < "2").
+    std::sort(result.users.begin(), result.users.end());
 
     return result;
 }
@@ -322,6 +464,78 @@ std::optional<ServerUsersSomeChange> JsonParser::parseServerUsersSomeChange(cons
     return result;
 }
 
+std::optional<ServerUserChangesPayload> JsonParser::parseServerUserChangesPayload(const nlohmann::json& payload)
+{
+    const auto type = getJsonField<std::string>(payload, "type");
+    auto logout = getJsonField<std::vector<IDType>>(payload, "logout");
+    const auto registeredIt = payload.find("registered");
+    if (!type.has_value() || *type != "user-changes" || !logout.has_value() || registeredIt == payload.end() ||
+        !registeredIt->is_object())
+    {
+        return std::nullopt;
+    }
+
+    ServerUserChangesPayload result{};
+    result.type = *type;
+    result.logout = std::move(*logout);
+    for (const auto& [key, value] : registeredIt->items())
+    {
+        if (!value.is_string())
+        {
+            continue;
+        }
+        try
+        {
+            result.registered.emplace(static_cast<IDType>(std::stoul(key)), value.get<std::string>());
+        }
+        catch (...)
+        {
+            continue;
+        }
+    }
+    return result;
+}
+
+std::optional<ServerMessagesPayload> JsonParser::parseServerMessagesPayload(const nlohmann::json& payload)
+{
+    const auto type = getJsonField<std::string>(payload, "type");
+    const auto chatId = getJsonField<IDType>(payload, "chat-id");
+    const auto hasMore = getJsonField<bool>(payload, "has-more");
+    const auto messagesIt = payload.find("messages");
+    if (!type.has_value() || *type != "messages-payload" || !chatId.has_value() || !hasMore.has_value() ||
+        messagesIt == payload.end() || !messagesIt->is_array())
+    {
+        return std::nullopt;
+    }
+
+    ServerMessagesPayload result{};
+    result.type = *type;
+    result.chatId = *chatId;
+    result.hasMore = *hasMore;
+    result.truncated = getJsonField<bool>(payload, "truncated").value_or(false);
+    result.messages.reserve(messagesIt->size());
+    for (const auto& item : *messagesIt)
+    {
+        if (!item.is_object())
+        {
+            return std::nullopt;
+        }
+        const auto serverMessageId = getJsonField<std::uint64_t>(item, "server-message-id");
+        const auto userId = getJsonField<IDType>(item, "user-id");
+        auto username = getJsonField<std::string>(item, "username");
+        auto message = getJsonField<std::string>(item, "message");
+        const auto timestamp = getJsonField<std::uint64_t>(item, "timestamp");
+        if (!serverMessageId.has_value() || !userId.has_value() || !username.has_value() || !message.has_value() ||
+            !timestamp.has_value())
+        {
+            return std::nullopt;
+        }
+        result.messages.push_back(
+            ServerHistoryMessage{*serverMessageId, *userId, std::move(*username), std::move(*message), *timestamp});
+    }
+    return result;
+}
+
 std::optional<bool> JsonParser::parseServerAlive(const nlohmann::json& payload)
 {
     return getJsonField<bool>(payload, "alive");
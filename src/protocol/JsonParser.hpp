@@ -2,13 +2,20 @@
 
 #include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
+#include "protocol/FastJsonReader.hpp"
 #include "protocol/JsonMessages.hpp"
+#include "protocol/MsgPackReader.hpp"
 
+// Поиск по string_view не создаёт строку-ключ, а для типов протокола тип значения
+// проверяется заранее, поэтому на корректных сообщениях исключения не бросаются.
 template<typename T>
-inline std::optional<T> getJsonField(const nlohmann::json& payload, const std::string& fieldName)
+inline std::optional<T> getJsonField(const nlohmann::json& payload, std::string_view fieldName)
 {
     const auto fieldIt = payload.find(fieldName);
     if (fieldIt == payload.end() || fieldIt->is_null())
@@ -16,22 +23,84 @@ inline std::optional<T> getJsonField(const nlohmann::json& payload, const std::s
         return std::nullopt;
     }
 
-    try
+    if constexpr (std::is_same_v<T, std::string>)
     {
-        return fieldIt->get<T>();
+        if (!fieldIt->is_string())
+            return std::nullopt;
+        return fieldIt->template get_ref<const std::string&>();
     }
-    catch (...)
+    else if constexpr (std::is_same_v<T, bool>)
     {
-        return std::nullopt;
+        if (!fieldIt->is_boolean())
+            return std::nullopt;
+        return fieldIt->template get<bool>();
+    }
+    else if constexpr (std::is_arithmetic_v<T>)
+    {
+        // boolean -- только там, где его принимал get<T>() исходного getJsonField.
+        if (!fieldIt->is_number() && !(jsonBooleanAsNumber<T> && fieldIt->is_boolean()))
+            return std::nullopt;
+        return fieldIt->template get<T>();
+    }
+    else if constexpr (std::is_same_v<T, std::vector<IDType>>)
+    {
+        if (!fieldIt->is_array())
+            return std::nullopt;
+        T result;
+        result.reserve(fieldIt->size());
+        for (const auto& item : *fieldIt)
+        {
+            if (!item.is_number() && !(jsonBooleanAsNumber<IDType> && item.is_boolean()))
+                return std::nullopt;
+            result.push_back(item.template get<IDType>());
+        }
+        return result;
+    }
+    else
+    {
+        try
+        {
+            return fieldIt->template get<T>();
+        }
+        catch (...)
+        {
+            return std::nullopt;
+        }
     }
 }
 
+template<typename T>
+inline std::optional<T> getJsonField(const FastJsonObject& payload, std::string_view fieldName)
+{
+    return payload.get<T>(fieldName);
+}
+
+template<typename T>
+inline std::optional<T> getJsonField(const MsgPackObject& payload, std::string_view fieldName)
+{
+    return payload.get<T>(fieldName);
+}
+
 class JsonParser
 {
 public:
+    // Документ, в который сервер разбирает входящие кадры; выбирается опцией CMake CHAT_JSON_BACKEND.
+#if defined(CHAT_JSON_BACKEND_FAST)
+    using InboundDocument = FastJsonObject;
+#else
+    using InboundDocument = nlohmann::json;
+#endif
+
+    // nullopt для некорректного JSON и для JSON, который не является объектом, в обоих бэкендах.
+    [[nodiscard]] static std::optional<InboundDocument> parseInbound(std::string_view rawPayload);
+
     [[nodiscard]] static std::optional<nlohmann::json> parseJson(const std::string& rawPayload);
     [[nodiscard]] static std::optional<nlohmann::json> parseJson(const std::string_view rawPayload);
     [[nodiscard]] static std::optional<std::string> parseMessageType(const nlohmann::json& payload);
+    // Ссылается на строку внутри payload, без копирования.
+    [[nodiscard]] static std::optional<std::string_view> parseMessageTypeView(const nlohmann::json& payload);
+    [[nodiscard]] static std::optional<std::string_view> parseMessageTypeView(const FastJsonObject& payload);
+    [[nodiscard]] static std::optional<std::string_view> parseMessageTypeView(const MsgPackObject& payload);
 
     // Client -> Server
     [[nodiscard]] static std::optional<ClientRegisterRequest> parseRegisterRequest(const nlohmann::json& payload);
@@ -40,6 +109,20 @@ public:
     [[nodiscard]] static std::optional<ClientCreateRoomRequest> parseCreateRoomRequest(const nlohmann::json& payload);
     [[nodiscard]] static std::optional<ClientLeaveRoomRequest> parseLeaveRoomRequest(const nlohmann::json& payload);
 
+    // Client -> Server, разбор без DOM
+    [[nodiscard]] static std::optional<ClientRegisterRequest> parseRegisterRequest(const FastJsonObject& payload);
+    [[nodiscard]] static std::optional<ClientChatMessageRequest> parseChatMessageRequest(const FastJsonObject& payload);
+    [[nodiscard]] static std::optional<ClientDataRequest> parseDataRequest(const FastJsonObject& payload);
+    [[nodiscard]] static std::optional<ClientCreateRoomRequest> parseCreateRoomRequest(const FastJsonObject& payload);
+    [[nodiscard]] static std::optional<ClientLeaveRoomRequest> parseLeaveRoomRequest(const FastJsonObject& payload);
+
+    // Client -> Server, бинарные кадры MessagePack
+    [[nodiscard]] static std::optional<ClientRegisterRequest> parseRegisterRequest(const MsgPackObject& payload);
+    [[nodiscard]] static std::optional<ClientChatMessageRequest> parseChatMessageRequest(const MsgPackObject& payload);
+    [[nodiscard]] static std::optional<ClientDataRequest> parseDataRequest(const MsgPackObject& payload);
+    [[nodiscard]] static std::optional<ClientCreateRoomRequest> parseCreateRoomRequest(const MsgPackObject& payload);
+    [[nodiscard]] static std::optional<ClientLeaveRoomRequest> parseLeaveRoomRequest(const MsgPackObject& payload);
+
     // Server -> Client
     [[nodiscard]] static std::optional<ServerHelloPayload> parseServerHelloPayload(const nlohmann::json& payload);
     [[nodiscard]] static std::optional<ServerRegistrationPayload> parseServerRegistrationPayload(
@@ -53,6 +136,8 @@ public:
     [[nodiscard]] static std::optional<ServerChatsRequestPayload> parseServerChatsRequestPayload(const nlohmann::json& payload);
     [[nodiscard]] static std::optional<ServerUsersRequestPayload> parseServerUsersRequestPayload(const nlohmann::json& payload);
     [[nodiscard]] static std::optional<ServerUsersSomeChange> parseServerUsersSomeChange(const nlohmann::json& payload);
+    [[nodiscard]] static std::optional<ServerUserChangesPayload> parseServerUserChangesPayload(const nlohmann::json& payload);
+    [[nodiscard]] static std::optional<ServerMessagesPayload> parseServerMessagesPayload(const nlohmann::json& payload);
 
     // HTTP responses
     [[nodiscard]] static std::optional<bool> parseServerAlive(const nlohmann::json& payload);
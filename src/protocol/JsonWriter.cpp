@@ -0,0 +1,151 @@
+#include "protocol/JsonWriter.hpp"
+
+#include <charconv>
+#include <stdexcept>
+
+#include "protocol/Utf8.hpp"
+
+JsonWriter::JsonWriter(std::string& out) : out_(out)
+{
+}
+
+JsonWriter& JsonWriter::beginObject()
+{
+    separator();
+    out_.push_back('{');
+    needComma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::endObject()
+{
+    out_.push_back('}');
+    needComma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::beginArray()
+{
+    separator();
+    out_.push_back('[');
+    needComma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::endArray()
+{
+    out_.push_back(']');
+    needComma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view name)
+{
+    separator();
+    appendEscaped(out_, name);
+    out_.push_back(':');
+    needComma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::string(std::string_view value)
+{
+    separator();
+    appendEscaped(out_, value);
+    needComma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::number(std::uint64_t value)
+{
+    separator();
+    char buffer[20];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out_.append(buffer, result.ptr);
+    needComma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::boolean(bool value)
+{
+    separator();
+    out_.append(value ? "true" : "false");
+    needComma_ = true;
+    return *this;
+}
+
+void JsonWriter::separator()
+{
+    if (needComma_)
+    {
+        out_.push_back(',');
+    }
+}
+
+void JsonWriter::appendEscaped(std::string& out, std::string_view value)
+{
+    static constexpr char hexDigits[] = "0123456789abcdef";
+
+    out.reserve(out.size() + value.size() + 2);
+    out.push_back('"');
+
+    const auto* data = reinterpret_cast<const unsigned char*>(value.data());
+    const std::size_t size = value.size();
+    std::size_t runStart = 0;
+    std::size_t i = 0;
+    while (i < size)
+    {
+        const unsigned char byte = data[i];
+        if (byte >= 0x20 && byte < 0x80 && byte != '"' && byte != '\\')
+        {
+            ++i;
+            continue;
+        }
+
+        if (byte >= 0x80)
+        {
+            const std::size_t length = utf8SequenceLength(data + i, size - i);
+            if (length == 0)
+            {
+                throw std::invalid_argument("invalid UTF-8 byte in JSON string");
+            }
+            i += length;
+            continue;
+        }
+
+        out.append(value.data() + runStart, i - runStart);
+        switch (byte)
+        {
+        case '"':
+            out.append("\\\"");
+            break;
+        case '\\':
+            out.append("\\\\");
+            break;
+        case '\b':
+            out.append("\\b");
+            break;
+        case '\f':
+            out.append("\\f");
+            break;
+        case '\n':
+            out.append("\\n");
+            break;
+        case '\r':
+            out.append("\\r");
+            break;
+        case '\t':
+            out.append("\\t");
+            break;
+        default: {
+            const char escaped[] = {'\\', 'u', '0', '0', hexDigits[byte >> 4], hexDigits[byte & 0xF]};
+            out.append(escaped, sizeof(escaped));
+            break;
+        }
+        }
+        ++i;
+        runStart = i;
+    }
+    out.append(value.data() + runStart, size - runStart);
+    out.push_back('"');
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Прямая запись JSON в буфер без промежуточного nlohmann::json.
+// Формат совпадает с nlohmann::json::dump() без отступов: без пробелов, строки в UTF-8,
+// экранируются только '"', '\' и управляющие символы. Порядок ключей задаёт вызывающий код.
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::string& out);
+
+    JsonWriter& beginObject();
+    JsonWriter& endObject();
+    JsonWriter& beginArray();
+    JsonWriter& endArray();
+
+    JsonWriter& key(std::string_view name);
+    JsonWriter& string(std::string_view value);
+    JsonWriter& number(std::uint64_t value);
+    JsonWriter& boolean(bool value);
+
+    // Бросает std::invalid_argument на некорректном UTF-8, как и dump() с error_handler::strict.
+    static void appendEscaped(std::string& out, std::string_view value);
+
+private:
+    void separator();
+
+private:
+    std::string& out_;
+    bool needComma_ = false;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Типы сообщений Клиент -> Сервер. Порядок совпадает с порядком маршрутов в ChatServer.
+enum class ClientMessageType : std::uint8_t
+{
+    Register,
+    ChatMessage,
+    CreateRoom,
+    LeaveRoom,
+    DataRequest,
+    Count
+};
+
+inline constexpr std::size_t clientMessageTypeCount = static_cast<std::size_t>(ClientMessageType::Count);
+
+// Разбор поля "type" без выделения памяти: ветвление по длине и первому символу,
+// затем одно сравнение с ожидаемой строкой.
+[[nodiscard]] constexpr std::optional<ClientMessageType> classifyClientMessage(std::string_view type) noexcept
+{
+    if (type.empty())
+    {
+        return std::nullopt;
+    }
+
+    switch (type.size())
+    {
+    case 8:
+        if (type[0] == 'r' && type == "register")
+            return ClientMessageType::Register;
+        if (type[0] == 'c' && type == "chat-msg")
+            return ClientMessageType::ChatMessage;
+        break;
+    case 10:
+        if (type == "leave-room")
+            return ClientMessageType::LeaveRoom;
+        break;
+    case 11:
+        if (type == "create-room")
+            return ClientMessageType::CreateRoom;
+        break;
+    case 12:
+        if (type == "data-request")
+            return ClientMessageType::DataRequest;
+        break;
+    default:
+        break;
+    }
+    return std::nullopt;
+}
+
+// Обратное classifyClientMessage: значение поля "type".
+[[nodiscard]] constexpr std::string_view clientMessageTypeName(ClientMessageType type) noexcept
+{
+    switch (type)
+    {
+    case ClientMessageType::Register:
+        return "register";
+    case ClientMessageType::ChatMessage:
+        return "chat-msg";
+    case ClientMessageType::CreateRoom:
+        return "create-room";
+    case ClientMessageType::LeaveRoom:
+        return "leave-room";
+    case ClientMessageType::DataRequest:
+        return "data-request";
+    case ClientMessageType::Count:
+        break;
+    }
+    return {};
+}
+
+static_assert(classifyClientMessage("register") == ClientMessageType::Register);
+static_assert(classifyClientMessage("chat-msg") == ClientMessageType::ChatMessage);
+static_assert(classifyClientMessage("create-room") == ClientMessageType::CreateRoom);
+static_assert(classifyClientMessage("leave-room") == ClientMessageType::LeaveRoom);
+static_assert(classifyClientMessage("data-request") == ClientMessageType::DataRequest);
+static_assert(!classifyClientMessage("chat-msh").has_value());
+static_assert(classifyClientMessage(clientMessageTypeName(ClientMessageType::DataRequest)) == ClientMessageType::DataRequest);
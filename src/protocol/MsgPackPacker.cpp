@@ -0,0 +1,217 @@
+#include "protocol/MsgPackPacker.hpp"
+
+#include <array>
+#include <charconv>
+#include <map>
+#include <string_view>
+
+#include "protocol/MsgPackWriter.hpp"
+
+namespace
+{
+
+// Ключи-ID записываются десятичными строками, как и в JSON.
+// Entries -- std::map или вектор пар (ID, имя).
+template<typename Entries>
+void writeIdNameMap(MsgPackWriter& writer, const Entries& entries)
+{
+    writer.beginMap(static_cast<std::uint32_t>(entries.size()));
+    std::array<char, 10> text{};
+    for (const auto& [id, name] : entries)
+    {
+        const auto result = std::to_chars(text.data(), text.data() + text.size(), id);
+        writer.key(std::string_view(text.data(), static_cast<std::size_t>(result.ptr - text.data()))).string(name);
+    }
+}
+
+template<typename Entries>
+std::size_t estimateIdNameMap(const Entries& entries)
+{
+    std::size_t size = 5;
+    for (const auto& [id, name] : entries)
+    {
+        size += 16 + name.size();
+    }
+    return size;
+}
+
+} // namespace
+
+std::string MsgPackPacker::packServerHello(const ServerHelloPayload& payload)
+{
+    std::string out;
+    out.reserve(80 + payload.serverName.size());
+    MsgPackWriter(out)
+        .beginMap(4)
+        .key("authorized").boolean(payload.authorized)
+        .key("registration-timeout-seconds").number(payload.registrationTimeoutSeconds)
+        .key("server-name").string(payload.serverName)
+        .key("type").string(payload.type);
+    return out;
+}
+
+std::string MsgPackPacker::packRegistration(const ServerRegistrationPayload& payload)
+{
+    std::string out;
+    out.reserve(128 + payload.serverName.size() + payload.serverPublicKey.size() + payload.sessionToken.size());
+    MsgPackWriter writer(out);
+    const std::uint32_t fields = payload.sessionToken.empty() ? 7 : 8;
+    if (payload.compression.empty())
+    {
+        writer.beginMap(fields);
+    }
+    else
+    {
+        writer.beginMap(fields + 3)
+            .key("compression").string(payload.compression)
+            .key("compression-context-takeover").boolean(payload.compressionContextTakeover)
+            .key("compression-window-bits").number(payload.compressionWindowBits);
+    }
+    writer.key("protocol-version").string(payload.protocolVersion)
+        .key("registered").boolean(payload.registered)
+        .key("resumed").boolean(payload.resumed)
+        .key("server-name").string(payload.serverName)
+        .key("server-public-key").string(payload.serverPublicKey);
+    if (!payload.sessionToken.empty())
+    {
+        writer.key("session-token").string(payload.sessionToken);
+    }
+    writer.key("type").string(payload.type)
+        .key("user-id").number(payload.userId);
+    return out;
+}
+
+std::string MsgPackPacker::packError(const ServerErrorPayload& payload)
+{
+    std::string out;
+    out.reserve(40 + payload.code.size() + payload.message.size());
+    MsgPackWriter(out)
+        .beginMap(3)
+        .key("code").string(payload.code)
+        .key("message").string(payload.message)
+        .key("type").string(payload.type);
+    return out;
+}
+
+std::string MsgPackPacker::packChatMessage(const ServerChatMessagePayload& payload)
+{
+    std::string out;
+    out.reserve(96 + payload.userName.size() + payload.message.size());
+    MsgPackWriter(out)
+        .beginMap(6)
+        .key("chat-id").number(payload.chatId)
+        .key("message").string(payload.message)
+        .key("server-message-id").number(payload.serverMessageId)
+        .key("type").string(payload.type)
+        .key("user-id").number(payload.userId)
+        .key("username").string(payload.userName);
+    return out;
+}
+
+std::string MsgPackPacker::packRoomCreated(const ServerRoomCreatedPayload& payload)
+{
+    std::string out;
+    out.reserve(96 + 2 * payload.name.size() + 5 * payload.participantUserIds.size());
+    MsgPackWriter writer(out);
+    writer.beginMap(6)
+        .key("chat-id").number(payload.chatId)
+        .key("chatname").string(payload.name)
+        .key("created").boolean(payload.created)
+        .key("name").string(payload.name)
+        .key("participant-user-ids").beginArray(static_cast<std::uint32_t>(payload.participantUserIds.size()));
+    for (const auto id : payload.participantUserIds)
+    {
+        writer.number(id);
+    }
+    writer.key("type").string(payload.type);
+    return out;
+}
+
+std::string MsgPackPacker::packRoomLeft(const ServerRoomLeftPayload& payload)
+{
+    std::string out;
+    out.reserve(64);
+    MsgPackWriter(out)
+        .beginMap(4)
+        .key("chat-id").number(payload.chatId)
+        .key("left").boolean(payload.left)
+        .key("type").string(payload.type)
+        .key("user-id").number(payload.userId);
+    return out;
+}
+
+std::string MsgPackPacker::packRequestChatsPayload(const ServerChatsRequestPayload& payload)
+{
+    std::string out;
+    out.reserve(24 + estimateIdNameMap(payload.chats));
+    MsgPackWriter writer(out);
+    writer.beginMap(2).key("chats");
+    writeIdNameMap(writer, payload.chats);
+    writer.key("type").string(payload.type);
+    return out;
+}
+
+std::string MsgPackPacker::packRequestUsersPayload(const ServerUsersRequestPayload& payload)
+{
+    std::string out;
+    out.reserve(36 + estimateIdNameMap(payload.users));
+    MsgPackWriter writer(out);
+    writer.beginMap(3)
+        .key("has-more").boolean(payload.hasMore)
+        .key("type").string(payload.type)
+        .key("users");
+    writeIdNameMap(writer, payload.users);
+    return out;
+}
+
+std::string MsgPackPacker::packUserChange(const ServerUsersSomeChange& payload)
+{
+    std::string out;
+    out.reserve(56 + payload.changeType.size() + payload.username.size());
+    MsgPackWriter(out)
+        .beginMap(4)
+        .key("change-type").string(payload.changeType)
+        .key("type").string(payload.type)
+        .key("user-id").number(payload.userId)
+        .key("username").string(payload.username);
+    return out;
+}
+
+std::string MsgPackPacker::packUserChanges(const ServerUserChangesPayload& payload)
+{
+    std::string out;
+    out.reserve(40 + estimateIdNameMap(payload.registered) + 5 * payload.logout.size());
+    MsgPackWriter writer(out);
+    writer.beginMap(3).key("logout").beginArray(static_cast<std::uint32_t>(payload.logout.size()));
+    for (const auto userId : payload.logout)
+        writer.number(userId);
+    writer.key("registered");
+    writeIdNameMap(writer, payload.registered);
+    writer.key("type").string(payload.type);
+    return out;
+}
+
+std::string MsgPackPacker::packMessagesPayload(const ServerMessagesPayload& payload)
+{
+    std::size_t estimate = 48;
+    for (const auto& message : payload.messages)
+        estimate += 88 + message.username.size() + message.message.size();
+    std::string out;
+    out.reserve(estimate);
+    MsgPackWriter writer(out);
+    writer.beginMap(5)
+        .key("chat-id").number(payload.chatId)
+        .key("has-more").boolean(payload.hasMore)
+        .key("messages").beginArray(static_cast<std::uint32_t>(payload.messages.size()));
+    for (const auto& message : payload.messages)
+    {
+        writer.beginMap(5)
+            .key("message").string(message.message)
+            .key("server-message-id").number(message.serverMessageId)
+            .key("timestamp").number(message.timestamp)
+            .key("user-id").number(message.userId)
+            .key("username").string(message.username);
+    }
+    writer.key("truncated").boolean(payload.truncated).key("type").string(payload.type);
+    return out;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+#include "protocol/JsonMessages.hpp"
+
+// Сообщения сервера в MessagePack: те же ключи и типы значений, что и в JSON (см. JsonApi.md),
+// поэтому клиент может разбирать оба формата в одну и ту же структуру.
+class MsgPackPacker
+{
+public:
+    // Server -> Client
+    [[nodiscard]] static std::string packServerHello(const ServerHelloPayload& payload);
+    [[nodiscard]] static std::string packRegistration(const ServerRegistrationPayload& payload);
+    [[nodiscard]] static std::string packError(const ServerErrorPayload& payload);
+    [[nodiscard]] static std::string packChatMessage(const ServerChatMessagePayload& payload);
+    [[nodiscard]] static std::string packRoomCreated(const ServerRoomCreatedPayload& payload);
+    [[nodiscard]] static std::string packRoomLeft(const ServerRoomLeftPayload& payload);
+    [[nodiscard]] static std::string packRequestChatsPayload(const ServerChatsRequestPayload& payload);
+    [[nodiscard]] static std::string packRequestUsersPayload(const ServerUsersRequestPayload& payload);
+    [[nodiscard]] static std::string packUserChange(const ServerUsersSomeChange& payload);
+    [[nodiscard]] static std::string packUserChanges(const ServerUserChangesPayload& payload);
+    [[nodiscard]] static std::string packMessagesPayload(const ServerMessagesPayload& payload);
+};
@@ -0,0 +1,313 @@
+#include "protocol/MsgPackReader.hpp"
+
+#include "protocol/Utf8.hpp"
+
+namespace
+{
+
+class Reader
+{
+public:
+    explicit Reader(std::string_view input)
+        : pos_(reinterpret_cast<const unsigned char*>(input.data())), end_(pos_ + input.size())
+    {
+    }
+
+    [[nodiscard]] bool atEnd() const
+    {
+        return pos_ == end_;
+    }
+
+    [[nodiscard]] std::size_t remaining() const
+    {
+        return static_cast<std::size_t>(end_ - pos_);
+    }
+
+    [[nodiscard]] const char* position() const
+    {
+        return reinterpret_cast<const char*>(pos_);
+    }
+
+    // Читает одно значение. Для строк value -- байты строки; для контейнеров читается только заголовок,
+    // число вложенных элементов (для карты -- ключей и значений) возвращается в nested.
+    bool readValue(MsgPackObject::Field& field, std::uint64_t& nested)
+    {
+        nested = 0;
+        field.count = 0;
+        field.bits = 0;
+        field.value = {};
+
+        std::uint8_t code = 0;
+        if (!readByte(code))
+            return false;
+
+        if (code <= 0x7F)
+            return setNumber(field, MsgPackObject::Kind::Unsigned, code);
+        if (code >= 0xE0)
+            return setNumber(field, MsgPackObject::Kind::Signed, static_cast<std::uint64_t>(static_cast<std::int8_t>(code)));
+        if (code >= 0x80 && code <= 0x8F)
+            return setContainer(field, MsgPackObject::Kind::Map, code & 0x0F, nested);
+        if (code >= 0x90 && code <= 0x9F)
+            return setContainer(field, MsgPackObject::Kind::Array, code & 0x0F, nested);
+        if (code >= 0xA0 && code <= 0xBF)
+            return readBytes(field, MsgPackObject::Kind::String, code & 0x1F);
+
+        std::uint64_t value = 0;
+        switch (code)
+        {
+        case 0xC0:
+            field.kind = MsgPackObject::Kind::Null;
+            return true;
+        case 0xC2:
+            field.kind = MsgPackObject::Kind::False;
+            return true;
+        case 0xC3:
+            field.kind = MsgPackObject::Kind::True;
+            return true;
+        case 0xC4:
+        case 0xC5:
+        case 0xC6:
+            return readBigEndian(std::size_t{1} << (code - 0xC4), value) &&
+                   readBytes(field, MsgPackObject::Kind::Other, value);
+        case 0xC7:
+        case 0xC8:
+        case 0xC9:
+            // ext: длина, байт типа, данные.
+            return readBigEndian(std::size_t{1} << (code - 0xC7), value) &&
+                   readBytes(field, MsgPackObject::Kind::Other, value + 1);
+        case 0xCA: {
+            if (!readBigEndian(4, value))
+                return false;
+            const auto single = std::bit_cast<float>(static_cast<std::uint32_t>(value));
+            return setNumber(field, MsgPackObject::Kind::Float, std::bit_cast<std::uint64_t>(static_cast<double>(single)));
+        }
+        case 0xCB:
+            return readBigEndian(8, value) && setNumber(field, MsgPackObject::Kind::Float, value);
+        case 0xCC:
+        case 0xCD:
+        case 0xCE:
+        case 0xCF:
+            return readBigEndian(std::size_t{1} << (code - 0xCC), value) &&
+                   setNumber(field, MsgPackObject::Kind::Unsigned, value);
+        case 0xD0:
+        case 0xD1:
+        case 0xD2:
+        case 0xD3: {
+            const std::size_t bytes = std::size_t{1} << (code - 0xD0);
+            if (!readBigEndian(bytes, value))
+                return false;
+            // Расширение знака до 64 бит.
+            const unsigned shift = static_cast<unsigned>(64 - bytes * 8);
+            const auto signedValue = static_cast<std::int64_t>(value << shift) >> shift;
+            return setNumber(field, MsgPackObject::Kind::Signed, static_cast<std::uint64_t>(signedValue));
+        }
+        case 0xD4:
+        case 0xD5:
+        case 0xD6:
+        case 0xD7:
+        case 0xD8:
+            // fixext: байт типа и 1..16 байт данных.
+            return readBytes(field, MsgPackObject::Kind::Other, 1 + (std::size_t{1} << (code - 0xD4)));
+        case 0xD9:
+        case 0xDA:
+        case 0xDB:
+            return readBigEndian(std::size_t{1} << (code - 0xD9), value) &&
+                   readBytes(field, MsgPackObject::Kind::String, value);
+        case 0xDC:
+        case 0xDD:
+            return readBigEndian(code == 0xDC ? 2 : 4, value) &&
+                   setContainer(field, MsgPackObject::Kind::Array, value, nested);
+        case 0xDE:
+        case 0xDF:
+            return readBigEndian(code == 0xDE ? 2 : 4, value) &&
+                   setContainer(field, MsgPackObject::Kind::Map, value, nested);
+        default:
+            // 0xC1 в MessagePack не используется.
+            return false;
+        }
+    }
+
+    // Пропускает count значений вместе со всем вложенным; глубина не ограничена и стек не растёт.
+    bool skipValues(std::uint64_t count)
+    {
+        MsgPackObject::Field field;
+        while (count != 0)
+        {
+            // Каждое значение занимает хотя бы байт: длина, превышающая остаток буфера, заведомо неверна.
+            if (count > remaining())
+                return false;
+            std::uint64_t nested = 0;
+            if (!readValue(field, nested))
+                return false;
+            count += nested - 1;
+        }
+        return true;
+    }
+
+private:
+    bool readByte(std::uint8_t& value)
+    {
+        if (pos_ == end_)
+            return false;
+        value = *pos_++;
+        return true;
+    }
+
+    bool readBigEndian(std::size_t bytes, std::uint64_t& value)
+    {
+        if (remaining() < bytes)
+            return false;
+        value = 0;
+        for (std::size_t i = 0; i < bytes; ++i)
+        {
+            value = (value << 8) | *pos_++;
+        }
+        return true;
+    }
+
+    bool readBytes(MsgPackObject::Field& field, MsgPackObject::Kind kind, std::uint64_t length)
+    {
+        if (remaining() < length)
+            return false;
+        field.kind = kind;
+        field.value = std::string_view(position(), static_cast<std::size_t>(length));
+        pos_ += length;
+        return true;
+    }
+
+    static bool setNumber(MsgPackObject::Field& field, MsgPackObject::Kind kind, std::uint64_t bits)
+    {
+        field.kind = kind;
+        field.bits = bits;
+        return true;
+    }
+
+    static bool setContainer(MsgPackObject::Field& field, MsgPackObject::Kind kind, std::uint64_t size,
+                             std::uint64_t& nested)
+    {
+        field.kind = kind;
+        field.count = static_cast<std::uint32_t>(size);
+        nested = kind == MsgPackObject::Kind::Map ? size * 2 : size;
+        return true;
+    }
+
+private:
+    const unsigned char* pos_;
+    const unsigned char* end_;
+};
+
+} // namespace
+
+std::optional<MsgPackObject> MsgPackObject::parse(std::string_view payload)
+{
+    Reader reader(payload);
+    Field header;
+    std::uint64_t nested = 0;
+    if (!reader.readValue(header, nested) || header.kind != Kind::Map)
+    {
+        return std::nullopt;
+    }
+
+    MsgPackObject object;
+    for (std::uint32_t i = 0; i < header.count; ++i)
+    {
+        Field keyField;
+        if (!reader.readValue(keyField, nested) || keyField.kind != Kind::String || !isValidUtf8(keyField.value))
+        {
+            return std::nullopt;
+        }
+
+        Field field;
+        if (!reader.readValue(field, nested))
+        {
+            return std::nullopt;
+        }
+        // Для контейнера запоминаем закодированные элементы после заголовка.
+        const char* elementsBegin = reader.position();
+        if (!reader.skipValues(nested))
+        {
+            return std::nullopt;
+        }
+        if (field.kind == Kind::String && !isValidUtf8(field.value))
+        {
+            return std::nullopt;
+        }
+        if (field.kind == Kind::Array || field.kind == Kind::Map)
+        {
+            field.value = std::string_view(elementsBegin, static_cast<std::size_t>(reader.position() - elementsBegin));
+        }
+        field.key = keyField.value;
+        object.addField(field);
+    }
+
+    if (!reader.atEnd())
+    {
+        return std::nullopt;
+    }
+    return object;
+}
+
+const MsgPackObject::Field* MsgPackObject::find(std::string_view key) const
+{
+    const Field* result = nullptr;
+    for (std::size_t i = 0; i < fieldCount_; ++i)
+    {
+        const Field& field = i < inlineFieldCount ? inlineFields_[i] : extraFields_[i - inlineFieldCount];
+        if (field.key == key)
+        {
+            result = &field;
+        }
+    }
+    return result;
+}
+
+std::size_t MsgPackObject::size() const
+{
+    return fieldCount_;
+}
+
+std::optional<std::string_view> MsgPackObject::getStringView(std::string_view key) const
+{
+    const Field* field = find(key);
+    if (field == nullptr || field->kind != Kind::String)
+    {
+        return std::nullopt;
+    }
+    return field->value;
+}
+
+void MsgPackObject::addField(const Field& field)
+{
+    if (fieldCount_ < inlineFieldCount)
+    {
+        inlineFields_[fieldCount_] = field;
+    }
+    else
+    {
+        extraFields_.push_back(field);
+    }
+    ++fieldCount_;
+}
+
+std::optional<std::vector<IDType>> MsgPackObject::decodeIdArray(const Field& field)
+{
+    std::vector<IDType> result;
+    result.reserve(field.count);
+    Reader reader(field.value);
+    for (std::uint32_t i = 0; i < field.count; ++i)
+    {
+        Field item;
+        std::uint64_t nested = 0;
+        if (!reader.readValue(item, nested))
+        {
+            return std::nullopt;
+        }
+        const auto id = toArithmetic<IDType>(item.kind, item.bits);
+        if (!id.has_value())
+        {
+            return std::nullopt;
+        }
+        result.push_back(*id);
+    }
+    return result;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "core/MemoryPool.hpp"
+#include "core/Types.hpp"
+
+// Разбор MessagePack-карты верхнего уровня без построения DOM, аналог FastJsonObject для бинарных кадров.
+// Вход полностью проверяется по формату MessagePack, ключи и строковые значения первого уровня -- на UTF-8.
+// Скаляры первого уровня декодируются сразу, строки и массивы остаются ссылками на исходный буфер.
+// Объект ссылается на исходную строку и не должен её переживать. Разобранный внутри MessageArena::Scope
+// держит служебные буферы в арене сообщения и не должен переживать и этот Scope.
+class MsgPackObject
+{
+public:
+    enum class Kind : std::uint8_t
+    {
+        String,
+        Unsigned,
+        Signed,
+        Float,
+        True,
+        False,
+        Null,
+        Array,
+        Map,
+        Other  // bin и ext: протоколом не используются.
+    };
+
+    struct Field
+    {
+        std::string_view key;
+        std::string_view value;  // Для строк -- байты строки, для массивов -- закодированные элементы.
+        Kind kind = Kind::Null;
+        std::uint32_t count = 0; // Число элементов массива.
+        std::uint64_t bits = 0;  // Значение числа: uint64, int64 или double в зависимости от kind.
+    };
+
+    // nullopt, если вход не является корректным MessagePack или верхний уровень -- не карта.
+    [[nodiscard]] static std::optional<MsgPackObject> parse(std::string_view payload);
+
+    // При повторяющихся ключах действует последнее значение, как и в JSON-разборе.
+    [[nodiscard]] const Field* find(std::string_view key) const;
+    [[nodiscard]] std::size_t size() const;
+
+    [[nodiscard]] std::optional<std::string_view> getStringView(std::string_view key) const;
+
+    // Приведение типов то же, что у getJsonField для nlohmann::json.
+    template<typename T>
+    [[nodiscard]] std::optional<T> get(std::string_view key) const
+    {
+        const Field* field = find(key);
+        if (field == nullptr || field->kind == Kind::Null)
+        {
+            return std::nullopt;
+        }
+
+        if constexpr (std::is_same_v<T, std::string>)
+        {
+            if (field->kind != Kind::String)
+                return std::nullopt;
+            return std::string(field->value);
+        }
+        else if constexpr (std::is_same_v<T, bool>)
+        {
+            if (field->kind != Kind::True && field->kind != Kind::False)
+                return std::nullopt;
+            return field->kind == Kind::True;
+        }
+        else if constexpr (std::is_arithmetic_v<T>)
+        {
+            return toArithmetic<T>(field->kind, field->bits);
+        }
+        else if constexpr (std::is_same_v<T, std::vector<IDType>>)
+        {
+            if (field->kind != Kind::Array)
+                return std::nullopt;
+            return decodeIdArray(*field);
+        }
+        else
+        {
+            static_assert(sizeof(T) == 0, "Unsupported field type for MsgPackObject");
+        }
+    }
+
+private:
+    static constexpr std::size_t inlineFieldCount = 16;
+
+    void addField(const Field& field);
+    static std::optional<std::vector<IDType>> decodeIdArray(const Field& field);
+
+    template<typename T>
+    static std::optional<T> toArithmetic(Kind kind, std::uint64_t bits)
+    {
+        switch (kind)
+        {
+        case Kind::Unsigned:
+            return static_cast<T>(bits);
+        case Kind::Signed:
+            return static_cast<T>(static_cast<std::int64_t>(bits));
+        case Kind::Float:
+            return static_cast<T>(std::bit_cast<double>(bits));
+        default:
+            return std::nullopt;
+        }
+    }
+
+private:
+    std::array<Field, inlineFieldCount> inlineFields_{};
+    std::pmr::vector<Field> extraFields_{MessageArena::resource()};
+    std::size_t fieldCount_ = 0;
+};
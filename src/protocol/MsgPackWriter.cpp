@@ -0,0 +1,118 @@
+#include "protocol/MsgPackWriter.hpp"
+
+#include <limits>
+#include <stdexcept>
+
+MsgPackWriter::MsgPackWriter(std::string& out) : out_(out)
+{
+}
+
+MsgPackWriter& MsgPackWriter::beginMap(std::uint32_t size)
+{
+    writeHeader(size, 0x80, 16, 0xDE, 0xDF);
+    return *this;
+}
+
+MsgPackWriter& MsgPackWriter::beginArray(std::uint32_t size)
+{
+    writeHeader(size, 0x90, 16, 0xDC, 0xDD);
+    return *this;
+}
+
+MsgPackWriter& MsgPackWriter::key(std::string_view name)
+{
+    return string(name);
+}
+
+MsgPackWriter& MsgPackWriter::string(std::string_view value)
+{
+    if (value.size() > std::numeric_limits<std::uint32_t>::max())
+    {
+        throw std::length_error("MessagePack string is too long");
+    }
+
+    const auto size = static_cast<std::uint32_t>(value.size());
+    if (size < 32)
+    {
+        out_.push_back(static_cast<char>(0xA0 | size));
+    }
+    else if (size <= std::numeric_limits<std::uint8_t>::max())
+    {
+        out_.push_back(static_cast<char>(0xD9));
+        writeBigEndian(size, 1);
+    }
+    else if (size <= std::numeric_limits<std::uint16_t>::max())
+    {
+        out_.push_back(static_cast<char>(0xDA));
+        writeBigEndian(size, 2);
+    }
+    else
+    {
+        out_.push_back(static_cast<char>(0xDB));
+        writeBigEndian(size, 4);
+    }
+    out_.append(value);
+    return *this;
+}
+
+MsgPackWriter& MsgPackWriter::number(std::uint64_t value)
+{
+    if (value < 0x80)
+    {
+        out_.push_back(static_cast<char>(value));
+    }
+    else if (value <= std::numeric_limits<std::uint8_t>::max())
+    {
+        out_.push_back(static_cast<char>(0xCC));
+        writeBigEndian(value, 1);
+    }
+    else if (value <= std::numeric_limits<std::uint16_t>::max())
+    {
+        out_.push_back(static_cast<char>(0xCD));
+        writeBigEndian(value, 2);
+    }
+    else if (value <= std::numeric_limits<std::uint32_t>::max())
+    {
+        out_.push_back(static_cast<char>(0xCE));
+        writeBigEndian(value, 4);
+    }
+    else
+    {
+        out_.push_back(static_cast<char>(0xCF));
+        writeBigEndian(value, 8);
+    }
+    return *this;
+}
+
+MsgPackWriter& MsgPackWriter::boolean(bool value)
+{
+    out_.push_back(static_cast<char>(value ? 0xC3 : 0xC2));
+    return *this;
+}
+
+void MsgPackWriter::writeHeader(std::uint32_t size, std::uint8_t fixBase, std::uint32_t fixLimit, std::uint8_t code16,
+                                std::uint8_t code32)
+{
+    if (size < fixLimit)
+    {
+        out_.push_back(static_cast<char>(fixBase | size));
+    }
+    else if (size <= std::numeric_limits<std::uint16_t>::max())
+    {
+        out_.push_back(static_cast<char>(code16));
+        writeBigEndian(size, 2);
+    }
+    else
+    {
+        out_.push_back(static_cast<char>(code32));
+        writeBigEndian(size, 4);
+    }
+}
+
+void MsgPackWriter::writeBigEndian(std::uint64_t value, std::size_t bytes)
+{
+    for (std::size_t i = bytes; i > 0; --i)
+    {
+        out_.push_back(static_cast<char>((value >> ((i - 1) * 8)) & 0xFF));
+    }
+}
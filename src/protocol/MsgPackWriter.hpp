@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Прямая запись MessagePack в буфер. Для целых и длин выбирается самая короткая форма,
+// как это делает nlohmann::json::to_msgpack(). Число элементов контейнера задаётся заранее.
+class MsgPackWriter
+{
+public:
+    explicit MsgPackWriter(std::string& out);
+
+    MsgPackWriter& beginMap(std::uint32_t size);
+    MsgPackWriter& beginArray(std::uint32_t size);
+
+    MsgPackWriter& key(std::string_view name);
+    MsgPackWriter& string(std::string_view value);
+    MsgPackWriter& number(std::uint64_t value);
+    MsgPackWriter& boolean(bool value);
+
+private:
+    void writeHeader(std::uint32_t size, std::uint8_t fixBase, std::uint32_t fixLimit, std::uint8_t code16,
+                     std::uint8_t code32);
+    void writeBigEndian(std::uint64_t value, std::size_t bytes);
+
+private:
+    std::string& out_;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// Длина корректной последовательности UTF-8, начинающейся в data[0], или 0.
+inline std::size_t utf8SequenceLength(const unsigned char* data, std::size_t available)
+{
+    const unsigned char lead = data[0];
+    std::size_t length = 0;
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF)
+    {
+        length = 2;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        length = 3;
+        if (lead == 0xE0)
+            low = 0xA0;
+        else if (lead == 0xED)
+            high = 0x9F;
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        length = 4;
+        if (lead == 0xF0)
+            low = 0x90;
+        else if (lead == 0xF4)
+            high = 0x8F;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (available < length)
+    {
+        return 0;
+    }
+    for (std::size_t i = 1; i < length; ++i)
+    {
+        const unsigned char min = i == 1 ? low : 0x80;
+        const unsigned char max = i == 1 ? high : 0xBF;
+        if (data[i] < min || data[i] > max)
+        {
+            return 0;
+        }
+    }
+    return length;
+}
+
+[[nodiscard]] inline bool isValidUtf8(std::string_view text)
+{
+    const auto* data = reinterpret_cast<const unsigned char*>(text.data());
+    std::size_t i = 0;
+    while (i < text.size())
+    {
+        if (data[i] < 0x80)
+        {
+            ++i;
+            continue;
+        }
+        const std::size_t length = utf8SequenceLength(data + i, text.size() - i);
+        if (length == 0)
+        {
+            return false;
+        }
+        i += length;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Кодировка сообщений соединения. Выбирается клиентом в поле "encoding" запроса register;
+// до регистрации и по умолчанию используется JSON в текстовых кадрах.
+enum class WireCodec : std::uint8_t
+{
+    Json,        // JSON, текстовые кадры.
+    MessagePack  // MessagePack с теми же ключами, бинарные кадры.
+};
+
+inline constexpr std::size_t wireCodecCount = 2;
+
+[[nodiscard]] constexpr std::optional<WireCodec> parseWireCodec(std::string_view name)
+{
+    if (name.empty() || name == "json")
+        return WireCodec::Json;
+    if (name == "msgpack")
+        return WireCodec::MessagePack;
+    return std::nullopt;
+}
+
+[[nodiscard]] constexpr bool isBinaryCodec(WireCodec codec)
+{
+    return codec != WireCodec::Json;
+}
+
+// Формат исходящих сообщений соединения: кодировка и признак общего сжатия.
+// sharedDeflate -- сжатие без сохранения контекста с окном сервера: такой payload одинаков
+// для всех соединений и сжимается один раз на рассылку. Сжатие с сохранением контекста
+// выполняется отдельно для каждого соединения при отправке и здесь не учитывается.
+struct WireFormat
+{
+    WireCodec codec = WireCodec::Json;
+    bool sharedDeflate = false;
+
+    [[nodiscard]] constexpr std::size_t index() const
+    {
+        return static_cast<std::size_t>(codec) * 2 + (sharedDeflate ? 1 : 0);
+    }
+};
+
+inline constexpr std::size_t wireFormatCount = wireCodecCount * 2;
+
+// Набор форматов, в которых нужно подготовить одну рассылку.
+class WireFormatSet
+{
+public:
+    constexpr void insert(WireFormat format)
+    {
+        bits_ |= static_cast<std::uint8_t>(1u << format.index());
+    }
+
+    [[nodiscard]] constexpr bool contains(WireFormat format) const
+    {
+        return (bits_ & (1u << format.index())) != 0;
+    }
+
+    [[nodiscard]] constexpr bool empty() const
+    {
+        return bits_ == 0;
+    }
+
+private:
+    std::uint8_t bits_ = 0;
+};
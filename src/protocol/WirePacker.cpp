@@ -0,0 +1,78 @@
+#include "protocol/WirePacker.hpp"
+
+#include "protocol/JsonPacker.hpp"
+#include "protocol/MsgPackPacker.hpp"
+
+namespace
+{
+
+template<typename Payload>
+std::string packWith(WireCodec codec, const Payload& payload, std::string (*packJson)(const Payload&),
+                     std::string (*packMsgPack)(const Payload&))
+{
+    switch (codec)
+    {
+    case WireCodec::MessagePack:
+        return packMsgPack(payload);
+    case WireCodec::Json:
+        break;
+    }
+    return packJson(payload);
+}
+
+} // namespace
+
+std::string WirePacker::packServerHello(WireCodec codec, const ServerHelloPayload& payload)
+{
+    return packWith(codec, payload, &JsonPacker::packServerHello, &MsgPackPacker::packServerHello);
+}
+
+std::string WirePacker::packRegistration(WireCodec codec, const ServerRegistrationPayload& payload)
+{
+    return packWith(codec, payload, &JsonPacker::packRegistration, &MsgPackPacker::packRegistration);
+}
+
+std::string WirePacker::packError(WireCodec codec, const ServerErrorPayload& payload)
+{
+    return packWith(codec, payload, &JsonPacker::packError, &MsgPackPacker::packError);
+}
+
+std::string WirePacker::packChatMessage(WireCodec codec, const ServerChatMessagePayload& payload)
+{
+    return packWith(codec, payload, &JsonPacker::packChatMessage, &MsgPackPacker::packChatMessage);
+}
+
+std::string WirePacker::packRoomCreated(WireCodec codec, const ServerRoomCreatedPayload& payload)
+{
+    return packWith(codec, payload, &JsonPacker::packRoomCreated, &MsgPackPacker::packRoomCreated);
+}
+
+std::string WirePacker::packRoomLeft(WireCodec codec, const ServerRoomLeftPayload& payload)
+{
+    return packWith(codec, payload, &JsonPacker::packRoomLeft, &MsgPackPacker::packRoomLeft);
+}
+
+std::string WirePacker::packRequestChatsPayload(WireCodec codec, const ServerChatsRequestPayload& payload)
+{
+    return packWith(codec, payload, &JsonPacker::packRequestChatsPayload, &MsgPackPacker::packRequestChatsPayload);
+}
+
+std::string WirePacker::packRequestUsersPayload(WireCodec codec, const ServerUsersRequestPayload& payload)
+{
+    return packWith(codec, payload, &JsonPacker::packRequestUsersPayload, &MsgPackPacker::packRequestUsersPayload);
+}
+
+std::string WirePacker::packUserChange(WireCodec codec, const ServerUsersSomeChange& payload)
+{
+    return packWith(codec, payload, &JsonPacker::packUserChange, &MsgPackPacker::packUserChange);
+}
+
+std::string WirePacker::packUserChanges(WireCodec codec, const ServerUserChangesPayload& payload)
+{
+    return packWith(codec, payload, &JsonPacker::packUserChanges, &MsgPackPacker::packUserChanges);
+}
+
+std::string WirePacker::packMessagesPayload(WireCodec codec, const ServerMessagesPayload& payload)
+{
+    return packWith(codec, payload, &JsonPacker::packMessagesPayload, &MsgPackPacker::packMessagesPayload);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <utility>
+
+#include "core/SharedPayload.hpp"
+#include "protocol/DeflateCompressor.hpp"
+#include "protocol/JsonMessages.hpp"
+#include "protocol/WireCodec.hpp"
+
+// Сообщения сервера в кодировке конкретного соединения: JsonPacker или MsgPackPacker.
+class WirePacker
+{
+public:
+    // pack(codec) вызывается не более одного раза на кодировку из набора;
+    // для форматов с общим сжатием результат сжимается один раз через sharedCompressor.
+    template<typename Pack>
+    [[nodiscard]] static WirePayloads encode(WireFormatSet formats, Pack&& pack,
+                                             DeflateCompressor* sharedCompressor = nullptr)
+    {
+        WirePayloads result;
+        for (std::size_t i = 0; i < wireCodecCount; ++i)
+        {
+            const WireFormat plain{static_cast<WireCodec>(i), false};
+            const WireFormat deflated{plain.codec, true};
+            const bool needDeflated = formats.contains(deflated) && sharedCompressor != nullptr;
+            if (!formats.contains(plain) && !needDeflated)
+            {
+                continue;
+            }
+
+            auto message = makeSharedPayload(pack(plain.codec));
+            if (needDeflated)
+            {
+                result.byFormat[deflated.index()] = makeSharedPayload(sharedCompressor->compress(*message));
+            }
+            if (formats.contains(plain))
+            {
+                result.byFormat[plain.index()] = std::move(message);
+            }
+        }
+        return result;
+    }
+
+    [[nodiscard]] static std::string packServerHello(WireCodec codec, const ServerHelloPayload& payload);
+    [[nodiscard]] static std::string packRegistration(WireCodec codec, const ServerRegistrationPayload& payload);
+    [[nodiscard]] static std::string packError(WireCodec codec, const ServerErrorPayload& payload);
+    [[nodiscard]] static std::string packChatMessage(WireCodec codec, const ServerChatMessagePayload& payload);
+    [[nodiscard]] static std::string packRoomCreated(WireCodec codec, const ServerRoomCreatedPayload& payload);
+    [[nodiscard]] static std::string packRoomLeft(WireCodec codec, const ServerRoomLeftPayload& payload);
+    [[nodiscard]] static std::string packRequestChatsPayload(WireCodec codec, const ServerChatsRequestPayload& payload);
+    [[nodiscard]] static std::string packRequestUsersPayload(WireCodec codec, const ServerUsersRequestPayload& payload);
+    [[nodiscard]] static std::string packUserChange(WireCodec codec, const ServerUsersSomeChange& payload);
+    [[nodiscard]] static std::string packUserChanges(WireCodec codec, const ServerUserChangesPayload& payload);
+    [[nodiscard]] static std::string packMessagesPayload(WireCodec codec, const ServerMessagesPayload& payload);
+};
@@ -0,0 +1,126 @@
+// Разбор клиентских запросов обоими JSON-бэкендами (nlohmann::json и FastJsonObject) против значений,
+// которые давал исходный getJsonField: get<T>() nlohmann 3.11 без предварительной проверки типа.
+// Он приводит true/false к 1/0 для IDType и uint32_t, но не для uint64_t; отрицательные и не помещающиеся
+// в тип целые приводятся по модулю, дробные -- отбрасыванием дробной части.
+
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "protocol/FastJsonReader.hpp"
+#include "protocol/JsonParser.hpp"
+
+namespace
+{
+
+int failures = 0;
+
+template<typename Request, typename Key>
+void checkCase(std::string_view input, std::optional<Request> (*parseDom)(const nlohmann::json&),
+               std::optional<Request> (*parseFast)(const FastJsonObject&), Key (*key)(const Request&),
+               const std::optional<Key>& expected)
+{
+    const auto check = [&](std::string_view backend, const std::optional<Request>& request) {
+        const bool ok = request.has_value() == expected.has_value() && (!request.has_value() || key(*request) == *expected);
+        if (!ok)
+        {
+            ++failures;
+            std::cerr << "FAIL [" << backend << "] " << input << '\n';
+        }
+    };
+
+    const auto document = JsonParser::parseJson(input);
+    const auto fastDocument = FastJsonObject::parse(input);
+    if (!document.has_value() || !fastDocument.has_value())
+    {
+        ++failures;
+        std::cerr << "FAIL [parse] " << input << '\n';
+        return;
+    }
+    check("nlohmann", parseDom(*document));
+    check("fast", parseFast(*fastDocument));
+}
+
+using ChatKey = std::tuple<IDType, IDType, std::uint64_t>;
+ChatKey chatKey(const ClientChatMessageRequest& request)
+{
+    return {request.userId, request.chatId, request.clientMessageId};
+}
+
+using CreateRoomKey = std::tuple<IDType, std::vector<IDType>, bool>;
+CreateRoomKey createRoomKey(const ClientCreateRoomRequest& request)
+{
+    return {request.userId, request.participantUserIds, request.isPrivate};
+}
+
+using DataKey = std::tuple<IDType, std::uint64_t, std::optional<std::uint64_t>, std::uint32_t>;
+DataKey dataKey(const ClientDataRequest& request)
+{
+    return {request.userId, request.before, request.after, request.limit};
+}
+
+constexpr IDType maxId = std::numeric_limits<IDType>::max();
+constexpr std::uint64_t maxU64 = std::numeric_limits<std::uint64_t>::max();
+
+void chatMessage(std::string_view input, std::optional<ChatKey> expected)
+{
+    checkCase<ClientChatMessageRequest, ChatKey>(input, &JsonParser::parseChatMessageRequest,
+                                                 &JsonParser::parseChatMessageRequest, &chatKey, expected);
+}
+
+void createRoom(std::string_view input, std::optional<CreateRoomKey> expected)
+{
+    checkCase<ClientCreateRoomRequest, CreateRoomKey>(input, &JsonParser::parseCreateRoomRequest,
+                                                      &JsonParser::parseCreateRoomRequest, &createRoomKey, expected);
+}
+
+void dataRequest(std::string_view input, std::optional<DataKey> expected)
+{
+    checkCase<ClientDataRequest, DataKey>(input, &JsonParser::parseDataRequest, &JsonParser::parseDataRequest,
+                                          &dataKey, expected);
+}
+
+} // namespace
+
+int main()
+{
+    // Булевы значения в полях IDType: 1/0.
+    chatMessage(R"({"type":"chat-msg","user-id":true,"chat-id":false,"message":"x"})", ChatKey{1, 0, 0});
+    // В uint64_t булево значение не приводится: необязательное поле считается отсутствующим.
+    chatMessage(R"({"type":"chat-msg","user-id":1,"chat-id":2,"message":"x","client-message-id":true})", ChatKey{1, 2, 0});
+    // Отрицательные и слишком большие -- по модулю 2^32, дробные -- отбрасывается дробная часть.
+    chatMessage(R"({"type":"chat-msg","user-id":-1,"chat-id":5000000000,"message":"x"})", ChatKey{maxId, 705032704, 0});
+    chatMessage(R"({"type":"chat-msg","user-id":1.9,"chat-id":2,"message":"x","client-message-id":-1})", ChatKey{1, 2, maxU64});
+    // Строка вместо числа -- обязательное поле отсутствует.
+    chatMessage(R"({"type":"chat-msg","user-id":"1","chat-id":2,"message":"x"})", std::nullopt);
+    chatMessage(R"({"type":"chat-msg","user-id":null,"chat-id":2,"message":"x"})", std::nullopt);
+
+    createRoom(R"({"type":"create-room","user-id":1,"participant-user-ids":[true,false,2],"name":"r"})",
+               CreateRoomKey{1, {1, 0, 2}, true});
+    createRoom(R"({"type":"create-room","user-id":1,"participant-user-ids":[-1,5000000000,2.5],"name":"r","is-private":false})",
+               CreateRoomKey{1, {maxId, 705032704, 2}, false});
+    createRoom(R"({"type":"create-room","user-id":1,"participant-user-ids":[1,"2"],"name":"r"})", std::nullopt);
+    createRoom(R"({"type":"create-room","user-id":1,"participant-user-ids":[null],"name":"r"})", std::nullopt);
+    // Булево значение вместо bool-поля -- только true/false, число не подходит.
+    createRoom(R"({"type":"create-room","user-id":1,"participant-user-ids":[],"name":"r","is-private":0})",
+               CreateRoomKey{1, {}, true});
+
+    dataRequest(R"({"type":"data-request","user-id":1,"data-type":"users","limit":true,"after":true,"before":false})",
+                DataKey{1, 0, std::nullopt, 1});
+    dataRequest(R"({"type":"data-request","user-id":1,"data-type":"users","limit":-1,"after":-1})",
+                DataKey{1, 0, maxU64, maxId});
+    dataRequest(R"({"type":"data-request","user-id":1,"data-type":"messages","before":18446744073709551615,"limit":4294967297})",
+                DataKey{1, maxU64, std::nullopt, 1});
+
+    if (failures != 0)
+    {
+        std::cerr << failures << " failed\n";
+        return 1;
+    }
+    std::cout << "ok\n";
+    return 0;
+}
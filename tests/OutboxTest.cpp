@@ -0,0 +1,317 @@
+// Очередь исходящих сообщений соединения (Outbox): политики переполнения, порядок ответов за рассылками,
+// оценка непрочитанного в takeBatch и лимиты по умолчанию -- клиент, переставший читать, упирается в лимит
+// и закрывается с кодом 4008, а всплеск быстрее оценки не теряет ни одного кадра.
+// Время передаётся в takeBatch/recordSent явно, сеть и Crow не нужны.
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "core/Outbox.hpp"
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool ok, std::string_view what)
+{
+    if (!ok)
+    {
+        ++failures;
+        std::cerr << "FAIL " << what << '\n';
+    }
+}
+
+using Clock = Outbox::Clock;
+
+SharedPayload payload(std::size_t size, char fill = 'x')
+{
+    return makeSharedPayload(std::string(size, fill));
+}
+
+SharedPayload text(std::string_view value)
+{
+    return makeSharedPayload(std::string(value));
+}
+
+// Лимиты без оценки непрочитанного: очередь копится, только пока её не забирают.
+OutboxLimits queueLimits(OverflowPolicy policy, std::size_t maxMessages, std::size_t maxBytes = 1024 * 1024)
+{
+    OutboxLimits limits;
+    limits.drainBytesPerSecond = 0;
+    limits.maxMessages = maxMessages;
+    limits.maxBytes = maxBytes;
+    limits.policy = policy;
+    return limits;
+}
+
+// Содержимое очереди по порядку, через пробел.
+std::string drain(Outbox& outbox, Clock::time_point now = Clock::now())
+{
+    std::vector<Outbox::Entry> batch;
+    std::string result;
+    while (outbox.takeBatch(batch, now) == Outbox::TakeResult::Batch)
+    {
+        for (const auto& entry : batch)
+        {
+            if (!result.empty())
+                result.push_back(' ');
+            result += *entry.payload;
+        }
+        batch.clear();
+    }
+    return result;
+}
+
+void checkQueue(Outbox& outbox, std::string_view expected, std::string_view what)
+{
+    const auto actual = drain(outbox);
+    if (actual != expected)
+    {
+        ++failures;
+        std::cerr << "FAIL " << what << ": got '" << actual << "', expected '" << expected << "'\n";
+    }
+}
+
+// Отправитель соединения, как UserContext::flushOutbox: забирает пачки и учитывает переданное в Crow.
+std::size_t flush(Outbox& outbox, Clock::time_point now, std::vector<Outbox::Entry>* sent = nullptr)
+{
+    std::vector<Outbox::Entry> batch;
+    std::size_t bytes = 0;
+    while (outbox.takeBatch(batch, now) == Outbox::TakeResult::Batch)
+    {
+        std::size_t batchBytes = 0;
+        for (auto& entry : batch)
+        {
+            batchBytes += entry.payload->size();
+            if (sent != nullptr)
+                sent->push_back(std::move(entry));
+        }
+        outbox.recordSent(batchBytes, now);
+        bytes += batchBytes;
+        batch.clear();
+    }
+    return bytes;
+}
+
+void dropOldestDropsAnyKind()
+{
+    Outbox outbox;
+    outbox.setLimits(queueLimits(OverflowPolicy::DropOldest, 3));
+    check(outbox.push(text("c1")) == Outbox::PushResult::FlushNeeded, "drop-oldest: first push schedules a flush");
+    check(outbox.push(text("p1"), Outbox::MessageKind::Presence, 7) == Outbox::PushResult::Queued, "drop-oldest: queued");
+    outbox.push(text("c2"));
+    check(outbox.push(text("c3")) == Outbox::PushResult::Queued, "drop-oldest: overflow is not a disconnect");
+    check(outbox.stats().droppedMessages == 1, "drop-oldest: one dropped");
+    checkQueue(outbox, "p1 c2 c3", "drop-oldest: oldest chat frame dropped");
+
+    // Одно сообщение больше лимита всё равно остаётся.
+    Outbox big;
+    big.setLimits(queueLimits(OverflowPolicy::DropOldest, 10, 4));
+    big.push(text("ab"));
+    big.push(text("abcdef"));
+    checkQueue(big, "abcdef", "drop-oldest: oversized last message kept");
+}
+
+void coalescePresenceKeepsChat()
+{
+    // Устаревшие изменения того же пользователя заменяются последним, чужие и чаты не трогаются.
+    Outbox coalesced;
+    coalesced.setLimits(queueLimits(OverflowPolicy::CoalescePresence, 4));
+    coalesced.push(text("u1a"), Outbox::MessageKind::Presence, 1);
+    coalesced.push(text("c1"));
+    coalesced.push(text("u2a"), Outbox::MessageKind::Presence, 2);
+    coalesced.push(text("u1b"), Outbox::MessageKind::Presence, 1);
+    check(coalesced.push(text("u1c"), Outbox::MessageKind::Presence, 1) == Outbox::PushResult::Queued,
+          "coalesce: queued after coalescing");
+    check(coalesced.stats().coalescedMessages == 2, "coalesce: two superseded changes");
+    check(coalesced.stats().droppedMessages == 0, "coalesce: nothing dropped");
+    checkQueue(coalesced, "c1 u2a u1c", "coalesce: latest change per user, in order");
+
+    // Без повторов отбрасываются самые старые уведомления, сообщения чатов остаются.
+    Outbox presence;
+    presence.setLimits(queueLimits(OverflowPolicy::CoalescePresence, 3));
+    presence.push(text("c1"));
+    presence.push(text("u1"), Outbox::MessageKind::Presence, 1);
+    presence.push(text("c2"));
+    presence.push(text("u2"), Outbox::MessageKind::Presence, 2);
+    presence.push(text("c3"));
+    check(presence.stats().droppedMessages == 2, "coalesce: two presence frames dropped");
+    checkQueue(presence, "c1 c2 c3", "coalesce: chat frames kept");
+
+    // Только сообщения чатов: отбрасывать нечего, соединение закрывается.
+    Outbox chat;
+    chat.setLimits(queueLimits(OverflowPolicy::CoalescePresence, 2));
+    chat.push(text("c1"));
+    chat.push(text("c2"));
+    check(chat.push(text("c3")) == Outbox::PushResult::Overflow, "coalesce: chat overflow disconnects");
+    check(chat.stats().overflowed, "coalesce: marked as overflowed");
+    check(chat.stats().droppedMessages == 3, "coalesce: queue counted as dropped on disconnect");
+    check(chat.push(text("c4")) == Outbox::PushResult::Dropped, "coalesce: closed outbox drops");
+    check(chat.stats().droppedMessages == 3, "coalesce: pushes after close are not counted");
+
+    // Одно сообщение больше лимита не повод закрывать соединение.
+    Outbox big;
+    big.setLimits(queueLimits(OverflowPolicy::CoalescePresence, 10, 4));
+    check(big.push(text("abcdef")) == Outbox::PushResult::FlushNeeded, "coalesce: oversized single message queued");
+}
+
+void disconnectOnAnyOverflow()
+{
+    Outbox outbox;
+    outbox.setLimits(queueLimits(OverflowPolicy::Disconnect, 2));
+    outbox.push(text("u1a"), Outbox::MessageKind::Presence, 1);
+    outbox.push(text("u1b"), Outbox::MessageKind::Presence, 1);
+    check(outbox.push(text("c1")) == Outbox::PushResult::Overflow, "disconnect: no coalescing, overflow");
+    check(outbox.stats().coalescedMessages == 0, "disconnect: nothing coalesced");
+    check(outbox.stats().queuedMessages == 0, "disconnect: queue released");
+    check(outbox.stats().overflowed, "disconnect: marked as overflowed");
+}
+
+void repliesQueueBehindBroadcasts()
+{
+    Outbox outbox;
+    outbox.setLimits(queueLimits(OverflowPolicy::CoalescePresence, 16));
+    check(!outbox.flushPending(), "reply: idle outbox has no sender");
+    check(!outbox.pushBehindPending(text("r0")).has_value(), "reply: idle outbox lets the reply go directly");
+
+    check(outbox.push(text("b1")) == Outbox::PushResult::FlushNeeded, "reply: broadcast schedules a flush");
+    outbox.push(text("b2"));
+    check(outbox.flushPending(), "reply: sender is scheduled");
+    check(outbox.pushBehindPending(text("r1")) == Outbox::PushResult::Queued, "reply: queued behind broadcasts");
+    outbox.push(text("b3"));
+    checkQueue(outbox, "b1 b2 r1 b3", "reply: frames keep send order");
+
+    check(!outbox.flushPending(), "reply: drained outbox has no sender");
+    check(!outbox.pushBehindPending(text("r2")).has_value(), "reply: drained outbox lets the reply go directly");
+
+    // Отправитель забрал последнюю пачку, но ещё не вернулся за следующей: ответ ждёт его.
+    std::vector<Outbox::Entry> batch;
+    outbox.push(text("b4"));
+    check(outbox.takeBatch(batch, Clock::now()) == Outbox::TakeResult::Batch, "reply: batch taken");
+    check(outbox.pushBehindPending(text("r3")) == Outbox::PushResult::Queued, "reply: queued while batch is in flight");
+    checkQueue(outbox, "r3", "reply: sent by the same sender");
+
+    Outbox closed;
+    closed.close();
+    check(closed.pushBehindPending(text("r")) == Outbox::PushResult::Dropped, "reply: closed outbox drops");
+}
+
+void takeBatchFollowsEstimate()
+{
+    OutboxLimits limits;
+    limits.maxInFlightBytes = 10;
+    limits.drainBytesPerSecond = 10;
+    Outbox outbox;
+    outbox.setLimits(limits);
+    auto now = Clock::now();
+    std::vector<Outbox::Entry> batch;
+
+    // Первый кадр уходит, даже если он один больше окна.
+    outbox.push(payload(15));
+    outbox.push(payload(4));
+    check(outbox.takeBatch(batch, now) == Outbox::TakeResult::Batch && batch.size() == 1, "estimate: first frame goes");
+    outbox.recordSent(15, now);
+    batch.clear();
+    check(outbox.takeBatch(batch, now) == Outbox::TakeResult::Throttled, "estimate: full window throttles");
+    check(outbox.flushPending(), "estimate: throttled sender stays scheduled");
+
+    // Через секунду оценка сходит до 5 байт: окно вмещает ещё 5.
+    now += std::chrono::seconds(1);
+    outbox.push(payload(4));
+    check(outbox.takeBatch(batch, now) == Outbox::TakeResult::Batch && batch.size() == 1, "estimate: window refills");
+    outbox.recordSent(4, now);
+    batch.clear();
+    check(outbox.stats().inFlightBytes == 9, "estimate: in-flight bytes tracked");
+    check(outbox.takeBatch(batch, now) == Outbox::TakeResult::Batch && batch.size() == 1, "estimate: rest fits later");
+
+    // Без оценки очередь забирается целиком, сколько бы ни было передано.
+    Outbox unlimited;
+    unlimited.setLimits(queueLimits(OverflowPolicy::CoalescePresence, 16));
+    for (int i = 0; i < 5; ++i)
+        unlimited.push(payload(100 * 1024));
+    unlimited.recordSent(100 * 1024 * 1024);
+    batch.clear();
+    check(unlimited.takeBatch(batch) == Outbox::TakeResult::Batch && batch.size() == 5, "estimate off: whole queue taken");
+    check(unlimited.stats().inFlightBytes == 0, "estimate off: nothing tracked");
+}
+
+void stalledConsumerIsDisconnected()
+{
+    Outbox outbox;
+    const OutboxLimits limits;
+    outbox.setLimits(limits);
+    const auto now = Clock::now();
+
+    // Время не идёт: клиент ничего не читает.
+    std::size_t pushed = 0;
+    auto result = Outbox::PushResult::Queued;
+    while (pushed < 2 * (limits.maxInFlightBytes + limits.maxBytes))
+    {
+        result = outbox.push(payload(64 * 1024));
+        if (result == Outbox::PushResult::Overflow)
+            break;
+        flush(outbox, now);
+        check(outbox.stats().queuedBytes <= limits.maxBytes, "stalled: queue stays within maxBytes");
+        pushed += 64 * 1024;
+    }
+    check(result == Outbox::PushResult::Overflow, "stalled: hits the cap");
+    check(pushed <= limits.maxInFlightBytes + limits.maxBytes, "stalled: cap reached within in-flight + queue limits");
+    check(outbox.stats().overflowed, "stalled: marked as overflowed");
+    check(Outbox::slowConsumerCloseCode == 4008, "stalled: close code is 4008");
+    check(outbox.push(payload(16)) == Outbox::PushResult::Dropped, "stalled: closed outbox drops further pushes");
+}
+
+void burstAboveEstimateLosesNothing()
+{
+    Outbox outbox;
+    const OutboxLimits limits;
+    outbox.setLimits(limits);
+    auto now = Clock::now();
+
+    // Сервер пять секунд шлёт вдвое быстрее оценённой скорости чтения:
+    // кадры ждут в очереди, но её хватает, и ни один не отброшен.
+    constexpr std::size_t frame = 16 * 1024;
+    const auto step = std::chrono::microseconds(1'000'000 * frame / (limits.drainBytesPerSecond * 2));
+    std::size_t pushedFrames = 0;
+    std::size_t sentBytes = 0;
+    for (; pushedFrames < 5 * 2 * limits.drainBytesPerSecond / frame; ++pushedFrames)
+    {
+        check(outbox.push(payload(frame)) != Outbox::PushResult::Overflow, "burst: never overflows");
+        sentBytes += flush(outbox, now);
+        now += step;
+    }
+    for (int i = 0; i < 100 && outbox.stats().queuedMessages != 0; ++i)
+    {
+        now += std::chrono::seconds(1);
+        sentBytes += flush(outbox, now);
+    }
+    check(sentBytes == pushedFrames * frame, "burst: every frame reaches Crow");
+    check(outbox.stats().droppedMessages == 0, "burst: nothing dropped");
+    check(!outbox.stats().overflowed, "burst: not disconnected");
+}
+
+} // namespace
+
+int main()
+{
+    dropOldestDropsAnyKind();
+    coalescePresenceKeepsChat();
+    disconnectOnAnyOverflow();
+    repliesQueueBehindBroadcasts();
+    takeBatchFollowsEstimate();
+    stalledConsumerIsDisconnected();
+    burstAboveEstimateLosesNothing();
+
+    if (failures != 0)
+    {
+        std::cerr << failures << " failed\n";
+        return 1;
+    }
+    std::cout << "ok\n";
+    return 0;
+}